@@ -0,0 +1,928 @@
+#ifndef ASSEMBLER_ASSEMBLER_C
+#define ASSEMBLER_ASSEMBLER_C
+
+#include <ctype.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Disassembler/disassembler.c"
+#include "../Disassembler/labels.c"
+#include "../Disassembler/corpus.c"
+
+/*
+    Intel 8080 assembler, for the syntax of the listings (MOV B, H / JPE addr / RST 2) and
+    of the labelled listings (see Disassembler/labels.c), so a listing assembles back to
+    the image it was made from.
+
+    Source : one statement per line, ';' starts a comment
+        label:  MNEMONIC operand, operand
+        NAME    EQU expression
+                DB 1, $20, 'text'   /   DW expression, ...   /   DS count
+                ORG expression      /   END
+    A label at the start of a line may leave out the ':'. The expressions are numbers ($1F,
+    0x1F, 1Fh, 101b, 31, 'c'), names and $ (the address of the statement), added and
+    subtracted. The mnemonics, the registers and the directives are case insensitive, the
+    names aren't, the register names are reserved.
+
+    The keywords are at most 4 characters, packed in a 32 bit key. Multiplied by
+    ASSEMBLER_MULTIPLIER, the top 9 bits of the key are a perfect hash of the keywords : the
+    table is built by the compiler (a collision is a duplicate initializer, which -Wextra
+    reports), a lookup is a multiply, a load and a compare.
+    The opcode of an instruction comes from the listing of the documented opcodes, indexed
+    by the mnemonic and the kinds of the two operands (register or expression), so what the
+    disassembler prints is what the assembler reads.
+
+    Two passes : the first one assembles every line into a flat buffer and defines the
+    labels, an operand naming a label that isn't defined yet is left as a fixup, the second
+    one patches the fixups.
+*/
+
+
+// the addresses of the statements are below ASSEMBLER_LIMIT
+#define ASSEMBLER_LIMIT 0x1000000
+// errors printed for a source
+#define ASSEMBLER_ERRORS 20
+#define ASSEMBLER_MULTIPLIER 0x3ef321cdu
+#define ASSEMBLER_KEY(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+#define ASSEMBLER_HASH(key) ((uint32_t)((key) * ASSEMBLER_MULTIPLIER) >> 23)
+// operand kinds : none, the registers (1 + REGISTER_x - REGISTER_B), an expression
+#define ASSEMBLER_IMMEDIATE 11
+#define ASSEMBLER_KINDS 12
+
+enum {
+    MNEMONIC_ACI = 1, MNEMONIC_ADC, MNEMONIC_ADD, MNEMONIC_ADI, MNEMONIC_ANA, MNEMONIC_ANI,
+    MNEMONIC_CALL, MNEMONIC_CC, MNEMONIC_CM, MNEMONIC_CMA, MNEMONIC_CMC, MNEMONIC_CMP, MNEMONIC_CNC,
+    MNEMONIC_CNZ, MNEMONIC_CP, MNEMONIC_CPE, MNEMONIC_CPI, MNEMONIC_CPO, MNEMONIC_CZ, MNEMONIC_DAA,
+    MNEMONIC_DAD, MNEMONIC_DCR, MNEMONIC_DCX, MNEMONIC_DI, MNEMONIC_EI, MNEMONIC_HLT, MNEMONIC_IN,
+    MNEMONIC_INR, MNEMONIC_INX, MNEMONIC_JC, MNEMONIC_JM, MNEMONIC_JMP, MNEMONIC_JNC, MNEMONIC_JNZ,
+    MNEMONIC_JP, MNEMONIC_JPE, MNEMONIC_JPO, MNEMONIC_JZ, MNEMONIC_LDA, MNEMONIC_LDAX,
+    MNEMONIC_LHLD, MNEMONIC_LXI, MNEMONIC_MOV, MNEMONIC_MVI, MNEMONIC_NOP, MNEMONIC_ORA,
+    MNEMONIC_ORI, MNEMONIC_OUT, MNEMONIC_PCHL, MNEMONIC_POP, MNEMONIC_PUSH, MNEMONIC_RAL,
+    MNEMONIC_RAR, MNEMONIC_RC, MNEMONIC_RET, MNEMONIC_RIM, MNEMONIC_RLC, MNEMONIC_RM, MNEMONIC_RNC,
+    MNEMONIC_RNZ, MNEMONIC_RP, MNEMONIC_RPE, MNEMONIC_RPO, MNEMONIC_RRC, MNEMONIC_RST, MNEMONIC_RZ,
+    MNEMONIC_SBB, MNEMONIC_SBI, MNEMONIC_SHLD, MNEMONIC_SIM, MNEMONIC_SPHL, MNEMONIC_STA,
+    MNEMONIC_STAX, MNEMONIC_STC, MNEMONIC_SUB, MNEMONIC_SUI, MNEMONIC_XCHG, MNEMONIC_XRA,
+    MNEMONIC_XRI, MNEMONIC_XTHL,
+    // in the order of the operand fields of the opcodes
+    REGISTER_B, REGISTER_C, REGISTER_D, REGISTER_E, REGISTER_H, REGISTER_L, REGISTER_M, REGISTER_A,
+    REGISTER_SP, REGISTER_PSW,
+    DIRECTIVE_DB, DIRECTIVE_DW, DIRECTIVE_DS, DIRECTIVE_ORG, DIRECTIVE_EQU, DIRECTIVE_END
+};
+
+#define MNEMONICS (MNEMONIC_XTHL + 1)
+
+typedef struct AssemblerKeyword {
+    uint32_t key;
+    uint8_t token;
+} AssemblerKeyword;
+
+#define KEYWORD(a, b, c, d, token) [ASSEMBLER_HASH(ASSEMBLER_KEY(a, b, c, d))] = {ASSEMBLER_KEY(a, b, c, d), token}
+
+static const AssemblerKeyword assembler_keywords[512] = {
+    KEYWORD('A', 'C', 'I', 0, MNEMONIC_ACI), KEYWORD('A', 'D', 'C', 0, MNEMONIC_ADC),
+    KEYWORD('A', 'D', 'D', 0, MNEMONIC_ADD), KEYWORD('A', 'D', 'I', 0, MNEMONIC_ADI),
+    KEYWORD('A', 'N', 'A', 0, MNEMONIC_ANA), KEYWORD('A', 'N', 'I', 0, MNEMONIC_ANI),
+    KEYWORD('C', 'A', 'L', 'L', MNEMONIC_CALL), KEYWORD('C', 'C', 0, 0, MNEMONIC_CC),
+    KEYWORD('C', 'M', 0, 0, MNEMONIC_CM), KEYWORD('C', 'M', 'A', 0, MNEMONIC_CMA),
+    KEYWORD('C', 'M', 'C', 0, MNEMONIC_CMC), KEYWORD('C', 'M', 'P', 0, MNEMONIC_CMP),
+    KEYWORD('C', 'N', 'C', 0, MNEMONIC_CNC), KEYWORD('C', 'N', 'Z', 0, MNEMONIC_CNZ),
+    KEYWORD('C', 'P', 0, 0, MNEMONIC_CP), KEYWORD('C', 'P', 'E', 0, MNEMONIC_CPE),
+    KEYWORD('C', 'P', 'I', 0, MNEMONIC_CPI), KEYWORD('C', 'P', 'O', 0, MNEMONIC_CPO),
+    KEYWORD('C', 'Z', 0, 0, MNEMONIC_CZ), KEYWORD('D', 'A', 'A', 0, MNEMONIC_DAA),
+    KEYWORD('D', 'A', 'D', 0, MNEMONIC_DAD), KEYWORD('D', 'C', 'R', 0, MNEMONIC_DCR),
+    KEYWORD('D', 'C', 'X', 0, MNEMONIC_DCX), KEYWORD('D', 'I', 0, 0, MNEMONIC_DI),
+    KEYWORD('E', 'I', 0, 0, MNEMONIC_EI), KEYWORD('H', 'L', 'T', 0, MNEMONIC_HLT),
+    KEYWORD('I', 'N', 0, 0, MNEMONIC_IN), KEYWORD('I', 'N', 'R', 0, MNEMONIC_INR),
+    KEYWORD('I', 'N', 'X', 0, MNEMONIC_INX), KEYWORD('J', 'C', 0, 0, MNEMONIC_JC),
+    KEYWORD('J', 'M', 0, 0, MNEMONIC_JM), KEYWORD('J', 'M', 'P', 0, MNEMONIC_JMP),
+    KEYWORD('J', 'N', 'C', 0, MNEMONIC_JNC), KEYWORD('J', 'N', 'Z', 0, MNEMONIC_JNZ),
+    KEYWORD('J', 'P', 0, 0, MNEMONIC_JP), KEYWORD('J', 'P', 'E', 0, MNEMONIC_JPE),
+    KEYWORD('J', 'P', 'O', 0, MNEMONIC_JPO), KEYWORD('J', 'Z', 0, 0, MNEMONIC_JZ),
+    KEYWORD('L', 'D', 'A', 0, MNEMONIC_LDA), KEYWORD('L', 'D', 'A', 'X', MNEMONIC_LDAX),
+    KEYWORD('L', 'H', 'L', 'D', MNEMONIC_LHLD), KEYWORD('L', 'X', 'I', 0, MNEMONIC_LXI),
+    KEYWORD('M', 'O', 'V', 0, MNEMONIC_MOV), KEYWORD('M', 'V', 'I', 0, MNEMONIC_MVI),
+    KEYWORD('N', 'O', 'P', 0, MNEMONIC_NOP), KEYWORD('O', 'R', 'A', 0, MNEMONIC_ORA),
+    KEYWORD('O', 'R', 'I', 0, MNEMONIC_ORI), KEYWORD('O', 'U', 'T', 0, MNEMONIC_OUT),
+    KEYWORD('P', 'C', 'H', 'L', MNEMONIC_PCHL), KEYWORD('P', 'O', 'P', 0, MNEMONIC_POP),
+    KEYWORD('P', 'U', 'S', 'H', MNEMONIC_PUSH), KEYWORD('R', 'A', 'L', 0, MNEMONIC_RAL),
+    KEYWORD('R', 'A', 'R', 0, MNEMONIC_RAR), KEYWORD('R', 'C', 0, 0, MNEMONIC_RC),
+    KEYWORD('R', 'E', 'T', 0, MNEMONIC_RET), KEYWORD('R', 'I', 'M', 0, MNEMONIC_RIM),
+    KEYWORD('R', 'L', 'C', 0, MNEMONIC_RLC), KEYWORD('R', 'M', 0, 0, MNEMONIC_RM),
+    KEYWORD('R', 'N', 'C', 0, MNEMONIC_RNC), KEYWORD('R', 'N', 'Z', 0, MNEMONIC_RNZ),
+    KEYWORD('R', 'P', 0, 0, MNEMONIC_RP), KEYWORD('R', 'P', 'E', 0, MNEMONIC_RPE),
+    KEYWORD('R', 'P', 'O', 0, MNEMONIC_RPO), KEYWORD('R', 'R', 'C', 0, MNEMONIC_RRC),
+    KEYWORD('R', 'S', 'T', 0, MNEMONIC_RST), KEYWORD('R', 'Z', 0, 0, MNEMONIC_RZ),
+    KEYWORD('S', 'B', 'B', 0, MNEMONIC_SBB), KEYWORD('S', 'B', 'I', 0, MNEMONIC_SBI),
+    KEYWORD('S', 'H', 'L', 'D', MNEMONIC_SHLD), KEYWORD('S', 'I', 'M', 0, MNEMONIC_SIM),
+    KEYWORD('S', 'P', 'H', 'L', MNEMONIC_SPHL), KEYWORD('S', 'T', 'A', 0, MNEMONIC_STA),
+    KEYWORD('S', 'T', 'A', 'X', MNEMONIC_STAX), KEYWORD('S', 'T', 'C', 0, MNEMONIC_STC),
+    KEYWORD('S', 'U', 'B', 0, MNEMONIC_SUB), KEYWORD('S', 'U', 'I', 0, MNEMONIC_SUI),
+    KEYWORD('X', 'C', 'H', 'G', MNEMONIC_XCHG), KEYWORD('X', 'R', 'A', 0, MNEMONIC_XRA),
+    KEYWORD('X', 'R', 'I', 0, MNEMONIC_XRI), KEYWORD('X', 'T', 'H', 'L', MNEMONIC_XTHL),
+    KEYWORD('B', 0, 0, 0, REGISTER_B), KEYWORD('C', 0, 0, 0, REGISTER_C), KEYWORD('D', 0, 0, 0, REGISTER_D),
+    KEYWORD('E', 0, 0, 0, REGISTER_E), KEYWORD('H', 0, 0, 0, REGISTER_H), KEYWORD('L', 0, 0, 0, REGISTER_L),
+    KEYWORD('M', 0, 0, 0, REGISTER_M), KEYWORD('A', 0, 0, 0, REGISTER_A),
+    KEYWORD('S', 'P', 0, 0, REGISTER_SP), KEYWORD('P', 'S', 'W', 0, REGISTER_PSW),
+    KEYWORD('D', 'B', 0, 0, DIRECTIVE_DB), KEYWORD('D', 'W', 0, 0, DIRECTIVE_DW),
+    KEYWORD('D', 'S', 0, 0, DIRECTIVE_DS), KEYWORD('O', 'R', 'G', 0, DIRECTIVE_ORG),
+    KEYWORD('E', 'Q', 'U', 0, DIRECTIVE_EQU), KEYWORD('E', 'N', 'D', 0, DIRECTIVE_END)
+};
+
+#undef KEYWORD
+
+typedef struct AssemblerSymbol {
+    // offset of the name in the pool
+    uint32_t name;
+    uint32_t length;
+    int32_t value;
+    int defined;
+} AssemblerSymbol;
+
+// An operand naming a label defined after it
+typedef struct AssemblerFixup {
+    uint32_t address;
+    int symbol;
+    int32_t addend;
+    int line;
+    // bytes of the operand
+    int size;
+} AssemblerFixup;
+
+// value, plus the value of symbol if it isn't -1 (not defined yet)
+typedef struct AssemblerValue {
+    int32_t value;
+    int symbol;
+} AssemblerValue;
+
+typedef struct Assembler8080 {
+    // opcode of a mnemonic and two operand kinds, -1 for none
+    int16_t opcodes[MNEMONICS][ASSEMBLER_KINDS][ASSEMBLER_KINDS];
+    // the assembled bytes, zeroed up to capacity, [low, end) was written
+    unsigned char *image;
+    uint32_t capacity;
+    uint32_t low;
+    uint32_t end;
+    uint32_t pc;
+    // address of the statement, $
+    uint32_t statement;
+    // symbols, and their index + 1 in table, open addressing on the hash of the name
+    AssemblerSymbol *symbols;
+    int symbol_count;
+    int symbol_capacity;
+    uint32_t *table;
+    uint32_t table_size;
+    char *pool;
+    size_t pool_used;
+    size_t pool_capacity;
+    AssemblerFixup *fixups;
+    int fixup_count;
+    int fixup_capacity;
+    const char *name;
+    int line;
+    int errors;
+} Assembler8080;
+
+
+static void assembler_error(Assembler8080 *as, int line, const char *format, ...)
+{
+    va_list arguments;
+
+    if (as->errors++ >= ASSEMBLER_ERRORS)
+        return;
+    printf("Error : %s:%d ", as->name, line);
+    va_start(arguments, format);
+    vprintf(format, arguments);
+    va_end(arguments);
+    printf("\n");
+}
+
+static void *assembler_grow(void *array, int *capacity, size_t size)
+{
+    int count = *capacity ? *capacity * 2 : 1024;
+    void *grown = realloc(array, count * size);
+
+    if (grown == NULL) {
+        printf("Error : couldn't allocate the assembler\n");
+        exit(1);
+    }
+    *capacity = count;
+    return grown;
+}
+
+// Keyword token of the name of length characters, 0 if it isn't one
+static inline int assembler_keyword(const char *name, int length)
+{
+    uint32_t key = 0;
+    const AssemblerKeyword *keyword;
+
+    if (length > 4)
+        return 0;
+    for (int i = 0; i < length; i++)
+        key |= (uint32_t)(uint8_t)toupper((unsigned char)name[i]) << (8 * i);
+    keyword = &assembler_keywords[ASSEMBLER_HASH(key)];
+    return keyword->key == key ? keyword->token : 0;
+}
+
+static inline int assembler_first(char c)
+{
+    return isalpha((unsigned char)c) || c == '_' || c == '.' || c == '?' || c == '@';
+}
+
+static inline int assembler_next(char c)
+{
+    return assembler_first(c) || isdigit((unsigned char)c);
+}
+
+static inline const char *assembler_skip(const char *c)
+{
+    while (*c == ' ' || *c == '\t')
+        c++;
+    return c;
+}
+
+// ';', the end of the line or of the source
+static inline int assembler_end(char c)
+{
+    return c == ';' || c == '\n' || c == '\r' || c == '\0';
+}
+
+
+/*
+    Assembler for the syntax of the listing, the opcodes are read from the listing of the
+    documented opcodes. Returns NULL if the memory can't be allocated.
+*/
+Assembler8080 *assembler_create(void)
+{
+    char templates[256][32];
+    Assembler8080 *as = calloc(1, sizeof(Assembler8080));
+
+    if (as == NULL || !templates8080(templates)) {
+        free(as);
+        return NULL;
+    }
+    memset(as->opcodes, 0xFF, sizeof(as->opcodes));
+    for (int op = 0; op < 256; op++) {
+        const char *c = templates[op];
+        int mnemonic, kinds[2] = {0, 0};
+        int length = 0;
+
+        // RST n is encoded from n
+        if (c[0] == '\0' || (op & 0xC7) == 0xC7)
+            continue;
+        while (c[length] != '\0' && c[length] != ' ')
+            length++;
+        mnemonic = assembler_keyword(c, length);
+        c += length;
+        for (int i = 0; i < 2 && *c != '\0'; i++) {
+            int token;
+
+            c += *c == ',' ? 2 : 1;
+            for (length = 0; c[length] != '\0' && c[length] != ','; length++)
+                ;
+            token = assembler_keyword(c, length);
+            kinds[i] = token >= REGISTER_B && token <= REGISTER_PSW ? 1 + token - REGISTER_B : ASSEMBLER_IMMEDIATE;
+            c += length;
+        }
+        if (mnemonic <= 0 || mnemonic >= MNEMONICS) {
+            printf("Error : no mnemonic for the opcode %02x (%s)\n", op, templates[op]);
+            free(as);
+            return NULL;
+        }
+        as->opcodes[mnemonic][kinds[0]][kinds[1]] = (int16_t)op;
+    }
+    return as;
+}
+
+void assembler_destroy(Assembler8080 *as)
+{
+    if (as == NULL)
+        return;
+    free(as->image);
+    free(as->symbols);
+    free(as->table);
+    free(as->pool);
+    free(as->fixups);
+    free(as);
+}
+
+// Symbol named by the length characters at name, added undefined if there is none
+static int assembler_symbol(Assembler8080 *as, const char *name, int length)
+{
+    uint32_t hash = 0x811c9dc5u;
+    uint32_t slot;
+
+    for (int i = 0; i < length; i++)
+        hash = (hash ^ (uint8_t)name[i]) * 0x01000193u;
+    if ((uint32_t)as->symbol_count * 2 >= as->table_size) {
+        uint32_t size = as->table_size ? as->table_size * 2 : 4096;
+        uint32_t *table = calloc(size, sizeof(uint32_t));
+
+        if (table == NULL) {
+            printf("Error : couldn't allocate the assembler\n");
+            exit(1);
+        }
+        for (int i = 0; i < as->symbol_count; i++) {
+            const AssemblerSymbol *symbol = &as->symbols[i];
+            uint32_t rehash = 0x811c9dc5u;
+
+            for (uint32_t j = 0; j < symbol->length; j++)
+                rehash = (rehash ^ (uint8_t)as->pool[symbol->name + j]) * 0x01000193u;
+            for (slot = rehash & (size - 1); table[slot] != 0; slot = (slot + 1) & (size - 1))
+                ;
+            table[slot] = (uint32_t)i + 1;
+        }
+        free(as->table);
+        as->table = table;
+        as->table_size = size;
+    }
+    for (slot = hash & (as->table_size - 1); as->table[slot] != 0; slot = (slot + 1) & (as->table_size - 1)) {
+        const AssemblerSymbol *symbol = &as->symbols[as->table[slot] - 1];
+
+        if (symbol->length == (uint32_t)length && memcmp(as->pool + symbol->name, name, length) == 0)
+            return (int)as->table[slot] - 1;
+    }
+
+    if (as->symbol_count == as->symbol_capacity)
+        as->symbols = assembler_grow(as->symbols, &as->symbol_capacity, sizeof(AssemblerSymbol));
+    while (as->pool_used + length > as->pool_capacity) {
+        as->pool_capacity = as->pool_capacity ? as->pool_capacity * 2 : 1 << 16;
+        as->pool = realloc(as->pool, as->pool_capacity);
+        if (as->pool == NULL) {
+            printf("Error : couldn't allocate the assembler\n");
+            exit(1);
+        }
+    }
+    memcpy(as->pool + as->pool_used, name, length);
+
+    AssemblerSymbol *symbol = &as->symbols[as->symbol_count];
+
+    symbol->name = (uint32_t)as->pool_used;
+    symbol->length = (uint32_t)length;
+    symbol->value = 0;
+    symbol->defined = 0;
+    as->pool_used += length;
+    as->table[slot] = (uint32_t)++as->symbol_count;
+    return as->symbol_count - 1;
+}
+
+static void assembler_define(Assembler8080 *as, const char *name, int length, int32_t value)
+{
+    int token = assembler_keyword(name, length);
+    AssemblerSymbol *symbol;
+    int index;
+
+    if (token >= REGISTER_B && token <= REGISTER_PSW) {
+        assembler_error(as, as->line, "%.*s is a register", length, name);
+        return;
+    }
+    // the symbols can move when one is added
+    index = assembler_symbol(as, name, length);
+    symbol = &as->symbols[index];
+    if (symbol->defined) {
+        assembler_error(as, as->line, "%.*s is already defined", length, name);
+        return;
+    }
+    symbol->defined = 1;
+    symbol->value = value;
+}
+
+// Number, name or $ at *c, returns 0 on a syntax error
+static int assembler_term(Assembler8080 *as, const char **c, AssemblerValue *term)
+{
+    const char *p = *c;
+    uint32_t value = 0;
+
+    term->symbol = -1;
+    if (*p == '$' && !isxdigit((unsigned char)p[1])) {
+        term->value = (int32_t)as->statement;
+        *c = p + 1;
+        return 1;
+    }
+    if (*p == '$' || (p[0] == '0' && (p[1] == 'x' || p[1] == 'X'))) {
+        p += *p == '$' ? 1 : 2;
+        if (!isxdigit((unsigned char)*p))
+            return 0;
+        for (; isxdigit((unsigned char)*p); p++)
+            value = value << 4 | (isdigit((unsigned char)*p) ? *p - '0' : (toupper((unsigned char)*p) - 'A' + 10));
+    }
+    else if (isdigit((unsigned char)*p)) {
+        const char *digits = p;
+        int length;
+
+        while (isxdigit((unsigned char)*p))
+            p++;
+        length = (int)(p - digits);
+        if (*p == 'h' || *p == 'H') {
+            for (int i = 0; i < length; i++)
+                value = value << 4 | (isdigit((unsigned char)digits[i]) ? digits[i] - '0' : (toupper((unsigned char)digits[i]) - 'A' + 10));
+            p++;
+        }
+        else if (toupper((unsigned char)digits[length - 1]) == 'B' && strspn(digits, "01") == (size_t)length - 1) {
+            for (int i = 0; i < length - 1; i++)
+                value = value << 1 | (digits[i] - '0');
+        }
+        else {
+            for (int i = 0; i < length; i++) {
+                if (!isdigit((unsigned char)digits[i]))
+                    return 0;
+                value = value * 10 + digits[i] - '0';
+            }
+        }
+    }
+    else if (p[0] == '\'' && p[1] != '\0' && p[1] != '\n' && p[2] == '\'') {
+        value = (uint8_t)p[1];
+        p += 3;
+    }
+    else if (assembler_first(*p)) {
+        const char *name = p;
+        int token;
+
+        while (assembler_next(*p))
+            p++;
+        token = assembler_keyword(name, (int)(p - name));
+        if (token >= REGISTER_B && token <= REGISTER_PSW)
+            return 0;
+
+        int index = assembler_symbol(as, name, (int)(p - name));
+
+        if (as->symbols[index].defined)
+            value = (uint32_t)as->symbols[index].value;
+        else
+            term->symbol = index;
+    }
+    else
+        return 0;
+    if (assembler_next(*p))
+        return 0;
+    term->value = (int32_t)value;
+    *c = p;
+    return 1;
+}
+
+// Terms added and subtracted at *c, at most one of them not defined yet. Returns 0 on a syntax error
+static int assembler_expression(Assembler8080 *as, const char **c, AssemblerValue *result)
+{
+    const char *p = assembler_skip(*c);
+    int sign = 1;
+
+    result->value = 0;
+    result->symbol = -1;
+    for (;;) {
+        AssemblerValue term;
+
+        if (*p == '-' || *p == '+') {
+            sign = *p == '-' ? -sign : sign;
+            p = assembler_skip(p + 1);
+        }
+        if (!assembler_term(as, &p, &term))
+            return 0;
+        if (term.symbol >= 0) {
+            if (result->symbol >= 0 || sign < 0)
+                return 0;
+            result->symbol = term.symbol;
+        }
+        result->value += sign * term.value;
+        p = assembler_skip(p);
+        if (*p != '+' && *p != '-')
+            break;
+        sign = *p == '-' ? -1 : 1;
+        p = assembler_skip(p + 1);
+    }
+    *c = p;
+    return 1;
+}
+
+// Room for count bytes at pc
+static int assembler_reserve(Assembler8080 *as, uint32_t count)
+{
+    if (as->pc + count > ASSEMBLER_LIMIT) {
+        assembler_error(as, as->line, "the code is past %d bytes", ASSEMBLER_LIMIT);
+        return 0;
+    }
+    if (as->pc + count > as->capacity) {
+        uint32_t capacity = as->capacity ? as->capacity : 0x10000;
+        unsigned char *image;
+
+        while (capacity < as->pc + count)
+            capacity *= 2;
+        image = realloc(as->image, capacity);
+        if (image == NULL) {
+            printf("Error : couldn't allocate %u bytes of memory\n", capacity);
+            exit(1);
+        }
+        memset(image + as->capacity, 0, capacity - as->capacity);
+        as->image = image;
+        as->capacity = capacity;
+    }
+    if (count > 0 && as->pc < as->low)
+        as->low = as->pc;
+    if (as->pc + count > as->end)
+        as->end = as->pc + count;
+    return 1;
+}
+
+static int assembler_fits(int32_t value, int size)
+{
+    return size == 1 ? value >= -128 && value <= 255 : value >= -32768 && value <= 65535;
+}
+
+// Write the size bytes of value at pc, or leave a fixup
+static void assembler_emit(Assembler8080 *as, const AssemblerValue *value, int size)
+{
+    if (!assembler_reserve(as, size))
+        return;
+    if (value->symbol >= 0) {
+        if (as->fixup_count == as->fixup_capacity)
+            as->fixups = assembler_grow(as->fixups, &as->fixup_capacity, sizeof(AssemblerFixup));
+        as->fixups[as->fixup_count++] = (AssemblerFixup){as->pc, value->symbol, value->value, as->line, size};
+    }
+    else if (!assembler_fits(value->value, size))
+        assembler_error(as, as->line, "%d doesn't fit in %d bits", value->value, size * 8);
+    else {
+        as->image[as->pc] = (uint8_t)value->value;
+        if (size == 2)
+            as->image[as->pc + 1] = (uint8_t)(value->value >> 8);
+    }
+    as->pc += size;
+}
+
+// Value of the operand of a directive, defined before it
+static int assembler_defined(Assembler8080 *as, const char **c, const char *directive, int32_t *value)
+{
+    AssemblerValue result;
+
+    if (!assembler_expression(as, c, &result)) {
+        assembler_error(as, as->line, "bad operand for %s", directive);
+        return 0;
+    }
+    if (result.symbol >= 0) {
+        const AssemblerSymbol *symbol = &as->symbols[result.symbol];
+
+        assembler_error(as, as->line, "%.*s must be defined before %s", (int)symbol->length, as->pool + symbol->name, directive);
+        return 0;
+    }
+    *value = result.value;
+    return 1;
+}
+
+// DB and DW, a list of expressions, and of strings for DB
+static const char *assembler_data(Assembler8080 *as, const char *c, int size)
+{
+    for (;;) {
+        AssemblerValue value;
+
+        c = assembler_skip(c);
+        if (size == 1 && (*c == '\'' || *c == '"')) {
+            char quote = *c++;
+            const char *text = c;
+
+            while (*c != quote && *c != '\n' && *c != '\0')
+                c++;
+            if (*c != quote) {
+                assembler_error(as, as->line, "unterminated string");
+                return NULL;
+            }
+            if (!assembler_reserve(as, (uint32_t)(c - text)))
+                return NULL;
+            memcpy(as->image + as->pc, text, c - text);
+            as->pc += (uint32_t)(c - text);
+            c++;
+        }
+        else if (assembler_expression(as, &c, &value))
+            assembler_emit(as, &value, size);
+        else {
+            assembler_error(as, as->line, "bad operand for %s", size == 1 ? "DB" : "DW");
+            return NULL;
+        }
+        c = assembler_skip(c);
+        if (*c != ',')
+            return c;
+        c++;
+    }
+}
+
+// An instruction, c is after the mnemonic
+static const char *assembler_instruction(Assembler8080 *as, const char *c, int mnemonic, const char *text, int length)
+{
+    int kinds[2] = {0, 0};
+    AssemblerValue value = {0, -1};
+    int op;
+
+    c = assembler_skip(c);
+    for (int i = 0; i < 2 && !assembler_end(*c); i++) {
+        const char *name = c;
+        int token = 0;
+
+        if (i > 0) {
+            if (*c != ',')
+                break;
+            c = name = assembler_skip(c + 1);
+        }
+        while (assembler_next(*c))
+            c++;
+        if (c > name)
+            token = assembler_keyword(name, (int)(c - name));
+        if (token >= REGISTER_B && token <= REGISTER_PSW) {
+            kinds[i] = 1 + token - REGISTER_B;
+            c = assembler_skip(c);
+            continue;
+        }
+        c = name;
+        if (!assembler_expression(as, &c, &value)) {
+            assembler_error(as, as->line, "bad operand for %.*s", length, text);
+            return NULL;
+        }
+        kinds[i] = ASSEMBLER_IMMEDIATE;
+    }
+
+    if (mnemonic == MNEMONIC_RST && kinds[0] == ASSEMBLER_IMMEDIATE && kinds[1] == 0) {
+        if (value.symbol >= 0 || value.value < 0 || value.value > 7) {
+            assembler_error(as, as->line, "RST takes a vector from 0 to 7");
+            return NULL;
+        }
+        op = 0xC7 | value.value << 3;
+    }
+    else
+        op = as->opcodes[mnemonic][kinds[0]][kinds[1]];
+    if (op < 0) {
+        assembler_error(as, as->line, "bad operands for %.*s", length, text);
+        return NULL;
+    }
+    if (!assembler_reserve(as, 1))
+        return NULL;
+    as->image[as->pc++] = (uint8_t)op;
+    if (length8080[op] > 1)
+        assembler_emit(as, &value, length8080[op] - 1);
+    return c;
+}
+
+// Assemble the line at c, returns 0 after END
+static int assembler_line(Assembler8080 *as, const char *c)
+{
+    const char *label = NULL;
+    int label_length = 0;
+    const char *text;
+    int token, length;
+
+    as->statement = as->pc;
+    // label, unless the line starts with an instruction
+    if (assembler_first(*c)) {
+        const char *p = c;
+
+        while (assembler_next(*p))
+            p++;
+        token = assembler_keyword(c, (int)(p - c));
+        if (*p == ':' || token == 0 || (token >= REGISTER_B && token <= REGISTER_PSW)) {
+            label = c;
+            label_length = (int)(p - c);
+            c = p + (*p == ':');
+        }
+    }
+    c = assembler_skip(c);
+    if (assembler_end(*c)) {
+        if (label != NULL)
+            assembler_define(as, label, label_length, (int32_t)as->pc);
+        return 1;
+    }
+
+    text = c;
+    while (assembler_next(*c))
+        c++;
+    length = (int)(c - text);
+    token = length > 0 ? assembler_keyword(text, length) : 0;
+    if (token == 0 || (token >= REGISTER_B && token <= REGISTER_PSW)) {
+        assembler_error(as, as->line, "unknown instruction %.*s", length > 0 ? length : 1, text);
+        return 1;
+    }
+    if (label != NULL && token != DIRECTIVE_EQU)
+        assembler_define(as, label, label_length, (int32_t)as->pc);
+
+    if (token < MNEMONICS)
+        c = assembler_instruction(as, c, token, text, length);
+    else {
+        int32_t value;
+
+        switch (token) {
+            case DIRECTIVE_DB:
+            case DIRECTIVE_DW:
+                c = assembler_data(as, c, token == DIRECTIVE_DB ? 1 : 2);
+                break;
+            case DIRECTIVE_DS:
+                if (!assembler_defined(as, &c, "DS", &value))
+                    return 1;
+                if (value < 0 || !assembler_reserve(as, (uint32_t)value))
+                    return 1;
+                as->pc += (uint32_t)value;
+                break;
+            case DIRECTIVE_ORG:
+                if (!assembler_defined(as, &c, "ORG", &value))
+                    return 1;
+                if (value < 0 || value >= ASSEMBLER_LIMIT) {
+                    assembler_error(as, as->line, "ORG past %d bytes", ASSEMBLER_LIMIT);
+                    return 1;
+                }
+                as->pc = (uint32_t)value;
+                break;
+            case DIRECTIVE_EQU:
+                if (label == NULL) {
+                    assembler_error(as, as->line, "EQU without a name");
+                    return 1;
+                }
+                if (assembler_defined(as, &c, "EQU", &value))
+                    assembler_define(as, label, label_length, value);
+                return 1;
+            case DIRECTIVE_END:
+                return 0;
+        }
+    }
+    if (c != NULL && !assembler_end(*(c = assembler_skip(c))))
+        assembler_error(as, as->line, "unexpected %.*s", (int)strcspn(c, "\r\n"), c);
+    return 1;
+}
+
+/*
+    Assemble the '\0' terminated source, name is used in the messages. Returns the number of
+    errors, the image is as->image + as->low, as->end - as->low bytes.
+*/
+int assemble8080(Assembler8080 *as, const char *source, const char *name)
+{
+    const char *c = source;
+
+    if (as->end > 0)
+        memset(as->image, 0, as->end);
+    if (as->table != NULL)
+        memset(as->table, 0, as->table_size * sizeof(uint32_t));
+    as->low = UINT32_MAX;
+    as->end = as->pc = 0;
+    as->symbol_count = 0;
+    as->pool_used = 0;
+    as->fixup_count = 0;
+    as->errors = 0;
+    as->name = name;
+
+    // first pass
+    for (as->line = 1; *c != '\0'; as->line++) {
+        const char *next = strchr(c, '\n');
+
+        if (!assembler_line(as, c))
+            break;
+        if (next == NULL)
+            break;
+        c = next + 1;
+    }
+    if (as->low > as->end)
+        as->low = as->end;
+
+    // second pass
+    for (int i = 0; i < as->fixup_count; i++) {
+        const AssemblerFixup *fixup = &as->fixups[i];
+        const AssemblerSymbol *symbol = &as->symbols[fixup->symbol];
+        int32_t value = symbol->value + fixup->addend;
+
+        if (!symbol->defined)
+            assembler_error(as, fixup->line, "%.*s isn't defined", (int)symbol->length, as->pool + symbol->name);
+        else if (!assembler_fits(value, fixup->size))
+            assembler_error(as, fixup->line, "%d doesn't fit in %d bits", value, fixup->size * 8);
+        else {
+            as->image[fixup->address] = (uint8_t)value;
+            if (fixup->size == 2)
+                as->image[fixup->address + 1] = (uint8_t)(value >> 8);
+        }
+    }
+    if (as->errors > ASSEMBLER_ERRORS)
+        printf("Error : %s, %d errors\n", name, as->errors);
+    return as->errors;
+}
+
+
+// Read the file at path followed by 3 zeroed bytes, NULL if it can't be read
+static unsigned char *assembler_load(const char *path, int *size)
+{
+    FILE *f = fopen(path, "rb");
+    unsigned char *buffer;
+    long length;
+
+    if (f == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        return NULL;
+    }
+    fseek(f, 0l, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0l, SEEK_SET);
+    buffer = length >= 0 && length < 0x7FFFFFF0l ? calloc(length + 3, 1) : NULL;
+    if (buffer == NULL || fread(buffer, 1, length, f) != (size_t)length) {
+        printf("Error : couldn't read the file %s\n", path);
+        free(buffer);
+        fclose(f);
+        return NULL;
+    }
+    fclose(f);
+    *size = (int)length;
+    return buffer;
+}
+
+// -assemble source output : returns the number of errors
+int assembler_run(const char *path, const char *output)
+{
+    int size = 0;
+    unsigned char *source;
+    Assembler8080 *as = assembler_create();
+    FILE *f;
+    int errors;
+
+    if (as == NULL) {
+        printf("Error : couldn't allocate the assembler\n");
+        return 1;
+    }
+    source = assembler_load(path, &size);
+    if (source == NULL) {
+        assembler_destroy(as);
+        return 1;
+    }
+    errors = assemble8080(as, (const char *)source, path);
+    free(source);
+    if (errors == 0) {
+        f = fopen(output, "wb");
+        // a source without any byte (only EQUs, ...) gives an empty file
+        if (f == NULL || (as->end != as->low && fwrite(as->image + as->low, 1, as->end - as->low, f) != as->end - as->low)) {
+            printf("Error : couldn't write %s\n", output);
+            errors = 1;
+        }
+        if (f != NULL && fclose(f) != 0)
+            errors = 1;
+    }
+    assembler_destroy(as);
+    return errors;
+}
+
+/*
+    -roundtrip input ... : list every file with labels, assemble the listing and compare it
+    with the file. Prints the first difference of every file that doesn't assemble back to
+    itself, and the speed of the assembler. Returns the number of these files.
+*/
+int assembler_roundtrip(char **inputs, int count)
+{
+    CorpusList list = {0};
+    Labels8080 *labels = labels_create(NULL);
+    Assembler8080 *as = assembler_create();
+    uint64_t bytes = 0, source = 0, lines = 0;
+    double seconds = 0;
+    int failed = 0;
+
+    if (labels == NULL || as == NULL) {
+        printf("Error : couldn't allocate the assembler\n");
+        exit(1);
+    }
+    for (int i = 0; i < count; i++)
+        if (!corpus_collect(&list, inputs[i]))
+            failed++;
+    for (int i = 0; i < list.count; i++) {
+        int size = 0;
+        unsigned char *code = assembler_load(list.paths[i], &size);
+        struct timespec start, end;
+        int errors;
+
+        if (code == NULL || size >= ASSEMBLER_LIMIT) {
+            if (code != NULL)
+                printf("Error : %s is past %d bytes\n", list.paths[i], ASSEMBLER_LIMIT);
+            free(code);
+            failed++;
+            continue;
+        }
+        labels_list(labels, NULL, code, size);
+        timespec_get(&start, TIME_UTC);
+        errors = assemble8080(as, labels->text, list.paths[i]);
+        timespec_get(&end, TIME_UTC);
+        seconds += (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+        bytes += size;
+        source += labels->used;
+        for (size_t j = 0; j < labels->used; j++)
+            lines += labels->text[j] == '\n';
+
+        if (errors == 0) {
+            uint32_t at = 0;
+
+            while (at < (uint32_t)size && at < as->end - as->low && as->image[as->low + at] == code[at])
+                at++;
+            if (at < (uint32_t)size || as->end - as->low != (uint32_t)size) {
+                printf("Error : %s assembles to %u bytes instead of %d, first difference at %04x\n", list.paths[i],
+                    as->end - as->low, size, at);
+                errors = 1;
+            }
+        }
+        failed += errors != 0;
+        free(code);
+    }
+    printf("%d files, %.2f MB assembled from %.2f MB of listings (%llu lines) in %.3f s : %.0f lines/s, %.2f MB/s, %d differences\n",
+        list.count, bytes / 1e6, source / 1e6, (unsigned long long)lines, seconds, seconds > 0 ? lines / seconds : 0.0,
+        seconds > 0 ? source / seconds / 1e6 : 0.0, failed);
+    assembler_destroy(as);
+    labels_destroy(labels);
+    corpus_free(&list);
+    return failed;
+}
+
+#endif
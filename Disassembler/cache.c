@@ -0,0 +1,503 @@
+#ifndef DISASSEMBLER_CACHE_C
+#define DISASSEMBLER_CACHE_C
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "disassembler.c"
+#include "index.c"
+
+/*
+    Analysis cache
+
+    The analysis of an image (instruction starts and code intervals of the index, basic
+    blocks, cross references) is saved in the cache directory ($CACHE8080, .cache8080 by
+    default) to a file named by the 64 bits xxHash (XXH64) of the image and the variant, so
+    the 8080 and 8085 builds can share the directory. The file is the analysis as it is used
+    in memory, so loading it is the hash of the image and an mmap :
+        header          AnalysisHeader, 64 bytes
+        boundaries      words * 8 bytes, bit n set if an instruction of the listing starts at n
+        intervals       IndexInterval, the code bytes reached by the recursive descent
+        blocks          AnalysisBlock, sorted by start
+        references      AnalysisReference, sorted by target then source
+
+    The file is used only if the magic, the version, the variant (8080 / 8085), the size and
+    the hash of the image and the length of every part agree, else the image is analysed
+    again and the file replaced (written to a temporary file, then renamed, so concurrent
+    runs never see half a file). ANALYSIS_VERSION must change with the format or with the
+    analysis itself.
+*/
+
+
+#define ANALYSIS_MAGIC "8080ANA"
+#define ANALYSIS_VERSION 1
+#ifdef CPU_8085
+#define ANALYSIS_VARIANT 8085
+#else
+#define ANALYSIS_VARIANT 8080
+#endif
+
+// kind of the references that aren't transfers (FLOW_JUMP, FLOW_BRANCH, FLOW_CALL, FLOW_RST)
+#define REFERENCE_DATA 7
+
+typedef struct AnalysisHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t variant;
+    uint64_t hash;
+    uint64_t length;
+    uint32_t size;
+    uint32_t words;
+    uint32_t intervals;
+    uint32_t blocks;
+    uint32_t references;
+    uint32_t reserved[3];
+} AnalysisHeader;
+
+// basic block [start, end), ends with a transfer or before a leader
+typedef struct AnalysisBlock {
+    uint32_t start;
+    uint32_t end;
+} AnalysisBlock;
+
+typedef struct AnalysisReference {
+    uint16_t target;
+    uint16_t source;
+    uint8_t kind;
+    uint8_t reserved[3];
+} AnalysisReference;
+
+typedef struct Analysis8080 {
+    const AnalysisHeader *header;
+    // the boundaries and intervals, for the index_* functions
+    Index8080 index;
+    const AnalysisBlock *blocks;
+    const AnalysisReference *references;
+    void *base;
+    size_t length;
+    // 1 if base is the mapped cache file, 0 if it is allocated
+    int mapped;
+} Analysis8080;
+
+
+#define XXH_PRIME1 0x9E3779B185EBCA87ull
+#define XXH_PRIME2 0xC2B2AE3D27D4EB4Full
+#define XXH_PRIME3 0x165667B19E3779F9ull
+#define XXH_PRIME4 0x85EBCA77C2B2AE63ull
+#define XXH_PRIME5 0x27D4EB2F165667C5ull
+
+static inline uint64_t cache_rotate(uint64_t x, int bits)
+{
+    return x << bits | x >> (64 - bits);
+}
+
+static inline uint64_t cache_read64(const unsigned char *p)
+{
+    uint64_t x;
+
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static inline uint64_t cache_round(uint64_t acc, uint64_t input)
+{
+    return cache_rotate(acc + input * XXH_PRIME2, 31) * XXH_PRIME1;
+}
+
+static inline uint64_t cache_merge(uint64_t acc, uint64_t lane)
+{
+    return (acc ^ cache_round(0, lane)) * XXH_PRIME1 + XXH_PRIME4;
+}
+
+// XXH64 with a seed of 0 (little endian host), 4 lanes of 8 bytes per 32 bytes stripe
+uint64_t cache_hash(const unsigned char *data, size_t size)
+{
+    const unsigned char *end = data + size;
+    uint64_t hash;
+
+    if (size >= 32) {
+        uint64_t v1 = XXH_PRIME1 + XXH_PRIME2, v2 = XXH_PRIME2, v3 = 0, v4 = -XXH_PRIME1;
+
+        for (; data + 32 <= end; data += 32) {
+            v1 = cache_round(v1, cache_read64(data));
+            v2 = cache_round(v2, cache_read64(data + 8));
+            v3 = cache_round(v3, cache_read64(data + 16));
+            v4 = cache_round(v4, cache_read64(data + 24));
+        }
+        hash = cache_rotate(v1, 1) + cache_rotate(v2, 7) + cache_rotate(v3, 12) + cache_rotate(v4, 18);
+        hash = cache_merge(cache_merge(cache_merge(cache_merge(hash, v1), v2), v3), v4);
+    } else
+        hash = XXH_PRIME5;
+    hash += size;
+
+    for (; data + 8 <= end; data += 8)
+        hash = cache_rotate(hash ^ cache_round(0, cache_read64(data)), 27) * XXH_PRIME1 + XXH_PRIME4;
+    if (data + 4 <= end) {
+        uint32_t x;
+
+        memcpy(&x, data, sizeof(x));
+        hash = cache_rotate(hash ^ x * XXH_PRIME1, 23) * XXH_PRIME2 + XXH_PRIME3;
+        data += 4;
+    }
+    for (; data < end; data++)
+        hash = cache_rotate(hash ^ *data * XXH_PRIME5, 11) * XXH_PRIME1;
+
+    hash ^= hash >> 33;
+    hash *= XXH_PRIME2;
+    hash ^= hash >> 29;
+    hash *= XXH_PRIME3;
+    return hash ^ hash >> 32;
+}
+
+
+// Length of the file for these counts, every part is a multiple of 8 bytes
+static size_t analysis_length(const AnalysisHeader *header)
+{
+    return sizeof(AnalysisHeader) + (size_t)header->words * sizeof(uint64_t)
+        + (size_t)header->intervals * sizeof(IndexInterval) + (size_t)header->blocks * sizeof(AnalysisBlock)
+        + (size_t)header->references * sizeof(AnalysisReference);
+}
+
+// Point the parts of the analysis at base
+static void analysis_point(Analysis8080 *analysis, void *base, size_t length, int mapped)
+{
+    const AnalysisHeader *header = base;
+    unsigned char *part = (unsigned char *)base + sizeof(AnalysisHeader);
+
+    analysis->header = header;
+    analysis->base = base;
+    analysis->length = length;
+    analysis->mapped = mapped;
+    memset(&analysis->index, 0, sizeof(analysis->index));
+    analysis->index.header.size = header->size;
+    analysis->index.header.words = header->words;
+    analysis->index.header.intervals = header->intervals;
+    analysis->index.header.hash = header->hash;
+    analysis->index.boundaries = (uint64_t *)part;
+    part += (size_t)header->words * sizeof(uint64_t);
+    analysis->index.intervals = (IndexInterval *)part;
+    part += (size_t)header->intervals * sizeof(IndexInterval);
+    analysis->blocks = (const AnalysisBlock *)part;
+    part += (size_t)header->blocks * sizeof(AnalysisBlock);
+    analysis->references = (const AnalysisReference *)part;
+}
+
+// Target of the reference of the instruction at pc, -1 if it has none, *kind is set to its kind
+int analysis_target(const unsigned char *code, int pc, uint8_t *kind)
+{
+    uint8_t op = code[pc];
+
+    *kind = flow8080[op] != FLOW_NEXT ? flow8080[op] : REFERENCE_DATA;
+    if (flow8080[op] == FLOW_RST)
+        return op & 0x38;
+    if (flow8080[op] == FLOW_JUMP || flow8080[op] == FLOW_BRANCH || flow8080[op] == FLOW_CALL
+        || ((op & 0xC7) == 0x01 && length8080[op] == 3) || ((op & 0xE7) == 0x22 && length8080[op] == 3))
+        return code[pc + 1] | code[pc + 2] << 8;
+    return -1;
+}
+
+/*
+    Lay out the analysis of size bytes of code (followed by 2 readable bytes) of hash, from its
+    boundaries and descent map (index_scan), into one allocation laid out like the cache file.
+    Returns 0 if the memory can't be allocated.
+*/
+int analysis_layout(Analysis8080 *analysis, const unsigned char *code, int size, uint64_t hash,
+    const uint8_t *map, const uint64_t *boundaries)
+{
+    static uint32_t first[0x10001];
+    int limit = size < 0x10000 ? size : 0x10000;
+    AnalysisReference *references = malloc(0x10000 * sizeof(AnalysisReference));
+    AnalysisHeader header;
+    Index8080 index = {0};
+    unsigned char *base = NULL;
+    uint32_t blocks = 0, count = 0;
+
+    if (references == NULL || !index_intervals(&index, map, size)) {
+        printf("Error : couldn't allocate the analysis of %d bytes\n", size);
+        free(references);
+        return 0;
+    }
+
+    // the blocks start at the reached leaders, the references come from the reached instructions
+    memset(first, 0, sizeof(first));
+    for (int pc = 0; pc < limit; pc++) {
+        uint8_t kind;
+        int target;
+
+        if ((map[pc] & 6) == 6)
+            blocks++;
+        if (!(map[pc] & 2) || (target = analysis_target(code, pc, &kind)) < 0)
+            continue;
+        references[count].target = (uint16_t)target;
+        references[count].source = (uint16_t)pc;
+        references[count].kind = kind;
+        memset(references[count].reserved, 0, sizeof(references[count].reserved));
+        first[target + 1]++;
+        count++;
+    }
+
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, ANALYSIS_MAGIC, sizeof(header.magic));
+    header.version = ANALYSIS_VERSION;
+    header.variant = ANALYSIS_VARIANT;
+    header.hash = hash;
+    header.size = (uint32_t)size;
+    header.words = (uint32_t)size / 64 + 1;
+    header.intervals = index.header.intervals;
+    header.blocks = blocks;
+    header.references = count;
+    header.length = analysis_length(&header);
+    base = malloc(header.length);
+    if (base != NULL) {
+        AnalysisBlock *block;
+        AnalysisReference *sorted;
+
+        memcpy(base, &header, sizeof(header));
+        analysis_point(analysis, base, header.length, 0);
+        memcpy(analysis->index.boundaries, boundaries, (size_t)header.words * sizeof(uint64_t));
+        memcpy(analysis->index.intervals, index.intervals, (size_t)header.intervals * sizeof(IndexInterval));
+
+        // a block runs until a transfer, the next leader or an instruction that doesn't fit
+        block = (AnalysisBlock *)analysis->blocks;
+        for (int pc = 0; pc < limit; pc++) {
+            int end = pc;
+
+            if ((map[pc] & 6) != 6)
+                continue;
+            for (;;) {
+                uint8_t op = code[end];
+
+                end += length8080[op];
+                if (flow8080[op] != FLOW_NEXT || end >= limit || (map[end] & 6) != 2)
+                    break;
+            }
+            block->start = (uint32_t)pc;
+            block->end = (uint32_t)end;
+            block++;
+        }
+
+        // counting sort by target, stable so the sources stay in order
+        for (int target = 0; target < 0x10000; target++)
+            first[target + 1] += first[target];
+        sorted = (AnalysisReference *)analysis->references;
+        for (uint32_t i = 0; i < count; i++)
+            sorted[first[references[i].target]++] = references[i];
+    } else
+        printf("Error : couldn't allocate the analysis of %d bytes\n", size);
+
+    free(references);
+    free(index.intervals);
+    return base != NULL;
+}
+
+// Analyse size bytes of code (followed by 2 readable bytes) of hash, returns 0 if the memory can't be allocated
+int analysis_build(Analysis8080 *analysis, const unsigned char *code, int size, uint64_t hash)
+{
+    uint8_t *map = calloc(0x10001, 1);
+    uint64_t *boundaries = calloc((uint32_t)size / 64 + 1, sizeof(uint64_t));
+    int ok = 0;
+
+    if (map != NULL && boundaries != NULL) {
+        index_scan(code, size, map, boundaries);
+        ok = analysis_layout(analysis, code, size, hash, map, boundaries);
+    } else
+        printf("Error : couldn't allocate the analysis of %d bytes\n", size);
+    free(map);
+    free(boundaries);
+    return ok;
+}
+
+void analysis_close(Analysis8080 *analysis)
+{
+    if (analysis->mapped)
+        munmap(analysis->base, analysis->length);
+    else
+        free(analysis->base);
+    memset(analysis, 0, sizeof(*analysis));
+}
+
+// The cache file of hash, to free
+static char *analysis_path(uint64_t hash, const char *suffix)
+{
+    const char *directory = getenv("CACHE8080") ? getenv("CACHE8080") : ".cache8080";
+    char *path = malloc(strlen(directory) + strlen(suffix) + 32);
+
+    if (path != NULL)
+        sprintf(path, "%s/%016llx-%d.ana%s", directory, (unsigned long long)hash, ANALYSIS_VARIANT, suffix);
+    return path;
+}
+
+// Map the cache file of the image, returns 0 if there is no valid one
+static int analysis_map(Analysis8080 *analysis, const char *path, int size, uint64_t hash)
+{
+    int fd = open(path, O_RDONLY);
+    struct stat info;
+    void *base;
+    const AnalysisHeader *header;
+
+    if (fd < 0)
+        return 0;
+    if (fstat(fd, &info) != 0 || (size_t)info.st_size < sizeof(AnalysisHeader)) {
+        close(fd);
+        return 0;
+    }
+    base = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED)
+        return 0;
+
+    header = base;
+    if (memcmp(header->magic, ANALYSIS_MAGIC, sizeof(header->magic)) != 0 || header->version != ANALYSIS_VERSION
+        || header->variant != ANALYSIS_VARIANT || header->hash != hash || header->size != (uint32_t)size
+        || header->words != (uint32_t)size / 64 + 1 || header->length != (uint64_t)info.st_size
+        || analysis_length(header) != (size_t)info.st_size) {
+        munmap(base, info.st_size);
+        return 0;
+    }
+    analysis_point(analysis, base, info.st_size, 1);
+    return 1;
+}
+
+// Write the analysis to its cache file, returns 0 if it can't be written
+static int analysis_save(const Analysis8080 *analysis)
+{
+    const char *directory = getenv("CACHE8080") ? getenv("CACHE8080") : ".cache8080";
+    char suffix[32];
+    char *path = analysis_path(analysis->header->hash, "");
+    char *temporary;
+    FILE *f;
+    int ok = 0;
+
+    sprintf(suffix, ".%ld", (long)getpid());
+    temporary = analysis_path(analysis->header->hash, suffix);
+    if (path == NULL || temporary == NULL) {
+        free(path);
+        free(temporary);
+        return 0;
+    }
+    mkdir(directory, 0777);
+    if ((f = fopen(temporary, "wb")) != NULL) {
+        ok = fwrite(analysis->base, analysis->length, 1, f) == 1;
+        ok = fclose(f) == 0 && ok && rename(temporary, path) == 0;
+        if (!ok)
+            remove(temporary);
+    }
+    free(path);
+    free(temporary);
+    return ok;
+}
+
+/*
+    Analysis of size bytes of code (followed by 2 readable bytes), mapped from the cache or
+    built and saved to it. Returns 0 on failure, 1 if it was in the cache, 2 if it was built.
+*/
+int analysis_open(Analysis8080 *analysis, const unsigned char *code, int size)
+{
+    uint64_t hash = cache_hash(code, size);
+    char *path = analysis_path(hash, "");
+    int found;
+
+    memset(analysis, 0, sizeof(*analysis));
+    if (path == NULL)
+        return 0;
+    found = analysis_map(analysis, path, size, hash);
+    free(path);
+    if (found)
+        return 1;
+    if (!analysis_build(analysis, code, size, hash))
+        return 0;
+    if (!analysis_save(analysis))
+        printf("Warning : couldn't save the analysis to the cache\n");
+    return 2;
+}
+
+
+// Index of the first reference to target, *count is set to the number of references
+uint32_t analysis_references(const Analysis8080 *analysis, uint16_t target, uint32_t *count)
+{
+    uint32_t low = 0, high = analysis->header->references, first;
+
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+
+        if (analysis->references[middle].target < target)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    first = low;
+    while (low < analysis->header->references && analysis->references[low].target == target)
+        low++;
+    *count = low - first;
+    return first;
+}
+
+// The block containing address, NULL if address isn't in a block
+const AnalysisBlock *analysis_block(const Analysis8080 *analysis, int address)
+{
+    uint32_t low = 0, high = analysis->header->blocks;
+
+    // last block starting at or before address
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+
+        if (analysis->blocks[middle].start <= (uint32_t)address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low == 0 || analysis->blocks[low - 1].end <= (uint32_t)address)
+        return NULL;
+    return &analysis->blocks[low - 1];
+}
+
+/*
+    Print the block containing address and the instructions referencing it, with the time
+    taken to get the analysis
+*/
+int analysis_run(const unsigned char *code, int size, int address)
+{
+    static const char *kinds[8] = {"", "jump", "branch", "call", "rst", "", "", "data"};
+    Analysis8080 analysis;
+    struct timespec start, end;
+    const AnalysisBlock *block;
+    uint32_t count, first;
+    int found;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    found = analysis_open(&analysis, code, size);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    if (!found)
+        return 1;
+    printf("; %s in %.3f ms : %u code intervals, %u blocks, %u references\n", found == 1 ? "cached" : "analysed",
+        (end.tv_sec - start.tv_sec) * 1e3 + (end.tv_nsec - start.tv_nsec) / 1e6, analysis.header->intervals,
+        analysis.header->blocks, analysis.header->references);
+
+    if ((block = analysis_block(&analysis, address)) != NULL) {
+        printf("; block %04x-%04x\n", block->start, block->end - 1);
+        for (uint32_t pc = block->start; pc < block->end; pc += length8080[code[pc]]) {
+            int inside = (uint32_t)address >= pc && (uint32_t)address < pc + length8080[code[pc]];
+
+            printf("%s%04x\t", inside ? "  > " : "    ", pc);
+            fdisassemble8080(stdout, (unsigned char *)code, pc);
+        }
+    } else
+        printf("; %04x isn't in a block\n", address);
+
+    first = analysis_references(&analysis, (uint16_t)address, &count);
+    printf("; %u references to %04x\n", count, address);
+    for (uint32_t i = first; i < first + count; i++) {
+        printf("%-6s\t%04x\t", kinds[analysis.references[i].kind], analysis.references[i].source);
+        fdisassemble8080(stdout, (unsigned char *)code, analysis.references[i].source);
+    }
+    analysis_close(&analysis);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,507 @@
+#ifndef DISASSEMBLER_CORPUS_C
+#define DISASSEMBLER_CORPUS_C
+
+#include <dirent.h>
+#include <glob.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "disassembler.c"
+#include "labels.c"
+#include "search.c"
+#include "stats.c"
+
+/*
+    Corpus mode : disassemble many files on a pool of threads
+
+    Inputs : files, directories (recursively, in name order), @list files (one input per
+    line) and globs, expanded here when the shell didn't.
+
+    The workers only share the index of the next file. Each one owns an input buffer and an
+    output buffer, reused from file to file :
+        - with an output directory, every listing goes to its own file (the path with '/'
+          replaced by '_', plus .asm), written through the buffer of the worker
+        - otherwise the listings go to stdout, one write per file, in completion order, or
+          in input order when ordered is set. The finished listings then wait for the writer,
+          at most CORPUS_WINDOW files ahead of it.
+        - with stats, nothing is listed, every worker counts the instructions of its files
+          (see Disassembler/stats.c) and the counters are merged at the end
+        - with a search, the hits (see Disassembler/search.c) take the place of the listings
+        - labelled, the listings name the jump and call targets (see Disassembler/labels.c),
+          every worker has its own label tables, the symbols are shared
+*/
+
+
+#define CORPUS_WINDOW 256
+#define CORPUS_OUTPUT (1 << 20)
+#define CORPUS_THREADS 256
+
+typedef struct CorpusList {
+    char **paths;
+    int count;
+    int capacity;
+} CorpusList;
+
+// A listing waiting for its turn in ordered mode
+typedef struct CorpusSlot {
+    char *listing;
+    size_t size;
+    int done;
+} CorpusSlot;
+
+typedef struct Corpus {
+    const CorpusList *list;
+    const char *directory;
+    int ordered;
+    int stats;
+    const Search8080 *search;
+    int labelled;
+    const Symbols8080 *symbols;
+    // instructions printed around a hit
+    int context;
+    // the next file to disassemble
+    atomic_int next;
+    // ordered mode, slots[i] is filled by a worker and written by corpus_run
+    CorpusSlot *slots;
+    int flushed;
+    pthread_mutex_t lock;
+    pthread_cond_t done;
+    pthread_cond_t room;
+} Corpus;
+
+typedef struct CorpusWorker {
+    Corpus *corpus;
+    pthread_t thread;
+    // the file, followed by 2 zeroed bytes
+    unsigned char *input;
+    size_t input_size;
+    // listing to stdout : memory stream, listing to files : stdio buffer
+    FILE *stream;
+    char *listing;
+    size_t listing_size;
+    char *output;
+    Stats8080 stats;
+    SearchScan scan;
+    Labels8080 *labels;
+    uint64_t files;
+    uint64_t failed;
+    uint64_t bytes;
+    uint64_t written;
+    uint64_t undocumented;
+} CorpusWorker;
+
+
+static void corpus_add(CorpusList *list, const char *path)
+{
+    if (list->count == list->capacity) {
+        list->capacity = list->capacity ? list->capacity * 2 : 64;
+        list->paths = realloc(list->paths, list->capacity * sizeof(char *));
+        if (list->paths == NULL) {
+            printf("Error : couldn't allocate a list of %d files\n", list->capacity);
+            exit(1);
+        }
+    }
+    list->paths[list->count] = malloc(strlen(path) + 1);
+    if (list->paths[list->count] == NULL) {
+        printf("Error : couldn't allocate the path %s\n", path);
+        exit(1);
+    }
+    strcpy(list->paths[list->count++], path);
+}
+
+void corpus_free(CorpusList *list)
+{
+    for (int i = 0; i < list->count; i++)
+        free(list->paths[i]);
+    free(list->paths);
+    list->paths = NULL;
+    list->count = list->capacity = 0;
+}
+
+static int corpus_compare(const void *a, const void *b)
+{
+    return strcmp(*(char * const *)a, *(char * const *)b);
+}
+
+static int corpus_collect(CorpusList *list, const char *input);
+
+// Add the files under path, in name order
+static int corpus_directory(CorpusList *list, const char *path)
+{
+    CorpusList entries = {0};
+    DIR *directory = opendir(path);
+    struct dirent *entry;
+    int result = 1;
+
+    if (directory == NULL) {
+        printf("Error : couldn't open the directory %s\n", path);
+        return 0;
+    }
+    while ((entry = readdir(directory)) != NULL) {
+        char child[4096];
+
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        snprintf(child, sizeof(child), "%s%s%s", path, path[strlen(path) - 1] == '/' ? "" : "/", entry->d_name);
+        corpus_add(&entries, child);
+    }
+    closedir(directory);
+
+    qsort(entries.paths, entries.count, sizeof(char *), corpus_compare);
+    for (int i = 0; i < entries.count; i++)
+        result &= corpus_collect(list, entries.paths[i]);
+    corpus_free(&entries);
+    return result;
+}
+
+// Add a file, a directory, an @list or a glob, returns 0 if some input wasn't found
+static int corpus_collect(CorpusList *list, const char *input)
+{
+    struct stat info;
+
+    if (input[0] == '@') {
+        FILE *f = fopen(input + 1, "r");
+        char line[4096];
+        int result = 1;
+
+        if (f == NULL) {
+            printf("Error : couldn't open the list %s\n", input + 1);
+            return 0;
+        }
+        while (fgets(line, sizeof(line), f) != NULL) {
+            line[strcspn(line, "\r\n")] = '\0';
+            if (line[0] != '\0')
+                result &= corpus_collect(list, line);
+        }
+        fclose(f);
+        return result;
+    }
+    if (stat(input, &info) == 0) {
+        if (S_ISDIR(info.st_mode))
+            return corpus_directory(list, input);
+        if (S_ISREG(info.st_mode))
+            corpus_add(list, input);
+        return 1;
+    }
+    if (strpbrk(input, "*?[") != NULL) {
+        glob_t matches;
+        int result = 1;
+
+        if (glob(input, 0, NULL, &matches) != 0) {
+            printf("Error : no file matches %s\n", input);
+            return 0;
+        }
+        for (size_t i = 0; i < matches.gl_pathc; i++)
+            result &= corpus_collect(list, matches.gl_pathv[i]);
+        globfree(&matches);
+        return result;
+    }
+    printf("Error : couldn't find %s\n", input);
+    return 0;
+}
+
+
+// Read path into the input buffer of worker, returns the size of the file or -1
+static long corpus_read(CorpusWorker *worker, const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    long size;
+
+    if (f == NULL)
+        return -1;
+    fseek(f, 0l, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0l, SEEK_SET);
+    if (size < 0 || size > 0x7FFFFFF0l) {
+        fclose(f);
+        return -1;
+    }
+    if ((size_t)size + 2 > worker->input_size) {
+        free(worker->input);
+        worker->input_size = (size_t)size + 2 > 65536 ? (size_t)size + 2 : 65536;
+        worker->input = malloc(worker->input_size);
+        if (worker->input == NULL) {
+            printf("Error : couldn't allocate %zu bytes of memory\n", worker->input_size);
+            exit(1);
+        }
+    }
+    if (fread(worker->input, 1, size, f) != (size_t)size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    worker->input[size] = 0;
+    worker->input[size + 1] = 0;
+    return size;
+}
+
+// Write the listing of input to the output directory, returns 0 on failure
+static int corpus_write(CorpusWorker *worker, const char *input, long size)
+{
+    char path[4096];
+    size_t length = strlen(worker->corpus->directory);
+    FILE *f;
+
+    while (input[0] == '.' && input[1] == '/')
+        input += 2;
+    snprintf(path, sizeof(path), "%s/%s.asm", worker->corpus->directory, input);
+    for (char *c = path + length + 1; *c != '\0'; c++)
+        if (*c == '/')
+            *c = '_';
+    f = fopen(path, "w");
+    if (f == NULL)
+        return 0;
+    setvbuf(f, worker->output, _IOFBF, CORPUS_OUTPUT);
+    if (worker->labels != NULL)
+        worker->undocumented += labels_list(worker->labels, f, worker->input, (int)size);
+    else
+        worker->undocumented += disassemble_buffer8080(f, worker->input, (int)size, 0);
+    worker->written += ftell(f);
+    return fclose(f) == 0;
+}
+
+// Put the listing or the hits of input in the memory stream of worker, returns their size
+static size_t corpus_list(CorpusWorker *worker, const char *input, long size)
+{
+    const Corpus *corpus = worker->corpus;
+
+    rewind(worker->stream);
+    if (corpus->search == NULL)
+        fprintf(worker->stream, "; %s\n", input);
+    if (size < 0)
+        fprintf(worker->stream, "Error : couldn't read the file %s\n", input);
+    else if (corpus->search != NULL)
+        search_scan(corpus->search, &worker->scan, worker->input, (int)size, input, corpus->context, worker->stream);
+    else if (worker->labels != NULL)
+        worker->undocumented += labels_list(worker->labels, worker->stream, worker->input, (int)size);
+    else
+        worker->undocumented += disassemble_buffer8080(worker->stream, worker->input, (int)size, 0);
+    fflush(worker->stream);
+    return (size_t)ftell(worker->stream);
+}
+
+static void *corpus_worker(void *argument)
+{
+    CorpusWorker *worker = argument;
+    Corpus *corpus = worker->corpus;
+    int index;
+
+    while ((index = atomic_fetch_add(&corpus->next, 1)) < corpus->list->count) {
+        const char *input = corpus->list->paths[index];
+        long size;
+
+        if (corpus->ordered) {
+            pthread_mutex_lock(&corpus->lock);
+            while (index >= corpus->flushed + CORPUS_WINDOW)
+                pthread_cond_wait(&corpus->room, &corpus->lock);
+            pthread_mutex_unlock(&corpus->lock);
+        }
+
+        size = corpus_read(worker, input);
+        if (size < 0)
+            worker->failed++;
+        else
+            worker->bytes += size;
+        worker->files++;
+
+        if (corpus->stats) {
+            if (size >= 0)
+                stats_decode(&worker->stats, worker->input, (int)size);
+            continue;
+        }
+        if (corpus->directory != NULL) {
+            if (size >= 0 && !corpus_write(worker, input, size)) {
+                printf("Error : couldn't write the listing of %s\n", input);
+                worker->failed++;
+            }
+            continue;
+        }
+
+        size_t listed = corpus_list(worker, input, size);
+        worker->written += listed;
+        if (!corpus->ordered) {
+            // one write per listing, stdout is locked by stdio for the call
+            fwrite(worker->listing, 1, listed, stdout);
+            continue;
+        }
+
+        CorpusSlot *slot = &corpus->slots[index];
+        slot->listing = malloc(listed);
+        if (slot->listing == NULL) {
+            printf("Error : couldn't allocate %zu bytes of memory\n", listed);
+            exit(1);
+        }
+        memcpy(slot->listing, worker->listing, listed);
+        slot->size = listed;
+        pthread_mutex_lock(&corpus->lock);
+        slot->done = 1;
+        pthread_cond_signal(&corpus->done);
+        pthread_mutex_unlock(&corpus->lock);
+    }
+    return NULL;
+}
+
+
+/*
+    Disassemble every file of inputs on threads workers (0 : one per processor). The listings
+    go to directory, or to stdout, in input order if ordered is set. With stats, only the
+    instruction mix of the corpus is printed. With search, only the hits are printed to
+    stdout, with context instructions around them. With labelled, the listings are labelled,
+    with the names of symbols if it isn't NULL.
+    Prints the files/s and MB/s, to stderr when the listings are on stdout.
+    Returns the number of files that couldn't be read or written
+*/
+int corpus_run(char **inputs, int count, int threads, const char *directory, int ordered, int stats,
+    const Search8080 *search, int context, int labelled, const Symbols8080 *symbols)
+{
+    CorpusList list = {0};
+    Corpus corpus;
+    CorpusWorker *workers;
+    static Stats8080 mix;
+    FILE *report;
+    struct timespec start, end;
+    uint64_t files = 0, failed = 0, bytes = 0, written = 0, undocumented = 0, hits = 0;
+    double seconds;
+
+    for (int i = 0; i < count; i++)
+        if (!corpus_collect(&list, inputs[i]))
+            failed++;
+    if (list.count == 0) {
+        printf("Error : no file to disassemble\n");
+        corpus_free(&list);
+        return 1;
+    }
+    if (threads <= 0)
+        threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    if (threads <= 0)
+        threads = 1;
+    if (threads > CORPUS_THREADS)
+        threads = CORPUS_THREADS;
+    if (threads > list.count)
+        threads = list.count;
+
+    if (stats)
+        search = NULL;
+    if (search != NULL)
+        directory = NULL;
+    report = directory != NULL || stats ? stdout : stderr;
+
+    memset(&corpus, 0, sizeof(corpus));
+    corpus.list = &list;
+    corpus.directory = directory;
+    corpus.stats = stats;
+    corpus.search = search;
+    corpus.context = context;
+    corpus.labelled = labelled && !stats && search == NULL;
+    corpus.symbols = symbols;
+    corpus.ordered = ordered && directory == NULL && !stats;
+    atomic_init(&corpus.next, 0);
+    pthread_mutex_init(&corpus.lock, NULL);
+    pthread_cond_init(&corpus.done, NULL);
+    pthread_cond_init(&corpus.room, NULL);
+    if (corpus.ordered && (corpus.slots = calloc(list.count, sizeof(CorpusSlot))) == NULL) {
+        printf("Error : couldn't allocate %d listings\n", list.count);
+        exit(1);
+    }
+    workers = calloc(threads, sizeof(CorpusWorker));
+    if (workers == NULL) {
+        printf("Error : couldn't allocate %d workers\n", threads);
+        exit(1);
+    }
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < threads; i++) {
+        CorpusWorker *worker = &workers[i];
+
+        worker->corpus = &corpus;
+        if (!stats && directory != NULL && (worker->output = malloc(CORPUS_OUTPUT)) == NULL) {
+            printf("Error : couldn't allocate the output buffer of a worker\n");
+            exit(1);
+        }
+        if (!stats && directory == NULL
+            && (worker->stream = open_memstream(&worker->listing, &worker->listing_size)) == NULL) {
+            printf("Error : couldn't allocate the output buffer of a worker\n");
+            exit(1);
+        }
+        if (corpus.labelled && (worker->labels = labels_create(symbols)) == NULL) {
+            printf("Error : couldn't allocate the labels of a worker\n");
+            exit(1);
+        }
+        if (pthread_create(&worker->thread, NULL, corpus_worker, worker) != 0) {
+            printf("Error : couldn't start %d threads\n", threads);
+            exit(1);
+        }
+    }
+
+    // ordered : write the listings as soon as the next one is done
+    for (int i = 0; corpus.ordered && i < list.count; i++) {
+        CorpusSlot *slot = &corpus.slots[i];
+
+        pthread_mutex_lock(&corpus.lock);
+        while (!slot->done)
+            pthread_cond_wait(&corpus.done, &corpus.lock);
+        pthread_mutex_unlock(&corpus.lock);
+        fwrite(slot->listing, 1, slot->size, stdout);
+        free(slot->listing);
+        slot->listing = NULL;
+        pthread_mutex_lock(&corpus.lock);
+        corpus.flushed = i + 1;
+        pthread_cond_broadcast(&corpus.room);
+        pthread_mutex_unlock(&corpus.lock);
+    }
+
+    for (int i = 0; i < threads; i++) {
+        CorpusWorker *worker = &workers[i];
+
+        pthread_join(worker->thread, NULL);
+        files += worker->files;
+        failed += worker->failed;
+        bytes += worker->bytes;
+        written += worker->written;
+        undocumented += worker->undocumented;
+        stats_merge(&mix, &worker->stats);
+        hits += worker->scan.hits;
+        if (worker->stream != NULL)
+            fclose(worker->stream);
+        free(worker->listing);
+        free(worker->output);
+        free(worker->input);
+        free(worker->scan.boundaries);
+        labels_destroy(worker->labels);
+    }
+    fflush(stdout);
+    timespec_get(&end, TIME_UTC);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    if (stats) {
+        for (int op = 0; op < 256; op++)
+            if (undocumented8080((unsigned char)op) >= 0)
+                undocumented += mix.count[op];
+        stats_print(&mix, stdout);
+        printf("\n");
+    }
+
+    fprintf(report, "%llu files, %.2f MB in %.3f s on %d threads : %.0f files/s, %.2f MB/s (%.2f MB of listings), %llu undocumented opcodes\n",
+        (unsigned long long)files, bytes / 1e6, seconds, threads, seconds > 0 ? files / seconds : 0.0,
+        seconds > 0 ? bytes / seconds / 1e6 : 0.0, written / 1e6, (unsigned long long)undocumented);
+    if (search != NULL)
+        fprintf(report, "%llu hits of %d patterns\n", (unsigned long long)hits, search->count);
+    if (failed)
+        fprintf(report, "Error : %llu files couldn't be read or written\n", (unsigned long long)failed);
+
+    pthread_cond_destroy(&corpus.room);
+    pthread_cond_destroy(&corpus.done);
+    pthread_mutex_destroy(&corpus.lock);
+    free(corpus.slots);
+    free(workers);
+    corpus_free(&list);
+    return (int)failed;
+}
+
+#endif
@@ -0,0 +1,397 @@
+#ifndef DISASSEMBLER_DIFF_C
+#define DISASSEMBLER_DIFF_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "disassembler.c"
+
+/*
+    Disassembly diff
+
+    Both images are decoded from the start into instruction records and the two lists of
+    records are aligned, not the lines of the listings :
+        1. The key of a record is its opcode and its 8 bits operand. The 16 bits operands
+           (addresses) aren't in the key, so the code moved by an insertion still lines up
+        2. Histogram diff : the common prefix and suffix are matched, then the longest run
+           of equal keys around a rare key of the first image (at most DIFF_CHAIN
+           occurrences) splits the rest in two parts, diffed the same way
+        3. A part without such a key is aligned by the Myers O(ND) diff, given up after
+           DIFF_EDITS edits (the part is then shown as removed and added)
+        4. Two aligned records with different addresses are the same if the address of the
+           first image is aligned with the address of the second one (relocated)
+
+    The listing is printed by hunks, with context records around the changes :
+        "  aaaa bbbb" same record, "- aaaa" removed, "+ bbbb" added
+*/
+
+
+// keys of at most 17 bits : opcode, 8 bits operand, 1 for a 2 bytes instruction
+#define DIFF_KEYS (1 << 17)
+#define DIFF_CHAIN 64
+#define DIFF_EDITS 512
+
+typedef struct DiffRecord {
+    uint16_t address;
+    uint8_t length;
+    uint32_t key;
+} DiffRecord;
+
+typedef struct Diff8080 {
+    const unsigned char *code[2];
+    DiffRecord *records[2];
+    int count[2];
+    // record of the other image aligned with each record, -1 for none
+    int *match[2];
+    // histogram of a part of the first image : occurrences of each key, chained by next
+    int *head;
+    int *occurrences;
+    uint32_t *stamp;
+    uint32_t generation;
+    int *next;
+    // Myers : the diagonals after each edit
+    int *trace;
+    // address of the second image aligned with each address of the first one, -1 for none
+    int32_t relocation[0x10000];
+} Diff8080;
+
+
+static int diff_decode(const unsigned char *code, int size, DiffRecord *records)
+{
+    int count = 0;
+
+    for (int pc = 0; pc < size; pc += length8080[code[pc]]) {
+        DiffRecord *record = &records[count++];
+
+        record->address = (uint16_t)pc;
+        record->length = length8080[code[pc]];
+        record->key = code[pc];
+        if (record->length == 2)
+            record->key |= (uint32_t)code[pc + 1] << 8 | 1u << 16;
+    }
+    return count;
+}
+
+#define DIFF_KEY(diff, side, i) ((diff)->records[side][i].key)
+
+static inline void diff_pair(Diff8080 *diff, int a, int b)
+{
+    diff->match[0][a] = b;
+    diff->match[1][b] = a;
+}
+
+/*
+    Myers diff of a[a0, a1) and b[b0, b1), returns 0 if it takes more than DIFF_EDITS edits
+    v[k] is the furthest x reached on the diagonal k = x - y, the row d of trace is v before
+    the edit d
+*/
+static int diff_myers(Diff8080 *diff, int a0, int a1, int b0, int b1)
+{
+    const int width = 2 * DIFF_EDITS + 3, middle = DIFF_EDITS + 1;
+    int n = a1 - a0, m = b1 - b0;
+    int limit = n + m < DIFF_EDITS ? n + m : DIFF_EDITS;
+    int *v = &diff->trace[(DIFF_EDITS + 1) * width + middle];
+    int x, y, d, k;
+
+    v[1] = 0;
+    for (d = 0; d <= limit; d++) {
+        memcpy(&diff->trace[d * width], v - middle, width * sizeof(int));
+        for (k = -d; k <= d; k += 2) {
+            x = k == -d || (k != d && v[k - 1] < v[k + 1]) ? v[k + 1] : v[k - 1] + 1;
+            y = x - k;
+            while (x < n && y < m && DIFF_KEY(diff, 0, a0 + x) == DIFF_KEY(diff, 1, b0 + y))
+                x++, y++;
+            v[k] = x;
+            if (x >= n && y >= m)
+                goto found;
+        }
+    }
+    return 0;
+
+found:
+    // back from (n, m), the diagonal run then the edit, for every edit
+    x = n;
+    y = m;
+    for (; d > 0; d--) {
+        const int *before = &diff->trace[d * width + middle];
+        int previous, px, py;
+
+        k = x - y;
+        previous = k == -d || (k != d && before[k - 1] < before[k + 1]) ? k + 1 : k - 1;
+        px = before[previous];
+        py = px - previous;
+        while (x > px && y > py)
+            diff_pair(diff, a0 + --x, b0 + --y);
+        x = px;
+        y = py;
+    }
+    while (x > 0 && y > 0)
+        diff_pair(diff, a0 + --x, b0 + --y);
+    return 1;
+}
+
+// Histogram diff of a[a0, a1) and b[b0, b1)
+static void diff_histogram(Diff8080 *diff, int a0, int a1, int b0, int b1)
+{
+    for (;;) {
+        int best_a = -1, best_b = -1, best_length = 0, best_count = DIFF_CHAIN + 1;
+
+        while (a0 < a1 && b0 < b1 && DIFF_KEY(diff, 0, a0) == DIFF_KEY(diff, 1, b0))
+            diff_pair(diff, a0++, b0++);
+        while (a0 < a1 && b0 < b1 && DIFF_KEY(diff, 0, a1 - 1) == DIFF_KEY(diff, 1, b1 - 1))
+            diff_pair(diff, --a1, --b1);
+        if (a0 == a1 || b0 == b1)
+            return;
+
+        // occurrences of the keys of the first part, stamped instead of cleared
+        diff->generation++;
+        for (int i = a1 - 1; i >= a0; i--) {
+            uint32_t key = DIFF_KEY(diff, 0, i);
+
+            if (diff->stamp[key] != diff->generation) {
+                diff->stamp[key] = diff->generation;
+                diff->head[key] = -1;
+                diff->occurrences[key] = 0;
+            }
+            diff->next[i] = diff->head[key];
+            diff->head[key] = i;
+            diff->occurrences[key]++;
+        }
+
+        // longest run around a key found at most DIFF_CHAIN times, the rarest key on a tie
+        for (int j = b0; j < b1; ) {
+            uint32_t key = DIFF_KEY(diff, 1, j);
+            int skip = j + 1;
+
+            if (diff->stamp[key] == diff->generation && diff->occurrences[key] <= DIFF_CHAIN) {
+                for (int i = diff->head[key]; i >= 0; i = diff->next[i]) {
+                    int before = 0, after = 1;
+
+                    while (i - before > a0 && j - before > b0 && DIFF_KEY(diff, 0, i - before - 1) == DIFF_KEY(diff, 1, j - before - 1))
+                        before++;
+                    while (i + after < a1 && j + after < b1 && DIFF_KEY(diff, 0, i + after) == DIFF_KEY(diff, 1, j + after))
+                        after++;
+                    if (before + after > best_length || (before + after == best_length && diff->occurrences[key] < best_count)) {
+                        best_count = diff->occurrences[key];
+                        best_length = before + after;
+                        best_a = i - before;
+                        best_b = j - before;
+                    }
+                    if (j + after > skip)
+                        skip = j + after;
+                }
+            }
+            j = skip;
+        }
+
+        if (best_a < 0) {
+            diff_myers(diff, a0, a1, b0, b1);
+            return;
+        }
+        diff_histogram(diff, a0, best_a, b0, best_b);
+        for (int i = 0; i < best_length; i++)
+            diff_pair(diff, best_a + i, best_b + i);
+        a0 = best_a + best_length;
+        b0 = best_b + best_length;
+    }
+}
+
+
+Diff8080 *diff_create(void)
+{
+    Diff8080 *diff = calloc(1, sizeof(Diff8080));
+
+    if (diff == NULL) {
+        printf("Error : couldn't allocate the diff\n");
+        exit(1);
+    }
+    // at most one record per byte of a 64 KB image
+    for (int side = 0; side < 2; side++) {
+        diff->records[side] = malloc(0x10000 * sizeof(DiffRecord));
+        diff->match[side] = malloc(0x10000 * sizeof(int));
+    }
+    diff->head = malloc(DIFF_KEYS * sizeof(int));
+    diff->occurrences = malloc(DIFF_KEYS * sizeof(int));
+    diff->stamp = calloc(DIFF_KEYS, sizeof(uint32_t));
+    diff->next = malloc(0x10000 * sizeof(int));
+    diff->trace = malloc((size_t)(DIFF_EDITS + 2) * (2 * DIFF_EDITS + 3) * sizeof(int));
+    if (diff->records[0] == NULL || diff->records[1] == NULL || diff->match[0] == NULL || diff->match[1] == NULL
+        || diff->head == NULL || diff->occurrences == NULL || diff->stamp == NULL || diff->next == NULL || diff->trace == NULL) {
+        printf("Error : couldn't allocate the diff\n");
+        exit(1);
+    }
+    return diff;
+}
+
+void diff_destroy(Diff8080 *diff)
+{
+    if (diff == NULL)
+        return;
+    for (int side = 0; side < 2; side++) {
+        free(diff->records[side]);
+        free(diff->match[side]);
+    }
+    free(diff->head);
+    free(diff->occurrences);
+    free(diff->stamp);
+    free(diff->next);
+    free(diff->trace);
+    free(diff);
+}
+
+/*
+    Align the records of a and b (at most 64 KB each, followed by 2 readable bytes)
+    Returns 0 if an image is too large
+*/
+int diff_images(Diff8080 *diff, const unsigned char *a, int a_size, const unsigned char *b, int b_size)
+{
+    if (a_size > 0x10000 || b_size > 0x10000) {
+        printf("Error : the images are %d and %d bytes, at most 65536 bytes are expected\n", a_size, b_size);
+        return 0;
+    }
+    diff->code[0] = a;
+    diff->code[1] = b;
+    diff->count[0] = diff_decode(a, a_size, diff->records[0]);
+    diff->count[1] = diff_decode(b, b_size, diff->records[1]);
+    memset(diff->match[0], 0xFF, diff->count[0] * sizeof(int));
+    memset(diff->match[1], 0xFF, diff->count[1] * sizeof(int));
+    diff_histogram(diff, 0, diff->count[0], 0, diff->count[1]);
+
+    memset(diff->relocation, 0xFF, sizeof(diff->relocation));
+    for (int i = 0; i < diff->count[0]; i++)
+        if (diff->match[0][i] >= 0)
+            diff->relocation[diff->records[0][i].address] = diff->records[1][diff->match[0][i]].address;
+    return 1;
+}
+
+// 1 if the aligned records a and b are the same instruction, once the addresses are relocated
+static int diff_same(const Diff8080 *diff, int a, int b)
+{
+    const DiffRecord *ra = &diff->records[0][a], *rb = &diff->records[1][b];
+    const unsigned char *ca = diff->code[0] + ra->address, *cb = diff->code[1] + rb->address;
+    uint16_t target_a, target_b;
+
+    if (ra->length != 3)
+        return 1;
+    target_a = (uint16_t)(ca[1] | ca[2] << 8);
+    target_b = (uint16_t)(cb[1] | cb[2] << 8);
+    return target_a == target_b || diff->relocation[target_a] == target_b;
+}
+
+
+// One line of the listing : ' ' same, '-' first image only, '+' second image only
+static void diff_line(const Diff8080 *diff, FILE *out, char kind, int a, int b)
+{
+    if (kind == '+')
+        fprintf(out, "+      %04x\t", diff->records[1][b].address);
+    else if (kind == '-')
+        fprintf(out, "- %04x     \t", diff->records[0][a].address);
+    else
+        fprintf(out, "  %04x %04x\t", diff->records[0][a].address, diff->records[1][b].address);
+    if (kind == '+')
+        fdisassemble8080(out, (unsigned char *)diff->code[1], diff->records[1][b].address);
+    else
+        fdisassemble8080(out, (unsigned char *)diff->code[0], diff->records[0][a].address);
+}
+
+// Address of the first record of side in the lines [start, end) of script
+static int diff_first(const Diff8080 *diff, const int *script, int start, int end, int side)
+{
+    for (int line = start; line < end; line++)
+        if (script[line] >= 0)
+            return diff->records[side][script[line]].address;
+    return 0;
+}
+
+/*
+    Print the changes with context records around them, returns the number of changed
+    records (removed, added, or aligned with a different address)
+*/
+int diff_print(const Diff8080 *diff, FILE *out, int context)
+{
+    // edit script : a / b records, kind, built once and printed by hunks
+    int total = diff->count[0] + diff->count[1];
+    int *script_a = malloc(total * sizeof(int)), *script_b = malloc(total * sizeof(int));
+    char *kind = malloc(total);
+    int length = 0, changes = 0, relocated = 0, a = 0, b = 0;
+
+    if (script_a == NULL || script_b == NULL || kind == NULL) {
+        printf("Error : couldn't allocate the edit script\n");
+        exit(1);
+    }
+    while (a < diff->count[0] || b < diff->count[1]) {
+        if (a < diff->count[0] && diff->match[0][a] < 0) {
+            kind[length] = '-', script_a[length] = a++, script_b[length++] = -1;
+        } else if (b < diff->count[1] && diff->match[1][b] < 0) {
+            kind[length] = '+', script_a[length] = -1, script_b[length++] = b++;
+        } else if (diff_same(diff, a, b)) {
+            const DiffRecord *ra = &diff->records[0][a];
+
+            relocated += ra->length == 3 && memcmp(diff->code[0] + ra->address, diff->code[1] + diff->records[1][b].address, 3) != 0;
+            kind[length] = ' ', script_a[length] = a++, script_b[length++] = b++;
+        } else {
+            kind[length] = '-', script_a[length] = a, script_b[length++] = -1;
+            kind[length] = '+', script_a[length] = -1, script_b[length++] = b;
+            a++, b++;
+        }
+    }
+
+    for (int i = 0; i < length; ) {
+        int start, end;
+
+        if (kind[i] == ' ') {
+            i++;
+            continue;
+        }
+        // a hunk runs until 2 * context same records in a row
+        start = i - context > 0 ? i - context : 0;
+        end = i;
+        while (end < length) {
+            int same = 0;
+
+            while (end + same < length && kind[end + same] == ' ')
+                same++;
+            if (end + same == length || same > 2 * context)
+                break;
+            end += same;
+            while (end < length && kind[end] != ' ')
+                end++;
+        }
+        for (int line = start; line < end; line++)
+            changes += kind[line] != ' ';
+        end = end + context < length ? end + context : length;
+        fprintf(out, "@@ -%04x +%04x @@\n", diff_first(diff, script_a, start, end, 0), diff_first(diff, script_b, start, end, 1));
+        for (int line = start; line < end; line++)
+            diff_line(diff, out, kind[line], script_a[line], script_b[line]);
+        i = end;
+    }
+    fprintf(out, "%d / %d records, %d changed, %d addresses relocated\n", diff->count[0], diff->count[1], changes, relocated);
+    free(script_a);
+    free(script_b);
+    free(kind);
+    return changes;
+}
+
+
+// Diff two images, prints the listing and the time taken, returns 1 if they differ
+int diff_run(const unsigned char *a, int a_size, const unsigned char *b, int b_size, int context)
+{
+    Diff8080 *diff = diff_create();
+    struct timespec start, end;
+    int changes;
+
+    timespec_get(&start, TIME_UTC);
+    if (!diff_images(diff, a, a_size, b, b_size)) {
+        diff_destroy(diff);
+        return 2;
+    }
+    timespec_get(&end, TIME_UTC);
+    changes = diff_print(diff, stdout, context);
+    printf("aligned in %.3f ms\n", ((end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9) * 1e3);
+    diff_destroy(diff);
+    return changes != 0;
+}
+
+#endif
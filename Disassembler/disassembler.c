@@ -1,7 +1,14 @@
+#ifndef DISASSEMBLER_DISASSEMBLER_C
+#define DISASSEMBLER_DISASSEMBLER_C
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 /*
+    Intel 8080 disassembler, built with -DCPU_8085 it decodes the 8085 (RIM / SIM in place
+    of the NOP aliases 0x20 / 0x30), like the emulator.
+
     1. Read the code into a buffer
     2. Get a pointer to the beginning of the buffer
     3. Use the byte at the pointer to determine the opcode
@@ -91,7 +98,8 @@
 */
 
 
-int disassemble8080(unsigned char *code_buffer, int pc)
+// Disassemble the instruction at pc to out, returns its length
+int fdisassemble8080(FILE *out, unsigned char *code_buffer, int pc)
 {
     unsigned char *opcode = &code_buffer[pc];
     // the number of bytes to advance the pc
@@ -123,199 +131,199 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x40:
-            printf("%02x\tMOV B, B\t(B) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV B, B\t(B) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x41:
-            printf("%02x\tMOV B, C\t(B) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV B, C\t(B) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x42:
-            printf("%02x\tMOV B, D\t(B) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV B, D\t(B) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x43:
-            printf("%02x\tMOV B, E\t(B) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV B, E\t(B) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x44:
-            printf("%02x\tMOV B, H\t(B) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV B, H\t(B) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x45:
-            printf("%02x\tMOV B, L\t(B) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV B, L\t(B) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x47:
-            printf("%02x\tMOV B, A\t(B) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV B, A\t(B) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x48:
-            printf("%02x\tMOV C, B\t(C) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV C, B\t(C) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x49:
-            printf("%02x\tMOV C, C\t(C) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV C, C\t(C) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x4A:
-            printf("%02x\tMOV C, D\t(C) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV C, D\t(C) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x4B:
-            printf("%02x\tMOV B, E\t(C) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV C, E\t(C) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x4C:
-            printf("%02x\tMOV B, H\t(C) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV C, H\t(C) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x4D:
-            printf("%02x\tMOV B, L\t(C) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV C, L\t(C) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x4F:
-            printf("%02x\tMOV B, A\t(C) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV C, A\t(C) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x50:
-            printf("%02x\tMOV D, B\t(D) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV D, B\t(D) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x51:
-            printf("%02x\tMOV D, C\t(D) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV D, C\t(D) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x52:
-            printf("%02x\tMOV D, D\t(D) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV D, D\t(D) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x53:
-            printf("%02x\tMOV D, E\t(D) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV D, E\t(D) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x54:
-            printf("%02x\tMOV D, H\t(D) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV D, H\t(D) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x55:
-            printf("%02x\tMOV D, L\t(D) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV D, L\t(D) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x57:
-            printf("%02x\tMOV D, A\t(D) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV D, A\t(D) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x58:
-            printf("%02x\tMOV E, B\t(E) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV E, B\t(E) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x59:
-            printf("%02x\tMOV E, C\t(E) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV E, C\t(E) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x5A:
-            printf("%02x\tMOV E, D\t(E) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV E, D\t(E) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x5B:
-            printf("%02x\tMOV E, E\t(E) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV E, E\t(E) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x5C:
-            printf("%02x\tMOV E, H\t(E) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV E, H\t(E) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x5D:
-            printf("%02x\tMOV E, L\t(E) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV E, L\t(E) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x5F:
-            printf("%02x\tMOV E, A\t(E) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV E, A\t(E) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x60:
-            printf("%02x\tMOV H, B\t(H) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV H, B\t(H) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x61:
-            printf("%02x\tMOV H, C\t(H) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV H, C\t(H) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x62:
-            printf("%02x\tMOV H, D\t(H) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV H, D\t(H) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x63:
-            printf("%02x\tMOV H, E\t(H) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV H, E\t(H) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x64:
-            printf("%02x\tMOV H, H\t(H) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV H, H\t(H) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x65:
-            printf("%02x\tMOV H, L\t(H) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV H, L\t(H) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x67:
-            printf("%02x\tMOV H, A\t(H) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV H, A\t(H) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x68:
-            printf("%02x\tMOV L, B\t(L) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV L, B\t(L) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x69:
-            printf("%02x\tMOV L, C\t(L) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV L, C\t(L) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x6A:
-            printf("%02x\tMOV L, D\t(L) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV L, D\t(L) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x6B:
-            printf("%02x\tMOV L, E\t(L) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV L, E\t(L) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x6C:
-            printf("%02x\tMOV L, H\t(L) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV L, H\t(L) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x6D:
-            printf("%02x\tMOV L, L\t(L) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV L, L\t(L) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x6F:
-            printf("%02x\tMOV L, A\t(L) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV L, A\t(L) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x78:
-            printf("%02x\tMOV A, B\t(A) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV A, B\t(A) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x79:
-            printf("%02x\tMOV A, C\t(A) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV A, C\t(A) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x7A:
-            printf("%02x\tMOV A, D\t(A) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV A, D\t(A) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x7B:
-            printf("%02x\tMOV A, E\t(A) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV A, E\t(A) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x7C:
-            printf("%02x\tMOV A, H\t(A) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV A, H\t(A) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x7D:
-            printf("%02x\tMOV A, L\t(A) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV A, L\t(A) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x7F:
-            printf("%02x\tMOV A, A\t(A) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV A, A\t(A) <= (A)", *opcode);
             op_bytes = 1;
             break;
         
@@ -330,31 +338,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x46:
-            printf("%02x\tMOV B, M\t(B) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV B, M\t(B) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
         case 0x4E:
-            printf("%02x\tMOV C, M\t(C) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV C, M\t(C) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
         case 0x56:
-            printf("%02x\tMOV D, M\t(D) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV D, M\t(D) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
         case 0x5E:
-            printf("%02x\tMOV E, M\t(E) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV E, M\t(E) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
         case 0x66:
-            printf("%02x\tMOV H, M\t(H) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV H, M\t(H) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
         case 0x6E:
-            printf("%02x\tMOV L, M\t(L) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV L, M\t(L) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
         case 0x7E:
-            printf("%02x\tMOV A, M\t(A) <= ((H)(L))", *opcode);
+            fprintf(out, "%02x\tMOV A, M\t(A) <= ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -369,31 +377,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x70:
-            printf("%02x\tMOV M, B\t((H)(L)) <= (B)", *opcode);
+            fprintf(out, "%02x\tMOV M, B\t((H)(L)) <= (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x71:
-            printf("%02x\tMOV M, C\t((H)(L)) <= (C)", *opcode);
+            fprintf(out, "%02x\tMOV M, C\t((H)(L)) <= (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x72:
-            printf("%02x\tMOV M, D\t((H)(L)) <= (D)", *opcode);
+            fprintf(out, "%02x\tMOV M, D\t((H)(L)) <= (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x73:
-            printf("%02x\tMOV M, E\t((H)(L)) <= (E)", *opcode);
+            fprintf(out, "%02x\tMOV M, E\t((H)(L)) <= (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x74:
-            printf("%02x\tMOV M, H\t((H)(L)) <= (H)", *opcode);
+            fprintf(out, "%02x\tMOV M, H\t((H)(L)) <= (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x75:
-            printf("%02x\tMOV M, L\t((H)(L)) <= (L)", *opcode);
+            fprintf(out, "%02x\tMOV M, L\t((H)(L)) <= (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x77:
-            printf("%02x\tMOV M, A\t((H)(L)) <= (A)", *opcode);
+            fprintf(out, "%02x\tMOV M, A\t((H)(L)) <= (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -411,31 +419,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x06:
-            printf("%02x\tMVI B, d8\t(B) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI B, d8\t(B) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
         case 0x0E:
-            printf("%02x\tMVI C, d8\t(C) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI C, d8\t(C) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
         case 0x16:
-            printf("%02x\tMVI D, d8\t(D) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI D, d8\t(D) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
         case 0x1E:
-            printf("%02x\tMVI E, d8\t(E) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI E, d8\t(E) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
         case 0x26:
-            printf("%02x\tMVI H, d8\t(H) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI H, d8\t(H) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
         case 0x2E:
-            printf("%02x\tMVI L, d8\t(L) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI L, d8\t(L) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
         case 0x3E:
-            printf("%02x\tMVI A, d8\t(A) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI A, d8\t(A) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -452,7 +460,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x36:
-            printf("%02x\tMVI M, d8\t((H)(L)) <= #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tMVI M, d8\t((H)(L)) <= #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -472,19 +480,19 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x01:
-            printf("%02x\tLXI B, d16\t(B) <= #$%02x, (C) <= #$%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tLXI B, d16\t(B) <= #$%02x, (C) <= #$%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0x11:
-            printf("%02x\tLXI D, d16\t(D) <= #$%02x, (E) <= #$%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tLXI D, d16\t(D) <= #$%02x, (E) <= #$%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0x21:
-            printf("%02x\tLXI H, d16\t(H) <= #$%02x, (L) <= #$%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tLXI H, d16\t(H) <= #$%02x, (L) <= #$%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0x31:
-            printf("%02x\tLXI SP, d16\t(SPH) <= #$%02x, (SPL) <= #$%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tLXI SP, d16\t(SPH) <= #$%02x, (SPL) <= #$%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -503,7 +511,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x3A:
-            printf("%02x\tLDA a16\t(A) <= ($%02x%02x)", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tLDA a16\t(A) <= ($%02x%02x)", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -522,7 +530,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x32:
-            printf("%02x\tSTA a16\t($%02x%02x) <= (A)", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tSTA a16\t($%02x%02x) <= (A)", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -543,7 +551,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x2A:
-            printf("%02x\tLHLD a16\t(L) <= ($%02x%02x), (H) <= ($%02x%02x + 1)", *opcode, opcode[2], opcode[1], opcode[2], opcode[1]);
+            fprintf(out, "%02x\tLHLD a16\t(L) <= ($%02x%02x), (H) <= ($%02x%02x + 1)", *opcode, opcode[2], opcode[1], opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -563,7 +571,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x22:
-            printf("%02x\tSHLD a16\t($%02x%02x) <= (L), ($%02x%02x + 1) <= (H)", *opcode, opcode[2], opcode[1], opcode[2], opcode[1]);
+            fprintf(out, "%02x\tSHLD a16\t($%02x%02x) <= (L), ($%02x%02x + 1) <= (H)", *opcode, opcode[2], opcode[1], opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -579,12 +587,12 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x0A:
-            printf("%02x\tLDAX B\t(A) <= ((B)(C))", *opcode);
-            op_bytes = 3;
+            fprintf(out, "%02x\tLDAX B\t(A) <= ((B)(C))", *opcode);
+            op_bytes = 1;
             break;
         case 0x1A:
-            printf("%02x\tLDAX D\t(A) <= ((D)(E))", *opcode);
-            op_bytes = 3;
+            fprintf(out, "%02x\tLDAX D\t(A) <= ((D)(E))", *opcode);
+            op_bytes = 1;
             break;
 
         /*
@@ -599,11 +607,11 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
        case 0x02:
-            printf("%02x\tSTAX B\t((B)(C)) <= (A)", *opcode);
+            fprintf(out, "%02x\tSTAX B\t((B)(C)) <= (A)", *opcode);
             op_bytes = 1;
             break;
         case 0x12:
-            printf("%02x\tSTAX D\t((D)(E)) <= (A)", *opcode);
+            fprintf(out, "%02x\tSTAX D\t((D)(E)) <= (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -618,7 +626,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xEB:
-            printf("%02x\tXCHG\t(H) <=> (D), (L) <=> (E)", *opcode);
+            fprintf(out, "%02x\tXCHG\t(H) <=> (D), (L) <=> (E)", *opcode);
             op_bytes = 1;
             break;
 
@@ -637,31 +645,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x80:
-            printf("%02x\tADD B\t(A) <= (A) + (B)", *opcode);
+            fprintf(out, "%02x\tADD B\t(A) <= (A) + (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x81:
-            printf("%02x\tADD C\t(A) <= (A) + (C)", *opcode);
+            fprintf(out, "%02x\tADD C\t(A) <= (A) + (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x82:
-            printf("%02x\tADD D\t(A) <= (A) + (D)", *opcode);
+            fprintf(out, "%02x\tADD D\t(A) <= (A) + (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x83:
-            printf("%02x\tADD E\t(A) <= (A) + (E)", *opcode);
+            fprintf(out, "%02x\tADD E\t(A) <= (A) + (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x84:
-            printf("%02x\tADD H\t(A) <= (A) + (H)", *opcode);
+            fprintf(out, "%02x\tADD H\t(A) <= (A) + (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x85:
-            printf("%02x\tADD L\t(A) <= (A) + (L)", *opcode);
+            fprintf(out, "%02x\tADD L\t(A) <= (A) + (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x87:
-            printf("%02x\tADD A\t(A) <= (A) + (A)", *opcode);
+            fprintf(out, "%02x\tADD A\t(A) <= (A) + (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -677,7 +685,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x86:
-            printf("%02x\tADD M\t(A) <= (A) + ((H)(L))", *opcode);
+            fprintf(out, "%02x\tADD M\t(A) <= (A) + ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -694,7 +702,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xC6:
-            printf("%02x\tADI d8\t(A) <= (A) + #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tADI d8\t(A) <= (A) + #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -709,31 +717,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x88:
-            printf("%02x\tADC B\t(A) <= (A) + (B) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC B\t(A) <= (A) + (B) + (CY)", *opcode);
             op_bytes = 1;
             break;
         case 0x89:
-            printf("%02x\tADC C\t(A) <= (A) + (C) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC C\t(A) <= (A) + (C) + (CY)", *opcode);
             op_bytes = 1;
             break;
         case 0x8A:
-            printf("%02x\tADC D\t(A) <= (A) + (D) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC D\t(A) <= (A) + (D) + (CY)", *opcode);
             op_bytes = 1;
             break;
         case 0x8B:
-            printf("%02x\tADC E\t(A) <= (A) + (E) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC E\t(A) <= (A) + (E) + (CY)", *opcode);
             op_bytes = 1;
             break;
         case 0x8C:
-            printf("%02x\tADC H\t(A) <= (A) + (H) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC H\t(A) <= (A) + (H) + (CY)", *opcode);
             op_bytes = 1;
             break;
         case 0x8D:
-            printf("%02x\tADC L\t(A) <= (A) + (L) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC L\t(A) <= (A) + (L) + (CY)", *opcode);
             op_bytes = 1;
             break;
         case 0x8F:
-            printf("%02x\tADC A\t(A) <= (A) + (A) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC A\t(A) <= (A) + (A) + (CY)", *opcode);
             op_bytes = 1;
             break;
 
@@ -749,7 +757,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x8E:
-            printf("%02x\tADC M\t(A) <= (A) + ((H)(L)) + (CY)", *opcode);
+            fprintf(out, "%02x\tADC M\t(A) <= (A) + ((H)(L)) + (CY)", *opcode);
             op_bytes = 1;
             break;
 
@@ -766,7 +774,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xCE:
-            printf("%02x\tACI d8\t(A) <= (A) + #$%02x + (CY)", *opcode, opcode[1]);
+            fprintf(out, "%02x\tACI d8\t(A) <= (A) + #$%02x + (CY)", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -781,31 +789,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x90:
-            printf("%02x\tSUB B\t(A) <= (A) - (B)", *opcode);
+            fprintf(out, "%02x\tSUB B\t(A) <= (A) - (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x91:
-            printf("%02x\tSUB C\t(A) <= (A) - (C)", *opcode);
+            fprintf(out, "%02x\tSUB C\t(A) <= (A) - (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x92:
-            printf("%02x\tSUB D\t(A) <= (A) - (D)", *opcode);
+            fprintf(out, "%02x\tSUB D\t(A) <= (A) - (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x93:
-            printf("%02x\tSUB E\t(A) <= (A) - (E)", *opcode);
+            fprintf(out, "%02x\tSUB E\t(A) <= (A) - (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x94:
-            printf("%02x\tSUB H\t(A) <= (A) - (H)", *opcode);
+            fprintf(out, "%02x\tSUB H\t(A) <= (A) - (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x95:
-            printf("%02x\tSUB L\t(A) <= (A) - (L)", *opcode);
+            fprintf(out, "%02x\tSUB L\t(A) <= (A) - (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x97:
-            printf("%02x\tSUB A\t(A) <= (A) - (A)", *opcode);
+            fprintf(out, "%02x\tSUB A\t(A) <= (A) - (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -821,7 +829,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x96:
-            printf("%02x\tSUB M\t(A) <= (A) - ((H)(L))", *opcode);
+            fprintf(out, "%02x\tSUB M\t(A) <= (A) - ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -838,7 +846,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xD6:
-            printf("%02x\tSUI d8\t(A) <= (A) - #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tSUI d8\t(A) <= (A) - #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -853,31 +861,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x98:
-            printf("%02x\tSBB B\t(A) <= (A) - (CY) - (B)", *opcode);
+            fprintf(out, "%02x\tSBB B\t(A) <= (A) - (CY) - (B)", *opcode);
             op_bytes = 1;
             break;
         case 0x99:
-            printf("%02x\tSBB C\t(A) <= (A) - (CY) - (C)", *opcode);
+            fprintf(out, "%02x\tSBB C\t(A) <= (A) - (CY) - (C)", *opcode);
             op_bytes = 1;
             break;
         case 0x9A:
-            printf("%02x\tSBB D\t(A) <= (A) - (CY) - (D)", *opcode);
+            fprintf(out, "%02x\tSBB D\t(A) <= (A) - (CY) - (D)", *opcode);
             op_bytes = 1;
             break;
         case 0x9B:
-            printf("%02x\tSBB E\t(A) <= (A) - (CY) - (E)", *opcode);
+            fprintf(out, "%02x\tSBB E\t(A) <= (A) - (CY) - (E)", *opcode);
             op_bytes = 1;
             break;
         case 0x9C:
-            printf("%02x\tSBB H\t(A) <= (A) - (CY) - (H)", *opcode);
+            fprintf(out, "%02x\tSBB H\t(A) <= (A) - (CY) - (H)", *opcode);
             op_bytes = 1;
             break;
         case 0x9D:
-            printf("%02x\tSBB L\t(A) <= (A) - (CY) - (L)", *opcode);
+            fprintf(out, "%02x\tSBB L\t(A) <= (A) - (CY) - (L)", *opcode);
             op_bytes = 1;
             break;
         case 0x9F:
-            printf("%02x\tSBB A\t(A) <= (A) - (CY) - (A)", *opcode);
+            fprintf(out, "%02x\tSBB A\t(A) <= (A) - (CY) - (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -893,7 +901,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x9E:
-            printf("%02x\tSBB M\t(A) <= (A) - ((H)(L)) - (CY)", *opcode);
+            fprintf(out, "%02x\tSBB M\t(A) <= (A) - ((H)(L)) - (CY)", *opcode);
             op_bytes = 1;
             break;
 
@@ -910,7 +918,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xDE:
-            printf("%02x\tSBI d8\t(A) <= (A) - #$%02x - (CY)", *opcode, opcode[1]);
+            fprintf(out, "%02x\tSBI d8\t(A) <= (A) - #$%02x - (CY)", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -925,31 +933,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, AC
         */
         case 0x04:
-            printf("%02x\tINR B\t(B) <= (B) + 1", *opcode);
+            fprintf(out, "%02x\tINR B\t(B) <= (B) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x0C:
-            printf("%02x\tINR C\t(C) <= (C) + 1", *opcode);
+            fprintf(out, "%02x\tINR C\t(C) <= (C) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x14:
-            printf("%02x\tINR D\t(D) <= (D) + 1", *opcode);
+            fprintf(out, "%02x\tINR D\t(D) <= (D) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x1C:
-            printf("%02x\tINR E\t(E) <= (E) + 1", *opcode);
+            fprintf(out, "%02x\tINR E\t(E) <= (E) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x24:
-            printf("%02x\tINR H\t(H) <= (H) + 1", *opcode);
+            fprintf(out, "%02x\tINR H\t(H) <= (H) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x2C:
-            printf("%02x\tINR L\t(L) <= (L) + 1", *opcode);
+            fprintf(out, "%02x\tINR L\t(L) <= (L) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x3C:
-            printf("%02x\tINR A\t(A) <= (A) + 1", *opcode);
+            fprintf(out, "%02x\tINR A\t(A) <= (A) + 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -964,7 +972,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, AC
         */
         case 0x34:
-            printf("%02x\tINR M\t((H)(L)) <= ((H)(L)) + 1", *opcode);
+            fprintf(out, "%02x\tINR M\t((H)(L)) <= ((H)(L)) + 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -979,31 +987,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, AC
         */
         case 0x05:
-            printf("%02x\tDCR B\t(B) <= (B) - 1", *opcode);
+            fprintf(out, "%02x\tDCR B\t(B) <= (B) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x0D:
-            printf("%02x\tDCR C\t(C) <= (C) - 1", *opcode);
+            fprintf(out, "%02x\tDCR C\t(C) <= (C) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x15:
-            printf("%02x\tDCR D\t(D) <= (D) - 1", *opcode);
+            fprintf(out, "%02x\tDCR D\t(D) <= (D) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x1D:
-            printf("%02x\tDCR E\t(E) <= (E) - 1", *opcode);
+            fprintf(out, "%02x\tDCR E\t(E) <= (E) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x25:
-            printf("%02x\tDCR H\t(H) <= (H) - 1", *opcode);
+            fprintf(out, "%02x\tDCR H\t(H) <= (H) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x2D:
-            printf("%02x\tDCR L\t(L) <= (L) - 1", *opcode);
+            fprintf(out, "%02x\tDCR L\t(L) <= (L) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x3D:
-            printf("%02x\tDCR A\t(A) <= (A) + 1", *opcode);
+            fprintf(out, "%02x\tDCR A\t(A) <= (A) + 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -1018,7 +1026,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, AC
         */
         case 0x35:
-            printf("%02x\tDCR M\t((H)(L)) <= ((H)(L)) - 1", *opcode);
+            fprintf(out, "%02x\tDCR M\t((H)(L)) <= ((H)(L)) - 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -1032,19 +1040,19 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x03:
-            printf("%02x\tINX B\t(B)(C) <= (B)(C) + 1", *opcode);
+            fprintf(out, "%02x\tINX B\t(B)(C) <= (B)(C) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x13:
-            printf("%02x\tINX D\t(D)(E) <= (D)(E) + 1", *opcode);
+            fprintf(out, "%02x\tINX D\t(D)(E) <= (D)(E) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x23:
-            printf("%02x\tINX H\t(H)(L) <= (H)(L) + 1", *opcode);
+            fprintf(out, "%02x\tINX H\t(H)(L) <= (H)(L) + 1", *opcode);
             op_bytes = 1;
             break;
         case 0x33:
-            printf("%02x\tINX SP\t(SP) <= (SP) + 1", *opcode);
+            fprintf(out, "%02x\tINX SP\t(SP) <= (SP) + 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -1058,19 +1066,19 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x0B:
-            printf("%02x\tDCX B\t(B)(C) <= (B)(C) - 1", *opcode);
+            fprintf(out, "%02x\tDCX B\t(B)(C) <= (B)(C) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x1B:
-            printf("%02x\tDCX D\t(D)(E) <= (D)(E) - 1", *opcode);
+            fprintf(out, "%02x\tDCX D\t(D)(E) <= (D)(E) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x2B:
-            printf("%02x\tDCX H\t(H)(L) <= (H)(L) - 1", *opcode);
+            fprintf(out, "%02x\tDCX H\t(H)(L) <= (H)(L) - 1", *opcode);
             op_bytes = 1;
             break;
         case 0x3B:
-            printf("%02x\tDCX SP\t(SP) <= (SP) - 1", *opcode);
+            fprintf(out, "%02x\tDCX SP\t(SP) <= (SP) - 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -1086,19 +1094,19 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x09:
-            printf("%02x\tDAD B\t(H)(L) <= (H)(L) + (B)(C)", *opcode);
+            fprintf(out, "%02x\tDAD B\t(H)(L) <= (H)(L) + (B)(C)", *opcode);
             op_bytes = 1;
             break;
         case 0x19:
-            printf("%02x\tDAD D\t(H)(L) <= (H)(L) + (D)(E)", *opcode);
+            fprintf(out, "%02x\tDAD D\t(H)(L) <= (H)(L) + (D)(E)", *opcode);
             op_bytes = 1;
             break;
         case 0x29:
-            printf("%02x\tDAD H\t(H)(L) <= (H)(L) + (H)(L)", *opcode);
+            fprintf(out, "%02x\tDAD H\t(H)(L) <= (H)(L) + (H)(L)", *opcode);
             op_bytes = 1;
             break;
         case 0x39:
-            printf("%02x\tDAD SP\t(H)(L) <= (H)(L) + (SP)", *opcode);
+            fprintf(out, "%02x\tDAD SP\t(H)(L) <= (H)(L) + (SP)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1117,7 +1125,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0x27:
-            printf("%02x\tDAA\tDecimal Adjust Accumulator", *opcode);
+            fprintf(out, "%02x\tDAA\tDecimal Adjust Accumulator", *opcode);
             op_bytes = 1;
             break;
 
@@ -1136,31 +1144,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xA0:
-            printf("%02x\tANA B\t(A) <= (A) && (B)", *opcode);
+            fprintf(out, "%02x\tANA B\t(A) <= (A) && (B)", *opcode);
             op_bytes = 1;
             break;
         case 0xA1:
-            printf("%02x\tANA C\t(A) <= (A) && (C)", *opcode);
+            fprintf(out, "%02x\tANA C\t(A) <= (A) && (C)", *opcode);
             op_bytes = 1;
             break;
         case 0xA2:
-            printf("%02x\tANA D\t(A) <= (A) && (D)", *opcode);
+            fprintf(out, "%02x\tANA D\t(A) <= (A) && (D)", *opcode);
             op_bytes = 1;
             break;
         case 0xA3:
-            printf("%02x\tANA E\t(A) <= (A) && (E)", *opcode);
+            fprintf(out, "%02x\tANA E\t(A) <= (A) && (E)", *opcode);
             op_bytes = 1;
             break;
         case 0xA4:
-            printf("%02x\tANA H\t(A) <= (A) && (H)", *opcode);
+            fprintf(out, "%02x\tANA H\t(A) <= (A) && (H)", *opcode);
             op_bytes = 1;
             break;
         case 0xA5:
-            printf("%02x\tANA L\t(A) <= (A) && (L)", *opcode);
+            fprintf(out, "%02x\tANA L\t(A) <= (A) && (L)", *opcode);
             op_bytes = 1;
             break;
         case 0xA7:
-            printf("%02x\tANA A\t(A) <= (A) && (A)", *opcode);
+            fprintf(out, "%02x\tANA A\t(A) <= (A) && (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1175,7 +1183,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xA6:
-            printf("%02x\tANA M\t(A) <= (A) && ((H)(L))", *opcode);
+            fprintf(out, "%02x\tANA M\t(A) <= (A) && ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -1192,7 +1200,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xE6:
-            printf("%02x\tANI d8\t(A) <= (A) && #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tANI d8\t(A) <= (A) && #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -1207,31 +1215,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xA8:
-            printf("%02x\tXRA B\t(A) <= (A) ^ (B)", *opcode);
+            fprintf(out, "%02x\tXRA B\t(A) <= (A) ^ (B)", *opcode);
             op_bytes = 1;
             break;
         case 0xA9:
-            printf("%02x\tXRA C\t(A) <= (A) ^ (C)", *opcode);
+            fprintf(out, "%02x\tXRA C\t(A) <= (A) ^ (C)", *opcode);
             op_bytes = 1;
             break;
         case 0xAA:
-            printf("%02x\tXRA D\t(A) <= (A) ^ (D)", *opcode);
+            fprintf(out, "%02x\tXRA D\t(A) <= (A) ^ (D)", *opcode);
             op_bytes = 1;
             break;
         case 0xAB:
-            printf("%02x\tXRA E\t(A) <= (A) ^ (E)", *opcode);
+            fprintf(out, "%02x\tXRA E\t(A) <= (A) ^ (E)", *opcode);
             op_bytes = 1;
             break;
         case 0xAC:
-            printf("%02x\tXRA H\t(A) <= (A) ^ (H)", *opcode);
+            fprintf(out, "%02x\tXRA H\t(A) <= (A) ^ (H)", *opcode);
             op_bytes = 1;
             break;
         case 0xAD:
-            printf("%02x\tXRA L\t(A) <= (A) ^ (L)", *opcode);
+            fprintf(out, "%02x\tXRA L\t(A) <= (A) ^ (L)", *opcode);
             op_bytes = 1;
             break;
         case 0xAF:
-            printf("%02x\tXRA A\t(A) <= (A) ^ (A)", *opcode);
+            fprintf(out, "%02x\tXRA A\t(A) <= (A) ^ (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1246,7 +1254,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xAE:
-            printf("%02x\tXRA M\t(A) <= (A) ^ ((H)(L))", *opcode);
+            fprintf(out, "%02x\tXRA M\t(A) <= (A) ^ ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -1263,7 +1271,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xEE:
-            printf("%02x\tXRI d8\t(A) <= (A) ^ #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tXRI d8\t(A) <= (A) ^ #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -1278,31 +1286,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xB0:
-            printf("%02x\tORA B\t(A) <= (A) || (B)", *opcode);
+            fprintf(out, "%02x\tORA B\t(A) <= (A) || (B)", *opcode);
             op_bytes = 1;
             break;
         case 0xB1:
-            printf("%02x\tORA C\t(A) <= (A) || (C)", *opcode);
+            fprintf(out, "%02x\tORA C\t(A) <= (A) || (C)", *opcode);
             op_bytes = 1;
             break;
         case 0xB2:
-            printf("%02x\tORA D\t(A) <= (A) || (D)", *opcode);
+            fprintf(out, "%02x\tORA D\t(A) <= (A) || (D)", *opcode);
             op_bytes = 1;
             break;
         case 0xB3:
-            printf("%02x\tORA E\t(A) <= (A) || (E)", *opcode);
+            fprintf(out, "%02x\tORA E\t(A) <= (A) || (E)", *opcode);
             op_bytes = 1;
             break;
         case 0xB4:
-            printf("%02x\tORA H\t(A) <= (A) || (H)", *opcode);
+            fprintf(out, "%02x\tORA H\t(A) <= (A) || (H)", *opcode);
             op_bytes = 1;
             break;
         case 0xB5:
-            printf("%02x\tORA L\t(A) <= (A) || (L)", *opcode);
+            fprintf(out, "%02x\tORA L\t(A) <= (A) || (L)", *opcode);
             op_bytes = 1;
             break;
         case 0xB7:
-            printf("%02x\tORA A\t(A) <= (A) || (A)", *opcode);
+            fprintf(out, "%02x\tORA A\t(A) <= (A) || (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1317,7 +1325,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xB6:
-            printf("%02x\tORA M\t(A) <= (A) || ((H)(L))", *opcode);
+            fprintf(out, "%02x\tORA M\t(A) <= (A) || ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -1334,7 +1342,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xF6:
-            printf("%02x\tORI d8\t(A) <= (A) || #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tORI d8\t(A) <= (A) || #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -1349,31 +1357,31 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xB8:
-            printf("%02x\tCMP B\t(A) - (B)", *opcode);
+            fprintf(out, "%02x\tCMP B\t(A) - (B)", *opcode);
             op_bytes = 1;
             break;
         case 0xB9:
-            printf("%02x\tCMP C\t(A) - (C)", *opcode);
+            fprintf(out, "%02x\tCMP C\t(A) - (C)", *opcode);
             op_bytes = 1;
             break;
         case 0xBA:
-            printf("%02x\tCMP D\t(A) - (D)", *opcode);
+            fprintf(out, "%02x\tCMP D\t(A) - (D)", *opcode);
             op_bytes = 1;
             break;
         case 0xBB:
-            printf("%02x\tCMP E\t(A) - (E)", *opcode);
+            fprintf(out, "%02x\tCMP E\t(A) - (E)", *opcode);
             op_bytes = 1;
             break;
         case 0xBC:
-            printf("%02x\tCMP H\t(A) - (H)", *opcode);
+            fprintf(out, "%02x\tCMP H\t(A) - (H)", *opcode);
             op_bytes = 1;
             break;
         case 0xBD:
-            printf("%02x\tCMP L\t(A) - (L)", *opcode);
+            fprintf(out, "%02x\tCMP L\t(A) - (L)", *opcode);
             op_bytes = 1;
             break;
         case 0xBF:
-            printf("%02x\tCMP A\t(A) - (A)", *opcode);
+            fprintf(out, "%02x\tCMP A\t(A) - (A)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1389,7 +1397,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xBE:
-            printf("%02x\tCMP M\t(A) - ((H)(L))", *opcode);
+            fprintf(out, "%02x\tCMP M\t(A) - ((H)(L))", *opcode);
             op_bytes = 1;
             break;
 
@@ -1406,7 +1414,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xFE:
-            printf("%02x\tCPI d8\t(A) - #$%02x", *opcode, opcode[1]);
+            fprintf(out, "%02x\tCPI d8\t(A) - #$%02x", *opcode, opcode[1]);
             op_bytes = 2;
             break;
 
@@ -1421,7 +1429,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x07:
-            printf("%02x\tRLC\t(An+1) <= (An), (A0) <= (A7), (CY) <= (A7)", *opcode);
+            fprintf(out, "%02x\tRLC\t(An+1) <= (An), (A0) <= (A7), (CY) <= (A7)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1436,7 +1444,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x0F:
-            printf("%02x\tRRC\t(An) <= (An+1), (A7) <= (A0), (CY) <= (A0)", *opcode);
+            fprintf(out, "%02x\tRRC\t(An) <= (An+1), (A7) <= (A0), (CY) <= (A0)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1451,7 +1459,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x17:
-            printf("%02x\tRAL\t(An+1) <= (An), (CY) <= (A7), (A0) <= (CY)", *opcode);
+            fprintf(out, "%02x\tRAL\t(An+1) <= (An), (CY) <= (A7), (A0) <= (CY)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1466,7 +1474,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x1F:
-            printf("%02x\tRAR\t(An) <= (An+1), (CY) <= (A0), (A7) <= (CY)", *opcode);
+            fprintf(out, "%02x\tRAR\t(An) <= (An+1), (CY) <= (A0), (A7) <= (CY)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1480,7 +1488,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x2F:
-            printf("%02x\tCMA\t(An) <= !(An)", *opcode);
+            fprintf(out, "%02x\tCMA\t(An) <= !(An)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1494,7 +1502,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x3F:
-            printf("%02x\tCMC\t(CY) <= !(CY)", *opcode);
+            fprintf(out, "%02x\tCMC\t(CY) <= !(CY)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1508,7 +1516,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : CY
         */
         case 0x37:
-            printf("%02x\tSTC\t(CY) <= 1", *opcode);
+            fprintf(out, "%02x\tSTC\t(CY) <= 1", *opcode);
             op_bytes = 1;
             break;
 
@@ -1552,7 +1560,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
         */
         case 0xC3:
         case 0xCB:
-            printf("%02x\tJMP addr\t(PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJMP addr\t(PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -1571,35 +1579,35 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xC2:
-            printf("%02x\tJNZ addr\tif(Z = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJNZ addr\tif(Z = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xCA:
-            printf("%02x\tJZ addr\tif(Z = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJZ addr\tif(Z = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xD2:
-            printf("%02x\tJNC addr\tif(CY = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJNC addr\tif(CY = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xDA:
-            printf("%02x\tJC addr\tif(CY = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJC addr\tif(CY = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xE2:
-            printf("%02x\tJPO addr\tif(P = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJPO addr\tif(P = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xEA:
-            printf("%02x\tJPE addr\tif(P = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJPE addr\tif(P = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xF2:
-            printf("%02x\tJP addr\tif(S = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJP addr\tif(S = 0): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xFA:
-            printf("%02x\tJM addr\tif(S = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tJM addr\tif(S = 1): (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -1624,7 +1632,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
         case 0xDD:
         case 0xED:
         case 0xFD:
-            printf("%02x\tCALL addr\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCALL addr\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -1643,35 +1651,35 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xC4:
-            printf("%02x\tCNZ addr\tif(Z = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCNZ addr\tif(Z = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xCC:
-            printf("%02x\tCZ addr\tif(Z = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCZ addr\tif(Z = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xD4:
-            printf("%02x\tCNC addr\tif(CY = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCNC addr\tif(CY = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xDC:
-            printf("%02x\tCC addr\tif(CY = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCC addr\tif(CY = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xE4:
-            printf("%02x\tCPO addr\tif(P = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCPO addr\tif(P = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xEC:
-            printf("%02x\tCPE addr\tif(P = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCPE addr\tif(P = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xF4:
-            printf("%02x\tCP addr\tif(S = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCP addr\tif(S = 0): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
         case 0xFC:
-            printf("%02x\tCM addr\tif(S = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
+            fprintf(out, "%02x\tCM addr\tif(S = 1): ((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP - 2), (PC) <= #$%02x%02x", *opcode, opcode[2], opcode[1]);
             op_bytes = 3;
             break;
 
@@ -1689,7 +1697,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
         */
         case 0xC9:
         case 0xD9:
-            printf("%02x\tRET\t(PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRET\t(PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
 
@@ -1704,35 +1712,35 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xC0:
-            printf("%02x\tRNZ\tif(Z = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRNZ\tif(Z = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xC8:
-            printf("%02x\tRZ\tif(Z = 1): ((PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRZ\tif(Z = 1): ((PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xD0:
-            printf("%02x\tRNC\tif(CY = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRNC\tif(CY = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xD8:
-            printf("%02x\tRC\tif(CY = 1): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRC\tif(CY = 1): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xE0:
-            printf("%02x\tRPO\tif(P = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRPO\tif(P = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xE8:
-            printf("%02x\tRPE\tif(P = 1): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRPE\tif(P = 1): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xF0:
-            printf("%02x\tRP\tif(S = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRP\tif(S = 0): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xF8:
-            printf("%02x\tRM\tif(S = 1): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tRM\tif(S = 1): (PCL) <= ((SP)), (PCH) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
 
@@ -1752,35 +1760,35 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xC7:
-            printf("%02x\tRST 0\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b000", *opcode);
+            fprintf(out, "%02x\tRST 0\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b000", *opcode);
             op_bytes = 1;
             break;
         case 0xCF:
-            printf("%02x\tRST 1\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b001", *opcode);
+            fprintf(out, "%02x\tRST 1\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b001", *opcode);
             op_bytes = 1;
             break;
         case 0xD7:
-            printf("%02x\tRST 2\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b010", *opcode);
+            fprintf(out, "%02x\tRST 2\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b010", *opcode);
             op_bytes = 1;
             break;
         case 0xDF:
-            printf("%02x\tRST 3\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b011", *opcode);
+            fprintf(out, "%02x\tRST 3\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b011", *opcode);
             op_bytes = 1;
             break;
         case 0xE7:
-            printf("%02x\tRST 4\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b100", *opcode);
+            fprintf(out, "%02x\tRST 4\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b100", *opcode);
             op_bytes = 1;
             break;
         case 0xEF:
-            printf("%02x\tRST 5\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b101", *opcode);
+            fprintf(out, "%02x\tRST 5\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b101", *opcode);
             op_bytes = 1;
             break;
         case 0xF7:
-            printf("%02x\tRST 6\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b110", *opcode);
+            fprintf(out, "%02x\tRST 6\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b110", *opcode);
             op_bytes = 1;
             break;
         case 0xFF:
-            printf("%02x\tRST 7\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b111", *opcode);
+            fprintf(out, "%02x\tRST 7\t((SP) - 1) <= (PCH), ((SP) - 2) <= (PCL), (SP) <= (SP) - 2, (PC) <= 8 * 0b111", *opcode);
             op_bytes = 1;
             break;
 
@@ -1796,7 +1804,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xE9:
-            printf("%02x\tPCHL\t(PCH) <= (H), (PCL) <= (L)", *opcode);
+            fprintf(out, "%02x\tPCHL\t(PCH) <= (H), (PCL) <= (L)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1818,15 +1826,15 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xC5:
-            printf("%02x\tPUSH B\t((SP) - 1) <= (C), ((SP) - 2) <= (B), (SP) <= (SP) - 2", *opcode);
+            fprintf(out, "%02x\tPUSH B\t((SP) - 1) <= (C), ((SP) - 2) <= (B), (SP) <= (SP) - 2", *opcode);
             op_bytes = 1;
             break;
         case 0xD5:
-            printf("%02x\tPUSH E\t((SP) - 1) <= (D), ((SP) - 2) <= (E), (SP) <= (SP) - 2", *opcode);
+            fprintf(out, "%02x\tPUSH D\t((SP) - 1) <= (D), ((SP) - 2) <= (E), (SP) <= (SP) - 2", *opcode);
             op_bytes = 1;
             break;
         case 0xE5:
-            printf("%02x\tPUSH H\t((SP) - 1) <= (H), ((SP) - 2) <= (L), (SP) <= (SP) - 2", *opcode);
+            fprintf(out, "%02x\tPUSH H\t((SP) - 1) <= (H), ((SP) - 2) <= (L), (SP) <= (SP) - 2", *opcode);
             op_bytes = 1;
             break;
 
@@ -1843,7 +1851,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xF5:
-            printf("%02x\tPUSH PSW\t((SP) - 1) <= (A), ((SP) - 2) <= (F), (SP) <= (SP) - 2", *opcode);
+            fprintf(out, "%02x\tPUSH PSW\t((SP) - 1) <= (A), ((SP) - 2) <= (F), (SP) <= (SP) - 2", *opcode);
             op_bytes = 1;
             break;
 
@@ -1863,15 +1871,15 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xC1:
-            printf("%02x\tPOP B\t(C) <= ((SP)), (B) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tPOP B\t(C) <= ((SP)), (B) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xD1:
-            printf("%02x\tPOP D\t(D) <= ((SP)), (E) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tPOP D\t(D) <= ((SP)), (E) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
         case 0xE1:
-            printf("%02x\tPOP H\t(H) <= ((SP)), (L) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tPOP H\t(H) <= ((SP)), (L) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
 
@@ -1888,7 +1896,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : Z, S, P, CY, AC
         */
         case 0xF1:
-            printf("%02x\tPOP PSW\t(F) <= ((SP)), (A) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
+            fprintf(out, "%02x\tPOP PSW\t(F) <= ((SP)), (A) <= ((SP) + 1), (SP) <= (SP) + 2", *opcode);
             op_bytes = 1;
             break;
 
@@ -1904,7 +1912,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xE3:
-            printf("%02x\tXTHL\t(L) <= ((SP)), (H) <= ((SP) + 1)", *opcode);
+            fprintf(out, "%02x\tXTHL\t(L) <= ((SP)), (H) <= ((SP) + 1)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1918,7 +1926,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xF9:
-            printf("%02x\tSPHL\t(SP) <= (H)(L)", *opcode);
+            fprintf(out, "%02x\tSPHL\t(SP) <= (H)(L)", *opcode);
             op_bytes = 1;
             break;
 
@@ -1934,7 +1942,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xDB:
-            printf("%02x\tIN port\t(A) <= (data)", *opcode);
+            fprintf(out, "%02x\tIN port\t(A) <= (data)", *opcode);
             op_bytes = 2;
             break;
 
@@ -1950,7 +1958,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xD3:
-            printf("%02x\tOUT port\t(data) <= (A)", *opcode);
+            fprintf(out, "%02x\tOUT port\t(data) <= (A)", *opcode);
             op_bytes = 2;
             break;
 
@@ -1964,7 +1972,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xFB:
-            printf("%02x\tEI\tEnable interrupts", *opcode);
+            fprintf(out, "%02x\tEI\tEnable interrupts", *opcode);
             op_bytes = 1;
             break;
 
@@ -1978,7 +1986,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0xF3:
-            printf("%02x\tDI\tDisable interrupts", *opcode);
+            fprintf(out, "%02x\tDI\tDisable interrupts", *opcode);
             op_bytes = 1;
             break;
 
@@ -1992,7 +2000,7 @@ int disassemble8080(unsigned char *code_buffer, int pc)
             Flags : None
         */
         case 0x76:
-            printf("%02x\tHLT\tStop processor", *opcode);
+            fprintf(out, "%02x\tHLT\tStop processor", *opcode);
             op_bytes = 1;
             break;
 
@@ -2009,18 +2017,259 @@ int disassemble8080(unsigned char *code_buffer, int pc)
         case 0x08:
         case 0x10:
         case 0x18:
-        case 0x20:
         case 0x28:
-        case 0x30:
         case 0x38:
-            printf("%02x\tNOP\t", *opcode);
+#ifndef CPU_8085
+        case 0x20:
+        case 0x30:
+#endif
+            fprintf(out, "%02x\tNOP\t", *opcode);
             op_bytes = 1;
             break;
 
+#ifdef CPU_8085
+        /*
+            Name : Read Interrupt Masks (8085 only, NOP on the 8080)
+            Explanation : The interrupt masks, the interrupt enable flag, the pending interrupts and the serial input line are moved to register A.
+                +---------------------------------------+
+                | 7 | 6  | 5  | 4  | 3 | 2  | 1  | 0  |
+                +---------------------------------------+
+                |SID|I7.5|I6.5|I5.5|IE |M7.5|M6.5|M5.5|
+                +---------------------------------------+
+            Encoding :  +---------------+
+                        |0|0|1|0|0|0|0|0|
+                        +---------------+
+            Cycles / States : 1 / 4
+            Flags : None
+        */
+        case 0x20:
+            fprintf(out, "%02x\tRIM\t(A) <= SID, pending interrupts, IE, interrupt masks", *opcode);
+            op_bytes = 1;
+            break;
+
+        /*
+            Name : Set Interrupt Masks (8085 only, NOP on the 8080)
+            Explanation : If MSE is set, the interrupt masks are loaded from register A. R7.5 resets the RST 7.5 latch,
+                if SOE is set, SOD is moved to the serial output line.
+                +---------------------------------------+
+                | 7 | 6 | 5 | 4  | 3 | 2  | 1  | 0  |
+                +---------------------------------------+
+                |SOD|SOE| - |R7.5|MSE|M7.5|M6.5|M5.5|
+                +---------------------------------------+
+            Encoding :  +---------------+
+                        |0|0|1|1|0|0|0|0|
+                        +---------------+
+            Cycles / States : 1 / 4
+            Flags : None
+        */
+        case 0x30:
+            fprintf(out, "%02x\tSIM\tinterrupt masks, SOD <= (A)", *opcode);
+            op_bytes = 1;
+            break;
+#endif
+
         default:
-            printf("Instruction non prise en charge : %02x", *opcode);
+            fprintf(out, "Instruction non prise en charge : %02x", *opcode);
             break;
     }
-    printf("\n");
+    fprintf(out, "\n");
     return op_bytes;
 }
+
+// Disassemble the instruction at pc to stdout
+int disassemble8080(unsigned char *code_buffer, int pc)
+{
+    return fdisassemble8080(stdout, code_buffer, pc);
+}
+
+
+/*
+    Undocumented opcodes : the 8080 decodes them as the documented instruction they alias,
+    with its length and timing, the disassembler and the emulator do the same.
+        0x08, 0x10, 0x18, 0x20, 0x28, 0x30, 0x38 : NOP (0x20 / 0x30 are RIM / SIM on the 8085)
+        0xCB : JMP
+        0xD9 : RET
+        0xDD, 0xED, 0xFD : CALL
+    Returns the documented opcode opcode is an alias of, -1 if opcode is documented.
+*/
+int undocumented8080(unsigned char opcode)
+{
+    switch (opcode) {
+        case 0x08:
+        case 0x10:
+        case 0x18:
+        case 0x28:
+        case 0x38:
+#ifndef CPU_8085
+        case 0x20:
+        case 0x30:
+#endif
+            return 0x00;
+        case 0xCB:
+            return 0xC3;
+        case 0xD9:
+            return 0xC9;
+        case 0xDD:
+        case 0xED:
+        case 0xFD:
+            return 0xCD;
+        default:
+            return -1;
+    }
+}
+
+/*
+    Mnemonic and operands of every documented opcode as the listing prints them ("MVI A, d8"),
+    empty for the undocumented ones. Returns 0 if the memory can't be allocated.
+*/
+int templates8080(char templates[256][32])
+{
+    char *listing = NULL;
+    size_t size = 0;
+    FILE *stream = open_memstream(&listing, &size);
+
+    if (stream == NULL)
+        return 0;
+    for (int op = 0; op < 256; op++) {
+        unsigned char code[3] = {(unsigned char)op, 0, 0};
+        char *text, *end;
+
+        templates[op][0] = '\0';
+        if (undocumented8080((unsigned char)op) >= 0)
+            continue;
+        rewind(stream);
+        fdisassemble8080(stream, code, 0);
+        fputc('\0', stream);
+        fflush(stream);
+        text = strchr(listing, '\t') + 1;
+        end = strchr(text, '\t');
+        if (end == NULL)
+            end = text + strcspn(text, "\n");
+        snprintf(templates[op], 32, "%.*s", (int)(end - text), text);
+    }
+    fclose(stream);
+    free(listing);
+    return 1;
+}
+
+/*
+    Length of every instruction and its group, as in the listing above, to walk code
+    without printing it
+*/
+const unsigned char length8080[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 1
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 2
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 3
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 4
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 5
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 6
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 7
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 8
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 9
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // A
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // B
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1, // C
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // D
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, // E
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1  // F
+};
+
+#define GROUP_TRANSFER 0
+#define GROUP_ARITHMETIC 1
+#define GROUP_LOGICAL 2
+#define GROUP_BRANCH 3
+#define GROUP_MACHINE 4
+#define GROUPS8080 5
+
+const char *const group_names8080[GROUPS8080] = {
+    "Data Transfer", "Arithmetic", "Logical", "Branch", "Stack, I/O, Machine Control"
+};
+
+const unsigned char group8080[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    4, 0, 0, 1, 1, 1, 0, 2, 4, 1, 0, 1, 1, 1, 0, 2, // 0
+    4, 0, 0, 1, 1, 1, 0, 2, 4, 1, 0, 1, 1, 1, 0, 2, // 1
+    4, 0, 0, 1, 1, 1, 0, 1, 4, 1, 0, 1, 1, 1, 0, 2, // 2
+    4, 0, 0, 1, 1, 1, 0, 2, 4, 1, 0, 1, 1, 1, 0, 2, // 3
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 4
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 5
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 6
+    0, 0, 0, 0, 0, 0, 4, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 7
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 8
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 9
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // A
+    2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, // B
+    3, 4, 3, 3, 3, 4, 1, 3, 3, 3, 3, 3, 3, 3, 1, 3, // C
+    3, 4, 3, 4, 3, 4, 1, 3, 3, 3, 3, 4, 3, 3, 1, 3, // D
+    3, 4, 3, 4, 3, 4, 2, 3, 3, 3, 3, 0, 3, 3, 2, 3, // E
+    3, 4, 3, 4, 3, 4, 2, 3, 3, 4, 3, 4, 3, 3, 2, 3  // F
+};
+
+/*
+    Where the execution goes after every instruction, the target of the jumps and calls is
+    the 16 bits operand, the one of RST n is 8 * n (aliases included)
+        FLOW_NEXT       next instruction
+        FLOW_JUMP       target only (JMP)
+        FLOW_BRANCH     target or next instruction (Jcc)
+        FLOW_CALL       target, then next instruction (CALL, Ccc)
+        FLOW_RST        8 * n, then next instruction
+        FLOW_RETURN     nowhere known (RET, PCHL)
+        FLOW_RETURN_IF  return or next instruction (Rcc)
+*/
+#define FLOW_NEXT 0
+#define FLOW_JUMP 1
+#define FLOW_BRANCH 2
+#define FLOW_CALL 3
+#define FLOW_RST 4
+#define FLOW_RETURN 5
+#define FLOW_RETURN_IF 6
+
+const unsigned char flow8080[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 1
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 2
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 3
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 4
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 5
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 6
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 7
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 8
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 9
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // A
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // B
+    6, 0, 2, 1, 3, 0, 0, 4, 6, 5, 2, 1, 3, 3, 0, 4, // C
+    6, 0, 2, 0, 3, 0, 0, 4, 6, 5, 2, 0, 3, 3, 0, 4, // D
+    6, 0, 2, 0, 3, 0, 0, 4, 6, 5, 2, 0, 3, 3, 0, 4, // E
+    6, 0, 2, 0, 3, 0, 0, 4, 6, 0, 2, 0, 3, 3, 0, 4  // F
+};
+
+/*
+    Disassemble size bytes of code_buffer to out. In strict mode, every undocumented opcode is
+    reported after its line. The pc always moves forward, so a scan never stalls.
+    Returns the number of undocumented opcodes found.
+*/
+int disassemble_buffer8080(FILE *out, unsigned char *code_buffer, int size, int strict)
+{
+    int undocumented = 0;
+    int pc = 0;
+
+    while (pc < size) {
+        int alias = undocumented8080(code_buffer[pc]);
+        int op_bytes = fdisassemble8080(out, code_buffer, pc);
+
+        if (alias >= 0) {
+            undocumented++;
+            if (strict)
+                fprintf(out, "Warning : undocumented opcode %02x at %04x, alias of %02x\n", code_buffer[pc], pc, alias);
+        }
+        pc += op_bytes > 0 ? op_bytes : 1;
+    }
+    if (strict)
+        fprintf(out, "%d undocumented opcodes\n", undocumented);
+    return undocumented;
+}
+
+#endif
@@ -0,0 +1,406 @@
+#ifndef DISASSEMBLER_INCREMENTAL_C
+#define DISASSEMBLER_INCREMENTAL_C
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "disassembler.c"
+#include "index.c"
+#include "cache.c"
+
+/*
+    Incremental analysis
+
+    The analysis of an image of at most 64 KB is kept in the form the descent builds it : the
+    starts of the listing, the descent map of index_descend (reached bytes, reached starts,
+    block leaders) and the reference of every reached instruction, with the list of the
+    sources of each target. The blocks are the reached leaders (see analysis_layout).
+
+    Patching the bytes [address, address + length) changes the decode of the instructions
+    starting in the window [address - 2, address + length) only :
+        1. The listing is decoded again from the instruction containing address until it
+           lands on a start of the old listing after the patch
+        2. The reached instructions of the window and everything the old code reached from
+           them (targets and next instructions, up to the returns and the entry points) are
+           forgotten with their references. What is left was reached without going through
+           the window, so it is still reached
+        3. The descent starts again from every way into the forgotten instructions and the
+           window from what is left (entry points, references, instruction just before),
+           then the leaders and the reached bytes around them are updated
+
+    The cost is the size of the code under the patch : a few instructions up to the return of
+    a subroutine, the whole program for a patch in a loop every path goes through (then, past
+    INCREMENTAL_FORGET instructions, the image is analysed again from scratch).
+*/
+
+
+// a patch forgetting more instructions analyses the image again, which is then as fast
+#define INCREMENTAL_FORGET 4096
+
+typedef struct Incremental8080 {
+    // image, followed by 2 zeroed bytes
+    unsigned char code[0x10000 + 2];
+    int size;
+    // descent map and starts of the listing, as index_scan makes them
+    uint8_t map[0x10001];
+    uint64_t boundaries[0x10000 / 64 + 1];
+    // target of the reference of the reached instruction at a source (-1 if none), its kind
+    int32_t target[0x10000];
+    uint8_t kind[0x10000];
+    // sources referencing a target : first source, then next / previous of each source
+    int32_t first[0x10000];
+    int32_t next[0x10000];
+    int32_t previous[0x10000];
+    uint16_t queue[0x10000];
+    // instructions forgotten by a patch (marked with stamp), their old targets and next instructions
+    uint16_t forgotten[0x10000];
+    uint16_t exits[2 * 0x10000];
+    uint32_t marks[0x10000];
+    uint32_t stamp;
+    // last patch : instructions decoded again for the listing, forgotten, walked again by the descent,
+    // 1 if the image was analysed again
+    int listed;
+    int cleared;
+    int walked;
+    int full;
+} Incremental8080;
+
+
+static void incremental_link(Incremental8080 *inc, int source, int target, uint8_t kind)
+{
+    inc->target[source] = target;
+    inc->kind[source] = kind;
+    inc->previous[source] = -1;
+    inc->next[source] = inc->first[target];
+    if (inc->first[target] >= 0)
+        inc->previous[inc->first[target]] = source;
+    inc->first[target] = source;
+}
+
+static void incremental_unlink(Incremental8080 *inc, int source)
+{
+    int target = inc->target[source];
+
+    if (target < 0)
+        return;
+    if (inc->previous[source] >= 0)
+        inc->next[inc->previous[source]] = inc->next[source];
+    else
+        inc->first[target] = inc->next[source];
+    if (inc->next[source] >= 0)
+        inc->previous[inc->next[source]] = inc->previous[source];
+    inc->target[source] = -1;
+}
+
+// Descent from start, same map as index_descend, linking the references on the way
+static void incremental_walk(Incremental8080 *inc, int start)
+{
+    int limit = inc->size;
+    int count = 0;
+
+    if (start >= limit || (inc->map[start] & 2))
+        return;
+    inc->queue[count++] = (uint16_t)start;
+
+    while (count > 0) {
+        int pc = inc->queue[--count];
+
+        while (pc < limit && !(inc->map[pc] & 2) && pc + length8080[inc->code[pc]] <= limit) {
+            uint8_t op = inc->code[pc];
+            int length = length8080[op];
+            uint8_t kind;
+            int target = analysis_target(inc->code, pc, &kind);
+
+            inc->map[pc] |= 2;
+            for (int i = 0; i < length; i++)
+                inc->map[pc + i] |= 1;
+            inc->walked++;
+            if (target >= 0)
+                incremental_link(inc, pc, target, kind);
+            if (target >= 0 && kind != REFERENCE_DATA && target < limit) {
+                inc->map[target] |= 4;
+                if (!(inc->map[target] & 2) && count < 0x10000)
+                    inc->queue[count++] = (uint16_t)target;
+            }
+            if (flow8080[op] == FLOW_JUMP || flow8080[op] == FLOW_RETURN)
+                break;
+            pc += length;
+            if (flow8080[op] != FLOW_NEXT && pc < limit)
+                inc->map[pc] |= 4;
+        }
+    }
+}
+
+// Analyse the image from scratch
+static void incremental_reset(Incremental8080 *inc)
+{
+    memset(inc->map, 0, sizeof(inc->map));
+    memset(inc->boundaries, 0, sizeof(inc->boundaries));
+    memset(inc->target, 0xFF, sizeof(inc->target));
+    memset(inc->first, 0xFF, sizeof(inc->first));
+    for (int pc = 0; pc < inc->size; pc += length8080[inc->code[pc]]) {
+        inc->boundaries[pc >> 6] |= 1ull << (pc & 63);
+        inc->listed++;
+    }
+    for (int entry = 0; entry < 64 && entry < inc->size; entry += 8)
+        inc->map[entry] |= 4;
+    for (int entry = 0; entry < 64 && entry < inc->size; entry += 8)
+        incremental_walk(inc, entry);
+}
+
+// Analyse size bytes of code, returns NULL if the image is larger than 64 KB or the memory can't be allocated
+Incremental8080 *incremental_open(const unsigned char *code, int size)
+{
+    Incremental8080 *inc;
+
+    if (size > 0x10000) {
+        printf("Error : the incremental analysis is limited to 64 KB, the image is %d bytes\n", size);
+        return NULL;
+    }
+    if ((inc = calloc(1, sizeof(Incremental8080))) == NULL) {
+        printf("Error : couldn't allocate the incremental analysis\n");
+        return NULL;
+    }
+    memcpy(inc->code, code, size);
+    inc->size = size;
+    incremental_reset(inc);
+    return inc;
+}
+
+void incremental_close(Incremental8080 *inc)
+{
+    free(inc);
+}
+
+// 1 if a block starts at p (< size) : entry point, target of a transfer or after one, as in index_descend
+static int incremental_leader(const Incremental8080 *inc, int p)
+{
+    if (p < 64 && p % 8 == 0)
+        return 1;
+    for (int source = inc->first[p]; source >= 0; source = inc->next[source])
+        if (inc->kind[source] != REFERENCE_DATA)
+            return 1;
+    for (int q = p > 3 ? p - 3 : 0; q < p; q++) {
+        uint8_t op = inc->code[q];
+
+        if ((inc->map[q] & 2) && q + length8080[op] == p && flow8080[op] != FLOW_NEXT
+            && flow8080[op] != FLOW_JUMP && flow8080[op] != FLOW_RETURN)
+            return 1;
+    }
+    return 0;
+}
+
+// 1 if the descent reaches p (< size) : entry point, reference or next instruction of a reached one
+static int incremental_entry(const Incremental8080 *inc, int p)
+{
+    if (p < 64 && p % 8 == 0)
+        return 1;
+    for (int source = inc->first[p]; source >= 0; source = inc->next[source])
+        if (inc->kind[source] != REFERENCE_DATA)
+            return 1;
+    for (int q = p > 3 ? p - 3 : 0; q < p; q++) {
+        uint8_t op = inc->code[q];
+
+        if ((inc->map[q] & 2) && q + length8080[op] == p && flow8080[op] != FLOW_JUMP && flow8080[op] != FLOW_RETURN)
+            return 1;
+    }
+    return 0;
+}
+
+// Forget the reached instruction at pc if it isn't yet, its target and next instruction are added to exits
+static int incremental_forget(Incremental8080 *inc, int pc, int *count, int exits)
+{
+    uint8_t op = inc->code[pc];
+    int after = pc + length8080[op];
+
+    if (!(inc->map[pc] & 2) || inc->marks[pc] == inc->stamp)
+        return exits;
+    inc->marks[pc] = inc->stamp;
+    inc->forgotten[(*count)++] = (uint16_t)pc;
+    if (inc->target[pc] >= 0 && inc->kind[pc] != REFERENCE_DATA && inc->target[pc] < inc->size)
+        inc->exits[exits++] = (uint16_t)inc->target[pc];
+    if (flow8080[op] != FLOW_JUMP && flow8080[op] != FLOW_RETURN && after < inc->size)
+        inc->exits[exits++] = (uint16_t)after;
+    return exits;
+}
+
+// Leader and reached bits of the byte p (< size), from the reached starts around it
+static void incremental_update(Incremental8080 *inc, int p)
+{
+    int reached = 0;
+
+    for (int q = p > 2 ? p - 2 : 0; q <= p; q++)
+        reached |= (inc->map[q] & 2) && q + length8080[inc->code[q]] > p;
+    inc->map[p] = (inc->map[p] & ~5) | (incremental_leader(inc, p) ? 4 : 0) | reached;
+}
+
+/*
+    Write the length bytes at address and update the analysis.
+    Returns 0 if they aren't in the image.
+*/
+int incremental_patch(Incremental8080 *inc, int address, const unsigned char *bytes, int length)
+{
+    int limit = inc->size;
+    int low = address > 2 ? address - 2 : 0;
+    int high = address + length;
+    int count = 0, exits = 0;
+    int pc;
+
+    if (address < 0 || length < 0 || address + length > inc->size) {
+        printf("Error : %d bytes at %04x aren't in the image\n", length, address);
+        return 0;
+    }
+    inc->listed = inc->cleared = inc->walked = inc->full = 0;
+    if (length == 0)
+        return 1;
+    if (++inc->stamp == 0) {
+        memset(inc->marks, 0, sizeof(inc->marks));
+        inc->stamp = 1;
+    }
+
+    // the window and what the old code reaches from it
+    for (pc = low; pc < high; pc++)
+        exits = incremental_forget(inc, pc, &count, exits);
+    // the entry points are reached whatever happens to the code leading to them
+    for (int i = 0; i < exits && count <= INCREMENTAL_FORGET; i++)
+        if (inc->exits[i] >= 64 || inc->exits[i] % 8)
+            exits = incremental_forget(inc, inc->exits[i], &count, exits);
+    if (count > INCREMENTAL_FORGET) {
+        memcpy(inc->code + address, bytes, length);
+        incremental_reset(inc);
+        inc->full = 1;
+        return 1;
+    }
+    for (int i = 0; i < count; i++) {
+        inc->map[inc->forgotten[i]] &= ~2;
+        incremental_unlink(inc, inc->forgotten[i]);
+    }
+    inc->cleared = count;
+    memcpy(inc->code + address, bytes, length);
+
+    // listing, from the instruction containing address until it meets the old decode
+    for (pc = address; !(inc->boundaries[pc >> 6] >> (pc & 63) & 1); pc--)
+        ;
+    for (;;) {
+        int end = pc + length8080[inc->code[pc]];
+
+        inc->boundaries[pc >> 6] |= 1ull << (pc & 63);
+        for (int i = pc + 1; i < end && i < limit; i++)
+            inc->boundaries[i >> 6] &= ~(1ull << (i & 63));
+        inc->listed++;
+        pc = end;
+        if (pc >= limit || (pc >= high && (inc->boundaries[pc >> 6] >> (pc & 63) & 1)))
+            break;
+    }
+
+    // descent from what is left
+    for (pc = low; pc < high; pc++)
+        if (incremental_entry(inc, pc))
+            incremental_walk(inc, pc);
+    for (int i = 0; i < count; i++)
+        if (incremental_entry(inc, inc->forgotten[i]))
+            incremental_walk(inc, inc->forgotten[i]);
+
+    for (pc = low; pc < high + 2 && pc < limit; pc++)
+        incremental_update(inc, pc);
+    for (int i = 0; i < count; i++)
+        for (pc = inc->forgotten[i]; pc < inc->forgotten[i] + 3 && pc < limit; pc++)
+            incremental_update(inc, pc);
+    for (int i = 0; i < exits; i++)
+        if (inc->marks[inc->exits[i]] != inc->stamp)
+            incremental_update(inc, inc->exits[i]);
+    return 1;
+}
+
+// Flat analysis of the patched image, as analysis_build makes it, returns 0 if the memory can't be allocated
+int incremental_export(const Incremental8080 *inc, Analysis8080 *analysis)
+{
+    return analysis_layout(analysis, inc->code, inc->size, cache_hash(inc->code, inc->size), inc->map, inc->boundaries);
+}
+
+
+static double incremental_microseconds(const struct timespec *start, const struct timespec *end)
+{
+    return (end->tv_sec - start->tv_sec) * 1e6 + (end->tv_nsec - start->tv_nsec) / 1e3;
+}
+
+/*
+    Apply the patches (address, hexadecimal bytes) to the image one by one and print what each
+    one cost, then check the result against a full analysis of the patched image and save it to
+    the analysis cache. Returns 0 if they agree.
+*/
+int incremental_run(const unsigned char *code, int size, char **patches, int count)
+{
+    Incremental8080 *inc = incremental_open(code, size);
+    Analysis8080 analysis, full;
+    struct timespec start, end;
+    double total = 0;
+    int result = 0;
+
+    if (inc == NULL)
+        return 1;
+    for (int i = 0; i + 1 < count; i += 2) {
+        unsigned char bytes[256];
+        int address = (int)strtol(patches[i], NULL, 0);
+        int length = (int)strlen(patches[i + 1]) / 2;
+        int patched;
+
+        for (int j = 0; j < length && j < (int)sizeof(bytes); j++) {
+            unsigned int byte;
+
+            if (!isxdigit((unsigned char)patches[i + 1][2 * j]) || !isxdigit((unsigned char)patches[i + 1][2 * j + 1])
+                || sscanf(patches[i + 1] + 2 * j, "%2x", &byte) != 1)
+                length = 0;
+            else
+                bytes[j] = (uint8_t)byte;
+        }
+        if (length == 0 || length > (int)sizeof(bytes) || strlen(patches[i + 1]) % 2) {
+            printf("Error : %s isn't 1 to %d bytes in hexadecimal\n", patches[i + 1], (int)sizeof(bytes));
+            incremental_close(inc);
+            return 1;
+        }
+
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        patched = incremental_patch(inc, address, bytes, length);
+        clock_gettime(CLOCK_MONOTONIC, &end);
+        if (!patched) {
+            incremental_close(inc);
+            return 1;
+        }
+        total += incremental_microseconds(&start, &end);
+        if (inc->full)
+            printf("%04x +%d bytes : analysed again, %.1f us\n", address, length, incremental_microseconds(&start, &end));
+        else
+            printf("%04x +%d bytes : %d instructions listed again, %d forgotten, %d walked, %.1f us\n", address, length,
+                inc->listed, inc->cleared, inc->walked, incremental_microseconds(&start, &end));
+    }
+
+    if (!incremental_export(inc, &analysis)) {
+        incremental_close(inc);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    if (!analysis_build(&full, inc->code, inc->size, analysis.header->hash)) {
+        analysis_close(&analysis);
+        incremental_close(inc);
+        return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    printf("%d patches in %.1f us, a full analysis takes %.1f us\n", count / 2, total,
+        incremental_microseconds(&start, &end));
+    if (analysis.length != full.length || memcmp(analysis.base, full.base, analysis.length) != 0) {
+        printf("Error : the patched analysis differs from a full analysis\n");
+        result = 1;
+    } else if (!analysis_save(&analysis))
+        printf("Warning : couldn't save the analysis to the cache\n");
+
+    analysis_close(&full);
+    analysis_close(&analysis);
+    incremental_close(inc);
+    return result;
+}
+
+#endif
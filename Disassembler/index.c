@@ -0,0 +1,318 @@
+#ifndef DISASSEMBLER_INDEX_C
+#define DISASSEMBLER_INDEX_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "disassembler.c"
+
+/*
+    Instruction index of an image, for the random access listing
+
+    One pass over the image builds :
+        - the bitmap of the instruction starts of the listing (decoded from 0, like
+          disassemble_buffer8080), bit n of word n / 64 is set if an instruction starts at n
+        - the code intervals : the bytes reached by a recursive descent from 0 and the RST
+          vectors (flow8080), sorted, everything between two intervals is data
+
+    The instruction containing an address is the last start at or before it (at most 2
+    bytes back), so the listing can start anywhere and scroll both ways without decoding
+    from 0. The index is saved next to the image (image.idx) with the size and the hash of
+    the image it was built from, a stale or damaged file is rebuilt.
+*/
+
+
+#define INDEX_MAGIC "8080IDX"
+#define INDEX_VERSION 1
+
+// file : header, boundary words, intervals
+typedef struct IndexHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint64_t hash;
+    uint32_t words;
+    uint32_t intervals;
+} IndexHeader;
+
+// code bytes [start, end)
+typedef struct IndexInterval {
+    uint32_t start;
+    uint32_t end;
+} IndexInterval;
+
+typedef struct Index8080 {
+    IndexHeader header;
+    uint64_t *boundaries;
+    IndexInterval *intervals;
+} Index8080;
+
+
+// FNV-1a, to tell if the index was built from this image
+uint64_t index_hash(const unsigned char *code, int size)
+{
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (int i = 0; i < size; i++)
+        hash = (hash ^ code[i]) * 0x100000001b3ull;
+    return hash;
+}
+
+void index_free(Index8080 *index)
+{
+    free(index->boundaries);
+    free(index->intervals);
+    memset(index, 0, sizeof(*index));
+}
+
+/*
+    Recursive descent over the first 64 KB of the image, map[address] gets :
+        bit 0 if the byte is part of a reached instruction
+        bit 1 if a reached instruction starts there
+        bit 2 if it is an entry point, the target of a transfer or follows one (block leader)
+*/
+static void index_descend(const unsigned char *code, int size, uint8_t *map)
+{
+    static uint16_t queue[0x10000];
+    int limit = size < 0x10000 ? size : 0x10000;
+    int count = 0;
+
+    for (int entry = 0; entry < 64 && entry < limit; entry += 8) {
+        map[entry] |= 4;
+        queue[count++] = (uint16_t)entry;
+    }
+
+    while (count > 0) {
+        int pc = queue[--count];
+
+        // until a known instruction, the end of the image or an unconditional transfer
+        while (pc < limit && !(map[pc] & 2) && pc + length8080[code[pc]] <= limit) {
+            uint8_t op = code[pc];
+            int length = length8080[op];
+            int target = -1;
+
+            map[pc] |= 2;
+            for (int i = 0; i < length; i++)
+                map[pc + i] |= 1;
+            if (flow8080[op] == FLOW_RST)
+                target = op & 0x38;
+            else if (flow8080[op] == FLOW_JUMP || flow8080[op] == FLOW_BRANCH || flow8080[op] == FLOW_CALL)
+                target = code[pc + 1] | code[pc + 2] << 8;
+            if (target >= 0 && target < limit) {
+                map[target] |= 4;
+                if (!(map[target] & 2) && count < 0x10000)
+                    queue[count++] = (uint16_t)target;
+            }
+            if (flow8080[op] == FLOW_JUMP || flow8080[op] == FLOW_RETURN)
+                break;
+            pc += length;
+            if (flow8080[op] != FLOW_NEXT && pc < limit)
+                map[pc] |= 4;
+        }
+    }
+}
+
+// Set the instruction starts of the listing in boundaries and the descent map, both zeroed
+void index_scan(const unsigned char *code, int size, uint8_t *map, uint64_t *boundaries)
+{
+    for (int pc = 0; pc < size; pc += length8080[code[pc]])
+        boundaries[pc >> 6] |= 1ull << (pc & 63);
+    index_descend(code, size, map);
+}
+
+// Allocate and fill the code intervals of the descent map, returns 0 if the memory can't be allocated
+int index_intervals(Index8080 *index, const uint8_t *map, int size)
+{
+    int limit = size < 0x10000 ? size : 0x10000;
+    uint32_t count = 0;
+
+    for (int i = 0; i < limit; i++)
+        count += (map[i] & 1) && !(map[i + 1] & 1);
+    index->header.intervals = 0;
+    index->intervals = malloc((count + 1) * sizeof(IndexInterval));
+    if (index->intervals == NULL) {
+        printf("Error : couldn't allocate the index of %d bytes\n", size);
+        return 0;
+    }
+    for (int i = 0; i < limit; i++) {
+        if ((map[i] & 1) && (i == 0 || !(map[i - 1] & 1)))
+            index->intervals[index->header.intervals].start = (uint32_t)i;
+        if ((map[i] & 1) && !(map[i + 1] & 1))
+            index->intervals[index->header.intervals++].end = (uint32_t)i + 1;
+    }
+    return 1;
+}
+
+/*
+    Index size bytes of code (followed by 2 readable bytes) into boundaries, size / 64 + 1
+    zeroed words. map, the zeroed descent map of 64 KB + 1 bytes, is filled on the way.
+    Only the intervals are allocated.
+    Returns 0 if the memory can't be allocated.
+*/
+int index_fill(Index8080 *index, const unsigned char *code, int size, uint8_t *map, uint64_t *boundaries)
+{
+    memset(index, 0, sizeof(*index));
+    memcpy(index->header.magic, INDEX_MAGIC, sizeof(index->header.magic));
+    index->header.version = INDEX_VERSION;
+    index->header.size = (uint32_t)size;
+    index->header.hash = index_hash(code, size);
+    index->header.words = (uint32_t)size / 64 + 1;
+    index->boundaries = boundaries;
+    index_scan(code, size, map, boundaries);
+    return index_intervals(index, map, size);
+}
+
+// Index size bytes of code (followed by 2 readable bytes), returns 0 if the memory can't be allocated
+int index_build(Index8080 *index, const unsigned char *code, int size)
+{
+    uint8_t *map = calloc(0x10001, 1);
+    uint64_t *boundaries = calloc((uint32_t)size / 64 + 1, sizeof(uint64_t));
+    int ok;
+
+    memset(index, 0, sizeof(*index));
+    ok = map != NULL && boundaries != NULL && index_fill(index, code, size, map, boundaries);
+    if (!ok) {
+        if (map == NULL || boundaries == NULL)
+            printf("Error : couldn't allocate the index of %d bytes\n", size);
+        free(boundaries);
+        free(index->intervals);
+        memset(index, 0, sizeof(*index));
+    }
+    free(map);
+    return ok;
+}
+
+// Returns 0 if the file can't be written
+int index_save(const Index8080 *index, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+    int ok;
+
+    if (f == NULL)
+        return 0;
+    ok = fwrite(&index->header, sizeof(index->header), 1, f) == 1
+        && fwrite(index->boundaries, sizeof(uint64_t), index->header.words, f) == index->header.words
+        && fwrite(index->intervals, sizeof(IndexInterval), index->header.intervals, f) == index->header.intervals;
+    return fclose(f) == 0 && ok;
+}
+
+// Returns 0 if path isn't a valid index of these size bytes of code
+int index_load(Index8080 *index, const char *path, const unsigned char *code, int size)
+{
+    FILE *f = fopen(path, "rb");
+    IndexHeader header;
+    int ok = 0;
+
+    memset(index, 0, sizeof(*index));
+    if (f == NULL)
+        return 0;
+    if (fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) == 0
+        && header.version == INDEX_VERSION && header.size == (uint32_t)size && header.words == (uint32_t)size / 64 + 1
+        && header.intervals <= 0x8000 && header.hash == index_hash(code, size)) {
+        index->header = header;
+        index->boundaries = malloc(header.words * sizeof(uint64_t));
+        index->intervals = malloc((header.intervals + 1) * sizeof(IndexInterval));
+        ok = index->boundaries != NULL && index->intervals != NULL
+            && fread(index->boundaries, sizeof(uint64_t), header.words, f) == header.words
+            && fread(index->intervals, sizeof(IndexInterval), header.intervals, f) == header.intervals;
+    }
+    fclose(f);
+    if (!ok)
+        index_free(index);
+    return ok;
+}
+
+// Load the index saved next to the image at path, or build and save it
+int index_open(Index8080 *index, const char *path, const unsigned char *code, int size)
+{
+    char *file = malloc(strlen(path) + 5);
+
+    if (file == NULL)
+        return 0;
+    sprintf(file, "%s.idx", path);
+    if (!index_load(index, file, code, size)) {
+        if (!index_build(index, code, size)) {
+            free(file);
+            return 0;
+        }
+        if (!index_save(index, file))
+            printf("Warning : couldn't save the index to %s\n", file);
+    }
+    free(file);
+    return 1;
+}
+
+
+// Start of the instruction containing address (< size), -1 if there is none before it
+int index_start(const Index8080 *index, int address)
+{
+    int word = address >> 6;
+    uint64_t bits = index->boundaries[word] & (~0ull >> (63 - (address & 63)));
+
+    while (bits == 0 && word > 0)
+        bits = index->boundaries[--word];
+    return bits ? word * 64 + 63 - __builtin_clzll(bits) : -1;
+}
+
+// Start of the instruction before the one at pc, -1 at the start of the image
+int index_previous(const Index8080 *index, int pc)
+{
+    return pc > 0 ? index_start(index, pc - 1) : -1;
+}
+
+/*
+    Returns 1 if address is code, 0 if it is data. *start and *end are set to the bounds of
+    the interval containing it.
+*/
+int index_region(const Index8080 *index, int address, int *start, int *end)
+{
+    uint32_t low = 0, high = index->header.intervals;
+
+    // first interval ending after address
+    while (low < high) {
+        uint32_t middle = (low + high) / 2;
+
+        if (index->intervals[middle].end <= (uint32_t)address)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    if (low < index->header.intervals && index->intervals[low].start <= (uint32_t)address) {
+        *start = index->intervals[low].start;
+        *end = index->intervals[low].end;
+        return 1;
+    }
+    *start = low > 0 ? (int)index->intervals[low - 1].end : 0;
+    *end = low < index->header.intervals ? (int)index->intervals[low].start : (int)index->header.size;
+    return 0;
+}
+
+/*
+    Print count instructions around address, the instruction containing it is marked with
+    "  > ", a "; code" / "; data" line starts every region
+*/
+void index_print(const Index8080 *index, const unsigned char *code, int address, int count, FILE *out)
+{
+    int target = index_start(index, address);
+    int pc = target;
+    int region_end = -1;
+
+    for (int i = 0; i < count / 2 && index_previous(index, pc) >= 0; i++)
+        pc = index_previous(index, pc);
+    for (int i = 0; i < count && pc < (int)index->header.size; i++) {
+        if (pc >= region_end) {
+            int region_start;
+            int is_code = index_region(index, pc, &region_start, &region_end);
+
+            fprintf(out, "; %s %04x-%04x\n", is_code ? "code" : "data", region_start, region_end - 1);
+        }
+        int op_bytes;
+
+        fprintf(out, "%s%04x\t", pc == target ? "  > " : "    ", pc);
+        op_bytes = fdisassemble8080(out, (unsigned char *)code, pc);
+        pc += op_bytes > 0 ? op_bytes : 1;
+    }
+}
+
+#endif
@@ -0,0 +1,526 @@
+#ifndef DISASSEMBLER_LABELS_C
+#define DISASSEMBLER_LABELS_C
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include "disassembler.c"
+
+/*
+    Labelled listing
+
+    The operands of the jumps and calls are replaced by names : the imported symbol of the
+    target if there is one, an automatic label L1234 otherwise. The imported symbols also
+    name the d16 / a16 operands. The listing is made in one decode pass into a text buffer :
+        - a forward reference marks its target, the label goes in front of the line when
+          the decode reaches it
+        - a backward reference writes the label into the 8 columns kept in front of the
+          line already in the buffer (the offset of the line of every address is kept)
+        - the targets without a line (inside an instruction or past the image) get an EQU
+          at the end
+    The undocumented opcodes and the truncated last instruction are written as DB, so the
+    listing assembles back to the same bytes.
+
+    Symbol files, one symbol per line, ';' starts a comment :
+        NAME EQU $1234
+        NAME = 0x1234
+        1234 NAME
+        NAME 1234h
+    The numbers are $1234, 0x1234, 1234h or bare hex. The names of the assembler (mnemonics,
+    registers, directives) and the automatic labels are skipped, so the listing assembles.
+    The addresses are 16 bits, so an address is its own perfect hash : the symbols are a
+    table of 64K name offsets, a lookup is one load.
+*/
+
+
+// a name is at most SYMBOL_LENGTH characters
+#define SYMBOL_LENGTH 63
+// bytes a line of the listing can take
+#define LABELS_LINE (SYMBOL_LENGTH * 2 + 64)
+
+typedef struct Symbols8080 {
+    // the names, '\0' terminated
+    char *pool;
+    size_t used;
+    size_t capacity;
+    // offset + 1 of the name of every address in pool, 0 for none
+    uint32_t name[0x10000];
+    int count;
+} Symbols8080;
+
+enum {
+    OPERAND_NONE,
+    // d8, port
+    OPERAND_BYTE,
+    // d16, a16
+    OPERAND_WORD,
+    // addr, the target of a jump or a call
+    OPERAND_TARGET
+};
+
+typedef struct Labels8080 {
+    const Symbols8080 *symbols;
+    char *text;
+    size_t used;
+    size_t capacity;
+    // stamp of the listing when the address was referenced / started a line
+    uint32_t stamp;
+    uint32_t referenced[0x10000];
+    uint32_t listed[0x10000];
+    // offset of the line of the instruction starting at the address
+    uint32_t line[0x10000];
+    // the referenced addresses, in reference order
+    uint16_t references[0x10000];
+    int reference_count;
+    // listing of every documented opcode, split before its operand
+    char prefix[256][32];
+    uint8_t prefix_length[256];
+    uint8_t operand[256];
+} Labels8080;
+
+
+static int symbols_name(const char *token)
+{
+    size_t length = strlen(token);
+
+    if (length == 0 || length > SYMBOL_LENGTH || isdigit((unsigned char)token[0]))
+        return 0;
+    for (size_t i = 0; i < length; i++)
+        if (!isalnum((unsigned char)token[i]) && strchr("_.?@", token[i]) == NULL)
+            return 0;
+    return 1;
+}
+
+/*
+    A name the listing can't use : a mnemonic, a register or a directive of the assembler
+    (any case), or an automatic label L1234. Returns what it is, NULL for a good name.
+*/
+static const char *symbols_reserved(const char *name)
+{
+    static const char *const words[] = {
+        "ACI", "ADC", "ADD", "ADI", "ANA", "ANI", "CALL", "CC", "CM", "CMA", "CMC", "CMP", "CNC",
+        "CNZ", "CP", "CPE", "CPI", "CPO", "CZ", "DAA", "DAD", "DCR", "DCX", "DI", "EI", "HLT", "IN",
+        "INR", "INX", "JC", "JM", "JMP", "JNC", "JNZ", "JP", "JPE", "JPO", "JZ", "LDA", "LDAX",
+        "LHLD", "LXI", "MOV", "MVI", "NOP", "ORA", "ORI", "OUT", "PCHL", "POP", "PUSH", "RAL",
+        "RAR", "RC", "RET", "RIM", "RLC", "RM", "RNC", "RNZ", "RP", "RPE", "RPO", "RRC", "RST",
+        "RZ", "SBB", "SBI", "SHLD", "SIM", "SPHL", "STA", "STAX", "STC", "SUB", "SUI", "XCHG",
+        "XRA", "XRI", "XTHL"
+    };
+    static const char *const registers[] = {"A", "B", "C", "D", "E", "H", "L", "M", "SP", "PSW"};
+    static const char *const directives[] = {"DB", "DW", "DS", "ORG", "EQU", "END"};
+
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++)
+        if (strcasecmp(name, words[i]) == 0)
+            return "a mnemonic";
+    for (size_t i = 0; i < sizeof(registers) / sizeof(registers[0]); i++)
+        if (strcasecmp(name, registers[i]) == 0)
+            return "a register";
+    for (size_t i = 0; i < sizeof(directives) / sizeof(directives[0]); i++)
+        if (strcasecmp(name, directives[i]) == 0)
+            return "a directive";
+    if (name[0] == 'L' && strlen(name) == 5 && strspn(name + 1, "0123456789ABCDEF") == 4)
+        return "an automatic label";
+    return NULL;
+}
+
+// $1234, 0x1234, 1234h or bare hex, *explicit is set if the base is written
+static int symbols_number(const char *token, long *value, int *explicit)
+{
+    size_t length = strlen(token);
+    char digits[16];
+    char *end;
+
+    *explicit = 1;
+    if (token[0] == '$')
+        token++, length--;
+    else if (token[0] == '0' && (token[1] == 'x' || token[1] == 'X'))
+        token += 2, length -= 2;
+    else if (length > 1 && (token[length - 1] == 'h' || token[length - 1] == 'H'))
+        length--;
+    else
+        *explicit = 0;
+    if (length == 0 || length >= sizeof(digits))
+        return 0;
+    memcpy(digits, token, length);
+    digits[length] = '\0';
+    for (size_t i = 0; i < length; i++)
+        if (!isxdigit((unsigned char)digits[i]))
+            return 0;
+    *value = strtol(digits, &end, 16);
+    return 1;
+}
+
+// Add name at address, the first name of an address stays. Returns 0 if the memory can't be allocated
+int symbols_add(Symbols8080 *symbols, uint16_t address, const char *name)
+{
+    size_t length = strlen(name) + 1;
+
+    if (symbols->name[address] != 0)
+        return 1;
+    if (symbols->used + length > symbols->capacity) {
+        size_t capacity = symbols->capacity ? symbols->capacity * 2 : 4096;
+        char *pool = realloc(symbols->pool, capacity);
+
+        if (pool == NULL)
+            return 0;
+        symbols->pool = pool;
+        symbols->capacity = capacity;
+    }
+    memcpy(symbols->pool + symbols->used, name, length);
+    symbols->name[address] = (uint32_t)symbols->used + 1;
+    symbols->used += length;
+    symbols->count++;
+    return 1;
+}
+
+// Name of address, NULL if there is none
+static inline const char *symbols_find(const Symbols8080 *symbols, uint16_t address)
+{
+    return symbols != NULL && symbols->name[address] != 0 ? symbols->pool + symbols->name[address] - 1 : NULL;
+}
+
+void symbols_destroy(Symbols8080 *symbols)
+{
+    if (symbols == NULL)
+        return;
+    free(symbols->pool);
+    free(symbols);
+}
+
+// Load the symbol file at path, the lines that can't be read are skipped with a warning on stderr, out of the listing
+Symbols8080 *symbols_load(const char *path)
+{
+    FILE *f = fopen(path, "r");
+    Symbols8080 *symbols;
+    char line[1024];
+    int number = 0;
+
+    if (f == NULL) {
+        printf("Error : couldn't open the symbols %s\n", path);
+        return NULL;
+    }
+    symbols = calloc(1, sizeof(Symbols8080));
+    if (symbols == NULL) {
+        printf("Error : couldn't allocate the symbols\n");
+        fclose(f);
+        return NULL;
+    }
+    while (fgets(line, sizeof(line), f) != NULL) {
+        char *tokens[4];
+        int count = 0;
+        long first = 0, second = 0;
+        int first_explicit, second_explicit;
+        const char *name;
+        const char *reserved;
+        long value;
+
+        number++;
+        line[strcspn(line, ";\r\n")] = '\0';
+        for (char *token = strtok(line, " \t="); token != NULL; token = strtok(NULL, " \t=")) {
+            size_t length = strlen(token);
+
+            if (strcasecmp(token, "EQU") == 0)
+                continue;
+            if (length > 1 && token[length - 1] == ':')
+                token[length - 1] = '\0';
+            if (count == 3)
+                break;
+            tokens[count++] = token;
+        }
+        if (count == 0)
+            continue;
+
+        // the address first (map files), unless the second token is a number written as one
+        int first_number = count == 2 && symbols_number(tokens[0], &first, &first_explicit);
+        int second_number = count == 2 && symbols_number(tokens[1], &second, &second_explicit);
+
+        if (second_number && symbols_name(tokens[0]) && (second_explicit || !first_number || !symbols_name(tokens[1]))) {
+            name = tokens[0];
+            value = second;
+        }
+        else if (first_number && symbols_name(tokens[1])) {
+            name = tokens[1];
+            value = first;
+        }
+        else {
+            fprintf(stderr, "Warning : %s:%d isn't a symbol\n", path, number);
+            continue;
+        }
+        if (value > 0xFFFF) {
+            fprintf(stderr, "Warning : %s:%d the address of %s is past 64 KB\n", path, number, name);
+            continue;
+        }
+        if ((reserved = symbols_reserved(name)) != NULL) {
+            fprintf(stderr, "Warning : %s:%d %s is %s\n", path, number, name, reserved);
+            continue;
+        }
+        if (!symbols_add(symbols, (uint16_t)value, name)) {
+            printf("Error : couldn't allocate the symbols\n");
+            symbols_destroy(symbols);
+            fclose(f);
+            return NULL;
+        }
+    }
+    fclose(f);
+    return symbols;
+}
+
+
+// Labelled listings, with the names of symbols if it isn't NULL. Returns NULL if the memory can't be allocated
+Labels8080 *labels_create(const Symbols8080 *symbols)
+{
+    char templates[256][32];
+    Labels8080 *labels = calloc(1, sizeof(Labels8080));
+
+    if (labels == NULL || !templates8080(templates)) {
+        free(labels);
+        return NULL;
+    }
+    labels->symbols = symbols;
+    for (int op = 0; op < 256; op++) {
+        const char *text = templates[op];
+        size_t length = strlen(text);
+        static const struct {
+            const char *placeholder;
+            uint8_t operand;
+        } placeholders[] = {
+            {" d8", OPERAND_BYTE}, {" port", OPERAND_BYTE}, {" d16", OPERAND_WORD},
+            {" a16", OPERAND_WORD}, {" addr", OPERAND_TARGET}
+        };
+
+        for (size_t i = 0; i < sizeof(placeholders) / sizeof(placeholders[0]); i++) {
+            size_t placeholder = strlen(placeholders[i].placeholder);
+
+            if (length > placeholder && strcmp(text + length - placeholder, placeholders[i].placeholder) == 0) {
+                labels->operand[op] = placeholders[i].operand;
+                length -= placeholder - 1;
+                break;
+            }
+        }
+        memcpy(labels->prefix[op], text, length);
+        labels->prefix_length[op] = (uint8_t)length;
+    }
+    return labels;
+}
+
+void labels_destroy(Labels8080 *labels)
+{
+    if (labels == NULL)
+        return;
+    free(labels->text);
+    free(labels);
+}
+
+static const char labels_digits[] = "0123456789abcdef";
+
+// Room for a line at the end of the text, returns the end
+static char *labels_reserve(Labels8080 *labels)
+{
+    if (labels->used + LABELS_LINE > labels->capacity) {
+        size_t capacity = labels->capacity ? labels->capacity * 2 : 1 << 16;
+        char *text = realloc(labels->text, capacity);
+
+        if (text == NULL) {
+            printf("Error : couldn't allocate %zu bytes of memory\n", capacity);
+            exit(1);
+        }
+        labels->text = text;
+        labels->capacity = capacity;
+    }
+    return labels->text + labels->used;
+}
+
+static inline char *labels_hex(char *c, unsigned value, int digits)
+{
+    for (int i = digits - 1; i >= 0; i--)
+        c[i] = labels_digits[(value >> (4 * (digits - 1 - i))) & 15];
+    return c + digits;
+}
+
+// "L1234", 5 characters
+static inline char *labels_auto(char *c, uint16_t address)
+{
+    *c++ = 'L';
+    for (int i = 3; i >= 0; i--)
+        *c++ = "0123456789ABCDEF"[(address >> (4 * i)) & 15];
+    return c;
+}
+
+// Write the name of address at c, a reference to it
+static char *labels_reference(Labels8080 *labels, char *c, uint16_t address)
+{
+    const char *name = symbols_find(labels->symbols, address);
+
+    if (labels->referenced[address] != labels->stamp) {
+        labels->referenced[address] = labels->stamp;
+        labels->references[labels->reference_count++] = address;
+        // backward reference to a line without a label yet
+        if (name == NULL && labels->listed[address] == labels->stamp)
+            memcpy(labels_auto(labels->text + labels->line[address], address), ":  ", 3);
+    }
+    if (name == NULL)
+        return labels_auto(c, address);
+    size_t length = strlen(name);
+
+    memcpy(c, name, length);
+    return c + length;
+}
+
+static int labels_compare(const void *a, const void *b)
+{
+    return *(const uint16_t *)a - *(const uint16_t *)b;
+}
+
+/*
+    List size bytes of code (followed by 2 readable bytes) with labels to out, or only to
+    labels->text if out is NULL. Returns the number of undocumented opcodes.
+*/
+int labels_list(Labels8080 *labels, FILE *out, const unsigned char *code, int size)
+{
+    int undocumented = 0;
+    int pc = 0;
+
+    if (++labels->stamp == 0) {
+        memset(labels->referenced, 0, sizeof(labels->referenced));
+        memset(labels->listed, 0, sizeof(labels->listed));
+        labels->stamp = 1;
+    }
+    labels->used = 0;
+    labels->reference_count = 0;
+
+    while (pc < size) {
+        uint8_t op = code[pc];
+        int length = length8080[op];
+        char *c = labels_reserve(labels);
+        char *start;
+
+        if (pc < 0x10000) {
+            const char *name = symbols_find(labels->symbols, (uint16_t)pc);
+
+            if (name != NULL) {
+                size_t name_length = strlen(name);
+
+                memcpy(c, name, name_length);
+                c[name_length] = ':';
+                c[name_length + 1] = '\n';
+                c += name_length + 2;
+            }
+            labels->listed[pc] = labels->stamp;
+            labels->line[pc] = (uint32_t)(c - labels->text);
+        }
+        // label field, filled now for a forward reference, later for a backward one
+        if (pc < 0x10000 && labels->referenced[pc] == labels->stamp && symbols_find(labels->symbols, (uint16_t)pc) == NULL)
+            memcpy(labels_auto(c, (uint16_t)pc), ":  ", 3);
+        else
+            memset(c, ' ', 8);
+        c += 8;
+        start = c;
+
+        if (undocumented8080(op) >= 0 || pc + length > size) {
+            undocumented += undocumented8080(op) >= 0;
+            if (pc + length > size)
+                length = size - pc;
+            memcpy(c, "DB ", 3);
+            c += 3;
+            for (int i = 0; i < length; i++) {
+                if (i > 0)
+                    *c++ = ',', *c++ = ' ';
+                *c++ = '$';
+                c = labels_hex(c, code[pc + i], 2);
+            }
+        }
+        else {
+            memcpy(c, labels->prefix[op], labels->prefix_length[op]);
+            c += labels->prefix_length[op];
+            switch (labels->operand[op]) {
+                case OPERAND_BYTE:
+                    *c++ = '$';
+                    c = labels_hex(c, code[pc + 1], 2);
+                    break;
+                case OPERAND_WORD: {
+                    uint16_t value = (uint16_t)(code[pc + 1] | code[pc + 2] << 8);
+                    const char *name = symbols_find(labels->symbols, value);
+
+                    if (name != NULL)
+                        c = labels_reference(labels, c, value);
+                    else {
+                        *c++ = '$';
+                        c = labels_hex(c, value, 4);
+                    }
+                    break;
+                }
+                case OPERAND_TARGET:
+                    c = labels_reference(labels, c, (uint16_t)(code[pc + 1] | code[pc + 2] << 8));
+                    break;
+            }
+        }
+
+        // address comment
+        do
+            *c++ = ' ';
+        while (c - start < 24);
+        *c++ = ';';
+        *c++ = ' ';
+        c = labels_hex(c, (unsigned)pc, pc < 0x10000 ? 4 : pc < 0x100000 ? 5 : 8);
+        *c++ = '\n';
+        labels->used = (size_t)(c - labels->text);
+        pc += length;
+    }
+
+    // the references without a line
+    int count = 0;
+
+    for (int i = 0; i < labels->reference_count; i++)
+        if (labels->listed[labels->references[i]] != labels->stamp)
+            labels->references[count++] = labels->references[i];
+    qsort(labels->references, count, sizeof(uint16_t), labels_compare);
+    for (int i = 0; i < count; i++) {
+        uint16_t address = labels->references[i];
+        char *c = labels_reserve(labels);
+        const char *name = symbols_find(labels->symbols, address);
+
+        if (name != NULL) {
+            size_t length = strlen(name);
+
+            memcpy(c, name, length);
+            c += length;
+        }
+        else
+            c = labels_auto(c, address);
+        memcpy(c, " EQU $", 6);
+        c = labels_hex(c + 6, address, 4);
+        *c++ = '\n';
+        labels->used = (size_t)(c - labels->text);
+    }
+
+    // '\0' terminated, for the assembler
+    *labels_reserve(labels) = '\0';
+    if (out != NULL)
+        fwrite(labels->text, 1, labels->used, out);
+    return undocumented;
+}
+
+// -labels : labelled listing of code, with the symbols of the file at symbols_path if it isn't NULL
+int labels_run(const unsigned char *code, int size, const char *symbols_path)
+{
+    Symbols8080 *symbols = NULL;
+    Labels8080 *labels;
+
+    if (symbols_path != NULL && (symbols = symbols_load(symbols_path)) == NULL)
+        return 1;
+    labels = labels_create(symbols);
+    if (labels == NULL) {
+        printf("Error : couldn't allocate the labels\n");
+        symbols_destroy(symbols);
+        return 1;
+    }
+    labels_list(labels, stdout, code, size);
+    labels_destroy(labels);
+    symbols_destroy(symbols);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef DISASSEMBLER_SEARCH_C
+#define DISASSEMBLER_SEARCH_C
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "disassembler.c"
+
+/*
+    Instruction pattern search
+
+    A pattern is a list of instructions written like the listing, separated by ';', the
+    operands can be wildcards (xx, xxxx, *, ?) :
+        LXI H, xxxx; MOV A, M; CPI 0x20
+    The numbers are 0x20, 20h, $20 or decimal. Every instruction is compiled to its opcode
+    (found in the listing of the documented opcodes) and its operand bytes, each byte with
+    a mask, 0 for a wildcard.
+
+    Scan :
+        1. The longest run of fixed bytes of each pattern is its key, the keys go in an
+           Aho-Corasick automaton over the bytes, compiled to a full table of transitions
+        2. In the start state, the bytes that can't start a key are skipped 32 (AVX2) or 16
+           (SSE2) at a time, comparing them with the first bytes of the keys
+        3. When a key is found, the whole pattern is compared under its mask around it
+        4. A match is a hit if it starts on an instruction boundary of the linear decode from
+           the start of the image. The bitmap of the boundaries is only made for the images
+           with a match, by SEARCH_CHAINS walks of parts of the image run side by side : the
+           walks after the first start at the beginning of their part, not on the real
+           boundary, but two decodes meet after a few instructions, so once the real walk
+           reaching the part is known only the instructions before the meeting point are fixed
+*/
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#define SEARCH_PATTERNS 64
+// bytes of a pattern
+#define SEARCH_LENGTH 64
+#define SEARCH_STATES (SEARCH_PATTERNS * SEARCH_LENGTH + 1)
+// at most SEARCH_FIRST first bytes for the SIMD skip, the scalar skip is used above
+#define SEARCH_FIRST 8
+// walks made side by side for the boundaries of an image
+#define SEARCH_CHAINS 8
+
+typedef struct SearchPattern {
+    char text[256];
+    uint8_t bytes[SEARCH_LENGTH];
+    // 0xFF for a fixed byte, 0 for a wildcard
+    uint8_t mask[SEARCH_LENGTH];
+    int length;
+    int instructions;
+    // the key is length bytes at offset key of the pattern
+    int key;
+    int key_length;
+    // next pattern with the same key, -1 for the last one
+    int same;
+} SearchPattern;
+
+typedef struct Search8080 {
+    SearchPattern patterns[SEARCH_PATTERNS];
+    int count;
+    // listing of every documented opcode, "MNEMONIC OPERAND, OPERAND"
+    char templates[256][32];
+    // automaton, state 0 is the start state
+    uint16_t (*next)[256];
+    // first pattern whose key ends in the state, -1 for none
+    int16_t *match;
+    // longest proper suffix state where a key ends, 0 for none
+    uint16_t *output;
+    int states;
+    // first bytes of the keys
+    uint8_t first[256];
+    uint8_t firsts[SEARCH_FIRST];
+    int first_count;
+} Search8080;
+
+// Boundaries of the image being scanned, reused from image to image
+typedef struct SearchScan {
+    // one bit per byte of the image
+    uint64_t *boundaries;
+    // words of boundaries
+    size_t capacity;
+    // 1 once the boundaries of the image are in the bitmap
+    int walked;
+    uint64_t hits;
+} SearchScan;
+
+
+Search8080 *search_create(void)
+{
+    Search8080 *search = calloc(1, sizeof(Search8080));
+
+    // the mnemonics and operands are taken from the listing
+    if (search == NULL || !templates8080(search->templates)) {
+        printf("Error : couldn't allocate the search\n");
+        exit(1);
+    }
+    return search;
+}
+
+void search_destroy(Search8080 *search)
+{
+    if (search == NULL)
+        return;
+    free(search->next);
+    free(search->match);
+    free(search->output);
+    free(search);
+}
+
+// Copy the next item of text up to separator, trimmed and in upper case, returns the rest
+static const char *search_token(const char *text, char separator, char *token, size_t size)
+{
+    size_t length = 0;
+
+    while (isspace((unsigned char)*text))
+        text++;
+    while (*text != '\0' && *text != separator) {
+        if (length + 1 < size)
+            token[length++] = (char)toupper((unsigned char)*text);
+        text++;
+    }
+    while (length > 0 && isspace((unsigned char)token[length - 1]))
+        length--;
+    token[length] = '\0';
+    return *text == separator ? text + 1 : text;
+}
+
+// Operand of the listing : 8 or 16 bits immediate, 0 for a register or a number
+static int search_immediate(const char *operand)
+{
+    if (strcmp(operand, "D8") == 0 || strcmp(operand, "PORT") == 0)
+        return 1;
+    if (strcmp(operand, "D16") == 0 || strcmp(operand, "A16") == 0 || strcmp(operand, "ADDR") == 0)
+        return 2;
+    return 0;
+}
+
+// Operand of a pattern : -1 for a wildcard, -2 for something else, else its value
+static long search_value(const char *operand)
+{
+    char *end;
+    long value;
+    size_t length = strlen(operand);
+
+    if (strcmp(operand, "*") == 0 || strcmp(operand, "?") == 0 || (length > 0 && strspn(operand, "X") == length))
+        return -1;
+    if (operand[0] == '#')
+        operand++, length--;
+    if (operand[0] == '$')
+        value = strtol(operand + 1, &end, 16);
+    else if (length > 1 && operand[length - 1] == 'H' && isxdigit((unsigned char)operand[0])) {
+        value = strtol(operand, &end, 16);
+        if (*end == 'H')
+            end++;
+    } else
+        value = strtol(operand, &end, 0);
+    return *end == '\0' && end != operand && value >= 0 && value <= 0xFFFF ? value : -2;
+}
+
+/*
+    Compile one instruction of a pattern at the end of pattern, returns 0 if no opcode takes
+    these operands
+*/
+static int search_instruction(const Search8080 *search, SearchPattern *pattern, const char *text)
+{
+    char mnemonic[16], operands[3][16], wanted[16];
+    int count = 0;
+    const char *rest = search_token(text, ' ', mnemonic, sizeof(mnemonic));
+
+    while (*rest != '\0' && count < 3)
+        rest = search_token(rest, ',', operands[count++], sizeof(operands[0]));
+
+    for (int op = 0; op < 256; op++) {
+        const char *template = search->templates[op];
+        char operand[16];
+        int immediate = 0, matched = 1, i = 0;
+        long value = -1;
+
+        if (template[0] == '\0')
+            continue;
+        template = search_token(template, ' ', wanted, sizeof(wanted));
+        if (strcmp(wanted, mnemonic) != 0)
+            continue;
+        for (; *template != '\0' && matched; i++) {
+            template = search_token(template, ',', operand, sizeof(operand));
+            if (i >= count) {
+                matched = 0;
+            } else if (search_immediate(operand)) {
+                immediate = search_immediate(operand);
+                value = search_value(operands[i]);
+                matched = value != -2 && (immediate == 2 || value <= 0xFF);
+            } else {
+                matched = strcmp(operand, operands[i]) == 0;
+            }
+        }
+        if (!matched || i != count)
+            continue;
+
+        if (pattern->length + 1 + immediate > SEARCH_LENGTH) {
+            printf("Error : the pattern %s is longer than %d bytes\n", pattern->text, SEARCH_LENGTH);
+            return 0;
+        }
+        pattern->bytes[pattern->length] = (uint8_t)op;
+        pattern->mask[pattern->length++] = 0xFF;
+        for (int byte = 0; byte < immediate; byte++) {
+            pattern->bytes[pattern->length] = value < 0 ? 0 : (uint8_t)(value >> (8 * byte));
+            pattern->mask[pattern->length++] = value < 0 ? 0 : 0xFF;
+        }
+        pattern->instructions++;
+        return 1;
+    }
+    printf("Error : no instruction matches %s\n", text);
+    return 0;
+}
+
+// Add a pattern, returns 0 if it can't be compiled
+int search_add(Search8080 *search, const char *text)
+{
+    SearchPattern *pattern = &search->patterns[search->count];
+    char instruction[64];
+    int run = 0;
+
+    if (search->count == SEARCH_PATTERNS) {
+        printf("Error : at most %d patterns are searched at once\n", SEARCH_PATTERNS);
+        return 0;
+    }
+    memset(pattern, 0, sizeof(*pattern));
+    snprintf(pattern->text, sizeof(pattern->text), "%s", text);
+    while (*text != '\0') {
+        text = search_token(text, ';', instruction, sizeof(instruction));
+        if (instruction[0] != '\0' && !search_instruction(search, pattern, instruction))
+            return 0;
+    }
+    if (pattern->length == 0) {
+        printf("Error : the pattern is empty\n");
+        return 0;
+    }
+    // the opcodes are fixed, so the key is at least one byte long
+    for (int i = 0; i < pattern->length; i++) {
+        run = pattern->mask[i] ? run + 1 : 0;
+        if (run > pattern->key_length) {
+            pattern->key_length = run;
+            pattern->key = i + 1 - run;
+        }
+    }
+    search->count++;
+    return 1;
+}
+
+// Compile the keys of the patterns into the automaton, once all of them are added
+void search_build(Search8080 *search)
+{
+    int states = 1;
+    int *fail, *queue, head = 0, tail = 0;
+
+    free(search->next);
+    free(search->match);
+    free(search->output);
+    search->next = calloc(SEARCH_STATES, sizeof(search->next[0]));
+    search->match = malloc(SEARCH_STATES * sizeof(int16_t));
+    search->output = calloc(SEARCH_STATES, sizeof(uint16_t));
+    fail = calloc(SEARCH_STATES, sizeof(int));
+    queue = malloc(SEARCH_STATES * sizeof(int));
+    if (search->next == NULL || search->match == NULL || search->output == NULL || fail == NULL || queue == NULL) {
+        printf("Error : couldn't allocate the search automaton\n");
+        exit(1);
+    }
+    memset(search->match, 0xFF, SEARCH_STATES * sizeof(int16_t));
+    memset(search->first, 0, sizeof(search->first));
+    search->first_count = 0;
+
+    // trie of the keys
+    for (int p = 0; p < search->count; p++) {
+        SearchPattern *pattern = &search->patterns[p];
+        int state = 0;
+
+        for (int i = 0; i < pattern->key_length; i++) {
+            uint8_t byte = pattern->bytes[pattern->key + i];
+
+            if (search->next[state][byte] == 0)
+                search->next[state][byte] = (uint16_t)states++;
+            state = search->next[state][byte];
+        }
+        pattern->same = search->match[state];
+        search->match[state] = (int16_t)p;
+
+        uint8_t first = pattern->bytes[pattern->key];
+        if (!search->first[first]) {
+            search->first[first] = 1;
+            if (search->first_count < SEARCH_FIRST)
+                search->firsts[search->first_count] = first;
+            search->first_count++;
+        }
+    }
+
+    // failure links in breadth first order, the missing transitions follow them
+    queue[tail++] = 0;
+    while (head < tail) {
+        int state = queue[head++];
+
+        for (int byte = 0; byte < 256; byte++) {
+            int child = search->next[state][byte];
+
+            if (child != 0) {
+                fail[child] = state == 0 ? 0 : search->next[fail[state]][byte];
+                search->output[child] = search->match[fail[child]] >= 0 ? (uint16_t)fail[child] : search->output[fail[child]];
+                queue[tail++] = child;
+            } else if (state != 0) {
+                search->next[state][byte] = search->next[fail[state]][byte];
+            }
+        }
+    }
+    search->states = states;
+    free(fail);
+    free(queue);
+}
+
+
+// Next position from i where a key can start
+static inline int search_skip(const Search8080 *search, const unsigned char *code, int i, int size)
+{
+    if (search->first_count <= SEARCH_FIRST) {
+#if defined(__AVX2__)
+        for (; i + 32 <= size; i += 32) {
+            __m256i bytes = _mm256_loadu_si256((const __m256i *)(code + i));
+            __m256i hit = _mm256_setzero_si256();
+
+            for (int f = 0; f < search->first_count; f++)
+                hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8((char)search->firsts[f])));
+            uint32_t mask = (uint32_t)_mm256_movemask_epi8(hit);
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+#elif defined(__SSE2__) || defined(_M_X64)
+        for (; i + 16 <= size; i += 16) {
+            __m128i bytes = _mm_loadu_si128((const __m128i *)(code + i));
+            __m128i hit = _mm_setzero_si128();
+
+            for (int f = 0; f < search->first_count; f++)
+                hit = _mm_or_si128(hit, _mm_cmpeq_epi8(bytes, _mm_set1_epi8((char)search->firsts[f])));
+            uint32_t mask = (uint32_t)_mm_movemask_epi8(hit);
+            if (mask != 0)
+                return i + __builtin_ctz(mask);
+        }
+#endif
+    }
+    while (i < size && !search->first[code[i]])
+        i++;
+    return i;
+}
+
+#define SEARCH_BIT(bitmap, address) ((bitmap)[(address) >> 6] >> ((address) & 63) & 1)
+#define SEARCH_SET(bitmap, address) ((bitmap)[(address) >> 6] |= 1ull << ((address) & 63))
+#define SEARCH_CLEAR(bitmap, address) ((bitmap)[(address) >> 6] &= ~(1ull << ((address) & 63)))
+
+// Mark the instruction boundaries of the linear decode of size bytes of code
+static void search_walk(SearchScan *scan, const unsigned char *code, int size)
+{
+    uint64_t *boundaries = scan->boundaries;
+    const int chains = SEARCH_CHAINS;
+    int start[SEARCH_CHAINS + 1], pc[SEARCH_CHAINS];
+    int entry;
+
+    memset(boundaries, 0, ((size_t)size / 64 + 1) * sizeof(uint64_t));
+    for (int chain = 0; chain < chains; chain++)
+        pc[chain] = start[chain] = (int)((int64_t)size * chain / chains);
+    start[chains] = size;
+
+    // independent walks, one step of each in turn, for as many steps as none can leave its part
+    for (;;) {
+        int steps = size;
+
+        for (int chain = 0; chain < chains; chain++)
+            if ((start[chain + 1] - pc[chain]) / 3 < steps)
+                steps = (start[chain + 1] - pc[chain]) / 3;
+        if (steps <= 0)
+            break;
+        while (steps--) {
+            for (int chain = 0; chain < chains; chain++) {
+                SEARCH_SET(boundaries, pc[chain]);
+                pc[chain] += length8080[code[pc[chain]]];
+            }
+        }
+    }
+    for (int chain = 0; chain < chains; chain++) {
+        for (; pc[chain] < start[chain + 1]; pc[chain] += length8080[code[pc[chain]]])
+            SEARCH_SET(boundaries, pc[chain]);
+    }
+
+    // the real walk enters each part at entry, follow it until it meets the walk of the part
+    entry = pc[0];
+    for (int chain = 1; chain < chains; chain++) {
+        int meet = entry;
+
+        while (meet < start[chain + 1] && !SEARCH_BIT(boundaries, meet))
+            meet += length8080[code[meet]];
+        for (int address = start[chain]; address < meet && address < size; address++)
+            SEARCH_CLEAR(boundaries, address);
+        for (int address = entry; address < meet; address += length8080[code[address]])
+            SEARCH_SET(boundaries, address);
+        entry = meet < start[chain + 1] ? pc[chain] : meet;
+    }
+    scan->walked = 1;
+}
+
+// 1 if address starts an instruction of the linear decode of code
+static inline int search_boundary(SearchScan *scan, const unsigned char *code, int size, int address)
+{
+    if (!scan->walked)
+        search_walk(scan, code, size);
+    return SEARCH_BIT(scan->boundaries, address);
+}
+
+// Print the hit of pattern at start with context instructions around it
+static void search_print(const SearchPattern *pattern, const SearchScan *scan, const unsigned char *code, int size,
+    int start, const char *name, int context, FILE *out)
+{
+    int first = start;
+
+    fprintf(out, "%s:%04x: %s\n", name, start, pattern->text);
+    // the bitmap is made before the first hit
+    for (int before = 0; before < context && first > 0; ) {
+        first--;
+        if (SEARCH_BIT(scan->boundaries, first))
+            before++;
+    }
+    for (int pc = first, instruction = 0; pc < size && instruction < context + pattern->instructions; ) {
+        if (pc >= start)
+            instruction++;
+        fprintf(out, "%s%04x\t", pc >= start && pc < start + pattern->length ? "  > " : "    ", pc);
+        pc += fdisassemble8080(out, (unsigned char *)code, pc);
+    }
+    if (context > 0)
+        fprintf(out, "\n");
+}
+
+/*
+    Search size bytes of code (followed by 2 readable bytes) for the patterns, print the hits
+    (named name, with context instructions before and after) to out, returns the number of hits
+*/
+uint64_t search_scan(const Search8080 *search, SearchScan *scan, const unsigned char *code, int size,
+    const char *name, int context, FILE *out)
+{
+    uint64_t hits = 0;
+    unsigned state = 0;
+
+    if ((size_t)size / 64 + 1 > scan->capacity) {
+        free(scan->boundaries);
+        scan->capacity = (size_t)size / 64 + 1;
+        scan->boundaries = malloc(scan->capacity * sizeof(uint64_t));
+        if (scan->boundaries == NULL) {
+            printf("Error : couldn't allocate %zu bytes of memory\n", scan->capacity * sizeof(uint64_t));
+            exit(1);
+        }
+    }
+    scan->walked = 0;
+
+    for (int i = 0; i < size; i++) {
+        if (state == 0 && (i = search_skip(search, code, i, size)) >= size)
+            break;
+        state = search->next[state][code[i]];
+        for (unsigned s = search->match[state] >= 0 ? state : search->output[state]; s != 0; s = search->output[s]) {
+            for (int p = search->match[s]; p >= 0; p = search->patterns[p].same) {
+                const SearchPattern *pattern = &search->patterns[p];
+                int start = i + 1 - pattern->key_length - pattern->key;
+                int j = 0;
+
+                if (start < 0 || start + pattern->length > size)
+                    continue;
+                while (j < pattern->length && ((code[start + j] ^ pattern->bytes[j]) & pattern->mask[j]) == 0)
+                    j++;
+                if (j < pattern->length || !search_boundary(scan, code, size, start))
+                    continue;
+                hits++;
+                if (out != NULL)
+                    search_print(pattern, scan, code, size, start, name, context, out);
+            }
+        }
+    }
+    scan->hits += hits;
+    return hits;
+}
+
+#endif
@@ -0,0 +1,105 @@
+#ifndef DISASSEMBLER_STATS_C
+#define DISASSEMBLER_STATS_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "disassembler.c"
+
+/*
+    Instruction mix
+
+    The decode (stats_decode) or execute (Emulator/stats.c) loop only adds to two flat
+    arrays of 256 counters indexed by the opcode, the groups (group8080) are summed when
+    the report is printed. On a corpus, each worker has its own counters, merged at the end.
+*/
+
+
+typedef struct Stats8080 {
+    uint64_t count[256];
+    // states per opcode, only for an execution
+    uint64_t cycles[256];
+    uint64_t bytes;
+} Stats8080;
+
+
+// Count the instructions of size bytes of code, decoded from the start like the listing
+void stats_decode(Stats8080 *stats, const unsigned char *code, int size)
+{
+    int pc = 0;
+
+    while (pc < size) {
+        stats->count[code[pc]]++;
+        pc += length8080[code[pc]];
+    }
+    stats->bytes += size;
+}
+
+void stats_merge(Stats8080 *stats, const Stats8080 *other)
+{
+    for (int op = 0; op < 256; op++) {
+        stats->count[op] += other->count[op];
+        stats->cycles[op] += other->cycles[op];
+    }
+    stats->bytes += other->bytes;
+}
+
+
+static const Stats8080 *stats_sort;
+
+static int stats_compare(const void *lhs, const void *rhs)
+{
+    uint64_t a = stats_sort->count[*(const uint8_t *)lhs];
+    uint64_t b = stats_sort->count[*(const uint8_t *)rhs];
+
+    return a < b ? 1 : a > b ? -1 : *(const uint8_t *)lhs - *(const uint8_t *)rhs;
+}
+
+// Print the groups, then the opcodes by count, with the states when there are some
+void stats_print(const Stats8080 *stats, FILE *out)
+{
+    uint64_t count[GROUPS8080] = {0}, cycles[GROUPS8080] = {0};
+    uint64_t total = 0, total_cycles = 0;
+    uint8_t order[256];
+
+    for (int op = 0; op < 256; op++) {
+        count[group8080[op]] += stats->count[op];
+        cycles[group8080[op]] += stats->cycles[op];
+        total += stats->count[op];
+        total_cycles += stats->cycles[op];
+        order[op] = (uint8_t)op;
+    }
+
+    fprintf(out, "group                      \tinstructions\t     %%");
+    if (total_cycles)
+        fprintf(out, "\t      states\t     %%\tstates / instruction");
+    fprintf(out, "\n");
+    for (int group = 0; group < GROUPS8080; group++) {
+        fprintf(out, "%-27s\t%12llu\t%6.2f", group_names8080[group], (unsigned long long)count[group],
+            total ? 100.0 * count[group] / total : 0.0);
+        if (total_cycles)
+            fprintf(out, "\t%12llu\t%6.2f\t%.2f", (unsigned long long)cycles[group], 100.0 * cycles[group] / total_cycles,
+                count[group] ? (double)cycles[group] / count[group] : 0.0);
+        fprintf(out, "\n");
+    }
+    fprintf(out, "%-27s\t%12llu\t%6.2f", "Total", (unsigned long long)total, total ? 100.0 : 0.0);
+    if (total_cycles)
+        fprintf(out, "\t%12llu\t%6.2f\t%.2f", (unsigned long long)total_cycles, 100.0, total ? (double)total_cycles / total : 0.0);
+    fprintf(out, "\n\n");
+
+    stats_sort = stats;
+    qsort(order, 256, sizeof(order[0]), stats_compare);
+    fprintf(out, "instructions\t     %%\t%s", total_cycles ? "      states\t     %\t" : "");
+    fprintf(out, "instruction\n");
+    for (int i = 0; i < 256 && stats->count[order[i]] > 0; i++) {
+        unsigned char code[3] = {order[i], 0, 0};
+
+        fprintf(out, "%12llu\t%6.2f\t", (unsigned long long)stats->count[order[i]], 100.0 * stats->count[order[i]] / total);
+        if (total_cycles)
+            fprintf(out, "%12llu\t%6.2f\t", (unsigned long long)stats->cycles[order[i]], 100.0 * stats->cycles[order[i]] / total_cycles);
+        fdisassemble8080(out, code, 0);
+    }
+}
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef EMULATOR_BENCHMARK_C
+#define EMULATOR_BENCHMARK_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include "emulator.c"
+
+/*
+    Register pair benchmark
+
+    A loop made of the instructions working on B-C, D-E and H-L as 16 bits words, the
+    ones paying for the split 8 bits registers before the pairs were unions :
+        0000    LXI SP, F000
+        0003    LXI H, 1000
+        0006    LXI D, 1234
+        0009    LXI B, 0001
+        000C    DAD B, DAD D, XCHG, INX H, INX D, DCX B, INX B
+        0013    PUSH H, PUSH D, PUSH B, XTHL, POP B, POP D, POP H
+        001A    SHLD 2000, LHLD 2002, XCHG, LHLD 2000, DAD H, INX SP, DCX SP
+        0027    JMP 000C
+*/
+
+
+static const uint8_t pair_program[] = {
+    0x31, 0x00, 0xF0, 0x21, 0x00, 0x10, 0x11, 0x34, 0x12, 0x01, 0x01, 0x00,
+    0x09, 0x19, 0xEB, 0x23, 0x13, 0x0B, 0x03,
+    0xE5, 0xD5, 0xC5, 0xE3, 0xC1, 0xD1, 0xE1,
+    0x22, 0x00, 0x20, 0x2A, 0x02, 0x20, 0xEB, 0x2A, 0x00, 0x20, 0x29, 0x33, 0x3B,
+    0xC3, 0x0C, 0x00
+};
+
+// Run the loop for cycles states and report the emulated MIPS
+int pair_benchmark(uint64_t cycles)
+{
+    State8080 state;
+    uint64_t instructions = 0;
+    struct timespec start, end;
+    double seconds;
+
+    init8080(&state, memory_create());
+    memory_load(state.memory, 0, pair_program, sizeof(pair_program));
+
+    timespec_get(&start, TIME_UTC);
+    while (state.cycles < cycles) {
+        emulate8080(&state);
+        instructions++;
+    }
+    timespec_get(&end, TIME_UTC);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%llu pair instructions, %llu states in %.3f s : %.2f MIPS (BC %04x DE %04x HL %04x)\n",
+        (unsigned long long)instructions, (unsigned long long)state.cycles, seconds,
+        seconds > 0 ? instructions / seconds / 1e6 : 0.0, state.bc, state.de, state.hl);
+    memory_destroy(state.memory);
+    return 0;
+}
+
+#endif
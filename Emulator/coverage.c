@@ -0,0 +1,587 @@
+#ifndef EMULATOR_COVERAGE_C
+#define EMULATOR_COVERAGE_C
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "emulator.c"
+#include "fork.c"
+#include "../Disassembler/disassembler.c"
+
+/*
+    Code coverage
+
+    coverage_step executes one instruction and sets, in three bitmaps of 64K bits :
+        executed : the address of the opcode
+        read     : the bytes the instruction reads as data
+        written  : the bytes the instruction writes
+    The data address comes from the opcode (coverage_kind) and the registers before the
+    instruction, so the core and the memory map are left as they are. The stack accesses
+    are found by SP moving by 2, like the profiler, an interrupt pushing the PC between two
+    instructions is a write.
+    Every opcode has its own handler (coverage_handlers), made from the handler of the core
+    and coverage_kind of the opcode folded at compile time : the opcodes without an access
+    cost the bit of executed only. coverage_execute runs a whole slice without looking for
+    interrupts between the instructions.
+    The conditional jumps, calls and returns count taken / not taken at their address : a
+    call or a return taken moves SP, a jump taken leaves PC + 3.
+
+    Coverage file (.cov) : header, the 3 bitmaps, then the branch sites executed, as
+    (address, taken, not taken). Coverages are merged by OR'ing the bitmaps and adding the
+    counters, whether they come from the threads of a run or from files.
+
+    Listing : the linear decode of the image (see disassemble_buffer8080), every line marked
+        X executed, R / W a byte of the instruction read / written as data, and the
+        taken / not taken counts of the conditional branches
+*/
+
+
+#define COVERAGE_MAGIC "8080COV"
+#define COVERAGE_VERSION 1
+#define COVERAGE_THREADS 256
+
+// address of the data access, coverage_kind(op) & 7
+#define COVERAGE_HL 1
+#define COVERAGE_BC 2
+#define COVERAGE_DE 3
+// the address is bytes 2 and 3 of the instruction
+#define COVERAGE_DIRECT 4
+// SP before or after the instruction
+#define COVERAGE_STACK 5
+// flags
+#define COVERAGE_READ 0x08
+#define COVERAGE_WRITE 0x10
+// 2 bytes are accessed
+#define COVERAGE_WORD 0x20
+#define COVERAGE_BRANCH 0x40
+
+// the handlers are only specialized if the compiler inlines their common body
+#if defined(__GNUC__)
+#define COVERAGE_INLINE static inline __attribute__((always_inline))
+#else
+#define COVERAGE_INLINE static inline
+#endif
+
+typedef struct CoverageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t sites;
+    // runs merged in the file
+    uint64_t runs;
+} CoverageHeader;
+
+typedef struct CoverageSite {
+    uint32_t address;
+    uint32_t reserved;
+    uint64_t taken;
+    uint64_t not_taken;
+} CoverageSite;
+
+typedef struct Coverage8080 {
+    uint8_t executed[0x10000 / 8];
+    uint8_t read[0x10000 / 8];
+    uint8_t written[0x10000 / 8];
+    uint64_t taken[0x10000];
+    uint64_t not_taken[0x10000];
+    // SP after the previous instruction
+    uint16_t sp;
+    uint64_t runs;
+} Coverage8080;
+
+
+static inline void coverage_set(uint8_t *bitmap, uint16_t address)
+{
+    bitmap[address >> 3] |= (uint8_t)(1 << (address & 7));
+}
+
+static inline int coverage_test(const uint8_t *bitmap, uint16_t address)
+{
+    return bitmap[address >> 3] >> (address & 7) & 1;
+}
+
+static inline void coverage_set_word(uint8_t *bitmap, uint16_t address)
+{
+    coverage_set(bitmap, address);
+    coverage_set(bitmap, (uint16_t)(address + 1));
+}
+
+// Empty coverage, state is the machine about to run (NULL if there is none)
+Coverage8080 *coverage_create(const State8080 *state)
+{
+    Coverage8080 *coverage = calloc(1, sizeof(Coverage8080));
+
+    if (coverage == NULL) {
+        printf("Error : couldn't allocate the coverage\n");
+        exit(1);
+    }
+    if (state != NULL)
+        coverage->sp = state->sp;
+    return coverage;
+}
+
+void coverage_destroy(Coverage8080 *coverage)
+{
+    free(coverage);
+}
+
+// Follow a new machine, state
+void coverage_attach(Coverage8080 *coverage, const State8080 *state)
+{
+    coverage->sp = state->sp;
+    coverage->runs++;
+}
+
+/*
+    Data access of op (COVERAGE_HL ... | flags, 0 for none). A function of the opcode only,
+    so it is folded into every handler below.
+*/
+COVERAGE_INLINE uint8_t coverage_kind(uint8_t op)
+{
+    // MOV r, M, ALU M
+    if (op >= 0x40 && op < 0xC0 && (op & 0x07) == 0x06 && op != 0x76)
+        return COVERAGE_HL | COVERAGE_READ;
+    // MOV M, r, MVI M
+    if (((op & 0xF8) == 0x70 && op != 0x76) || op == 0x36)
+        return COVERAGE_HL | COVERAGE_WRITE;
+    switch (op) {
+        // INR M, DCR M
+        case 0x34: case 0x35: return COVERAGE_HL | COVERAGE_READ | COVERAGE_WRITE;
+        case 0x0A: return COVERAGE_BC | COVERAGE_READ;
+        case 0x02: return COVERAGE_BC | COVERAGE_WRITE;
+        case 0x1A: return COVERAGE_DE | COVERAGE_READ;
+        case 0x12: return COVERAGE_DE | COVERAGE_WRITE;
+        case 0x3A: return COVERAGE_DIRECT | COVERAGE_READ;
+        case 0x32: return COVERAGE_DIRECT | COVERAGE_WRITE;
+        case 0x2A: return COVERAGE_DIRECT | COVERAGE_READ | COVERAGE_WORD;
+        case 0x22: return COVERAGE_DIRECT | COVERAGE_WRITE | COVERAGE_WORD;
+        // XTHL
+        case 0xE3: return COVERAGE_STACK | COVERAGE_READ | COVERAGE_WRITE | COVERAGE_WORD;
+        default: break;
+    }
+    // Rccc, Cccc
+    if ((op & 0xC7) == 0xC0 || (op & 0xC7) == 0xC4)
+        return COVERAGE_STACK | COVERAGE_WORD | COVERAGE_BRANCH;
+    // Jccc
+    if ((op & 0xC7) == 0xC2)
+        return COVERAGE_BRANCH;
+    // POP, PUSH, RET, CALL (and their aliases), RST
+    if ((op & 0xCF) == 0xC1 || (op & 0xCF) == 0xC5 || op == 0xC9 || op == 0xD9 || (op & 0xCF) == 0xCD || (op & 0xC7) == 0xC7)
+        return COVERAGE_STACK | COVERAGE_WORD;
+    return 0;
+}
+
+/*
+    Execute op (PC is past the opcode, pc is its address) and mark its accesses. op is a
+    constant in every handler, the tests on its kind are resolved at compile time.
+*/
+COVERAGE_INLINE int coverage_execute_op(Coverage8080 *coverage, State8080 *state, uint16_t pc, uint8_t op)
+{
+    uint8_t kind = coverage_kind(op);
+    uint16_t sp = state->sp;
+    uint16_t address = sp;
+    int states;
+
+    if (kind == 0)
+        return handlers8080[op](state);
+    switch (kind & 7) {
+        case COVERAGE_HL: address = state->hl; break;
+        case COVERAGE_BC: address = state->bc; break;
+        case COVERAGE_DE: address = state->de; break;
+        case COVERAGE_DIRECT: address = read_word8080(state, (uint16_t)(pc + 1)); break;
+        default: break;
+    }
+    states = handlers8080[op](state);
+
+    if (kind & COVERAGE_BRANCH) {
+        // a call or a return taken moves SP, a jump taken leaves the next instruction
+        int taken = (kind & 7) == COVERAGE_STACK ? state->sp != sp
+            : state->pc != (uint16_t)(pc + 3) || condition8080(state, op >> 3 & 7);
+
+        if (taken)
+            coverage->taken[pc]++;
+        else
+            coverage->not_taken[pc]++;
+    }
+    if ((kind & 7) == COVERAGE_STACK) {
+        if (state->sp == (uint16_t)(sp - 2))
+            coverage_set_word(coverage->written, state->sp);
+        else if (state->sp == (uint16_t)(sp + 2))
+            coverage_set_word(coverage->read, sp);
+    }
+    if (kind & COVERAGE_READ) {
+        coverage_set(coverage->read, address);
+        if (kind & COVERAGE_WORD)
+            coverage_set(coverage->read, (uint16_t)(address + 1));
+    }
+    if (kind & COVERAGE_WRITE) {
+        coverage_set(coverage->written, address);
+        if (kind & COVERAGE_WORD)
+            coverage_set(coverage->written, (uint16_t)(address + 1));
+    }
+    return states;
+}
+
+typedef int (*CoverageHandler)(Coverage8080 *coverage, State8080 *state, uint16_t pc);
+
+#define COVERAGE_HANDLER(op) \
+    static int coverage_op_##op(Coverage8080 *coverage, State8080 *state, uint16_t pc) \
+    { \
+        return coverage_execute_op(coverage, state, pc, 0x##op); \
+    }
+
+#define COVERAGE_ROW(high) \
+    COVERAGE_HANDLER(high##0) COVERAGE_HANDLER(high##1) COVERAGE_HANDLER(high##2) COVERAGE_HANDLER(high##3) \
+    COVERAGE_HANDLER(high##4) COVERAGE_HANDLER(high##5) COVERAGE_HANDLER(high##6) COVERAGE_HANDLER(high##7) \
+    COVERAGE_HANDLER(high##8) COVERAGE_HANDLER(high##9) COVERAGE_HANDLER(high##A) COVERAGE_HANDLER(high##B) \
+    COVERAGE_HANDLER(high##C) COVERAGE_HANDLER(high##D) COVERAGE_HANDLER(high##E) COVERAGE_HANDLER(high##F)
+
+COVERAGE_ROW(0) COVERAGE_ROW(1) COVERAGE_ROW(2) COVERAGE_ROW(3)
+COVERAGE_ROW(4) COVERAGE_ROW(5) COVERAGE_ROW(6) COVERAGE_ROW(7)
+COVERAGE_ROW(8) COVERAGE_ROW(9) COVERAGE_ROW(A) COVERAGE_ROW(B)
+COVERAGE_ROW(C) COVERAGE_ROW(D) COVERAGE_ROW(E) COVERAGE_ROW(F)
+
+#define COVERAGE_ENTRIES(high) \
+    coverage_op_##high##0, coverage_op_##high##1, coverage_op_##high##2, coverage_op_##high##3, \
+    coverage_op_##high##4, coverage_op_##high##5, coverage_op_##high##6, coverage_op_##high##7, \
+    coverage_op_##high##8, coverage_op_##high##9, coverage_op_##high##A, coverage_op_##high##B, \
+    coverage_op_##high##C, coverage_op_##high##D, coverage_op_##high##E, coverage_op_##high##F
+
+static const CoverageHandler coverage_handlers[256] = {
+    COVERAGE_ENTRIES(0), COVERAGE_ENTRIES(1), COVERAGE_ENTRIES(2), COVERAGE_ENTRIES(3),
+    COVERAGE_ENTRIES(4), COVERAGE_ENTRIES(5), COVERAGE_ENTRIES(6), COVERAGE_ENTRIES(7),
+    COVERAGE_ENTRIES(8), COVERAGE_ENTRIES(9), COVERAGE_ENTRIES(A), COVERAGE_ENTRIES(B),
+    COVERAGE_ENTRIES(C), COVERAGE_ENTRIES(D), COVERAGE_ENTRIES(E), COVERAGE_ENTRIES(F)
+};
+
+#undef COVERAGE_HANDLER
+#undef COVERAGE_ROW
+#undef COVERAGE_ENTRIES
+
+// The stack moved since the last instruction : an interrupt pushed PC
+static inline void coverage_interrupt(Coverage8080 *coverage, const State8080 *state)
+{
+    if (state->sp == (uint16_t)(coverage->sp - 2))
+        coverage_set_word(coverage->written, state->sp);
+    coverage->sp = state->sp;
+}
+
+// Execute one instruction of state, returns the number of states used
+static inline int coverage_step(Coverage8080 *coverage, State8080 *state)
+{
+    uint16_t pc = state->pc;
+    int states;
+
+    if (state->sp != coverage->sp)
+        coverage_interrupt(coverage, state);
+    if (state->halted)
+        return emulate8080(state);
+    coverage_set(coverage->executed, pc);
+    state->pc = (uint16_t)(pc + 1);
+    states = coverage_handlers[memory_read(state->memory, pc)](coverage, state, pc);
+    state->cycles += states;
+    coverage->sp = state->sp;
+    return states;
+}
+
+/*
+    coverage_step until state has used cycles states or halts with the interrupts disabled.
+    Nothing can interrupt the machine inside the loop, SP is only compared on entry.
+*/
+void coverage_execute(Coverage8080 *coverage, State8080 *state, uint64_t cycles)
+{
+    uint8_t *executed = coverage->executed;
+
+    if (state->sp != coverage->sp)
+        coverage_interrupt(coverage, state);
+    while (state->cycles < cycles && !(state->halted && !state->int_enable)) {
+        uint16_t pc = state->pc;
+
+        if (state->halted) {
+            emulate8080(state);
+            continue;
+        }
+        coverage_set(executed, pc);
+        state->pc = (uint16_t)(pc + 1);
+        state->cycles += coverage_handlers[memory_read(state->memory, pc)](coverage, state, pc);
+    }
+    coverage->sp = state->sp;
+}
+
+// Add the coverage of source to coverage
+void coverage_merge(Coverage8080 *coverage, const Coverage8080 *source)
+{
+    for (int i = 0; i < 0x10000 / 8; i++) {
+        coverage->executed[i] |= source->executed[i];
+        coverage->read[i] |= source->read[i];
+        coverage->written[i] |= source->written[i];
+    }
+    for (int i = 0; i < 0x10000; i++) {
+        coverage->taken[i] += source->taken[i];
+        coverage->not_taken[i] += source->not_taken[i];
+    }
+    coverage->runs += source->runs;
+}
+
+
+// Returns 0 if the file can't be written
+int coverage_save(const Coverage8080 *coverage, const char *path)
+{
+    CoverageHeader header;
+    FILE *f = fopen(path, "wb");
+    int ok;
+
+    if (f == NULL)
+        return 0;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, COVERAGE_MAGIC, sizeof(header.magic));
+    header.version = COVERAGE_VERSION;
+    header.runs = coverage->runs;
+    for (int i = 0; i < 0x10000; i++)
+        header.sites += coverage->taken[i] != 0 || coverage->not_taken[i] != 0;
+    ok = fwrite(&header, sizeof(header), 1, f) == 1
+        && fwrite(coverage->executed, sizeof(coverage->executed), 1, f) == 1
+        && fwrite(coverage->read, sizeof(coverage->read), 1, f) == 1
+        && fwrite(coverage->written, sizeof(coverage->written), 1, f) == 1;
+    for (int i = 0; ok && i < 0x10000; i++) {
+        CoverageSite site = {(uint32_t)i, 0, coverage->taken[i], coverage->not_taken[i]};
+
+        if (site.taken != 0 || site.not_taken != 0)
+            ok = fwrite(&site, sizeof(site), 1, f) == 1;
+    }
+    return fclose(f) == 0 && ok;
+}
+
+// Merge the coverage file at path into coverage, returns 0 if it isn't a valid coverage file
+int coverage_load(Coverage8080 *coverage, const char *path)
+{
+    static Coverage8080 file;
+    CoverageHeader header;
+    FILE *f = fopen(path, "rb");
+    int ok;
+
+    if (f == NULL) {
+        printf("Error : couldn't open the coverage %s\n", path);
+        return 0;
+    }
+    memset(&file, 0, sizeof(file));
+    ok = fread(&header, sizeof(header), 1, f) == 1 && memcmp(header.magic, COVERAGE_MAGIC, sizeof(header.magic)) == 0
+        && header.version == COVERAGE_VERSION && header.sites <= 0x10000
+        && fread(file.executed, sizeof(file.executed), 1, f) == 1
+        && fread(file.read, sizeof(file.read), 1, f) == 1
+        && fread(file.written, sizeof(file.written), 1, f) == 1;
+    for (uint32_t i = 0; ok && i < header.sites; i++) {
+        CoverageSite site;
+
+        ok = fread(&site, sizeof(site), 1, f) == 1 && site.address <= 0xFFFF;
+        if (ok) {
+            file.taken[site.address] += site.taken;
+            file.not_taken[site.address] += site.not_taken;
+        }
+    }
+    fclose(f);
+    if (!ok) {
+        printf("Error : %s isn't a coverage file\n", path);
+        return 0;
+    }
+    file.runs = header.runs;
+    coverage_merge(coverage, &file);
+    return 1;
+}
+
+
+// Executed addresses, bytes read and written, branch sites taken both ways / one way
+void coverage_print(const Coverage8080 *coverage, FILE *out)
+{
+    int executed = 0, read = 0, written = 0, both = 0, one = 0;
+
+    for (int i = 0; i < 0x10000 / 8; i++) {
+        executed += __builtin_popcount(coverage->executed[i]);
+        read += __builtin_popcount(coverage->read[i]);
+        written += __builtin_popcount(coverage->written[i]);
+    }
+    for (int i = 0; i < 0x10000; i++) {
+        both += coverage->taken[i] != 0 && coverage->not_taken[i] != 0;
+        one += (coverage->taken[i] != 0) != (coverage->not_taken[i] != 0);
+    }
+    fprintf(out, "; %llu runs : %d instructions executed, %d bytes read, %d bytes written, %d branches taken both ways, %d one way\n",
+        (unsigned long long)coverage->runs, executed, read, written, both, one);
+}
+
+/*
+    Listing of size bytes of code (followed by 2 readable bytes) loaded at 0, marked with
+    the coverage
+*/
+void coverage_list(const Coverage8080 *coverage, const unsigned char *code, int size, FILE *out)
+{
+    int pc = 0, listed = 0, covered = 0;
+
+    coverage_print(coverage, out);
+    while (pc < size) {
+        int length = length8080[code[pc]];
+        int read = 0, written = 0;
+        char counts[48] = "";
+
+        if (pc < 0x10000) {
+            for (int i = 0; i < length; i++) {
+                read |= coverage_test(coverage->read, (uint16_t)(pc + i));
+                written |= coverage_test(coverage->written, (uint16_t)(pc + i));
+            }
+            if (coverage_kind(code[pc]) & COVERAGE_BRANCH)
+                snprintf(counts, sizeof(counts), "%llu/%llu", (unsigned long long)coverage->taken[pc],
+                    (unsigned long long)coverage->not_taken[pc]);
+            covered += coverage_test(coverage->executed, (uint16_t)pc);
+        }
+        fprintf(out, "%c%c%c %-14s %04x\t", pc < 0x10000 && coverage_test(coverage->executed, (uint16_t)pc) ? 'X' : '-',
+            read ? 'R' : '-', written ? 'W' : '-', counts, pc);
+        fdisassemble8080(out, (unsigned char *)code, pc);
+        listed++;
+        pc += length;
+    }
+    fprintf(out, "; %d of %d instructions of the listing executed (%.1f%%)\n", covered, listed,
+        listed ? 100.0 * covered / listed : 0.0);
+}
+
+
+typedef struct CoverageWorker {
+    pthread_t thread;
+    Coverage8080 *coverage;
+    Memory8080 *memory;
+    const unsigned char *program;
+    int size;
+    uint64_t cycles;
+    // runs first, first + step, ... below runs
+    int first;
+    int step;
+    int runs;
+    uint64_t states;
+} CoverageWorker;
+
+static void *coverage_worker(void *argument)
+{
+    static const uint8_t zeros[0x10000];
+    CoverageWorker *worker = argument;
+
+    for (int run = worker->first; run < worker->runs; run += worker->step) {
+        State8080 state;
+
+        memory_load(worker->memory, 0, zeros, sizeof(zeros));
+        memory_load(worker->memory, 0, worker->program, worker->size);
+        init8080(&state, worker->memory);
+        // every run has its own input
+        state.port_in = fork_port_in;
+        state.user = (void *)(intptr_t)(run + 1);
+        coverage_attach(worker->coverage, &state);
+        coverage_execute(worker->coverage, &state, worker->cycles);
+        worker->states += state.cycles;
+    }
+    return NULL;
+}
+
+/*
+    -coverage : run program (loaded at 0, at most 64 KB) runs times on every processor, each
+    run for cycles states or until it halts with the interrupts disabled, IN returns a hash
+    of the run and of the cycle counter. Merges the coverages, prints the summary and saves
+    it to output if it isn't NULL.
+*/
+int coverage_run(const unsigned char *program, int size, uint64_t cycles, int runs, const char *output)
+{
+    CoverageWorker workers[COVERAGE_THREADS];
+    Coverage8080 *coverage = coverage_create(NULL);
+    int threads = (int)sysconf(_SC_NPROCESSORS_ONLN);
+    uint64_t states = 0;
+    struct timespec start, end;
+    double seconds;
+    int result = 0;
+
+    if (size > 0x10000) {
+        printf("Error : the program is %d bytes, at most 64 KB are expected\n", size);
+        coverage_destroy(coverage);
+        return 1;
+    }
+    if (runs < 1)
+        runs = 1;
+    if (threads < 1)
+        threads = 1;
+    if (threads > COVERAGE_THREADS)
+        threads = COVERAGE_THREADS;
+    if (threads > runs)
+        threads = runs;
+
+    timespec_get(&start, TIME_UTC);
+    for (int i = 0; i < threads; i++) {
+        CoverageWorker *worker = &workers[i];
+
+        memset(worker, 0, sizeof(*worker));
+        worker->coverage = coverage_create(NULL);
+        worker->memory = memory_create();
+        worker->program = program;
+        worker->size = size;
+        worker->cycles = cycles;
+        worker->first = i;
+        worker->step = threads;
+        worker->runs = runs;
+        if (pthread_create(&worker->thread, NULL, coverage_worker, worker) != 0) {
+            printf("Error : couldn't start %d threads\n", threads);
+            exit(1);
+        }
+    }
+    for (int i = 0; i < threads; i++) {
+        pthread_join(workers[i].thread, NULL);
+        coverage_merge(coverage, workers[i].coverage);
+        states += workers[i].states;
+        coverage_destroy(workers[i].coverage);
+        memory_destroy(workers[i].memory);
+    }
+    timespec_get(&end, TIME_UTC);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("%d runs, %llu states in %.3f s on %d threads\n", runs, (unsigned long long)states, seconds, threads);
+    coverage_print(coverage, stdout);
+    if (output != NULL && !coverage_save(coverage, output)) {
+        printf("Error : couldn't write the coverage %s\n", output);
+        result = 1;
+    }
+    coverage_destroy(coverage);
+    return result;
+}
+
+// -coverage-merge : merge the coverage files inputs into output
+int coverage_merge_files(const char *output, char **inputs, int count)
+{
+    Coverage8080 *coverage = coverage_create(NULL);
+    int result = 0;
+
+    for (int i = 0; i < count && result == 0; i++)
+        if (!coverage_load(coverage, inputs[i]))
+            result = 1;
+    if (result == 0) {
+        coverage_print(coverage, stdout);
+        if (!coverage_save(coverage, output)) {
+            printf("Error : couldn't write the coverage %s\n", output);
+            result = 1;
+        }
+    }
+    coverage_destroy(coverage);
+    return result;
+}
+
+// -coverage-list : listing of program marked with the merged coverage files inputs
+int coverage_list_files(const unsigned char *program, int size, char **inputs, int count)
+{
+    Coverage8080 *coverage = coverage_create(NULL);
+    int result = 0;
+
+    for (int i = 0; i < count && result == 0; i++)
+        if (!coverage_load(coverage, inputs[i]))
+            result = 1;
+    if (result == 0)
+        coverage_list(coverage, program, size, stdout);
+    coverage_destroy(coverage);
+    return result;
+}
+
+#endif
@@ -0,0 +1,157 @@
+#ifndef EMULATOR_CPM_C
+#define EMULATOR_CPM_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.c"
+
+/*
+    Minimal CP/M environment, enough for the exercisers (TST8080, CPUTEST, 8080PRE, 8080EXM)
+
+    Memory :
+        0x0000          : warm boot, the program returns to CP/M by jumping here, the run stops
+        0x0005          : JMP CPM_BDOS, the BDOS entry (0x0006 is the top of the memory)
+        0x0100          : the program (.COM file)
+        CPM_BDOS        : OUT CPM_PORT, RET
+
+    The BDOS calls end up in cpm_out through the OUT instruction, nothing is checked per
+    instruction. Functions :
+        C = 0 : system reset, the run stops
+        C = 2 : print the character in E
+        C = 9 : print the string at DE, terminated by '$'
+    The other functions are ignored.
+*/
+
+
+#define CPM_LOAD 0x0100
+#define CPM_BDOS 0xFE00
+#define CPM_PORT 0xFF
+
+typedef struct Cpm8080 {
+    State8080 cpu;
+    // set once the program returns to CP/M
+    int done;
+    // 0 to only count the output
+    int echo;
+    uint64_t characters;
+    uint64_t instructions;
+} Cpm8080;
+
+
+static void cpm_print(Cpm8080 *cpm, uint8_t character)
+{
+    cpm->characters++;
+    if (cpm->echo)
+        putchar(character);
+}
+
+static void cpm_out(State8080 *state, uint8_t port, uint8_t value)
+{
+    Cpm8080 *cpm = (Cpm8080 *)state->user;
+
+    (void)value;
+    if (port != CPM_PORT)
+        return;
+    switch (state->c) {
+        case 0:
+            cpm->done = 1;
+            break;
+        case 2:
+            cpm_print(cpm, state->e);
+            break;
+        case 9: {
+            uint16_t address = (uint16_t)(state->d << 8 | state->e);
+            uint32_t length = 0;
+
+            for (; length < 0x10000 && memory_read(state->memory, address) != '$'; length++, address++)
+                cpm_print(cpm, memory_read(state->memory, address));
+            if (length == 0x10000) {
+                // the program is stopped, cpm_benchmark reports it didn't return to CP/M
+                printf("\nError : the string at %04x has no '$'\n", address);
+                state->halted = 1;
+            }
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+// Returns 0 if the program doesn't fit below the BDOS
+int cpm_init(Cpm8080 *cpm, const uint8_t *program, int size)
+{
+    static const uint8_t bdos[] = {0xD3, CPM_PORT, 0xC9};
+    const uint8_t vectors[] = {0x76, 0, 0, 0, 0, 0xC3, CPM_BDOS & 0xff, CPM_BDOS >> 8};
+
+    if (size > CPM_BDOS - CPM_LOAD) {
+        printf("Error : the program is %d bytes, at most %d bytes are expected\n", size, CPM_BDOS - CPM_LOAD);
+        return 0;
+    }
+    memset(cpm, 0, sizeof(*cpm));
+    init8080(&cpm->cpu, memory_create());
+    memory_load(cpm->cpu.memory, 0, vectors, sizeof(vectors));
+    memory_load(cpm->cpu.memory, CPM_BDOS, bdos, sizeof(bdos));
+    memory_load(cpm->cpu.memory, CPM_LOAD, program, size);
+    cpm->cpu.pc = CPM_LOAD;
+    cpm->cpu.sp = CPM_BDOS;
+    cpm->cpu.port_out = cpm_out;
+    cpm->cpu.user = cpm;
+    cpm->echo = 1;
+    return 1;
+}
+
+void cpm_free(Cpm8080 *cpm)
+{
+    memory_destroy(cpm->cpu.memory);
+    cpm->cpu.memory = NULL;
+}
+
+// Run until the program returns to CP/M or halts
+void cpm_run(Cpm8080 *cpm)
+{
+    State8080 *cpu = &cpm->cpu;
+    uint64_t instructions = 0;
+
+    // the warm boot vector is a HLT
+    while (!cpm->done && !cpu->halted) {
+        emulate8080(cpu);
+        instructions++;
+    }
+    if (cpu->halted && cpu->pc == 1)
+        cpm->done = 1;
+    cpm->instructions += instructions;
+}
+
+
+/*
+    Run a CP/M program and report the emulated MIPS, the wall time and the time the
+    program takes on a 2 MHz 8080
+*/
+int cpm_benchmark(const uint8_t *program, int size, int echo)
+{
+    static Cpm8080 cpm;
+    struct timespec start, end;
+    double seconds;
+
+    if (!cpm_init(&cpm, program, size))
+        return 1;
+    cpm.echo = echo;
+
+    timespec_get(&start, TIME_UTC);
+    cpm_run(&cpm);
+    timespec_get(&end, TIME_UTC);
+    seconds = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+
+    printf("\n%llu instructions, %llu states in %.3f s : %.2f MIPS (%.1f s on a 2 MHz 8080)\n",
+        (unsigned long long)cpm.instructions, (unsigned long long)cpm.cpu.cycles, seconds,
+        seconds > 0 ? cpm.instructions / seconds / 1e6 : 0.0, cpm.cpu.cycles / 2e6);
+    if (!cpm.done)
+        printf("Error : the program stopped at %04x without returning to CP/M\n", cpm.cpu.pc);
+    cpm_free(&cpm);
+    return !cpm.done;
+}
+
+#endif
@@ -0,0 +1,749 @@
+#ifndef EMULATOR_DEBUG_C
+#define EMULATOR_DEBUG_C
+
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emulator.c"
+#include "../Disassembler/disassembler.c"
+
+/*
+    Debugger : breakpoints and watchpoints
+
+    Nothing is checked per instruction unless it is needed, debug_update picks the step
+    function for what is set :
+        - nothing                   : emulate8080, debug_run is the plain interpreter loop
+        - breakpoints               : one bit test of the breakpoint bitmap per instruction
+        - read watchpoints          : the data addresses read by the instruction are decoded
+                                      (debug_access) and tested against the watched pages
+    The write watchpoints cost nothing per instruction : their pages are flagged MEMORY_WATCH
+    so the writes to them leave the fast path of memory_write and call debug_watch.
+
+    A breakpoint can have a condition, compiled once into a tree of nodes whose eval
+    functions are specialized at compile time (register, constant, comparison with a
+    constant, ...). Syntax :
+        registers   A B C D E H L BC DE HL SP PC, flags Z S P CY AC (0 or 1)
+        numbers     10, 0x1f, $1f
+        memory      [expression] is the byte at the address
+        operators   + - & | ^   == != < <= > >=   && ||   ! ( )
+    Example : "A == 0x10 && [HL] != 0"
+*/
+
+
+#define DEBUG_BREAKPOINTS 64
+#define DEBUG_WATCHPOINTS 16
+#define DEBUG_NODES 64
+
+// watchpoint kinds
+#define DEBUG_READ 1
+#define DEBUG_WRITE 2
+
+// reasons of a stop
+#define DEBUG_NONE 0
+#define DEBUG_BREAK 1
+#define DEBUG_WATCH_READ 2
+#define DEBUG_WATCH_WRITE 3
+
+typedef struct DebugNode DebugNode;
+typedef unsigned (*DebugEval)(const DebugNode *node, const State8080 *state);
+
+struct DebugNode {
+    DebugEval eval;
+    const DebugNode *lhs;
+    const DebugNode *rhs;
+    unsigned value;
+};
+
+typedef struct DebugCondition {
+    DebugNode nodes[DEBUG_NODES];
+    int count;
+    const DebugNode *root;
+} DebugCondition;
+
+typedef struct DebugBreakpoint {
+    uint16_t address;
+    // NULL for an unconditional breakpoint
+    DebugCondition *condition;
+    uint64_t hits;
+} DebugBreakpoint;
+
+typedef struct DebugWatchpoint {
+    uint16_t start;
+    uint16_t end;
+    int kind;
+    uint64_t hits;
+} DebugWatchpoint;
+
+typedef struct Debug8080 Debug8080;
+typedef int (*DebugStep)(Debug8080 *debug, State8080 *state);
+
+struct Debug8080 {
+    DebugBreakpoint breakpoints[DEBUG_BREAKPOINTS];
+    int breakpoint_count;
+    // one bit per address holding a breakpoint
+    uint8_t break_map[0x10000 / 8];
+    DebugWatchpoint watchpoints[DEBUG_WATCHPOINTS];
+    int watchpoint_count;
+    int read_watches;
+    int write_watches;
+    // pages holding a read watchpoint
+    uint8_t read_pages[MEMORY_PAGE_COUNT];
+    DebugStep step;
+    Memory8080 *memory;
+    // why and where the last run stopped
+    int stop;
+    uint16_t stop_address;
+    // end of the current run, set to 0 to stop it : the stop costs no test of its own
+    uint64_t limit;
+};
+
+
+/*
+    Condition compiler
+*/
+typedef struct DebugParser {
+    const char *text;
+    DebugCondition *condition;
+    int error;
+} DebugParser;
+
+static unsigned debug_eval_const(const DebugNode *node, const State8080 *state) { (void)state; return node->value; }
+static unsigned debug_eval_a(const DebugNode *node, const State8080 *state) { (void)node; return state->a; }
+static unsigned debug_eval_b(const DebugNode *node, const State8080 *state) { (void)node; return state->b; }
+static unsigned debug_eval_c(const DebugNode *node, const State8080 *state) { (void)node; return state->c; }
+static unsigned debug_eval_d(const DebugNode *node, const State8080 *state) { (void)node; return state->d; }
+static unsigned debug_eval_e(const DebugNode *node, const State8080 *state) { (void)node; return state->e; }
+static unsigned debug_eval_h(const DebugNode *node, const State8080 *state) { (void)node; return state->h; }
+static unsigned debug_eval_l(const DebugNode *node, const State8080 *state) { (void)node; return state->l; }
+static unsigned debug_eval_bc(const DebugNode *node, const State8080 *state) { (void)node; return state->b << 8 | state->c; }
+static unsigned debug_eval_de(const DebugNode *node, const State8080 *state) { (void)node; return state->d << 8 | state->e; }
+static unsigned debug_eval_hl(const DebugNode *node, const State8080 *state) { (void)node; return state->hl; }
+static unsigned debug_eval_sp(const DebugNode *node, const State8080 *state) { (void)node; return state->sp; }
+static unsigned debug_eval_pc(const DebugNode *node, const State8080 *state) { (void)node; return state->pc; }
+static unsigned debug_eval_z(const DebugNode *node, const State8080 *state) { (void)node; return state->cc.z; }
+static unsigned debug_eval_s(const DebugNode *node, const State8080 *state) { (void)node; return state->cc.s; }
+static unsigned debug_eval_p(const DebugNode *node, const State8080 *state) { (void)node; return state->cc.p; }
+static unsigned debug_eval_cy(const DebugNode *node, const State8080 *state) { (void)node; return state->cc.cy; }
+static unsigned debug_eval_ac(const DebugNode *node, const State8080 *state) { (void)node; return state->cc.ac; }
+
+static unsigned debug_eval_memory(const DebugNode *node, const State8080 *state)
+{
+    return memory_read(state->memory, (uint16_t)node->lhs->eval(node->lhs, state));
+}
+
+// [HL], the most common memory operand, without evaluating a child
+static unsigned debug_eval_memory_hl(const DebugNode *node, const State8080 *state)
+{
+    (void)node;
+    return memory_read(state->memory, state->hl);
+}
+
+static unsigned debug_eval_memory_const(const DebugNode *node, const State8080 *state)
+{
+    return memory_read(state->memory, (uint16_t)node->value);
+}
+
+#define DEBUG_BINARY(name, operator) \
+    static unsigned debug_eval_##name(const DebugNode *node, const State8080 *state) \
+    { \
+        return node->lhs->eval(node->lhs, state) operator node->rhs->eval(node->rhs, state); \
+    } \
+    static unsigned debug_eval_##name##_const(const DebugNode *node, const State8080 *state) \
+    { \
+        return node->lhs->eval(node->lhs, state) operator node->value; \
+    }
+
+DEBUG_BINARY(add, +)
+DEBUG_BINARY(sub, -)
+DEBUG_BINARY(and, &)
+DEBUG_BINARY(or, |)
+DEBUG_BINARY(xor, ^)
+DEBUG_BINARY(eq, ==)
+DEBUG_BINARY(ne, !=)
+DEBUG_BINARY(lt, <)
+DEBUG_BINARY(le, <=)
+DEBUG_BINARY(gt, >)
+DEBUG_BINARY(ge, >=)
+
+static unsigned debug_eval_land(const DebugNode *node, const State8080 *state)
+{
+    return node->lhs->eval(node->lhs, state) && node->rhs->eval(node->rhs, state);
+}
+
+static unsigned debug_eval_lor(const DebugNode *node, const State8080 *state)
+{
+    return node->lhs->eval(node->lhs, state) || node->rhs->eval(node->rhs, state);
+}
+
+static unsigned debug_eval_not(const DebugNode *node, const State8080 *state)
+{
+    return !node->lhs->eval(node->lhs, state);
+}
+
+static const struct {
+    const char *name;
+    DebugEval eval;
+} debug_registers[] = {
+    // the pairs and CY / AC before the single letters
+    {"BC", debug_eval_bc}, {"DE", debug_eval_de}, {"HL", debug_eval_hl}, {"SP", debug_eval_sp},
+    {"PC", debug_eval_pc}, {"CY", debug_eval_cy}, {"AC", debug_eval_ac},
+    {"A", debug_eval_a}, {"B", debug_eval_b}, {"C", debug_eval_c}, {"D", debug_eval_d},
+    {"E", debug_eval_e}, {"H", debug_eval_h}, {"L", debug_eval_l}, {"Z", debug_eval_z},
+    {"S", debug_eval_s}, {"P", debug_eval_p},
+};
+
+static DebugNode *debug_node(DebugParser *parser, DebugEval eval, const DebugNode *lhs, const DebugNode *rhs, unsigned value)
+{
+    DebugNode *node;
+
+    if (parser->condition->count == DEBUG_NODES) {
+        parser->error = 1;
+        return NULL;
+    }
+    node = &parser->condition->nodes[parser->condition->count++];
+    node->eval = eval;
+    node->lhs = lhs;
+    node->rhs = rhs;
+    node->value = value;
+    return node;
+}
+
+static void debug_skip(DebugParser *parser)
+{
+    while (isspace((unsigned char)*parser->text))
+        parser->text++;
+}
+
+static int debug_accept(DebugParser *parser, const char *token)
+{
+    size_t length = strlen(token);
+
+    debug_skip(parser);
+    if (strncmp(parser->text, token, length) != 0)
+        return 0;
+    parser->text += length;
+    return 1;
+}
+
+static const DebugNode *debug_parse_expression(DebugParser *parser);
+
+static const DebugNode *debug_parse_term(DebugParser *parser)
+{
+    const DebugNode *node;
+
+    debug_skip(parser);
+    if (parser->error)
+        return NULL;
+    if (debug_accept(parser, "!")) {
+        node = debug_parse_term(parser);
+        return node ? debug_node(parser, debug_eval_not, node, NULL, 0) : NULL;
+    }
+    if (debug_accept(parser, "(")) {
+        node = debug_parse_expression(parser);
+        if (!debug_accept(parser, ")"))
+            parser->error = 1;
+        return node;
+    }
+    if (debug_accept(parser, "[")) {
+        node = debug_parse_expression(parser);
+        if (!debug_accept(parser, "]") || node == NULL) {
+            parser->error = 1;
+            return NULL;
+        }
+        if (node->eval == debug_eval_const)
+            return debug_node(parser, debug_eval_memory_const, NULL, NULL, node->value);
+        if (node->eval == debug_eval_hl)
+            return debug_node(parser, debug_eval_memory_hl, NULL, NULL, 0);
+        return debug_node(parser, debug_eval_memory, node, NULL, 0);
+    }
+    if (isdigit((unsigned char)*parser->text) || *parser->text == '$') {
+        char *end;
+        unsigned long value = *parser->text == '$' ? strtoul(parser->text + 1, &end, 16) : strtoul(parser->text, &end, 0);
+
+        parser->text = end;
+        return debug_node(parser, debug_eval_const, NULL, NULL, (unsigned)value);
+    }
+    for (size_t i = 0; i < sizeof(debug_registers) / sizeof(debug_registers[0]); i++) {
+        const char *name = debug_registers[i].name;
+        size_t length = 0;
+
+        while (name[length] != '\0' && toupper((unsigned char)parser->text[length]) == name[length])
+            length++;
+        if (name[length] == '\0' && !isalnum((unsigned char)parser->text[length])) {
+            parser->text += length;
+            return debug_node(parser, debug_registers[i].eval, NULL, NULL, 0);
+        }
+    }
+    parser->error = 1;
+    return NULL;
+}
+
+// A binary operation, folded when both sides are constants, specialized when the right side is
+static const DebugNode *debug_binary(DebugParser *parser, DebugEval eval, DebugEval eval_const, const DebugNode *lhs, const DebugNode *rhs)
+{
+    if (lhs == NULL || rhs == NULL) {
+        parser->error = 1;
+        return NULL;
+    }
+    if (rhs->eval == debug_eval_const) {
+        if (lhs->eval == debug_eval_const) {
+            DebugNode folded = {eval_const, lhs, NULL, rhs->value};
+
+            return debug_node(parser, debug_eval_const, NULL, NULL, eval_const(&folded, NULL));
+        }
+        return debug_node(parser, eval_const, lhs, NULL, rhs->value);
+    }
+    return debug_node(parser, eval, lhs, rhs, 0);
+}
+
+static const DebugNode *debug_parse_sum(DebugParser *parser)
+{
+    const DebugNode *node = debug_parse_term(parser);
+
+    for (;;) {
+        debug_skip(parser);
+        // & and | but not && and ||
+        if (parser->text[0] == '&' && parser->text[1] != '&') {
+            parser->text++;
+            node = debug_binary(parser, debug_eval_and, debug_eval_and_const, node, debug_parse_term(parser));
+        } else if (parser->text[0] == '|' && parser->text[1] != '|') {
+            parser->text++;
+            node = debug_binary(parser, debug_eval_or, debug_eval_or_const, node, debug_parse_term(parser));
+        } else if (debug_accept(parser, "+")) {
+            node = debug_binary(parser, debug_eval_add, debug_eval_add_const, node, debug_parse_term(parser));
+        } else if (debug_accept(parser, "-")) {
+            node = debug_binary(parser, debug_eval_sub, debug_eval_sub_const, node, debug_parse_term(parser));
+        } else if (debug_accept(parser, "^")) {
+            node = debug_binary(parser, debug_eval_xor, debug_eval_xor_const, node, debug_parse_term(parser));
+        } else {
+            return node;
+        }
+    }
+}
+
+static const DebugNode *debug_parse_comparison(DebugParser *parser)
+{
+    const DebugNode *node = debug_parse_sum(parser);
+
+    if (debug_accept(parser, "=="))
+        return debug_binary(parser, debug_eval_eq, debug_eval_eq_const, node, debug_parse_sum(parser));
+    if (debug_accept(parser, "!="))
+        return debug_binary(parser, debug_eval_ne, debug_eval_ne_const, node, debug_parse_sum(parser));
+    if (debug_accept(parser, "<="))
+        return debug_binary(parser, debug_eval_le, debug_eval_le_const, node, debug_parse_sum(parser));
+    if (debug_accept(parser, ">="))
+        return debug_binary(parser, debug_eval_ge, debug_eval_ge_const, node, debug_parse_sum(parser));
+    if (debug_accept(parser, "<"))
+        return debug_binary(parser, debug_eval_lt, debug_eval_lt_const, node, debug_parse_sum(parser));
+    if (debug_accept(parser, ">"))
+        return debug_binary(parser, debug_eval_gt, debug_eval_gt_const, node, debug_parse_sum(parser));
+    return node;
+}
+
+static const DebugNode *debug_parse_and(DebugParser *parser)
+{
+    const DebugNode *node = debug_parse_comparison(parser);
+
+    while (debug_accept(parser, "&&")) {
+        const DebugNode *rhs = debug_parse_comparison(parser);
+
+        node = node && rhs ? debug_node(parser, debug_eval_land, node, rhs, 0) : NULL;
+    }
+    return node;
+}
+
+static const DebugNode *debug_parse_expression(DebugParser *parser)
+{
+    const DebugNode *node = debug_parse_and(parser);
+
+    while (debug_accept(parser, "||")) {
+        const DebugNode *rhs = debug_parse_and(parser);
+
+        node = node && rhs ? debug_node(parser, debug_eval_lor, node, rhs, 0) : NULL;
+    }
+    return node;
+}
+
+// Compile text, returns NULL (and prints the error) if it isn't a valid condition
+DebugCondition *debug_compile(const char *text)
+{
+    DebugCondition *condition = calloc(1, sizeof(DebugCondition));
+    DebugParser parser = {text, condition, 0};
+
+    if (condition == NULL) {
+        printf("Error : couldn't allocate a condition\n");
+        exit(1);
+    }
+    condition->root = debug_parse_expression(&parser);
+    debug_skip(&parser);
+    if (parser.error || condition->root == NULL || *parser.text != '\0') {
+        printf("Error : invalid condition \"%s\" at \"%s\"\n", text, parser.text);
+        free(condition);
+        return NULL;
+    }
+    return condition;
+}
+
+static inline int debug_condition_true(const DebugCondition *condition, const State8080 *state)
+{
+    return condition->root->eval(condition->root, state) != 0;
+}
+
+
+/*
+    Data addresses read by an instruction
+*/
+#define DEBUG_ACCESS_NONE 0
+#define DEBUG_ACCESS_HL 1
+#define DEBUG_ACCESS_BC 2
+#define DEBUG_ACCESS_DE 3
+#define DEBUG_ACCESS_ADDRESS 4
+#define DEBUG_ACCESS_ADDRESS_WORD 5
+#define DEBUG_ACCESS_STACK 6
+// Rcc : the stack is only read when the condition is true
+#define DEBUG_ACCESS_STACK_CONDITIONAL 7
+
+static uint8_t debug_access[256];
+
+static void debug_init_access(void)
+{
+    static const uint8_t hl[] = {
+        0x46, 0x4E, 0x56, 0x5E, 0x66, 0x6E, 0x7E, 0x86, 0x8E, 0x96, 0x9E, 0xA6, 0xAE, 0xB6, 0xBE, 0x34, 0x35
+    };
+    static const uint8_t stack[] = {0xC1, 0xD1, 0xE1, 0xF1, 0xC9, 0xD9, 0xE3};
+    static const uint8_t conditional[] = {0xC0, 0xC8, 0xD0, 0xD8, 0xE0, 0xE8, 0xF0, 0xF8};
+
+    for (size_t i = 0; i < sizeof(hl); i++)
+        debug_access[hl[i]] = DEBUG_ACCESS_HL;
+    for (size_t i = 0; i < sizeof(stack); i++)
+        debug_access[stack[i]] = DEBUG_ACCESS_STACK;
+    for (size_t i = 0; i < sizeof(conditional); i++)
+        debug_access[conditional[i]] = DEBUG_ACCESS_STACK_CONDITIONAL;
+    debug_access[0x0A] = DEBUG_ACCESS_BC;
+    debug_access[0x1A] = DEBUG_ACCESS_DE;
+    debug_access[0x3A] = DEBUG_ACCESS_ADDRESS;
+    debug_access[0x2A] = DEBUG_ACCESS_ADDRESS_WORD;
+}
+
+
+/*
+    Stepping
+*/
+static int debug_check_break(Debug8080 *debug, State8080 *state)
+{
+    for (int i = 0; i < debug->breakpoint_count; i++) {
+        DebugBreakpoint *breakpoint = &debug->breakpoints[i];
+
+        if (breakpoint->address == state->pc
+                && (breakpoint->condition == NULL || debug_condition_true(breakpoint->condition, state))) {
+            breakpoint->hits++;
+            debug->stop = DEBUG_BREAK;
+            debug->stop_address = state->pc;
+            debug->limit = 0;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int debug_step_break(Debug8080 *debug, State8080 *state)
+{
+    uint16_t pc = state->pc;
+
+    if ((debug->break_map[pc >> 3] >> (pc & 7)) & 1 && debug_check_break(debug, state))
+        return 0;
+    return emulate8080(state);
+}
+
+static void debug_check_read(Debug8080 *debug, uint16_t address, int size)
+{
+    for (int byte = 0; byte < size; byte++, address++) {
+        if (!debug->read_pages[address >> MEMORY_PAGE_SHIFT])
+            continue;
+        for (int i = 0; i < debug->watchpoint_count; i++) {
+            DebugWatchpoint *watchpoint = &debug->watchpoints[i];
+
+            if ((watchpoint->kind & DEBUG_READ) && address >= watchpoint->start && address <= watchpoint->end) {
+                watchpoint->hits++;
+                debug->stop = DEBUG_WATCH_READ;
+                debug->stop_address = address;
+                debug->limit = 0;
+                return;
+            }
+        }
+    }
+}
+
+// Breakpoints and read watchpoints, the reads are reported after the instruction
+static int debug_step_watch(Debug8080 *debug, State8080 *state)
+{
+    uint16_t pc = state->pc;
+    uint16_t sp = state->sp;
+    uint8_t op = memory_read(state->memory, pc);
+    uint16_t address = memory_read(state->memory, (uint16_t)(pc + 1)) | memory_read(state->memory, (uint16_t)(pc + 2)) << 8;
+    int states;
+
+    if ((debug->break_map[pc >> 3] >> (pc & 7)) & 1 && debug_check_break(debug, state))
+        return 0;
+    // the registers before the instruction, MOV H,M changes HL
+    switch (debug_access[op]) {
+        case DEBUG_ACCESS_HL: address = state->hl; break;
+        case DEBUG_ACCESS_BC: address = state->bc; break;
+        case DEBUG_ACCESS_DE: address = state->de; break;
+        default: break;
+    }
+    states = emulate8080(state);
+
+    switch (debug_access[op]) {
+        case DEBUG_ACCESS_HL:
+        case DEBUG_ACCESS_BC:
+        case DEBUG_ACCESS_DE:
+        case DEBUG_ACCESS_ADDRESS: debug_check_read(debug, address, 1); break;
+        case DEBUG_ACCESS_ADDRESS_WORD: debug_check_read(debug, address, 2); break;
+        case DEBUG_ACCESS_STACK: debug_check_read(debug, sp, 2); break;
+        case DEBUG_ACCESS_STACK_CONDITIONAL:
+            if (state->sp == (uint16_t)(sp + 2))
+                debug_check_read(debug, sp, 2);
+            break;
+        default: break;
+    }
+    return states;
+}
+
+static int debug_step_plain(Debug8080 *debug, State8080 *state)
+{
+    (void)debug;
+    return emulate8080(state);
+}
+
+// Called by memory_write_slow for the writes to the watched pages
+static void debug_watch(Memory8080 *memory, uint16_t address, uint8_t value)
+{
+    Debug8080 *debug = memory->watch_user;
+
+    (void)value;
+    for (int i = 0; i < debug->watchpoint_count; i++) {
+        DebugWatchpoint *watchpoint = &debug->watchpoints[i];
+
+        if ((watchpoint->kind & DEBUG_WRITE) && address >= watchpoint->start && address <= watchpoint->end) {
+            watchpoint->hits++;
+            debug->stop = DEBUG_WATCH_WRITE;
+            debug->stop_address = address;
+            debug->limit = 0;
+            return;
+        }
+    }
+}
+
+// Pick the step function and flag the watched pages for what is set
+static void debug_update(Debug8080 *debug)
+{
+    memset(debug->break_map, 0, sizeof(debug->break_map));
+    for (int i = 0; i < debug->breakpoint_count; i++)
+        debug->break_map[debug->breakpoints[i].address >> 3] |= 1 << (debug->breakpoints[i].address & 7);
+
+    memory_set_flags(debug->memory, 0, 0x10000, MEMORY_WATCH, 0);
+    memset(debug->read_pages, 0, sizeof(debug->read_pages));
+    debug->read_watches = debug->write_watches = 0;
+    for (int i = 0; i < debug->watchpoint_count; i++) {
+        DebugWatchpoint *watchpoint = &debug->watchpoints[i];
+        uint32_t size = watchpoint->end - watchpoint->start + 1;
+
+        if (watchpoint->kind & DEBUG_WRITE) {
+            memory_set_flags(debug->memory, watchpoint->start, size, MEMORY_WATCH, 1);
+            debug->write_watches++;
+        }
+        if (watchpoint->kind & DEBUG_READ) {
+            for (uint32_t page = watchpoint->start >> MEMORY_PAGE_SHIFT; page <= (uint32_t)watchpoint->end >> MEMORY_PAGE_SHIFT; page++)
+                debug->read_pages[page] = 1;
+            debug->read_watches++;
+        }
+    }
+
+    if (debug->read_watches > 0)
+        debug->step = debug_step_watch;
+    else if (debug->breakpoint_count > 0)
+        debug->step = debug_step_break;
+    else
+        debug->step = debug_step_plain;
+}
+
+
+void debug_init(Debug8080 *debug, State8080 *state)
+{
+    memset(debug, 0, sizeof(*debug));
+    debug_init_access();
+    debug->memory = state->memory;
+    debug->memory->watch = debug_watch;
+    debug->memory->watch_user = debug;
+    debug_update(debug);
+}
+
+// Remove every breakpoint and watchpoint
+void debug_free(Debug8080 *debug)
+{
+    for (int i = 0; i < debug->breakpoint_count; i++)
+        free(debug->breakpoints[i].condition);
+    debug->breakpoint_count = 0;
+    debug->watchpoint_count = 0;
+    debug_update(debug);
+    debug->memory->watch = NULL;
+    debug->memory->watch_user = NULL;
+}
+
+// condition can be NULL. Returns 0 if the condition is invalid or there are too many breakpoints
+int debug_break(Debug8080 *debug, uint16_t address, const char *condition)
+{
+    DebugCondition *compiled = NULL;
+
+    if (debug->breakpoint_count == DEBUG_BREAKPOINTS) {
+        printf("Error : at most %d breakpoints can be set\n", DEBUG_BREAKPOINTS);
+        return 0;
+    }
+    if (condition != NULL && (compiled = debug_compile(condition)) == NULL)
+        return 0;
+    debug->breakpoints[debug->breakpoint_count].address = address;
+    debug->breakpoints[debug->breakpoint_count].condition = compiled;
+    debug->breakpoints[debug->breakpoint_count].hits = 0;
+    debug->breakpoint_count++;
+    debug_update(debug);
+    return 1;
+}
+
+void debug_clear_break(Debug8080 *debug, uint16_t address)
+{
+    for (int i = 0; i < debug->breakpoint_count; i++) {
+        if (debug->breakpoints[i].address != address)
+            continue;
+        free(debug->breakpoints[i].condition);
+        debug->breakpoints[i--] = debug->breakpoints[--debug->breakpoint_count];
+    }
+    debug_update(debug);
+}
+
+// Watch start - end (included) for kind (DEBUG_READ, DEBUG_WRITE or both)
+int debug_watchpoint(Debug8080 *debug, uint16_t start, uint16_t end, int kind)
+{
+    if (debug->watchpoint_count == DEBUG_WATCHPOINTS) {
+        printf("Error : at most %d watchpoints can be set\n", DEBUG_WATCHPOINTS);
+        return 0;
+    }
+    if (end < start) {
+        uint16_t swap = start;
+
+        start = end;
+        end = swap;
+    }
+    debug->watchpoints[debug->watchpoint_count].start = start;
+    debug->watchpoints[debug->watchpoint_count].end = end;
+    debug->watchpoints[debug->watchpoint_count].kind = kind;
+    debug->watchpoints[debug->watchpoint_count].hits = 0;
+    debug->watchpoint_count++;
+    debug_update(debug);
+    return 1;
+}
+
+/*
+    Run until the cycle counter reaches cycles or a breakpoint / watchpoint is hit.
+    Returns the reason of the stop (DEBUG_NONE when cycles was reached). After a breakpoint,
+    state->pc is the address of the breakpoint, the instruction is not executed yet.
+*/
+int debug_run(Debug8080 *debug, State8080 *state, uint64_t cycles)
+{
+    DebugStep step = debug->step;
+
+    // don't stop again on the breakpoint the previous run stopped on
+    if (debug->stop == DEBUG_BREAK && state->pc == debug->stop_address && state->cycles < cycles)
+        emulate8080(state);
+    debug->stop = DEBUG_NONE;
+    debug->limit = cycles;
+
+    if (step == debug_step_plain) {
+        while (state->cycles < debug->limit)
+            emulate8080(state);
+    } else {
+        while (state->cycles < debug->limit)
+            step(debug, state);
+    }
+    return debug->stop;
+}
+
+void debug_print_state(const State8080 *state)
+{
+    unsigned char code[3];
+
+    for (int i = 0; i < 3; i++)
+        code[i] = memory_read(state->memory, (uint16_t)(state->pc + i));
+    printf("%12llu\t%04x\t%02x %02x%02x %02x%02x %02x%02x %04x %02x\t", (unsigned long long)state->cycles,
+        state->pc, state->a, state->b, state->c, state->d, state->e, state->h, state->l, state->sp, psw8080(state));
+    disassemble8080(code, 0);
+}
+
+
+/*
+    Run program (loaded at 0) for cycles states with the breakpoints / watchpoints of specs :
+        b:address[:condition]   breakpoint
+        r:start[-end]           read watchpoint
+        w:start[-end]           write watchpoint
+        rw:start[-end]          both
+    Every stop is printed, at most 20 of them
+*/
+int debug_run_program(const unsigned char *program, int size, uint64_t cycles, char **specs, int count)
+{
+    State8080 state;
+    Debug8080 *debug = malloc(sizeof(Debug8080));
+    static const char *reasons[] = {"", "breakpoint", "read", "write"};
+    int stops = 0, result = 0;
+
+    if (debug == NULL) {
+        printf("Error : couldn't allocate the debugger\n");
+        return 1;
+    }
+    init8080(&state, memory_create());
+    memory_load(state.memory, 0, program, size);
+    debug_init(debug, &state);
+
+    for (int i = 0; i < count && result == 0; i++) {
+        char *colon = strchr(specs[i], ':');
+        char *end;
+        unsigned long start, last;
+
+        if (colon == NULL) {
+            printf("Error : invalid breakpoint or watchpoint \"%s\"\n", specs[i]);
+            result = 1;
+            break;
+        }
+        start = strtoul(colon + 1, &end, 16);
+        last = *end == '-' ? strtoul(end + 1, &end, 16) : start;
+        if (strncmp(specs[i], "b:", 2) == 0)
+            result = !debug_break(debug, (uint16_t)start, *end == ':' ? end + 1 : NULL);
+        else if (strncmp(specs[i], "r:", 2) == 0)
+            result = !debug_watchpoint(debug, (uint16_t)start, (uint16_t)last, DEBUG_READ);
+        else if (strncmp(specs[i], "w:", 2) == 0)
+            result = !debug_watchpoint(debug, (uint16_t)start, (uint16_t)last, DEBUG_WRITE);
+        else if (strncmp(specs[i], "rw:", 3) == 0)
+            result = !debug_watchpoint(debug, (uint16_t)start, (uint16_t)last, DEBUG_READ | DEBUG_WRITE);
+        else {
+            printf("Error : invalid breakpoint or watchpoint \"%s\"\n", specs[i]);
+            result = 1;
+        }
+    }
+
+    while (result == 0 && debug_run(debug, &state, cycles) != DEBUG_NONE) {
+        if (stops++ < 20) {
+            printf("%s %04x\n", reasons[debug->stop], debug->stop_address);
+            debug_print_state(&state);
+        }
+    }
+    if (result == 0)
+        printf("%d stops in %llu states\n", stops, (unsigned long long)state.cycles);
+
+    debug_free(debug);
+    free(debug);
+    memory_destroy(state.memory);
+    return result;
+}
+
+#endif
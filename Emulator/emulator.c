@@ -0,0 +1,872 @@
+#ifndef EMULATOR_EMULATOR_C
+#define EMULATOR_EMULATOR_C
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "memory.c"
+
+/*
+    Scalar 8080 core
+
+    1. Fetch the opcode at (PC)
+    2. Execute it, updating the registers, the flags and the memory
+    3. Add the number of states used by the instruction to the cycle counter
+    4. Go to step 1
+
+    The register names, the DDD / SSS and RP encodings and the flags follow the
+    tables at the top of Disassembler/disassembler.c.
+    This core is the reference implementation : every other engine (lockstep, ...)
+    must produce exactly the same state for the same program.
+
+    CPU variant, chosen at compile time with -DCPU_8085 (the disassembler follows the
+    same macro) :
+        - 8080 (default)
+        - 8085 : RIM / SIM in place of the NOP aliases 0x20 / 0x30, the 8085 states,
+          ANA / ANI set AC. The undocumented 8085 opcodes keep their 8080 meaning.
+    The 8080 build has no test of the variant left at run time.
+*/
+
+#ifdef CPU_8085
+#define CPU_NAME "8085"
+#else
+#define CPU_NAME "8080"
+#endif
+
+
+typedef struct ConditionCodes {
+    uint8_t z;
+    uint8_t s;
+    uint8_t p;
+    uint8_t cy;
+    uint8_t ac;
+} ConditionCodes;
+
+typedef struct State8080 State8080;
+
+// I/O device callbacks, a NULL port_in reads 0 and a NULL port_out discards the value
+typedef uint8_t (*PortIn8080)(State8080 *state, uint8_t port);
+typedef void (*PortOut8080)(State8080 *state, uint8_t port, uint8_t value);
+
+/*
+    B-C, D-E and H-L are unions of the two 8 bits registers and the 16 bits pair (bc, de,
+    hl) : the pair instructions (LXI, INX, DAD, PUSH, ...) use the pair as one host word,
+    the other instructions the registers, nothing is split nor joined. The order of the
+    two halves follows the host byte order, checked by init8080.
+*/
+#if defined(__BYTE_ORDER__) && defined(__ORDER_BIG_ENDIAN__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define PAIR8080(high, low) union { struct { uint8_t high; uint8_t low; }; uint16_t high##low; }
+#elif defined(__BYTE_ORDER__) && defined(__ORDER_LITTLE_ENDIAN__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define PAIR8080(high, low) union { struct { uint8_t low; uint8_t high; }; uint16_t high##low; }
+#elif defined(_WIN32) || defined(__x86_64__) || defined(__i386__) || defined(__aarch64__)
+#define PAIR8080(high, low) union { struct { uint8_t low; uint8_t high; }; uint16_t high##low; }
+#else
+#error "unknown host byte order, define __BYTE_ORDER__"
+#endif
+
+struct State8080 {
+    uint8_t a;
+    PAIR8080(b, c);
+    PAIR8080(d, e);
+    PAIR8080(h, l);
+    uint16_t sp;
+    uint16_t pc;
+    ConditionCodes cc;
+    uint8_t int_enable;
+    uint8_t halted;
+    // total number of states executed
+    uint64_t cycles;
+    // 64 KB of addressable memory, see memory.c
+    Memory8080 *memory;
+    PortIn8080 port_in;
+    PortOut8080 port_out;
+    // free for the owner of the state (machine, lane index, ...)
+    void *user;
+    // input log being recorded or played, see replay.c
+    struct Replay8080 *replay;
+    // instruction trace being recorded, see trace.c
+    struct Trace8080 *trace;
+#ifdef CPU_8085
+    // interrupt masks set by SIM : bit 0 RST 5.5, bit 1 RST 6.5, bit 2 RST 7.5
+    uint8_t interrupt_mask;
+    // serial input line read by RIM (set by the board), serial output line written by SIM
+    uint8_t sid;
+    uint8_t sod;
+#endif
+};
+
+
+/*
+    Number of states used by each opcode, the conditional branches not taken.
+    The conditional jumps, calls and returns taken use JUMP_TAKEN8080, CALL_TAKEN8080 and
+    RETURN_TAKEN8080 more states.
+*/
+#ifdef CPU_8085
+#define JUMP_TAKEN8080 3
+#define CALL_TAKEN8080 9
+#define RETURN_TAKEN8080 6
+
+static const uint8_t cycles8080[256] = {
+//  0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+    4,  10, 7,  6,  4,  4,  7,  4,  4,  10, 7,  6,  4,  4,  7,  4,  // 0
+    4,  10, 7,  6,  4,  4,  7,  4,  4,  10, 7,  6,  4,  4,  7,  4,  // 1
+    4,  10, 16, 6,  4,  4,  7,  4,  4,  10, 16, 6,  4,  4,  7,  4,  // 2
+    4,  10, 13, 6,  10, 10, 10, 4,  4,  10, 13, 6,  4,  4,  7,  4,  // 3
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 4
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 5
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 6
+    7,  7,  7,  7,  7,  7,  5,  7,  4,  4,  4,  4,  4,  4,  7,  4,  // 7
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 8
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 9
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // A
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // B
+    6,  10, 7,  10, 9,  12, 7,  12, 6,  10, 7,  10, 9,  18, 7,  12, // C
+    6,  10, 7,  10, 9,  12, 7,  12, 6,  10, 7,  10, 9,  18, 7,  12, // D
+    6,  10, 7,  16, 9,  12, 7,  12, 6,  6,  7,  4,  9,  18, 7,  12, // E
+    6,  10, 7,  4,  9,  12, 7,  12, 6,  6,  7,  4,  9,  18, 7,  12  // F
+};
+#else
+#define JUMP_TAKEN8080 0
+#define CALL_TAKEN8080 6
+#define RETURN_TAKEN8080 6
+
+static const uint8_t cycles8080[256] = {
+//  0   1   2   3   4   5   6   7   8   9   A   B   C   D   E   F
+    4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7,  4,  // 0
+    4,  10, 7,  5,  5,  5,  7,  4,  4,  10, 7,  5,  5,  5,  7,  4,  // 1
+    4,  10, 16, 5,  5,  5,  7,  4,  4,  10, 16, 5,  5,  5,  7,  4,  // 2
+    4,  10, 13, 5,  10, 10, 10, 4,  4,  10, 13, 5,  5,  5,  7,  4,  // 3
+    5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,  // 4
+    5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,  // 5
+    5,  5,  5,  5,  5,  5,  7,  5,  5,  5,  5,  5,  5,  5,  7,  5,  // 6
+    7,  7,  7,  7,  7,  7,  7,  7,  5,  5,  5,  5,  5,  5,  7,  5,  // 7
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 8
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // 9
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // A
+    4,  4,  4,  4,  4,  4,  7,  4,  4,  4,  4,  4,  4,  4,  7,  4,  // B
+    5,  10, 10, 10, 11, 11, 7,  11, 5,  10, 10, 10, 11, 17, 7,  11, // C
+    5,  10, 10, 10, 11, 11, 7,  11, 5,  10, 10, 10, 11, 17, 7,  11, // D
+    5,  10, 10, 18, 11, 11, 7,  11, 5,  5,  10, 4,  11, 17, 7,  11, // E
+    5,  10, 10, 4,  11, 11, 7,  11, 5,  5,  10, 4,  11, 17, 7,  11  // F
+};
+#endif
+
+// 1 if the number of bits set is even
+static const uint8_t parity8080[256] = {
+#define P2(n) n, n ^ 1, n ^ 1, n
+#define P4(n) P2(n), P2(n ^ 1), P2(n ^ 1), P2(n)
+#define P6(n) P4(n), P4(n ^ 1), P4(n ^ 1), P4(n)
+    P6(1), P6(0), P6(0), P6(1)
+#undef P6
+#undef P4
+#undef P2
+};
+
+
+_Static_assert(sizeof(((State8080 *)0)->bc) == 2 && offsetof(State8080, sp) == 8, "the register pairs must be 16 bits words");
+
+void init8080(State8080 *state, Memory8080 *memory)
+{
+    memset(state, 0, sizeof(*state));
+    // the high-order register of the pair must be the high-order byte of the word
+    state->b = 1;
+    if (state->bc != 0x0100) {
+        printf("Error : the register pairs don't follow the byte order of the host\n");
+        exit(1);
+    }
+    state->b = 0;
+    state->memory = memory;
+}
+
+static inline uint8_t read8080(State8080 *state, uint16_t address)
+{
+    return memory_read(state->memory, address);
+}
+
+static inline void write8080(State8080 *state, uint16_t address, uint8_t value)
+{
+    memory_write(state->memory, address, value);
+}
+
+static inline uint16_t read_word8080(State8080 *state, uint16_t address)
+{
+    return read8080(state, address) | (read8080(state, (uint16_t)(address + 1)) << 8);
+}
+
+static inline void write_word8080(State8080 *state, uint16_t address, uint16_t value)
+{
+    write8080(state, address, value & 0xff);
+    write8080(state, (uint16_t)(address + 1), value >> 8);
+}
+
+static inline void push8080(State8080 *state, uint16_t value)
+{
+    state->sp -= 2;
+    write_word8080(state, state->sp, value);
+}
+
+static inline uint16_t pop8080(State8080 *state)
+{
+    uint16_t value = read_word8080(state, state->sp);
+    state->sp += 2;
+    return value;
+}
+
+// Processor Status Word : |S|Z|0|AC|0|P|1|CY|
+uint8_t psw8080(const State8080 *state)
+{
+    return (state->cc.s << 7) | (state->cc.z << 6) | (state->cc.ac << 4) | (state->cc.p << 2) | 0x02 | state->cc.cy;
+}
+
+void set_psw8080(State8080 *state, uint8_t psw)
+{
+    state->cc.s = (psw >> 7) & 1;
+    state->cc.z = (psw >> 6) & 1;
+    state->cc.ac = (psw >> 4) & 1;
+    state->cc.p = (psw >> 2) & 1;
+    state->cc.cy = psw & 1;
+}
+
+static inline void flags_zsp(State8080 *state, uint8_t value)
+{
+    state->cc.z = value == 0;
+    state->cc.s = value >> 7;
+    state->cc.p = parity8080[value];
+}
+
+/*
+    Arithmetic helpers, the subtraction is an addition of the complement :
+    AC is the carry out of bit 3 of that addition, CY is the inverted carry out of bit 7
+*/
+static inline uint8_t add8080(State8080 *state, uint8_t lhs, uint8_t rhs, uint8_t carry)
+{
+    uint16_t result = lhs + rhs + carry;
+    state->cc.cy = result >> 8;
+    state->cc.ac = ((lhs ^ rhs ^ result) >> 4) & 1;
+    flags_zsp(state, (uint8_t)result);
+    return (uint8_t)result;
+}
+
+static inline uint8_t sub8080(State8080 *state, uint8_t lhs, uint8_t rhs, uint8_t borrow)
+{
+    uint8_t result = add8080(state, lhs, ~rhs, !borrow);
+    state->cc.cy = !state->cc.cy;
+    return result;
+}
+
+static inline void and8080(State8080 *state, uint8_t value)
+{
+#ifdef CPU_8085
+    state->cc.ac = 1;
+#else
+    state->cc.ac = ((state->a | value) >> 3) & 1;
+#endif
+    state->a &= value;
+    state->cc.cy = 0;
+    flags_zsp(state, state->a);
+}
+
+static inline void xor8080(State8080 *state, uint8_t value)
+{
+    state->a ^= value;
+    state->cc.cy = 0;
+    state->cc.ac = 0;
+    flags_zsp(state, state->a);
+}
+
+static inline void or8080(State8080 *state, uint8_t value)
+{
+    state->a |= value;
+    state->cc.cy = 0;
+    state->cc.ac = 0;
+    flags_zsp(state, state->a);
+}
+
+static inline uint8_t inr8080(State8080 *state, uint8_t value)
+{
+    value++;
+    state->cc.ac = (value & 0x0f) == 0;
+    flags_zsp(state, value);
+    return value;
+}
+
+static inline uint8_t dcr8080(State8080 *state, uint8_t value)
+{
+    value--;
+    state->cc.ac = (value & 0x0f) != 0x0f;
+    flags_zsp(state, value);
+    return value;
+}
+
+static inline void daa8080(State8080 *state)
+{
+    uint8_t carry = state->cc.cy;
+    uint8_t correction = 0;
+    uint8_t lsb = state->a & 0x0f;
+    uint8_t msb = state->a >> 4;
+
+    if (state->cc.ac || lsb > 9)
+        correction += 0x06;
+    if (state->cc.cy || msb > 9 || (msb >= 9 && lsb > 9)) {
+        correction += 0x60;
+        carry = 1;
+    }
+    state->a = add8080(state, state->a, correction, 0);
+    state->cc.cy = carry;
+}
+
+static inline void dad8080(State8080 *state, uint16_t value)
+{
+    uint32_t result = state->hl + value;
+    state->hl = (uint16_t)result;
+    state->cc.cy = (result >> 16) & 1;
+}
+
+// CCC condition field of the branch group (NZ, Z, NC, C, PO, PE, P, M)
+static inline int condition8080(const State8080 *state, uint8_t ccc)
+{
+    switch (ccc) {
+        case 0: return !state->cc.z;
+        case 1: return state->cc.z;
+        case 2: return !state->cc.cy;
+        case 3: return state->cc.cy;
+        case 4: return !state->cc.p;
+        case 5: return state->cc.p;
+        case 6: return !state->cc.s;
+        default: return state->cc.s;
+    }
+}
+
+/*
+    Push the PC and jump to the vector 8 * rst, as if the interrupting device had placed
+    a RST instruction on the data bus. Does nothing while interrupts are disabled.
+*/
+void interrupt8080(State8080 *state, int rst)
+{
+    if (!state->int_enable)
+        return;
+    state->int_enable = 0;
+    state->halted = 0;
+    push8080(state, state->pc);
+    state->pc = (uint16_t)(8 * rst);
+    state->cycles += 11;
+}
+
+/*
+    Opcode handlers
+
+    Every opcode has its own handler, entered with PC past the opcode byte and returning
+    the number of states used. The handlers of the families encoding a register in the
+    opcode are generated from one template per family, the field being a constant of the
+    template :
+        MOV r1, r2      01DDDSSS
+        ALU r           10AAASSS    (ADD ADC SUB SBB ANA XRA ORA CMP)
+        MVI r, d8       00DDD110
+        INR r / DCR r   00DDD100 / 00DDD101
+        LXI / INX / DCX / DAD / PUSH / POP / LDAX / STAX on RP
+        Jccc / Cccc / Rccc on CCC, RST on NNN
+    so the register access (GET8080_x / SET8080_x, 110 designates the memory location
+    (H)(L)) and the condition are resolved at compile time, no handler switches on a field.
+*/
+
+typedef int (*Handler8080)(State8080 *state);
+
+#define HL8080(state) (state)->hl
+
+#define GET8080_0(state) (state)->b
+#define GET8080_1(state) (state)->c
+#define GET8080_2(state) (state)->d
+#define GET8080_3(state) (state)->e
+#define GET8080_4(state) (state)->h
+#define GET8080_5(state) (state)->l
+#define GET8080_6(state) read8080(state, HL8080(state))
+#define GET8080_7(state) (state)->a
+
+#define SET8080_0(state, value) (state)->b = (value)
+#define SET8080_1(state, value) (state)->c = (value)
+#define SET8080_2(state, value) (state)->d = (value)
+#define SET8080_3(state, value) (state)->e = (value)
+#define SET8080_4(state, value) (state)->h = (value)
+#define SET8080_5(state, value) (state)->l = (value)
+#define SET8080_6(state, value) write8080(state, HL8080(state), value)
+#define SET8080_7(state, value) (state)->a = (value)
+
+// RP : 0 B-C, 1 D-E, 2 H-L, 3 SP, all of them 16 bits words
+#define PAIR8080_0(state) (state)->bc
+#define PAIR8080_1(state) (state)->de
+#define PAIR8080_2(state) (state)->hl
+#define PAIR8080_3(state) (state)->sp
+
+// byte 2 / bytes 2 and 3 of the instruction, PC moves past them
+static inline uint8_t fetch8080(State8080 *state)
+{
+    return read8080(state, state->pc++);
+}
+
+static inline uint16_t fetch_word8080(State8080 *state)
+{
+    uint16_t value = read_word8080(state, state->pc);
+    state->pc += 2;
+    return value;
+}
+
+
+/*
+    Data Transfer Group
+*/
+#define MOV8080(ddd, sss) \
+    static int op_mov_##ddd##sss(State8080 *state) \
+    { \
+        SET8080_##ddd(state, GET8080_##sss(state)); \
+        return cycles8080[0x40 | ddd << 3 | sss]; \
+    }
+
+#define MOV_FAMILY8080(ddd) \
+    MOV8080(ddd, 0) MOV8080(ddd, 1) MOV8080(ddd, 2) MOV8080(ddd, 3) \
+    MOV8080(ddd, 4) MOV8080(ddd, 5) MOV8080(ddd, 6) MOV8080(ddd, 7)
+
+MOV_FAMILY8080(0) MOV_FAMILY8080(1) MOV_FAMILY8080(2) MOV_FAMILY8080(3)
+MOV_FAMILY8080(4) MOV_FAMILY8080(5) MOV_FAMILY8080(7)
+// MOV M, M is HLT
+MOV8080(6, 0) MOV8080(6, 1) MOV8080(6, 2) MOV8080(6, 3) MOV8080(6, 4) MOV8080(6, 5) MOV8080(6, 7)
+
+#define MVI8080(ddd) \
+    static int op_mvi_##ddd(State8080 *state) \
+    { \
+        SET8080_##ddd(state, fetch8080(state)); \
+        return cycles8080[0x06 | ddd << 3]; \
+    }
+
+MVI8080(0) MVI8080(1) MVI8080(2) MVI8080(3) MVI8080(4) MVI8080(5) MVI8080(6) MVI8080(7)
+
+#define LXI8080(rp) \
+    static int op_lxi_##rp(State8080 *state) \
+    { \
+        PAIR8080_##rp(state) = fetch_word8080(state); \
+        return cycles8080[0x01 | rp << 4]; \
+    }
+
+LXI8080(0) LXI8080(1) LXI8080(2) LXI8080(3)
+
+// LDAX / STAX B and D
+#define LDAX8080(rp) \
+    static int op_ldax_##rp(State8080 *state) \
+    { \
+        state->a = read8080(state, PAIR8080_##rp(state)); \
+        return cycles8080[0x0A | rp << 4]; \
+    } \
+    static int op_stax_##rp(State8080 *state) \
+    { \
+        write8080(state, PAIR8080_##rp(state), state->a); \
+        return cycles8080[0x02 | rp << 4]; \
+    }
+
+LDAX8080(0) LDAX8080(1)
+
+static int op_lda(State8080 *state)
+{
+    state->a = read8080(state, fetch_word8080(state));
+    return cycles8080[0x3A];
+}
+
+static int op_sta(State8080 *state)
+{
+    write8080(state, fetch_word8080(state), state->a);
+    return cycles8080[0x32];
+}
+
+static int op_lhld(State8080 *state)
+{
+    state->hl = read_word8080(state, fetch_word8080(state));
+    return cycles8080[0x2A];
+}
+
+static int op_shld(State8080 *state)
+{
+    write_word8080(state, fetch_word8080(state), HL8080(state));
+    return cycles8080[0x22];
+}
+
+static int op_xchg(State8080 *state)
+{
+    uint16_t value = state->hl;
+
+    state->hl = state->de;
+    state->de = value;
+    return cycles8080[0xEB];
+}
+
+
+/*
+    Arithmetic and Logical Groups
+*/
+#define ADD_OP8080(state, value) (state)->a = add8080(state, (state)->a, value, 0)
+#define ADC_OP8080(state, value) (state)->a = add8080(state, (state)->a, value, (state)->cc.cy)
+#define SUB_OP8080(state, value) (state)->a = sub8080(state, (state)->a, value, 0)
+#define SBB_OP8080(state, value) (state)->a = sub8080(state, (state)->a, value, (state)->cc.cy)
+#define ANA_OP8080(state, value) and8080(state, value)
+#define XRA_OP8080(state, value) xor8080(state, value)
+#define ORA_OP8080(state, value) or8080(state, value)
+#define CMP_OP8080(state, value) sub8080(state, (state)->a, value, 0)
+
+// ALU r (10AAASSS) and the immediate form ALU d8 (11AAA110)
+#define ALU8080(name, NAME, aaa, immediate) \
+    static int op_##name##_0(State8080 *state) { NAME##_OP8080(state, GET8080_0(state)); return cycles8080[0x80 | aaa << 3 | 0]; } \
+    static int op_##name##_1(State8080 *state) { NAME##_OP8080(state, GET8080_1(state)); return cycles8080[0x80 | aaa << 3 | 1]; } \
+    static int op_##name##_2(State8080 *state) { NAME##_OP8080(state, GET8080_2(state)); return cycles8080[0x80 | aaa << 3 | 2]; } \
+    static int op_##name##_3(State8080 *state) { NAME##_OP8080(state, GET8080_3(state)); return cycles8080[0x80 | aaa << 3 | 3]; } \
+    static int op_##name##_4(State8080 *state) { NAME##_OP8080(state, GET8080_4(state)); return cycles8080[0x80 | aaa << 3 | 4]; } \
+    static int op_##name##_5(State8080 *state) { NAME##_OP8080(state, GET8080_5(state)); return cycles8080[0x80 | aaa << 3 | 5]; } \
+    static int op_##name##_6(State8080 *state) { NAME##_OP8080(state, GET8080_6(state)); return cycles8080[0x80 | aaa << 3 | 6]; } \
+    static int op_##name##_7(State8080 *state) { NAME##_OP8080(state, GET8080_7(state)); return cycles8080[0x80 | aaa << 3 | 7]; } \
+    static int op_##immediate(State8080 *state) { NAME##_OP8080(state, fetch8080(state)); return cycles8080[0xC6 | aaa << 3]; }
+
+ALU8080(add, ADD, 0, adi)
+ALU8080(adc, ADC, 1, aci)
+ALU8080(sub, SUB, 2, sui)
+ALU8080(sbb, SBB, 3, sbi)
+ALU8080(ana, ANA, 4, ani)
+ALU8080(xra, XRA, 5, xri)
+ALU8080(ora, ORA, 6, ori)
+ALU8080(cmp, CMP, 7, cpi)
+
+#define INR8080(ddd) \
+    static int op_inr_##ddd(State8080 *state) \
+    { \
+        SET8080_##ddd(state, inr8080(state, GET8080_##ddd(state))); \
+        return cycles8080[0x04 | ddd << 3]; \
+    } \
+    static int op_dcr_##ddd(State8080 *state) \
+    { \
+        SET8080_##ddd(state, dcr8080(state, GET8080_##ddd(state))); \
+        return cycles8080[0x05 | ddd << 3]; \
+    }
+
+INR8080(0) INR8080(1) INR8080(2) INR8080(3) INR8080(4) INR8080(5) INR8080(6) INR8080(7)
+
+// INX / DCX / DAD rp
+#define PAIR_OPS8080(rp) \
+    static int op_inx_##rp(State8080 *state) \
+    { \
+        PAIR8080_##rp(state)++; \
+        return cycles8080[0x03 | rp << 4]; \
+    } \
+    static int op_dcx_##rp(State8080 *state) \
+    { \
+        PAIR8080_##rp(state)--; \
+        return cycles8080[0x0B | rp << 4]; \
+    } \
+    static int op_dad_##rp(State8080 *state) \
+    { \
+        dad8080(state, PAIR8080_##rp(state)); \
+        return cycles8080[0x09 | rp << 4]; \
+    }
+
+PAIR_OPS8080(0) PAIR_OPS8080(1) PAIR_OPS8080(2) PAIR_OPS8080(3)
+
+static int op_daa(State8080 *state)
+{
+    daa8080(state);
+    return cycles8080[0x27];
+}
+
+static int op_rlc(State8080 *state)
+{
+    state->cc.cy = state->a >> 7;
+    state->a = (uint8_t)((state->a << 1) | state->cc.cy);
+    return cycles8080[0x07];
+}
+
+static int op_rrc(State8080 *state)
+{
+    state->cc.cy = state->a & 1;
+    state->a = (uint8_t)((state->a >> 1) | (state->cc.cy << 7));
+    return cycles8080[0x0F];
+}
+
+static int op_ral(State8080 *state)
+{
+    uint8_t carry = state->cc.cy;
+
+    state->cc.cy = state->a >> 7;
+    state->a = (uint8_t)((state->a << 1) | carry);
+    return cycles8080[0x17];
+}
+
+static int op_rar(State8080 *state)
+{
+    uint8_t carry = state->cc.cy;
+
+    state->cc.cy = state->a & 1;
+    state->a = (uint8_t)((state->a >> 1) | (carry << 7));
+    return cycles8080[0x1F];
+}
+
+static int op_cma(State8080 *state)
+{
+    state->a = ~state->a;
+    return cycles8080[0x2F];
+}
+
+static int op_cmc(State8080 *state)
+{
+    state->cc.cy = !state->cc.cy;
+    return cycles8080[0x3F];
+}
+
+static int op_stc(State8080 *state)
+{
+    state->cc.cy = 1;
+    return cycles8080[0x37];
+}
+
+
+/*
+    Branch Group
+*/
+// JMP and its alias 0xCB
+static int op_jmp(State8080 *state)
+{
+    state->pc = read_word8080(state, state->pc);
+    return cycles8080[0xC3];
+}
+
+// CALL and its aliases 0xDD, 0xED, 0xFD
+static int op_call(State8080 *state)
+{
+    uint16_t address = fetch_word8080(state);
+
+    push8080(state, state->pc);
+    state->pc = address;
+    return cycles8080[0xCD];
+}
+
+// RET and its alias 0xD9
+static int op_ret(State8080 *state)
+{
+    state->pc = pop8080(state);
+    return cycles8080[0xC9];
+}
+
+// Jccc / Cccc / Rccc, the address is always fetched
+#define BRANCH8080(ccc) \
+    static int op_j_##ccc(State8080 *state) \
+    { \
+        uint16_t address = fetch_word8080(state); \
+        if (!condition8080(state, ccc)) \
+            return cycles8080[0xC2 | ccc << 3]; \
+        state->pc = address; \
+        return cycles8080[0xC2 | ccc << 3] + JUMP_TAKEN8080; \
+    } \
+    static int op_c_##ccc(State8080 *state) \
+    { \
+        uint16_t address = fetch_word8080(state); \
+        if (!condition8080(state, ccc)) \
+            return cycles8080[0xC4 | ccc << 3]; \
+        push8080(state, state->pc); \
+        state->pc = address; \
+        return cycles8080[0xC4 | ccc << 3] + CALL_TAKEN8080; \
+    } \
+    static int op_r_##ccc(State8080 *state) \
+    { \
+        if (!condition8080(state, ccc)) \
+            return cycles8080[0xC0 | ccc << 3]; \
+        state->pc = pop8080(state); \
+        return cycles8080[0xC0 | ccc << 3] + RETURN_TAKEN8080; \
+    }
+
+BRANCH8080(0) BRANCH8080(1) BRANCH8080(2) BRANCH8080(3)
+BRANCH8080(4) BRANCH8080(5) BRANCH8080(6) BRANCH8080(7)
+
+#define RST8080(nnn) \
+    static int op_rst_##nnn(State8080 *state) \
+    { \
+        push8080(state, state->pc); \
+        state->pc = 8 * nnn; \
+        return cycles8080[0xC7 | nnn << 3]; \
+    }
+
+RST8080(0) RST8080(1) RST8080(2) RST8080(3) RST8080(4) RST8080(5) RST8080(6) RST8080(7)
+
+static int op_pchl(State8080 *state)
+{
+    state->pc = HL8080(state);
+    return cycles8080[0xE9];
+}
+
+
+/*
+    Stack, I/O, and Machine Control Group
+*/
+#define STACK8080(rp) \
+    static int op_push_##rp(State8080 *state) \
+    { \
+        push8080(state, PAIR8080_##rp(state)); \
+        return cycles8080[0xC5 | rp << 4]; \
+    } \
+    static int op_pop_##rp(State8080 *state) \
+    { \
+        PAIR8080_##rp(state) = pop8080(state); \
+        return cycles8080[0xC1 | rp << 4]; \
+    }
+
+STACK8080(0) STACK8080(1) STACK8080(2)
+
+static int op_push_psw(State8080 *state)
+{
+    push8080(state, (state->a << 8) | psw8080(state));
+    return cycles8080[0xF5];
+}
+
+static int op_pop_psw(State8080 *state)
+{
+    uint16_t value = pop8080(state);
+
+    state->a = value >> 8;
+    set_psw8080(state, value & 0xff);
+    return cycles8080[0xF1];
+}
+
+static int op_xthl(State8080 *state)
+{
+    uint16_t value = read_word8080(state, state->sp);
+
+    write_word8080(state, state->sp, state->hl);
+    state->hl = value;
+    return cycles8080[0xE3];
+}
+
+static int op_sphl(State8080 *state)
+{
+    state->sp = HL8080(state);
+    return cycles8080[0xF9];
+}
+
+// the device is called with PC on the port byte and the cycle counter at the start of the instruction
+static int op_in(State8080 *state)
+{
+    uint8_t port = read8080(state, state->pc);
+
+    state->a = state->port_in ? state->port_in(state, port) : 0;
+    state->pc++;
+    return cycles8080[0xDB];
+}
+
+static int op_out(State8080 *state)
+{
+    uint8_t port = read8080(state, state->pc);
+
+    if (state->port_out)
+        state->port_out(state, port, state->a);
+    state->pc++;
+    return cycles8080[0xD3];
+}
+
+static int op_ei(State8080 *state)
+{
+    state->int_enable = 1;
+    return cycles8080[0xFB];
+}
+
+static int op_di(State8080 *state)
+{
+    state->int_enable = 0;
+    return cycles8080[0xF3];
+}
+
+static int op_hlt(State8080 *state)
+{
+    state->halted = 1;
+    return cycles8080[0x76];
+}
+
+// NOP and its aliases 0x08, 0x10, 0x18, 0x20, 0x28, 0x30, 0x38
+static int op_nop(State8080 *state)
+{
+    (void)state;
+    return cycles8080[0x00];
+}
+
+#ifdef CPU_8085
+// RIM : |SID|I7.5|I6.5|I5.5|IE|M7.5|M6.5|M5.5|, no interrupt is pending
+static int op_rim(State8080 *state)
+{
+    state->a = (uint8_t)(state->sid << 7 | state->int_enable << 3 | state->interrupt_mask);
+    return cycles8080[0x20];
+}
+
+// SIM : |SOD|SOE|-|R7.5|MSE|M7.5|M6.5|M5.5|
+static int op_sim(State8080 *state)
+{
+    if (state->a & 0x08)
+        state->interrupt_mask = state->a & 0x07;
+    if (state->a & 0x40)
+        state->sod = state->a >> 7;
+    return cycles8080[0x30];
+}
+
+#define op_20 op_rim
+#define op_30 op_sim
+#else
+#define op_20 op_nop
+#define op_30 op_nop
+#endif
+
+
+#define MOV_ROW8080(ddd) \
+    op_mov_##ddd##0, op_mov_##ddd##1, op_mov_##ddd##2, op_mov_##ddd##3, \
+    op_mov_##ddd##4, op_mov_##ddd##5, op_mov_##ddd##6, op_mov_##ddd##7
+
+#define ALU_ROW8080(name) \
+    op_##name##_0, op_##name##_1, op_##name##_2, op_##name##_3, \
+    op_##name##_4, op_##name##_5, op_##name##_6, op_##name##_7
+
+static const Handler8080 handlers8080[256] = {
+    // 0x00 - 0x3F
+    op_nop,  op_lxi_0, op_stax_0, op_inx_0, op_inr_0, op_dcr_0, op_mvi_0, op_rlc,
+    op_nop,  op_dad_0, op_ldax_0, op_dcx_0, op_inr_1, op_dcr_1, op_mvi_1, op_rrc,
+    op_nop,  op_lxi_1, op_stax_1, op_inx_1, op_inr_2, op_dcr_2, op_mvi_2, op_ral,
+    op_nop,  op_dad_1, op_ldax_1, op_dcx_1, op_inr_3, op_dcr_3, op_mvi_3, op_rar,
+    op_20,   op_lxi_2, op_shld,   op_inx_2, op_inr_4, op_dcr_4, op_mvi_4, op_daa,
+    op_nop,  op_dad_2, op_lhld,   op_dcx_2, op_inr_5, op_dcr_5, op_mvi_5, op_cma,
+    op_30,   op_lxi_3, op_sta,    op_inx_3, op_inr_6, op_dcr_6, op_mvi_6, op_stc,
+    op_nop,  op_dad_3, op_lda,    op_dcx_3, op_inr_7, op_dcr_7, op_mvi_7, op_cmc,
+    // 0x40 - 0x7F
+    MOV_ROW8080(0), MOV_ROW8080(1), MOV_ROW8080(2), MOV_ROW8080(3),
+    MOV_ROW8080(4), MOV_ROW8080(5),
+    op_mov_60, op_mov_61, op_mov_62, op_mov_63, op_mov_64, op_mov_65, op_hlt, op_mov_67,
+    MOV_ROW8080(7),
+    // 0x80 - 0xBF
+    ALU_ROW8080(add), ALU_ROW8080(adc), ALU_ROW8080(sub), ALU_ROW8080(sbb),
+    ALU_ROW8080(ana), ALU_ROW8080(xra), ALU_ROW8080(ora), ALU_ROW8080(cmp),
+    // 0xC0 - 0xFF
+    op_r_0, op_pop_0,   op_j_0, op_jmp,  op_c_0, op_push_0,   op_adi, op_rst_0,
+    op_r_1, op_ret,     op_j_1, op_jmp,  op_c_1, op_call,     op_aci, op_rst_1,
+    op_r_2, op_pop_1,   op_j_2, op_out,  op_c_2, op_push_1,   op_sui, op_rst_2,
+    op_r_3, op_ret,     op_j_3, op_in,   op_c_3, op_call,     op_sbi, op_rst_3,
+    op_r_4, op_pop_2,   op_j_4, op_xthl, op_c_4, op_push_2,   op_ani, op_rst_4,
+    op_r_5, op_pchl,    op_j_5, op_xchg, op_c_5, op_call,     op_xri, op_rst_5,
+    op_r_6, op_pop_psw, op_j_6, op_di,   op_c_6, op_push_psw, op_ori, op_rst_6,
+    op_r_7, op_sphl,    op_j_7, op_ei,   op_c_7, op_call,     op_cpi, op_rst_7
+};
+
+/*
+    Execute one instruction and return the number of states it used.
+    A halted processor only burns states until the next interrupt.
+*/
+int emulate8080(State8080 *state)
+{
+    int states;
+
+    if (state->halted) {
+        state->cycles += 4;
+        return 4;
+    }
+    states = handlers8080[read8080(state, state->pc++)](state);
+    state->cycles += states;
+    return states;
+}
+
+#endif
@@ -0,0 +1,216 @@
+#ifndef EMULATOR_FORK_C
+#define EMULATOR_FORK_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.c"
+
+/*
+    Fork pool, for state space exploration
+
+    A fork is a copy of a running machine : the registers are copied and the memory map
+    shares every page of its parent (see memory_fork), so a fork costs one memory map
+    and the pages it writes to, not 64 KB.
+
+    The forks are identified by an id, an id is never reused. Discarding a fork releases
+    its pages, the forks made from it keep running with their own references.
+    The pool is not thread safe.
+*/
+
+
+typedef struct Fork8080 {
+    State8080 state;
+    // id of the fork it was made from, -1 for a machine added to the pool
+    int parent;
+    int live;
+} Fork8080;
+
+typedef struct ForkPool8080 {
+    Fork8080 *forks;
+    int count;
+    int capacity;
+    int live;
+} ForkPool8080;
+
+
+void fork_pool_init(ForkPool8080 *pool)
+{
+    memset(pool, 0, sizeof(*pool));
+}
+
+static int fork_pool_new(ForkPool8080 *pool)
+{
+    if (pool->count == pool->capacity) {
+        int capacity = pool->capacity ? pool->capacity * 2 : 64;
+        Fork8080 *forks = realloc(pool->forks, capacity * sizeof(Fork8080));
+
+        if (forks == NULL) {
+            printf("Error : couldn't allocate %d forks\n", capacity);
+            exit(1);
+        }
+        pool->forks = forks;
+        pool->capacity = capacity;
+    }
+    pool->live++;
+    return pool->count++;
+}
+
+// Add a machine to the pool, the pool takes the ownership of its memory. Returns its id
+int fork_pool_add(ForkPool8080 *pool, const State8080 *state)
+{
+    int id = fork_pool_new(pool);
+
+    pool->forks[id].state = *state;
+    pool->forks[id].parent = -1;
+    pool->forks[id].live = 1;
+    return id;
+}
+
+// Fork the machine id, returns the id of the new fork or -1 if id is not a live fork
+int fork_pool_fork(ForkPool8080 *pool, int id)
+{
+    int child;
+
+    if (id < 0 || id >= pool->count || !pool->forks[id].live)
+        return -1;
+    child = fork_pool_new(pool);
+    pool->forks[child].state = pool->forks[id].state;
+    pool->forks[child].state.memory = memory_fork(pool->forks[id].state.memory);
+    pool->forks[child].parent = id;
+    pool->forks[child].live = 1;
+    return child;
+}
+
+// The state of a live fork, the pointer is valid until the next fork or add
+State8080 *fork_pool_state(ForkPool8080 *pool, int id)
+{
+    if (id < 0 || id >= pool->count || !pool->forks[id].live)
+        return NULL;
+    return &pool->forks[id].state;
+}
+
+int fork_pool_parent(const ForkPool8080 *pool, int id)
+{
+    if (id < 0 || id >= pool->count)
+        return -1;
+    return pool->forks[id].parent;
+}
+
+/*
+    Enumerate the live forks :
+        for (id = fork_pool_next(pool, -1); id >= 0; id = fork_pool_next(pool, id))
+*/
+int fork_pool_next(const ForkPool8080 *pool, int id)
+{
+    for (id++; id < pool->count; id++)
+        if (pool->forks[id].live)
+            return id;
+    return -1;
+}
+
+void fork_pool_discard(ForkPool8080 *pool, int id)
+{
+    if (id < 0 || id >= pool->count || !pool->forks[id].live)
+        return;
+    memory_destroy(pool->forks[id].state.memory);
+    pool->forks[id].state.memory = NULL;
+    pool->forks[id].live = 0;
+    pool->live--;
+}
+
+// Discard the live forks made from id, directly or not, id itself is kept
+void fork_pool_discard_descendants(ForkPool8080 *pool, int id)
+{
+    for (int child = id + 1; child < pool->count; child++) {
+        int ancestor = pool->forks[child].parent;
+
+        // a fork is always made after its parent, so the ancestors have smaller ids
+        while (ancestor > id)
+            ancestor = pool->forks[ancestor].parent;
+        if (ancestor == id)
+            fork_pool_discard(pool, child);
+    }
+}
+
+void fork_pool_free(ForkPool8080 *pool)
+{
+    for (int id = 0; id < pool->count; id++)
+        fork_pool_discard(pool, id);
+    free(pool->forks);
+    fork_pool_init(pool);
+}
+
+
+/*
+    Benchmark : run program for cycles states, fork it forks times and run every fork
+    for cycles more states with its own input (IN returns a hash of the fork id and of
+    the cycle counter)
+*/
+static uint8_t fork_port_in(State8080 *state, uint8_t port)
+{
+    uint32_t hash = (uint32_t)(intptr_t)state->user * 0x9E3779B1u ^ (uint32_t)state->cycles * 0x85EBCA6Bu ^ port;
+
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    return (uint8_t)(hash ^ (hash >> 13));
+}
+
+static void fork_run(State8080 *state, uint64_t cycles)
+{
+    uint64_t end = state->cycles + cycles;
+
+    while (!state->halted && state->cycles < end)
+        emulate8080(state);
+}
+
+void fork_benchmark(const unsigned char *program, int size, int forks, uint64_t cycles)
+{
+    ForkPool8080 pool;
+    State8080 root;
+    uint64_t copies = 0;
+    int id, root_id, live = 0;
+    clock_t start;
+    double fork_time, run_time;
+
+    fork_pool_init(&pool);
+    init8080(&root, memory_create());
+    memory_load(root.memory, 0, program, size);
+    root.port_in = fork_port_in;
+    fork_run(&root, cycles);
+    root_id = fork_pool_add(&pool, &root);
+
+    start = clock();
+    for (int i = 0; i < forks; i++)
+        fork_pool_state(&pool, fork_pool_fork(&pool, root_id))->user = (void *)(intptr_t)(i + 1);
+    fork_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (id = fork_pool_next(&pool, root_id); id >= 0; id = fork_pool_next(&pool, id))
+        fork_run(fork_pool_state(&pool, id), cycles);
+    run_time = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    for (id = fork_pool_next(&pool, root_id); id >= 0; id = fork_pool_next(&pool, id))
+        copies += fork_pool_state(&pool, id)->memory->copies;
+
+    printf("%d forks in %.3f s (%.2f us per fork), run in %.3f s\n", forks, fork_time,
+        forks ? fork_time * 1e6 / forks : 0.0, run_time);
+    printf("%llu pages copied on write, %llu KB allocated instead of %llu KB\n", (unsigned long long)copies,
+        (unsigned long long)(memory_pages_allocated * MEMORY_PAGE_SIZE / 1024),
+        (unsigned long long)(forks + 1) * 64);
+
+    // keep every other fork, then enumerate the survivors
+    for (id = fork_pool_next(&pool, root_id); id >= 0; id = fork_pool_next(&pool, id))
+        if (id % 2)
+            fork_pool_discard(&pool, id);
+    for (id = fork_pool_next(&pool, -1); id >= 0; id = fork_pool_next(&pool, id))
+        live++;
+    printf("%d forks left after discarding the odd ids, %llu KB allocated\n", live,
+        (unsigned long long)(memory_pages_allocated * MEMORY_PAGE_SIZE / 1024));
+
+    fork_pool_free(&pool);
+}
+
+#endif
@@ -0,0 +1,717 @@
+#ifndef EMULATOR_LOCKSTEP_C
+#define EMULATOR_LOCKSTEP_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.c"
+
+/*
+    Lockstep execution of many instances running the same program
+
+    The registers of every instance (lane) are stored in Structure of Arrays form, one
+    byte per lane, so that one SIMD register holds the same 8080 register for 16 (SSE2)
+    or 32 (AVX2) lanes.
+
+    1. Find the lowest PC among the running lanes, the lanes at that PC form the group
+    2. If the group fetches the same instruction and it is a register / ALU / jump
+       instruction, execute it for the whole group at once
+    3. Otherwise (the lanes diverged, memory heavy or I/O instructions, ...) execute the
+       instruction of each lane of the group with the scalar core
+    4. Go to step 1
+
+    Stepping the lowest PC first lets the lanes which are ahead wait for the others, so
+    the lanes converge again at the end of loops and conditional blocks.
+    Each lane owns its memory, the program is expected to be the same in every memory.
+
+    Build with -DLOCKSTEP_LANES=8, 16 or 32 and -msse2 / -mavx2 to select the width,
+    without SIMD support the group is executed with plain loops.
+*/
+
+
+#ifndef LOCKSTEP_LANES
+#define LOCKSTEP_LANES 32
+#endif
+
+#if LOCKSTEP_LANES != 8 && LOCKSTEP_LANES != 16 && LOCKSTEP_LANES != 32
+#error "LOCKSTEP_LANES must be 8, 16 or 32"
+#endif
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#define LOCKSTEP_VECTOR 32
+typedef __m256i LaneVector;
+#define VLOAD(p)            _mm256_loadu_si256((const __m256i *)(p))
+#define VSTORE(p, v)        _mm256_storeu_si256((__m256i *)(p), (v))
+#define VSET8(x)            _mm256_set1_epi8((char)(x))
+#define VSET16(x)           _mm256_set1_epi16((short)(x))
+#define VZERO()             _mm256_setzero_si256()
+#define VAND(x, y)          _mm256_and_si256((x), (y))
+#define VOR(x, y)           _mm256_or_si256((x), (y))
+#define VXOR(x, y)          _mm256_xor_si256((x), (y))
+#define VANDNOT(x, y)       _mm256_andnot_si256((x), (y))
+#define VADD8(x, y)         _mm256_add_epi8((x), (y))
+#define VSUB8(x, y)         _mm256_sub_epi8((x), (y))
+#define VCMPEQ8(x, y)       _mm256_cmpeq_epi8((x), (y))
+#define VADD16(x, y)        _mm256_add_epi16((x), (y))
+#define VSRL16(x, n)        _mm256_srli_epi16((x), (n))
+#define VUNPACKLO8(x, y)    _mm256_unpacklo_epi8((x), (y))
+#define VUNPACKHI8(x, y)    _mm256_unpackhi_epi8((x), (y))
+#define VPACKUS16(x, y)     _mm256_packus_epi16((x), (y))
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define LOCKSTEP_VECTOR 16
+typedef __m128i LaneVector;
+#define VLOAD(p)            _mm_loadu_si128((const __m128i *)(p))
+#define VSTORE(p, v)        _mm_storeu_si128((__m128i *)(p), (v))
+#define VSET8(x)            _mm_set1_epi8((char)(x))
+#define VSET16(x)           _mm_set1_epi16((short)(x))
+#define VZERO()             _mm_setzero_si128()
+#define VAND(x, y)          _mm_and_si128((x), (y))
+#define VOR(x, y)           _mm_or_si128((x), (y))
+#define VXOR(x, y)          _mm_xor_si128((x), (y))
+#define VANDNOT(x, y)       _mm_andnot_si128((x), (y))
+#define VADD8(x, y)         _mm_add_epi8((x), (y))
+#define VSUB8(x, y)         _mm_sub_epi8((x), (y))
+#define VCMPEQ8(x, y)       _mm_cmpeq_epi8((x), (y))
+#define VADD16(x, y)        _mm_add_epi16((x), (y))
+#define VSRL16(x, n)        _mm_srli_epi16((x), (n))
+#define VUNPACKLO8(x, y)    _mm_unpacklo_epi8((x), (y))
+#define VUNPACKHI8(x, y)    _mm_unpackhi_epi8((x), (y))
+#define VPACKUS16(x, y)     _mm_packus_epi16((x), (y))
+#else
+#define LOCKSTEP_VECTOR 1
+#endif
+
+// lane arrays are padded to a whole number of vectors, the padding lanes never run
+#define LOCKSTEP_STRIDE (LOCKSTEP_LANES > LOCKSTEP_VECTOR ? LOCKSTEP_LANES : LOCKSTEP_VECTOR)
+
+// index of the (H)(L) scratch row in reg[], the memory operand is gathered / scattered through it
+#define LOCKSTEP_M 6
+
+typedef struct Lockstep8080 {
+    // DDD / SSS order : B, C, D, E, H, L, M (scratch), A
+    uint8_t reg[8][LOCKSTEP_STRIDE];
+    uint8_t z[LOCKSTEP_STRIDE];
+    uint8_t s[LOCKSTEP_STRIDE];
+    uint8_t p[LOCKSTEP_STRIDE];
+    uint8_t cy[LOCKSTEP_STRIDE];
+    uint8_t ac[LOCKSTEP_STRIDE];
+    uint16_t sp[LOCKSTEP_STRIDE];
+    uint16_t pc[LOCKSTEP_STRIDE];
+    uint8_t int_enable[LOCKSTEP_STRIDE];
+    uint8_t halted[LOCKSTEP_STRIDE];
+#ifdef CPU_8085
+    uint8_t interrupt_mask[LOCKSTEP_STRIDE];
+    uint8_t sid[LOCKSTEP_STRIDE];
+    uint8_t sod[LOCKSTEP_STRIDE];
+#endif
+    uint64_t cycles[LOCKSTEP_STRIDE];
+    Memory8080 *memory[LOCKSTEP_LANES];
+    void *user[LOCKSTEP_LANES];
+    PortIn8080 port_in;
+    PortOut8080 port_out;
+    // number of lanes in use
+    int lanes;
+    /*
+        The code below rom_end is read-only and the same in every lane, the fetch of the
+        group is not checked lane by lane there. 0 checks every fetch.
+    */
+    uint16_t rom_end;
+    // instructions executed for a whole group / for a single lane
+    uint64_t vector_steps;
+    uint64_t scalar_steps;
+} Lockstep8080;
+
+#define LOCKSTEP_A 7
+
+
+void lockstep_init(Lockstep8080 *ls, int lanes, PortIn8080 port_in, PortOut8080 port_out)
+{
+    memset(ls, 0, sizeof(*ls));
+    ls->lanes = lanes;
+    ls->port_in = port_in;
+    ls->port_out = port_out;
+}
+
+// Copy a scalar state into a lane (the lane shares the memory of the state)
+void lockstep_load(Lockstep8080 *ls, int lane, const State8080 *state)
+{
+    ls->reg[0][lane] = state->b;
+    ls->reg[1][lane] = state->c;
+    ls->reg[2][lane] = state->d;
+    ls->reg[3][lane] = state->e;
+    ls->reg[4][lane] = state->h;
+    ls->reg[5][lane] = state->l;
+    ls->reg[LOCKSTEP_A][lane] = state->a;
+    ls->z[lane] = state->cc.z;
+    ls->s[lane] = state->cc.s;
+    ls->p[lane] = state->cc.p;
+    ls->cy[lane] = state->cc.cy;
+    ls->ac[lane] = state->cc.ac;
+    ls->sp[lane] = state->sp;
+    ls->pc[lane] = state->pc;
+    ls->int_enable[lane] = state->int_enable;
+    ls->halted[lane] = state->halted;
+#ifdef CPU_8085
+    ls->interrupt_mask[lane] = state->interrupt_mask;
+    ls->sid[lane] = state->sid;
+    ls->sod[lane] = state->sod;
+#endif
+    ls->cycles[lane] = state->cycles;
+    ls->memory[lane] = state->memory;
+    ls->user[lane] = state->user;
+}
+
+// Copy a lane back into a scalar state
+void lockstep_store(const Lockstep8080 *ls, int lane, State8080 *state)
+{
+    state->b = ls->reg[0][lane];
+    state->c = ls->reg[1][lane];
+    state->d = ls->reg[2][lane];
+    state->e = ls->reg[3][lane];
+    state->h = ls->reg[4][lane];
+    state->l = ls->reg[5][lane];
+    state->a = ls->reg[LOCKSTEP_A][lane];
+    state->cc.z = ls->z[lane];
+    state->cc.s = ls->s[lane];
+    state->cc.p = ls->p[lane];
+    state->cc.cy = ls->cy[lane];
+    state->cc.ac = ls->ac[lane];
+    state->sp = ls->sp[lane];
+    state->pc = ls->pc[lane];
+    state->int_enable = ls->int_enable[lane];
+    state->halted = ls->halted[lane];
+#ifdef CPU_8085
+    state->interrupt_mask = ls->interrupt_mask[lane];
+    state->sid = ls->sid[lane];
+    state->sod = ls->sod[lane];
+#endif
+    state->cycles = ls->cycles[lane];
+    state->memory = ls->memory[lane];
+    state->user = ls->user[lane];
+    state->port_in = ls->port_in;
+    state->port_out = ls->port_out;
+}
+
+// Execute one instruction of a single lane with the scalar core
+static void lockstep_scalar(Lockstep8080 *ls, int lane)
+{
+    State8080 state = {0};
+
+    lockstep_store(ls, lane, &state);
+    emulate8080(&state);
+    lockstep_load(ls, lane, &state);
+    ls->scalar_steps++;
+}
+
+static inline uint16_t lockstep_pair(const Lockstep8080 *ls, int rh, int lane)
+{
+    return (ls->reg[rh][lane] << 8) | ls->reg[rh + 1][lane];
+}
+
+static inline void lockstep_set_pair(Lockstep8080 *ls, int rh, int lane, uint16_t value)
+{
+    ls->reg[rh][lane] = value >> 8;
+    ls->reg[rh + 1][lane] = value & 0xff;
+}
+
+static inline int lockstep_condition(const Lockstep8080 *ls, int lane, uint8_t ccc)
+{
+    switch (ccc) {
+        case 0: return !ls->z[lane];
+        case 1: return ls->z[lane];
+        case 2: return !ls->cy[lane];
+        case 3: return ls->cy[lane];
+        case 4: return !ls->p[lane];
+        case 5: return ls->p[lane];
+        case 6: return !ls->s[lane];
+        default: return ls->s[lane];
+    }
+}
+
+static void lockstep_gather_m(Lockstep8080 *ls, const uint8_t *mask)
+{
+    for (int lane = 0; lane < ls->lanes; lane++)
+        if (mask[lane])
+            ls->reg[LOCKSTEP_M][lane] = memory_read(ls->memory[lane], lockstep_pair(ls, 4, lane));
+}
+
+static void lockstep_scatter_m(Lockstep8080 *ls, const uint8_t *mask)
+{
+    for (int lane = 0; lane < ls->lanes; lane++)
+        if (mask[lane])
+            memory_write(ls->memory[lane], lockstep_pair(ls, 4, lane), ls->reg[LOCKSTEP_M][lane]);
+}
+
+
+#if LOCKSTEP_VECTOR > 1
+
+static inline LaneVector lockstep_blend(LaneVector old, LaneVector value, LaneVector mask)
+{
+    return VOR(VAND(mask, value), VANDNOT(mask, old));
+}
+
+// dst <= src for the lanes of the mask
+static void lockstep_copy(uint8_t *dst, const uint8_t *src, const uint8_t *mask)
+{
+    for (int i = 0; i < LOCKSTEP_STRIDE; i += LOCKSTEP_VECTOR)
+        VSTORE(dst + i, lockstep_blend(VLOAD(dst + i), VLOAD(src + i), VLOAD(mask + i)));
+}
+
+// Z, S and P of 8-bit results, as 0 / 1 bytes
+static inline void lockstep_zsp(Lockstep8080 *ls, int i, LaneVector result, LaneVector mask)
+{
+    const LaneVector one = VSET8(1);
+    LaneVector parity = VXOR(result, VSRL16(result, 4));
+
+    parity = VXOR(parity, VSRL16(parity, 2));
+    parity = VXOR(parity, VSRL16(parity, 1));
+    VSTORE(ls->z + i, lockstep_blend(VLOAD(ls->z + i), VAND(VCMPEQ8(result, VZERO()), one), mask));
+    VSTORE(ls->s + i, lockstep_blend(VLOAD(ls->s + i), VAND(VSRL16(result, 7), one), mask));
+    VSTORE(ls->p + i, lockstep_blend(VLOAD(ls->p + i), VXOR(VAND(parity, one), one), mask));
+}
+
+/*
+    ADD / ADC / SUB / SBB / ANA / XRA / ORA / CMP (alu = bits 5-3 of the opcode) of A with src.
+    The additions are done on 16-bit lanes so that the carry out of bit 7 is bit 8 of the sum.
+*/
+static void lockstep_alu(Lockstep8080 *ls, const uint8_t *mask, int alu, const uint8_t *src)
+{
+    const LaneVector zero = VZERO();
+    const LaneVector one = VSET8(1);
+    const LaneVector ones = VSET8(0xff);
+    const LaneVector low = VSET16(0x00ff);
+
+    for (int i = 0; i < LOCKSTEP_STRIDE; i += LOCKSTEP_VECTOR) {
+        LaneVector m = VLOAD(mask + i);
+        LaneVector a = VLOAD(ls->reg[LOCKSTEP_A] + i);
+        LaneVector b = VLOAD(src + i);
+        LaneVector result, carry, aux;
+
+        if (alu <= 3 || alu == 7) {
+            LaneVector carry_in = (alu == 1 || alu == 3) ? VLOAD(ls->cy + i) : zero;
+            LaneVector sum_low, sum_high;
+
+            // subtraction : A + ~src + !borrow
+            if (alu >= 2) {
+                b = VXOR(b, ones);
+                carry_in = VXOR(carry_in, one);
+            }
+            sum_low = VADD16(VADD16(VUNPACKLO8(a, zero), VUNPACKLO8(b, zero)), VUNPACKLO8(carry_in, zero));
+            sum_high = VADD16(VADD16(VUNPACKHI8(a, zero), VUNPACKHI8(b, zero)), VUNPACKHI8(carry_in, zero));
+            result = VPACKUS16(VAND(sum_low, low), VAND(sum_high, low));
+            carry = VPACKUS16(VSRL16(sum_low, 8), VSRL16(sum_high, 8));
+            if (alu >= 2)
+                carry = VXOR(carry, one);
+            aux = VAND(VSRL16(VXOR(VXOR(a, b), result), 4), one);
+        } else if (alu == 4) {
+            result = VAND(a, b);
+            carry = zero;
+#ifdef CPU_8085
+            aux = one;
+#else
+            aux = VAND(VSRL16(VOR(a, b), 3), one);
+#endif
+        } else {
+            result = alu == 5 ? VXOR(a, b) : VOR(a, b);
+            carry = zero;
+            aux = zero;
+        }
+
+        if (alu != 7)
+            VSTORE(ls->reg[LOCKSTEP_A] + i, lockstep_blend(a, result, m));
+        VSTORE(ls->cy + i, lockstep_blend(VLOAD(ls->cy + i), carry, m));
+        VSTORE(ls->ac + i, lockstep_blend(VLOAD(ls->ac + i), aux, m));
+        lockstep_zsp(ls, i, result, m);
+    }
+}
+
+// INR / DCR r, CY is not affected
+static void lockstep_inr_dcr(Lockstep8080 *ls, const uint8_t *mask, uint8_t *r, int decrement)
+{
+    const LaneVector one = VSET8(1);
+    const LaneVector nibble = VSET8(0x0f);
+
+    for (int i = 0; i < LOCKSTEP_STRIDE; i += LOCKSTEP_VECTOR) {
+        LaneVector m = VLOAD(mask + i);
+        LaneVector value = VLOAD(r + i);
+        LaneVector result, aux;
+
+        if (decrement) {
+            result = VSUB8(value, one);
+            aux = VXOR(VAND(VCMPEQ8(VAND(result, nibble), nibble), one), one);
+        } else {
+            result = VADD8(value, one);
+            aux = VAND(VCMPEQ8(VAND(result, nibble), VZERO()), one);
+        }
+        VSTORE(r + i, lockstep_blend(value, result, m));
+        VSTORE(ls->ac + i, lockstep_blend(VLOAD(ls->ac + i), aux, m));
+        lockstep_zsp(ls, i, result, m);
+    }
+}
+
+#else
+
+static void lockstep_copy(uint8_t *dst, const uint8_t *src, const uint8_t *mask)
+{
+    for (int i = 0; i < LOCKSTEP_STRIDE; i++)
+        if (mask[i])
+            dst[i] = src[i];
+}
+
+// Plain loops over the lanes, using the helpers of the scalar core
+static void lockstep_alu(Lockstep8080 *ls, const uint8_t *mask, int alu, const uint8_t *src)
+{
+    for (int lane = 0; lane < ls->lanes; lane++) {
+        State8080 state = {0};
+
+        if (!mask[lane])
+            continue;
+        lockstep_store(ls, lane, &state);
+        switch (alu) {
+            case 0: state.a = add8080(&state, state.a, src[lane], 0); break;
+            case 1: state.a = add8080(&state, state.a, src[lane], state.cc.cy); break;
+            case 2: state.a = sub8080(&state, state.a, src[lane], 0); break;
+            case 3: state.a = sub8080(&state, state.a, src[lane], state.cc.cy); break;
+            case 4: and8080(&state, src[lane]); break;
+            case 5: xor8080(&state, src[lane]); break;
+            case 6: or8080(&state, src[lane]); break;
+            default: sub8080(&state, state.a, src[lane], 0); break;
+        }
+        lockstep_load(ls, lane, &state);
+    }
+}
+
+static void lockstep_inr_dcr(Lockstep8080 *ls, const uint8_t *mask, uint8_t *r, int decrement)
+{
+    for (int lane = 0; lane < ls->lanes; lane++) {
+        State8080 state = {0};
+
+        if (!mask[lane])
+            continue;
+        lockstep_store(ls, lane, &state);
+        r[lane] = decrement ? dcr8080(&state, r[lane]) : inr8080(&state, r[lane]);
+        ls->z[lane] = state.cc.z;
+        ls->s[lane] = state.cc.s;
+        ls->p[lane] = state.cc.p;
+        ls->ac[lane] = state.cc.ac;
+    }
+}
+
+#endif
+
+
+/*
+    Execute the instruction op for every lane of the mask at once.
+    Returns 0 if the instruction has to be executed with the scalar core.
+*/
+static int lockstep_vector(Lockstep8080 *ls, const uint8_t *mask, uint8_t op, uint8_t byte2, uint8_t byte3)
+{
+    uint8_t immediate[LOCKSTEP_STRIDE];
+    uint16_t address = byte2 | (byte3 << 8);
+    int length = 1;
+    int dst = (op >> 3) & 7;
+    int src = op & 7;
+    int rh = (op >> 3) & 6;
+
+    if (op >= 0x40 && op <= 0x7F && op != 0x76) {
+        // MOV
+        if (src == LOCKSTEP_M)
+            lockstep_gather_m(ls, mask);
+        lockstep_copy(ls->reg[dst], ls->reg[src], mask);
+        if (dst == LOCKSTEP_M)
+            lockstep_scatter_m(ls, mask);
+    } else if (op >= 0x80 && op <= 0xBF) {
+        // ALU r
+        if (src == LOCKSTEP_M)
+            lockstep_gather_m(ls, mask);
+        lockstep_alu(ls, mask, dst, ls->reg[src]);
+    } else if (op >= 0xC0 && (op & 7) == 6) {
+        // ALU d8
+        memset(immediate, byte2, sizeof(immediate));
+        lockstep_alu(ls, mask, dst, immediate);
+        length = 2;
+    } else if (op < 0x40 && (op & 7) == 6) {
+        // MVI
+        memset(immediate, byte2, sizeof(immediate));
+        lockstep_copy(ls->reg[dst], immediate, mask);
+        if (dst == LOCKSTEP_M)
+            lockstep_scatter_m(ls, mask);
+        length = 2;
+    } else if (op < 0x40 && ((op & 7) == 4 || (op & 7) == 5)) {
+        // INR / DCR
+        if (dst == LOCKSTEP_M)
+            lockstep_gather_m(ls, mask);
+        lockstep_inr_dcr(ls, mask, ls->reg[dst], op & 1);
+        if (dst == LOCKSTEP_M)
+            lockstep_scatter_m(ls, mask);
+    } else if (op < 0x40 && (op & 0x0F) == 0x01) {
+        // LXI
+        for (int lane = 0; lane < ls->lanes; lane++) {
+            if (!mask[lane])
+                continue;
+            if (rh == 6)
+                ls->sp[lane] = address;
+            else
+                lockstep_set_pair(ls, rh, lane, address);
+        }
+        length = 3;
+    } else if (op < 0x40 && ((op & 0x0F) == 0x03 || (op & 0x0F) == 0x0B)) {
+        // INX / DCX
+        int delta = (op & 0x08) ? -1 : 1;
+
+        for (int lane = 0; lane < ls->lanes; lane++) {
+            if (!mask[lane])
+                continue;
+            if (rh == 6)
+                ls->sp[lane] += delta;
+            else
+                lockstep_set_pair(ls, rh, lane, (uint16_t)(lockstep_pair(ls, rh, lane) + delta));
+        }
+    } else if (op < 0x40 && (op & 0x0F) == 0x09) {
+        // DAD
+        for (int lane = 0; lane < ls->lanes; lane++) {
+            uint32_t result;
+
+            if (!mask[lane])
+                continue;
+            result = lockstep_pair(ls, 4, lane) + (rh == 6 ? ls->sp[lane] : lockstep_pair(ls, rh, lane));
+            lockstep_set_pair(ls, 4, lane, (uint16_t)result);
+            ls->cy[lane] = (result >> 16) & 1;
+        }
+    } else if (op == 0xC3 || (op & 0xC7) == 0xC2) {
+        // JMP / Jccc, each lane takes its own branch, the groups split on the next step
+        for (int lane = 0; lane < ls->lanes; lane++) {
+            if (!mask[lane])
+                continue;
+            if (op == 0xC3) {
+                ls->pc[lane] = address;
+                ls->cycles[lane] += cycles8080[op];
+            } else if (lockstep_condition(ls, lane, dst)) {
+                ls->pc[lane] = address;
+                ls->cycles[lane] += cycles8080[op] + JUMP_TAKEN8080;
+            } else {
+                ls->pc[lane] += 3;
+                ls->cycles[lane] += cycles8080[op];
+            }
+        }
+        ls->vector_steps++;
+        return 1;
+    } else if (op == 0x00) {
+        // NOP
+    } else {
+        return 0;
+    }
+
+    for (int lane = 0; lane < LOCKSTEP_STRIDE; lane++) {
+        ls->pc[lane] += mask[lane] & length;
+        ls->cycles[lane] += mask[lane] & cycles8080[op];
+    }
+    ls->vector_steps++;
+    return 1;
+}
+
+/*
+    Execute one instruction for the group of lanes with the lowest PC.
+    A lane stops when it halts or when it has used budget states.
+    Returns the number of lanes which executed an instruction, 0 once every lane stopped.
+*/
+int lockstep_step(Lockstep8080 *ls, uint64_t budget)
+{
+    uint8_t mask[LOCKSTEP_STRIDE];
+    uint8_t running[LOCKSTEP_STRIDE];
+    uint8_t fetched[3];
+    uint16_t leader_pc = 0xffff;
+    int leader = -1;
+    int count = 0;
+
+    // fixed length loops over the whole stride so that the compiler can vectorize them
+    for (int lane = 0; lane < LOCKSTEP_STRIDE; lane++)
+        running[lane] = (lane < ls->lanes) & !ls->halted[lane] & (ls->cycles[lane] < budget);
+    for (int lane = 0; lane < LOCKSTEP_STRIDE; lane++)
+        if (running[lane] && ls->pc[lane] <= leader_pc) {
+            leader_pc = ls->pc[lane];
+            leader = lane;
+        }
+    if (leader < 0)
+        return 0;
+
+    for (int i = 0; i < 3; i++)
+        fetched[i] = memory_read(ls->memory[leader], (uint16_t)(leader_pc + i));
+
+    // outside of the ROM, lanes at the same PC with different code (self modifying code) wait for the next step
+    for (int lane = 0; lane < LOCKSTEP_STRIDE; lane++) {
+        mask[lane] = 0;
+        if (!running[lane] || ls->pc[lane] != leader_pc)
+            continue;
+        if (lane != leader && leader_pc >= ls->rom_end) {
+            Memory8080 *memory = ls->memory[lane];
+
+            if (memory_read(memory, leader_pc) != fetched[0] || memory_read(memory, (uint16_t)(leader_pc + 1)) != fetched[1]
+                || memory_read(memory, (uint16_t)(leader_pc + 2)) != fetched[2])
+                continue;
+        }
+        mask[lane] = 0xff;
+        count++;
+    }
+
+    if (count > 1 && lockstep_vector(ls, mask, fetched[0], fetched[1], fetched[2]))
+        return count;
+
+    for (int lane = 0; lane < ls->lanes; lane++)
+        if (mask[lane])
+            lockstep_scalar(ls, lane);
+    return count;
+}
+
+void lockstep_run(Lockstep8080 *ls, uint64_t budget)
+{
+    while (lockstep_step(ls, budget))
+        ;
+}
+
+
+/*
+    Benchmark and check of the lockstep engine against the scalar core.
+    Every lane runs program with its own input : IN returns a hash of the lane number and
+    of the number of IN executed so far.
+*/
+typedef struct LockstepInput {
+    uint32_t lane;
+    uint32_t reads;
+} LockstepInput;
+
+static uint8_t lockstep_port_in(State8080 *state, uint8_t port)
+{
+    LockstepInput *input = (LockstepInput *)state->user;
+    uint32_t hash = (input->lane + 1) * 0x9E3779B1u ^ (input->reads++ * 0x85EBCA6Bu) ^ port;
+
+    hash ^= hash >> 15;
+    hash *= 0x2C1B3C6Du;
+    return (uint8_t)(hash ^ (hash >> 13));
+}
+
+static double lockstep_seconds(void)
+{
+    return (double)clock() / CLOCKS_PER_SEC;
+}
+
+// Returns the number of lanes whose final state differs from the scalar core
+int lockstep_benchmark(const unsigned char *program, int size, int lanes, uint64_t budget, uint16_t rom_end)
+{
+    static Lockstep8080 ls;
+    State8080 reference[LOCKSTEP_LANES];
+    State8080 result;
+    LockstepInput inputs[2][LOCKSTEP_LANES];
+    Memory8080 *image = NULL;
+    uint64_t instructions = 0;
+    double start, scalar_time, lockstep_time;
+    int mismatches = 0;
+
+    if (lanes < 1 || lanes > LOCKSTEP_LANES) {
+        printf("Error : the number of lanes must be between 1 and %d\n", LOCKSTEP_LANES);
+        return -1;
+    }
+
+    // every lane starts from a copy on write fork of the same image
+    image = memory_create();
+    memory_load(image, 0, program, size);
+
+    lockstep_init(&ls, lanes, lockstep_port_in, NULL);
+    ls.rom_end = rom_end;
+    for (int lane = 0; lane < lanes; lane++) {
+        inputs[0][lane].lane = inputs[1][lane].lane = lane;
+        inputs[0][lane].reads = inputs[1][lane].reads = 0;
+
+        init8080(&reference[lane], memory_fork(image));
+        reference[lane].port_in = lockstep_port_in;
+        reference[lane].user = &inputs[0][lane];
+
+        init8080(&result, memory_fork(image));
+        result.user = &inputs[1][lane];
+        lockstep_load(&ls, lane, &result);
+    }
+
+    start = lockstep_seconds();
+    for (int lane = 0; lane < lanes; lane++) {
+        while (!reference[lane].halted && reference[lane].cycles < budget) {
+            emulate8080(&reference[lane]);
+            instructions++;
+        }
+    }
+    scalar_time = lockstep_seconds() - start;
+
+    start = lockstep_seconds();
+    lockstep_run(&ls, budget);
+    lockstep_time = lockstep_seconds() - start;
+
+    for (int lane = 0; lane < lanes; lane++) {
+        State8080 *expected = &reference[lane];
+
+        lockstep_store(&ls, lane, &result);
+        if (result.a != expected->a || result.b != expected->b || result.c != expected->c
+            || result.d != expected->d || result.e != expected->e || result.h != expected->h
+            || result.l != expected->l || result.sp != expected->sp || result.pc != expected->pc
+            || psw8080(&result) != psw8080(expected) || result.cycles != expected->cycles
+            || result.halted != expected->halted || result.int_enable != expected->int_enable
+#ifdef CPU_8085
+            || result.interrupt_mask != expected->interrupt_mask || result.sod != expected->sod
+#endif
+            || !memory_equal(result.memory, expected->memory)) {
+            printf("Lane %d differs : PC %04x / %04x, cycles %llu / %llu\n", lane, result.pc, expected->pc,
+                (unsigned long long)result.cycles, (unsigned long long)expected->cycles);
+            mismatches++;
+        }
+        memory_destroy(result.memory);
+        memory_destroy(expected->memory);
+    }
+
+    printf("%d lanes, %d bytes per vector, %llu instructions\n", lanes, LOCKSTEP_VECTOR, (unsigned long long)instructions);
+    printf("scalar   : %.3f s, %.2f MIPS\n", scalar_time, scalar_time > 0 ? instructions / scalar_time / 1e6 : 0.0);
+    printf("lockstep : %.3f s, %.2f MIPS, %llu group steps, %llu scalar steps\n", lockstep_time,
+        lockstep_time > 0 ? instructions / lockstep_time / 1e6 : 0.0,
+        (unsigned long long)ls.vector_steps, (unsigned long long)ls.scalar_steps);
+    printf("%d / %d lanes match the scalar core\n", lanes - mismatches, lanes);
+
+    memory_destroy(image);
+    return mismatches;
+}
+
+#ifdef CPU_8085
+/*
+    8085 self check, run by -lockstep before the program of the user
+
+    Covers the instructions whose flags or state differ from the 8080 : the AND group
+    sets AC, RIM and SIM read and write the interrupt mask and SOD, every lane reads its
+    own input so the flags and masks differ between the lanes
+*/
+static const unsigned char lockstep_check8085[] = {
+    0x31, 0x00, 0x80,   // LXI SP,8000h
+    0xDB, 0x00,         // IN 0
+    0x47,               // MOV B,A
+    0xE6, 0x0F,         // ANI 0Fh
+    0xA0,               // ANA B
+    0xF5,               // PUSH PSW
+    0x20,               // RIM
+    0x4F,               // MOV C,A
+    0x78,               // MOV A,B
+    0xF6, 0x48,         // ORI 48h
+    0x30,               // SIM
+    0x20,               // RIM
+    0x57,               // MOV D,A
+    0xF5,               // PUSH PSW
+    0xC3, 0x00, 0x00    // JMP 0000h
+};
+
+// Returns the number of lanes whose final state differs from the scalar core
+int lockstep_check(int lanes)
+{
+    printf("8085 check :\n");
+    return lockstep_benchmark(lockstep_check8085, sizeof(lockstep_check8085), lanes, 100000, sizeof(lockstep_check8085));
+}
+#endif
+
+#endif
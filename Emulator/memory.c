@@ -0,0 +1,263 @@
+#ifndef EMULATOR_MEMORY_C
+#define EMULATOR_MEMORY_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Memory map
+
+    The 64 KB address space is split in 64 pages of 1 KB. A page can be shared by several
+    memory maps (forks of the same machine), it holds a reference count and is copied the
+    first time one of its owners writes to it (copy on write).
+
+    read[page] always points to the data of the page.
+    write[page] points to the same data when the page can be written directly (private
+    RAM page without flags) and is NULL otherwise : the write then goes through
+    memory_write_slow which copies shared pages, drops the writes to ROM pages and records
+    the bytes changed in tracked pages and reports the writes to watched pages.
+*/
+
+
+#define MEMORY_PAGE_SHIFT 10
+#define MEMORY_PAGE_SIZE (1 << MEMORY_PAGE_SHIFT)
+#define MEMORY_PAGE_MASK (MEMORY_PAGE_SIZE - 1)
+#define MEMORY_PAGE_COUNT (0x10000 >> MEMORY_PAGE_SHIFT)
+
+// page flags
+#define MEMORY_ROM 0x01
+#define MEMORY_TRACK 0x02
+// the writes to the page are reported to memory->watch
+#define MEMORY_WATCH 0x04
+
+typedef struct MemoryPage {
+    uint32_t refcount;
+    uint8_t data[MEMORY_PAGE_SIZE];
+} MemoryPage;
+
+typedef struct Memory8080 Memory8080;
+
+// Called for every write to a MEMORY_WATCH page, before the write is done (or dropped)
+typedef void (*MemoryWatch8080)(Memory8080 *memory, uint16_t address, uint8_t value);
+
+struct Memory8080 {
+    uint8_t *read[MEMORY_PAGE_COUNT];
+    uint8_t *write[MEMORY_PAGE_COUNT];
+    MemoryPage *pages[MEMORY_PAGE_COUNT];
+    uint8_t flags[MEMORY_PAGE_COUNT];
+    // number of pages copied by the writes to shared pages
+    uint64_t copies;
+    // one bit per byte of the address space, set when a write changes a byte of a MEMORY_TRACK page
+    uint8_t *written;
+    MemoryWatch8080 watch;
+    void *watch_user;
+};
+
+// number of pages allocated by every memory map, shared pages are counted once
+static uint64_t memory_pages_allocated = 0;
+
+
+static MemoryPage *memory_new_page(void)
+{
+    MemoryPage *page = malloc(sizeof(MemoryPage));
+
+    if (page == NULL) {
+        printf("Error : couldn't allocate a page of memory\n");
+        exit(1);
+    }
+    page->refcount = 1;
+    memory_pages_allocated++;
+    return page;
+}
+
+static void memory_release_page(MemoryPage *page)
+{
+    if (--page->refcount == 0) {
+        memory_pages_allocated--;
+        free(page);
+    }
+}
+
+// Writes to the page can skip memory_write_slow
+static void memory_update_page(Memory8080 *memory, int index)
+{
+    MemoryPage *page = memory->pages[index];
+
+    memory->read[index] = page->data;
+    memory->write[index] = (page->refcount == 1 && memory->flags[index] == 0) ? page->data : NULL;
+}
+
+// 64 KB of RAM filled with zeros
+Memory8080 *memory_create(void)
+{
+    Memory8080 *memory = calloc(1, sizeof(Memory8080));
+
+    if (memory == NULL) {
+        printf("Error : couldn't allocate a memory map\n");
+        exit(1);
+    }
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++) {
+        memory->pages[index] = memory_new_page();
+        memset(memory->pages[index]->data, 0, MEMORY_PAGE_SIZE);
+        memory_update_page(memory, index);
+    }
+    return memory;
+}
+
+void memory_destroy(Memory8080 *memory)
+{
+    if (memory == NULL)
+        return;
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++)
+        memory_release_page(memory->pages[index]);
+    free(memory->written);
+    free(memory);
+}
+
+/*
+    New memory map sharing every page of memory, the pages are copied the first time
+    either map writes to them. Cost : one reference per page, no data is copied.
+*/
+Memory8080 *memory_fork(Memory8080 *memory)
+{
+    Memory8080 *fork = malloc(sizeof(Memory8080));
+
+    if (fork == NULL) {
+        printf("Error : couldn't allocate a memory map\n");
+        exit(1);
+    }
+    memcpy(fork, memory, sizeof(Memory8080));
+    fork->copies = 0;
+    // the tracked pages stay tracked, the fork records its writes once it calls memory_track
+    fork->written = NULL;
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++) {
+        memory->pages[index]->refcount++;
+        memory->write[index] = NULL;
+        fork->write[index] = NULL;
+    }
+    return fork;
+}
+
+// Make the page private to memory, copying it if it is shared
+static uint8_t *memory_own_page(Memory8080 *memory, int index)
+{
+    MemoryPage *page = memory->pages[index];
+
+    if (page->refcount > 1) {
+        MemoryPage *copy = memory_new_page();
+
+        memcpy(copy->data, page->data, MEMORY_PAGE_SIZE);
+        memory_release_page(page);
+        memory->pages[index] = copy;
+        memory->copies++;
+    }
+    memory_update_page(memory, index);
+    return memory->pages[index]->data;
+}
+
+void memory_write_slow(Memory8080 *memory, uint16_t address, uint8_t value)
+{
+    int index = address >> MEMORY_PAGE_SHIFT;
+    uint8_t flags = memory->flags[index];
+    uint8_t *page;
+
+    if ((flags & MEMORY_WATCH) && memory->watch != NULL)
+        memory->watch(memory, address, value);
+    if (flags & MEMORY_ROM)
+        return;
+    page = memory_own_page(memory, index);
+    if ((flags & MEMORY_TRACK) && memory->written != NULL && page[address & MEMORY_PAGE_MASK] != value)
+        memory->written[address >> 3] |= 1 << (address & 7);
+    page[address & MEMORY_PAGE_MASK] = value;
+}
+
+static inline uint8_t memory_read(const Memory8080 *memory, uint16_t address)
+{
+    return memory->read[address >> MEMORY_PAGE_SHIFT][address & MEMORY_PAGE_MASK];
+}
+
+static inline void memory_write(Memory8080 *memory, uint16_t address, uint8_t value)
+{
+    uint8_t *page = memory->write[address >> MEMORY_PAGE_SHIFT];
+
+    if (page != NULL)
+        page[address & MEMORY_PAGE_MASK] = value;
+    else
+        memory_write_slow(memory, address, value);
+}
+
+// Copy data into the memory, ROM pages included
+void memory_load(Memory8080 *memory, uint16_t address, const uint8_t *data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size && address + i <= 0xffff; i++) {
+        int index = (address + i) >> MEMORY_PAGE_SHIFT;
+        uint8_t *page = memory_own_page(memory, index);
+
+        page[(address + i) & MEMORY_PAGE_MASK] = data[i];
+    }
+}
+
+// Copy size bytes of the memory starting at address into data
+void memory_dump(const Memory8080 *memory, uint16_t address, uint8_t *data, uint32_t size)
+{
+    for (uint32_t i = 0; i < size; i++)
+        data[i] = memory_read(memory, (uint16_t)(address + i));
+}
+
+// Add (set = 1) or remove (set = 0) flags on the pages between start and start + size
+void memory_set_flags(Memory8080 *memory, uint16_t start, uint32_t size, uint8_t flags, int set)
+{
+    for (uint32_t address = start & ~MEMORY_PAGE_MASK; address < start + size && address <= 0xffff; address += MEMORY_PAGE_SIZE) {
+        int index = address >> MEMORY_PAGE_SHIFT;
+
+        if (set)
+            memory->flags[index] |= flags;
+        else
+            memory->flags[index] &= ~flags;
+        memory_update_page(memory, index);
+    }
+}
+
+// The writes between start and start + size are ignored
+void memory_protect(Memory8080 *memory, uint16_t start, uint32_t size)
+{
+    memory_set_flags(memory, start, size, MEMORY_ROM, 1);
+}
+
+/*
+    Record the bytes changed between start and start + size in memory->written.
+    The owner of the memory reads and clears the bits.
+*/
+void memory_track(Memory8080 *memory, uint16_t start, uint32_t size)
+{
+    if (memory->written == NULL) {
+        memory->written = calloc(0x10000 / 8, 1);
+        if (memory->written == NULL) {
+            printf("Error : couldn't allocate the write tracking bitmap\n");
+            exit(1);
+        }
+    }
+    memory_set_flags(memory, start, size, MEMORY_TRACK, 1);
+}
+
+int memory_equal(const Memory8080 *lhs, const Memory8080 *rhs)
+{
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++)
+        if (lhs->read[index] != rhs->read[index] && memcmp(lhs->read[index], rhs->read[index], MEMORY_PAGE_SIZE) != 0)
+            return 0;
+    return 1;
+}
+
+// Number of pages only owned by memory
+int memory_private_pages(const Memory8080 *memory)
+{
+    int count = 0;
+
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++)
+        count += memory->pages[index]->refcount == 1;
+    return count;
+}
+
+#endif
@@ -0,0 +1,254 @@
+#ifndef EMULATOR_PROFILE_C
+#define EMULATOR_PROFILE_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.c"
+#include "../Disassembler/disassembler.c"
+
+/*
+    Execution profiler
+
+    profile_step executes one instruction and adds 1 to executions[PC] and the states of
+    the instruction to cycles[PC], two flat arrays of 64K counters.
+
+    A shadow call stack follows CALL / Ccc / RST / interrupts and RET / Rcc, the states are
+    also added to the node of the call tree of the current routine (a routine is named
+    by its entry address). A call or a return is detected by SP moving by 2, so the calls
+    not taken, the return addresses dropped by the program (POP, SPHL, ...) and the
+    interrupts (SP moving between two instructions) are handled without decoding.
+
+    Output :
+        - folded stacks, one line per call path "0000;01a4;1c4b 12345", for flamegraph.pl
+        - the hottest addresses, annotated with disassemble8080
+*/
+
+
+#define PROFILE_DEPTH 64
+// nodes of the call tree, power of two
+#define PROFILE_NODES 16384
+
+// opcode kinds for the call stack
+#define PROFILE_CALL 1
+#define PROFILE_RET 2
+
+typedef struct ProfileFrame {
+    // node of the caller
+    uint32_t node;
+    // SP before the call, the frame is left once SP goes back to it
+    uint16_t sp;
+} ProfileFrame;
+
+typedef struct Profile8080 {
+    uint64_t executions[0x10000];
+    uint64_t cycles[0x10000];
+    uint8_t kind[256];
+    // call tree, node 0 is the code running when profiling started
+    uint16_t node_address[PROFILE_NODES];
+    uint32_t node_parent[PROFILE_NODES];
+    uint64_t node_cycles[PROFILE_NODES];
+    uint32_t node_count;
+    // (parent, address) -> child + 1, 0 for an empty slot
+    uint32_t children[PROFILE_NODES * 2];
+    ProfileFrame stack[PROFILE_DEPTH];
+    int depth;
+    uint32_t node;
+    // SP after the previous instruction
+    uint16_t sp;
+    uint64_t total;
+} Profile8080;
+
+
+Profile8080 *profile_create(const State8080 *state)
+{
+    static const uint8_t calls[] = {
+        0xCD, 0xC4, 0xCC, 0xD4, 0xDC, 0xE4, 0xEC, 0xF4, 0xFC, 0xDD, 0xED, 0xFD,
+        0xC7, 0xCF, 0xD7, 0xDF, 0xE7, 0xEF, 0xF7, 0xFF
+    };
+    static const uint8_t returns[] = {0xC9, 0xD9, 0xC0, 0xC8, 0xD0, 0xD8, 0xE0, 0xE8, 0xF0, 0xF8};
+    Profile8080 *profile = calloc(1, sizeof(Profile8080));
+
+    if (profile == NULL) {
+        printf("Error : couldn't allocate the profiler\n");
+        exit(1);
+    }
+    for (size_t i = 0; i < sizeof(calls); i++)
+        profile->kind[calls[i]] = PROFILE_CALL;
+    for (size_t i = 0; i < sizeof(returns); i++)
+        profile->kind[returns[i]] = PROFILE_RET;
+    profile->node_address[0] = state->pc;
+    profile->node_count = 1;
+    profile->sp = state->sp;
+    return profile;
+}
+
+void profile_destroy(Profile8080 *profile)
+{
+    free(profile);
+}
+
+// Node of the routine address called from parent, the parent once the tree is full
+static uint32_t profile_child(Profile8080 *profile, uint32_t parent, uint16_t address)
+{
+    uint32_t key = parent << 16 | address;
+    uint32_t slot = (key * 2654435761u) & (PROFILE_NODES * 2 - 1);
+
+    while (profile->children[slot] != 0) {
+        uint32_t node = profile->children[slot] - 1;
+
+        if (profile->node_parent[node] == parent && profile->node_address[node] == address)
+            return node;
+        slot = (slot + 1) & (PROFILE_NODES * 2 - 1);
+    }
+    if (profile->node_count == PROFILE_NODES)
+        return parent;
+    profile->node_address[profile->node_count] = address;
+    profile->node_parent[profile->node_count] = parent;
+    profile->children[slot] = ++profile->node_count;
+    return profile->node_count - 1;
+}
+
+// sp : SP before the call, address : the routine called
+static void profile_enter(Profile8080 *profile, uint16_t sp, uint16_t address)
+{
+    // past the maximum depth the calls are attributed to the deepest routine, their
+    // returns don't match any frame
+    if (profile->depth == PROFILE_DEPTH)
+        return;
+    profile->stack[profile->depth].node = profile->node;
+    profile->stack[profile->depth].sp = sp;
+    profile->depth++;
+    profile->node = profile_child(profile, profile->node, address);
+}
+
+static void profile_leave(Profile8080 *profile, uint16_t sp)
+{
+    while (profile->depth > 0 && profile->stack[profile->depth - 1].sp <= sp)
+        profile->node = profile->stack[--profile->depth].node;
+}
+
+// Execute one instruction of state, returns the number of states used
+static inline int profile_step(Profile8080 *profile, State8080 *state)
+{
+    uint16_t pc = state->pc;
+    uint16_t sp = state->sp;
+    uint8_t op = memory_read(state->memory, pc);
+    int states;
+
+    // the stack moved outside of an instruction : interrupt
+    if (sp != profile->sp && sp == (uint16_t)(profile->sp - 2))
+        profile_enter(profile, profile->sp, pc);
+
+    states = emulate8080(state);
+    profile->executions[pc]++;
+    profile->cycles[pc] += states;
+    profile->node_cycles[profile->node] += states;
+    profile->total += states;
+
+    if (profile->kind[op] == PROFILE_CALL && state->sp == (uint16_t)(sp - 2))
+        profile_enter(profile, sp, state->pc);
+    else if (profile->kind[op] == PROFILE_RET && state->sp == (uint16_t)(sp + 2))
+        profile_leave(profile, state->sp);
+    profile->sp = state->sp;
+    return states;
+}
+
+// One line per call path with states : "caller;callee;... states"
+void profile_write_folded(const Profile8080 *profile, FILE *f)
+{
+    uint32_t path[PROFILE_NODES];
+
+    for (uint32_t node = 0; node < profile->node_count; node++) {
+        int length = 0;
+
+        if (profile->node_cycles[node] == 0)
+            continue;
+        for (uint32_t current = node; ; current = profile->node_parent[current]) {
+            path[length++] = current;
+            if (current == 0)
+                break;
+        }
+        while (length-- > 0)
+            fprintf(f, "%04x%s", profile->node_address[path[length]], length ? ";" : "");
+        fprintf(f, " %llu\n", (unsigned long long)profile->node_cycles[node]);
+    }
+}
+
+static const uint64_t *profile_sort_cycles;
+
+static int profile_compare(const void *lhs, const void *rhs)
+{
+    uint64_t a = profile_sort_cycles[*(const uint16_t *)lhs];
+    uint64_t b = profile_sort_cycles[*(const uint16_t *)rhs];
+
+    return a < b ? 1 : a > b ? -1 : 0;
+}
+
+// The count addresses with the most states, disassembled from the current memory
+void profile_print_hot(const Profile8080 *profile, const Memory8080 *memory, int count)
+{
+    static uint16_t order[0x10000];
+    // 2 more bytes for the operands of an instruction at 0xFFFF
+    static unsigned char code[0x10002];
+
+    memory_dump(memory, 0, code, 0x10000);
+    for (int pc = 0; pc < 0x10000; pc++)
+        order[pc] = (uint16_t)pc;
+    profile_sort_cycles = profile->cycles;
+    qsort(order, 0x10000, sizeof(order[0]), profile_compare);
+
+    printf("address\t    states\t   %%\texecutions\tinstruction\n");
+    for (int i = 0; i < count && i < 0x10000 && profile->cycles[order[i]] > 0; i++) {
+        uint16_t pc = order[i];
+
+        printf("%04x\t%10llu\t%5.2f\t%10llu\t", pc, (unsigned long long)profile->cycles[pc],
+            profile->total ? 100.0 * profile->cycles[pc] / profile->total : 0.0,
+            (unsigned long long)profile->executions[pc]);
+        disassemble8080(code, pc);
+    }
+}
+
+
+/*
+    Profile program (loaded at 0) for cycles states or until it halts with the interrupts
+    disabled, print the hot addresses and write the folded stacks to folded
+*/
+int profile_run(const unsigned char *program, int size, uint64_t cycles, const char *folded)
+{
+    State8080 state;
+    Profile8080 *profile;
+    clock_t start;
+    double seconds;
+
+    init8080(&state, memory_create());
+    memory_load(state.memory, 0, program, size);
+    profile = profile_create(&state);
+
+    start = clock();
+    while (state.cycles < cycles && !(state.halted && !state.int_enable))
+        profile_step(profile, &state);
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("%llu states profiled in %.3f s, %u routines in the call tree\n\n",
+        (unsigned long long)profile->total, seconds, profile->node_count);
+    profile_print_hot(profile, state.memory, 20);
+
+    if (folded != NULL) {
+        FILE *f = fopen(folded, "w");
+
+        if (f == NULL) {
+            printf("Error : couldn't open the file %s\n", folded);
+        } else {
+            profile_write_folded(profile, f);
+            fclose(f);
+        }
+    }
+    profile_destroy(profile);
+    memory_destroy(state.memory);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,374 @@
+#ifndef EMULATOR_REPLAY_C
+#define EMULATOR_REPLAY_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "emulator.c"
+
+/*
+    Deterministic record / replay
+
+    The core is deterministic, the only inputs of a run are :
+        - the values read by IN
+        - the interrupts, and the cycle at which they are taken
+        - the host input (buttons, ...), only kept so the host can follow the replay
+
+    While recording, every input is appended to a log, keyed by the cycle counter.
+    Replaying the log from the same initial state reproduces the run bit exactly, without
+    the devices nor the host : replay_play runs the CPU up to the next interrupt or host
+    event, the IN instructions read their value from the log.
+
+    Event encoding, little endian base 128 varints :
+        varint (cycle - cycle of the previous event) << 3 | kind, followed by
+            REPLAY_IN_SAME      port                (same value as the previous IN of the port)
+            REPLAY_IN           port, value
+            REPLAY_INTERRUPT    rst
+            REPLAY_HOST         channel, value
+    Most events take 2 or 3 bytes. Recording costs nothing per instruction, only per IN.
+*/
+
+
+#define REPLAY_RECORD 0
+#define REPLAY_PLAY 1
+
+// event kinds
+#define REPLAY_IN_SAME 0
+#define REPLAY_IN 1
+#define REPLAY_INTERRUPT 2
+#define REPLAY_HOST 3
+
+#define REPLAY_MAGIC "R8080"
+#define REPLAY_VERSION 1
+
+// Called during replay_play for the host events
+typedef void (*ReplayHost8080)(State8080 *state, uint8_t channel, uint8_t value);
+
+typedef struct Replay8080 {
+    int mode;
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+    // read position of the next event (play)
+    size_t position;
+    // cycle of the previous event
+    uint64_t cycle;
+    // cycle counter at the end of the recording
+    uint64_t end;
+    // hash of the program the log was recorded with
+    uint32_t program;
+    uint8_t last_in[256];
+    // previous value of each host channel, 0x100 before the first one
+    uint16_t last_host[256];
+    // the device wrapped by replay_attach
+    PortIn8080 port_in;
+    // next event (play), kind is -1 at the end of the log
+    int kind;
+    uint64_t next;
+    uint8_t arg1;
+    uint8_t arg2;
+    uint64_t events;
+    // set when the run doesn't follow the log (different program or initial state)
+    int desync;
+} Replay8080;
+
+
+// FNV-1a, identifies the program a log was recorded with
+uint32_t replay_hash(const uint8_t *data, size_t size)
+{
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < size; i++)
+        hash = (hash ^ data[i]) * 16777619u;
+    return hash;
+}
+
+void replay_init(Replay8080 *replay, int mode, uint32_t program)
+{
+    memset(replay, 0, sizeof(*replay));
+    replay->mode = mode;
+    replay->program = program;
+    replay->kind = -1;
+    for (int i = 0; i < 256; i++)
+        replay->last_host[i] = 0x100;
+}
+
+void replay_free(Replay8080 *replay)
+{
+    free(replay->data);
+    replay->data = NULL;
+    replay->size = replay->capacity = 0;
+}
+
+static void replay_byte(Replay8080 *replay, uint8_t value)
+{
+    if (replay->size == replay->capacity) {
+        size_t capacity = replay->capacity ? replay->capacity * 2 : 4096;
+        uint8_t *data = realloc(replay->data, capacity);
+
+        if (data == NULL) {
+            printf("Error : couldn't allocate %zu bytes for the replay log\n", capacity);
+            exit(1);
+        }
+        replay->data = data;
+        replay->capacity = capacity;
+    }
+    replay->data[replay->size++] = value;
+}
+
+static void replay_varint(Replay8080 *replay, uint64_t value)
+{
+    while (value >= 0x80) {
+        replay_byte(replay, (uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    replay_byte(replay, (uint8_t)value);
+}
+
+static void replay_event(Replay8080 *replay, uint64_t cycle, int kind)
+{
+    replay_varint(replay, (cycle - replay->cycle) << 3 | kind);
+    replay->cycle = cycle;
+    replay->events++;
+}
+
+// Decode the next event of the log into kind, next, arg1 and arg2
+static void replay_decode(Replay8080 *replay)
+{
+    uint64_t value = 0;
+    int shift = 0;
+
+    replay->kind = -1;
+    if (replay->position >= replay->size)
+        return;
+    do {
+        if (replay->position >= replay->size || shift > 63) {
+            replay->desync = 1;
+            return;
+        }
+        value |= (uint64_t)(replay->data[replay->position] & 0x7f) << shift;
+        shift += 7;
+    } while (replay->data[replay->position++] & 0x80);
+
+    replay->next = replay->cycle + (value >> 3);
+    replay->cycle = replay->next;
+    replay->kind = value & 7;
+    if (replay->position + (replay->kind == REPLAY_IN || replay->kind == REPLAY_HOST ? 2 : 1) > replay->size) {
+        replay->kind = -1;
+        replay->desync = 1;
+        return;
+    }
+    replay->arg1 = replay->data[replay->position++];
+    if (replay->kind == REPLAY_IN || replay->kind == REPLAY_HOST)
+        replay->arg2 = replay->data[replay->position++];
+    else if (replay->kind == REPLAY_IN_SAME)
+        replay->arg2 = replay->last_in[replay->arg1];
+}
+
+
+static uint8_t replay_port_in(State8080 *state, uint8_t port)
+{
+    Replay8080 *replay = state->replay;
+    uint8_t value;
+
+    if (replay->mode == REPLAY_RECORD) {
+        value = replay->port_in ? replay->port_in(state, port) : 0;
+        if (value == replay->last_in[port]) {
+            replay_event(replay, state->cycles, REPLAY_IN_SAME);
+            replay_byte(replay, port);
+        } else {
+            replay_event(replay, state->cycles, REPLAY_IN);
+            replay_byte(replay, port);
+            replay_byte(replay, value);
+        }
+        replay->last_in[port] = value;
+        return value;
+    }
+
+    if ((replay->kind != REPLAY_IN && replay->kind != REPLAY_IN_SAME) || replay->next != state->cycles
+            || replay->arg1 != port) {
+        replay->desync = 1;
+        return 0;
+    }
+    value = replay->arg2;
+    replay->last_in[port] = value;
+    replay_decode(replay);
+    return value;
+}
+
+/*
+    Attach the log to state, the IN instructions go through the log.
+    To play, state must be in the initial state of the recording.
+*/
+void replay_attach(Replay8080 *replay, State8080 *state)
+{
+    replay->port_in = state->port_in;
+    state->port_in = replay_port_in;
+    state->replay = replay;
+    if (replay->mode == REPLAY_PLAY) {
+        replay->position = 0;
+        replay->cycle = 0;
+        memset(replay->last_in, 0, sizeof(replay->last_in));
+        replay_decode(replay);
+    }
+}
+
+// Restore the device wrapped by replay_attach
+void replay_detach(Replay8080 *replay, State8080 *state)
+{
+    if (replay->mode == REPLAY_RECORD)
+        replay->end = state->cycles;
+    state->port_in = replay->port_in;
+    state->replay = NULL;
+}
+
+/*
+    interrupt8080 for the machines that can be recorded : the interrupts actually taken are
+    logged. While playing, the interrupts come from the log and this call does nothing.
+*/
+void replay_interrupt(State8080 *state, int rst)
+{
+    Replay8080 *replay = state->replay;
+
+    if (replay == NULL) {
+        interrupt8080(state, rst);
+        return;
+    }
+    if (replay->mode == REPLAY_PLAY || !state->int_enable)
+        return;
+    replay_event(replay, state->cycles, REPLAY_INTERRUPT);
+    replay_byte(replay, (uint8_t)rst);
+    interrupt8080(state, rst);
+}
+
+// Host input on channel (a button port, ...), only the changes are logged
+void replay_host(State8080 *state, uint8_t channel, uint8_t value)
+{
+    Replay8080 *replay = state->replay;
+
+    if (replay == NULL || replay->mode != REPLAY_RECORD || replay->last_host[channel] == value)
+        return;
+    replay->last_host[channel] = value;
+    replay_event(replay, state->cycles, REPLAY_HOST);
+    replay_byte(replay, channel);
+    replay_byte(replay, value);
+}
+
+/*
+    Run the attached state until the cycle counter reaches cycles (or the end of the
+    recording), delivering the interrupts and the host events of the log.
+    Returns 0 once the end of the recording is reached or if the run left the log.
+*/
+int replay_play(State8080 *state, uint64_t cycles, ReplayHost8080 host)
+{
+    Replay8080 *replay = state->replay;
+
+    if (cycles > replay->end)
+        cycles = replay->end;
+    while (state->cycles < cycles && !replay->desync) {
+        uint64_t limit = cycles;
+
+        while (replay->kind == REPLAY_INTERRUPT || replay->kind == REPLAY_HOST) {
+            if (replay->next > state->cycles)
+                break;
+            if (replay->next < state->cycles) {
+                replay->desync = 1;
+                return 0;
+            }
+            if (replay->kind == REPLAY_INTERRUPT)
+                interrupt8080(state, replay->arg1);
+            else if (host != NULL)
+                host(state, replay->arg1, replay->arg2);
+            replay_decode(replay);
+        }
+        // an IN is read by the instruction starting at its cycle
+        if ((replay->kind == REPLAY_IN || replay->kind == REPLAY_IN_SAME) && replay->next < state->cycles) {
+            replay->desync = 1;
+            return 0;
+        }
+        if (replay->kind >= 0 && replay->next < limit)
+            limit = replay->kind == REPLAY_IN || replay->kind == REPLAY_IN_SAME ? replay->next + 1 : replay->next;
+        while (state->cycles < limit)
+            emulate8080(state);
+    }
+    return !replay->desync && state->cycles < replay->end;
+}
+
+
+static void replay_write64(FILE *f, uint64_t value)
+{
+    uint8_t bytes[8];
+
+    for (int i = 0; i < 8; i++)
+        bytes[i] = (uint8_t)(value >> (8 * i));
+    fwrite(bytes, sizeof(bytes), 1, f);
+}
+
+static uint64_t replay_read64(const uint8_t *bytes)
+{
+    uint64_t value = 0;
+
+    for (int i = 0; i < 8; i++)
+        value |= (uint64_t)bytes[i] << (8 * i);
+    return value;
+}
+
+/*
+    File : "R8080", version, program hash (4 bytes), end cycle (8 bytes), event count
+    (8 bytes), log size (8 bytes), log
+*/
+int replay_save(const Replay8080 *replay, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        return 0;
+    }
+    fwrite(REPLAY_MAGIC, 5, 1, f);
+    fputc(REPLAY_VERSION, f);
+    for (int i = 0; i < 4; i++)
+        fputc((replay->program >> (8 * i)) & 0xff, f);
+    replay_write64(f, replay->end);
+    replay_write64(f, replay->events);
+    replay_write64(f, replay->size);
+    fwrite(replay->data, 1, replay->size, f);
+    fclose(f);
+    return 1;
+}
+
+// Load a log to play, returns 0 if the file isn't a log of this version
+int replay_load(Replay8080 *replay, const char *path)
+{
+    uint8_t header[34];
+    FILE *f = fopen(path, "rb");
+    uint64_t size;
+
+    if (f == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        return 0;
+    }
+    if (fread(header, sizeof(header), 1, f) != 1 || memcmp(header, REPLAY_MAGIC, 5) != 0
+            || header[5] != REPLAY_VERSION) {
+        printf("Error : %s is not a replay log\n", path);
+        fclose(f);
+        return 0;
+    }
+    replay_init(replay, REPLAY_PLAY, header[6] | header[7] << 8 | header[8] << 16 | (uint32_t)header[9] << 24);
+    replay->end = replay_read64(header + 10);
+    replay->events = replay_read64(header + 18);
+    size = replay_read64(header + 26);
+    replay->data = malloc(size ? size : 1);
+    if (replay->data == NULL || fread(replay->data, 1, size, f) != size) {
+        printf("Error : couldn't read the replay log %s\n", path);
+        fclose(f);
+        replay_free(replay);
+        return 0;
+    }
+    replay->size = replay->capacity = size;
+    fclose(f);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef EMULATOR_STATS_C
+#define EMULATOR_STATS_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.c"
+#include "../Disassembler/stats.c"
+
+/*
+    Dynamic instruction mix : stats_step adds 1 to the counter of the opcode at PC and the
+    states of the instruction to its cycles, the time spent halted isn't counted.
+*/
+
+
+// Count the instruction at PC and execute it, returns the number of states used
+static inline int stats_step(Stats8080 *stats, State8080 *state)
+{
+    uint8_t op = read8080(state, state->pc);
+    int halted = state->halted;
+    int states = emulate8080(state);
+
+    if (!halted) {
+        stats->count[op]++;
+        stats->cycles[op] += states;
+    }
+    return states;
+}
+
+
+/*
+    Print the static mix of program, then, if cycles isn't 0, run it (loaded at 0) for cycles
+    states or until it halts with the interrupts disabled and print the dynamic mix
+*/
+int stats_run(const unsigned char *program, int size, uint64_t cycles)
+{
+    static Stats8080 stats;
+    State8080 state;
+    clock_t start;
+    double seconds;
+
+    memset(&stats, 0, sizeof(stats));
+    stats_decode(&stats, program, size);
+    printf("Static mix, %d bytes :\n\n", size);
+    stats_print(&stats, stdout);
+    if (cycles == 0)
+        return 0;
+
+    memset(&stats, 0, sizeof(stats));
+    init8080(&state, memory_create());
+    memory_load(state.memory, 0, program, size);
+    start = clock();
+    while (state.cycles < cycles && !(state.halted && !state.int_enable))
+        stats_step(&stats, &state);
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("\nDynamic mix, %llu states in %.3f s :\n\n", (unsigned long long)state.cycles, seconds);
+    stats_print(&stats, stdout);
+    memory_destroy(state.memory);
+    return 0;
+}
+
+#endif
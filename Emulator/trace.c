@@ -0,0 +1,572 @@
+#ifndef EMULATOR_TRACE_C
+#define EMULATOR_TRACE_C
+
+#include <signal.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "emulator.c"
+#include "../Disassembler/disassembler.c"
+
+/*
+    Instruction trace
+
+    trace_step packs every instruction in 8 bytes of a ring buffer : the 4 bytes at PC (the
+    opcode is dispatched from them, so the instruction isn't read twice) and PC. Every
+    sample instructions (a power of two, 1 for all of them) the registers, flags and cycle
+    counter are also copied in one block from State8080 into a second ring of snapshots,
+    and the values read by IN are logged through a port_in wrapper, like replay.c does.
+    Nothing is formatted while recording : the last records are only rendered by
+    trace_dump, through disassemble8080 on the stored opcode bytes, so the listing is right
+    even if the program has since overwritten its code. The registers of the steps between
+    two snapshots are rebuilt by trace_dump, see trace_replay. trace_execute runs the same
+    loop with the ring and the step count in registers, it is the one to use for a whole
+    run.
+
+    trace_dump_on_crash dumps the trace when the process receives SIGSEGV, SIGABRT, ...
+*/
+
+
+// The registers, the flags and the cycle counter are the first fields of State8080
+#define TRACE_STATE (offsetof(State8080, cycles) + sizeof(uint64_t))
+// instructions between two snapshots by default
+#define TRACE_SAMPLE 256
+
+typedef struct TraceSnapshot {
+    // raw copy of the first TRACE_STATE bytes of State8080
+    unsigned char state[TRACE_STATE];
+#ifdef CPU_8085
+    // read by RIM
+    uint8_t interrupt_mask;
+    uint8_t sid;
+    uint8_t sod;
+#endif
+} TraceSnapshot;
+
+typedef struct Trace8080 {
+    /*
+        bytes 0 - 3 : the bytes at PC, 4 - 5 : PC. Twice as many as the steps kept, so the
+        steps from the snapshot before the oldest one, which trace_dump replays, are kept too.
+    */
+    uint64_t *steps;
+    uint64_t step_mask;
+    // cycle counter << 8 | value of every IN, as many as the steps
+    uint64_t *inputs;
+    uint64_t input_count;
+    // number of steps kept, power of two
+    uint32_t size;
+    // steps written so far, the next one goes to steps[count & step_mask]
+    uint64_t count;
+    // snapshot of the state before every step count & sample_mask == 0, as many as the steps
+    TraceSnapshot *snapshots;
+    uint32_t snapshot_count;
+    uint32_t sample_shift;
+    uint64_t sample_mask;
+    // the state being traced, trace_dump replays the steps on its memory
+    const State8080 *state;
+    // the device wrapped by trace_port_in
+    PortIn8080 port_in;
+} Trace8080;
+
+
+static inline uint32_t trace_round(uint32_t size)
+{
+    uint32_t rounded = 1;
+
+    while (rounded < size && rounded < 0x80000000u)
+        rounded <<= 1;
+    return rounded;
+}
+
+/*
+    Keep the last size instructions, with the registers of one instruction out of sample.
+    size and sample are rounded up to powers of two.
+*/
+Trace8080 *trace_create(uint32_t size, uint32_t sample)
+{
+    Trace8080 *trace = malloc(sizeof(Trace8080));
+    uint32_t rounded = trace_round(size);
+    uint32_t period = trace_round(sample > 0 ? sample : 1);
+
+    if (period > rounded)
+        period = rounded;
+    if (trace == NULL || (trace->steps = malloc((size_t)rounded * 2 * sizeof(uint64_t))) == NULL
+        || (trace->inputs = malloc((size_t)rounded * 2 * sizeof(uint64_t))) == NULL
+        || (trace->snapshots = malloc(rounded / period * 2 * sizeof(TraceSnapshot))) == NULL) {
+        printf("Error : couldn't allocate a trace of %u instructions\n", rounded);
+        exit(1);
+    }
+    trace->step_mask = (uint64_t)rounded * 2 - 1;
+    trace->size = rounded;
+    trace->count = 0;
+    trace->input_count = 0;
+    trace->snapshot_count = rounded / period * 2;
+    trace->sample_mask = period - 1;
+    trace->sample_shift = 0;
+    trace->state = NULL;
+    trace->port_in = NULL;
+    while ((1u << trace->sample_shift) < period)
+        trace->sample_shift++;
+    return trace;
+}
+
+void trace_destroy(Trace8080 *trace)
+{
+    if (trace == NULL)
+        return;
+    free(trace->steps);
+    free(trace->inputs);
+    free(trace->snapshots);
+    free(trace);
+}
+
+// The 4 bytes at PC (3 at the end of a page), the opcode in the low byte
+static inline uint32_t trace_code(const State8080 *state)
+{
+    uint16_t pc = state->pc;
+    uint16_t offset = pc & MEMORY_PAGE_MASK;
+
+    if (offset <= MEMORY_PAGE_SIZE - 4) {
+        const uint8_t *code = state->memory->read[pc >> MEMORY_PAGE_SHIFT] + offset;
+
+        return (uint32_t)code[0] | (uint32_t)code[1] << 8 | (uint32_t)code[2] << 16 | (uint32_t)code[3] << 24;
+    }
+    return (uint32_t)memory_read(state->memory, pc) | (uint32_t)memory_read(state->memory, (uint16_t)(pc + 1)) << 8
+        | (uint32_t)memory_read(state->memory, (uint16_t)(pc + 2)) << 16;
+}
+
+static inline void trace_snapshot(Trace8080 *trace, uint64_t index, const State8080 *state)
+{
+    TraceSnapshot *snapshot = &trace->snapshots[(index >> trace->sample_shift) & (trace->snapshot_count - 1)];
+
+    // one block copy instead of a store per register
+    memcpy(snapshot->state, state, TRACE_STATE);
+#ifdef CPU_8085
+    snapshot->interrupt_mask = state->interrupt_mask;
+    snapshot->sid = state->sid;
+    snapshot->sod = state->sod;
+#endif
+}
+
+// Log the value read by IN with the cycle counter of the instruction
+static uint8_t trace_port_in(State8080 *state, uint8_t port)
+{
+    Trace8080 *trace = state->trace;
+    uint8_t value = trace->port_in ? trace->port_in(state, port) : 0;
+
+    trace->inputs[trace->input_count++ & trace->step_mask] = state->cycles << 8 | value;
+    return value;
+}
+
+// Wrap the device of state with trace_port_in
+static inline void trace_attach(Trace8080 *trace, State8080 *state)
+{
+    trace->state = state;
+    trace->port_in = state->port_in;
+    state->port_in = trace_port_in;
+    state->trace = trace;
+}
+
+static inline void trace_detach(Trace8080 *trace, State8080 *state)
+{
+    state->port_in = trace->port_in;
+    state->trace = NULL;
+}
+
+// Record the instruction at PC and execute it, returns the number of states used
+static inline int trace_step(Trace8080 *trace, State8080 *state)
+{
+    uint64_t index = trace->count++;
+    uint32_t code;
+    int states;
+
+    if ((index & trace->sample_mask) == 0)
+        trace_snapshot(trace, index, state);
+    code = trace_code(state);
+    trace->steps[index & trace->step_mask] = code | (uint64_t)state->pc << 32;
+    trace_attach(trace, state);
+    if (state->halted) {
+        states = emulate8080(state);
+    } else {
+        state->pc++;
+        states = handlers8080[code & 0xff](state);
+        state->cycles += states;
+    }
+    trace_detach(trace, state);
+    return states;
+}
+
+/*
+    trace_step until state has used cycles states or halts with the interrupts disabled,
+    the ring and the step count stay in registers and the snapshots are taken between runs
+    of sample steps
+*/
+void trace_execute(Trace8080 *trace, State8080 *state, uint64_t cycles)
+{
+    uint64_t *steps = trace->steps;
+    uint64_t mask = trace->step_mask;
+    uint64_t index = trace->count;
+
+    trace_attach(trace, state);
+    while (state->cycles < cycles && !(state->halted && !state->int_enable)) {
+        // the steps left before the next snapshot
+        uint64_t end = (index | trace->sample_mask) + 1;
+
+        if ((index & trace->sample_mask) == 0)
+            trace_snapshot(trace, index, state);
+        if (state->halted) {
+            // waiting for an interrupt
+            steps[index++ & mask] = trace_code(state) | (uint64_t)state->pc << 32;
+            emulate8080(state);
+            continue;
+        }
+        do {
+            uint32_t code = trace_code(state);
+
+            steps[index++ & mask] = code | (uint64_t)state->pc << 32;
+            state->pc++;
+            state->cycles += handlers8080[code & 0xff](state);
+        } while (index != end && !state->halted && state->cycles < cycles);
+    }
+    trace->count = index;
+    trace_detach(trace, state);
+}
+
+static inline void trace_load(const Trace8080 *trace, uint64_t index, State8080 *state)
+{
+    const TraceSnapshot *snapshot = &trace->snapshots[(index >> trace->sample_shift) & (trace->snapshot_count - 1)];
+
+    memcpy(state, snapshot->state, TRACE_STATE);
+#ifdef CPU_8085
+    state->interrupt_mask = snapshot->interrupt_mask;
+    state->sid = snapshot->sid;
+    state->sod = snapshot->sod;
+#endif
+}
+
+// 1 if the registers, the flags and the cycle counter of lhs and rhs are the same
+static int trace_same(const State8080 *lhs, const State8080 *rhs)
+{
+    return lhs->a == rhs->a && lhs->bc == rhs->bc && lhs->de == rhs->de && lhs->hl == rhs->hl
+        && lhs->sp == rhs->sp && lhs->pc == rhs->pc && psw8080(lhs) == psw8080(rhs) && lhs->cycles == rhs->cycles
+        && lhs->int_enable == rhs->int_enable && lhs->halted == rhs->halted
+#ifdef CPU_8085
+        && lhs->interrupt_mask == rhs->interrupt_mask && lhs->sod == rhs->sod
+#endif
+        ;
+}
+
+// The first input logged at or after cycle
+static uint64_t trace_input(const Trace8080 *trace, uint64_t cycle)
+{
+    uint64_t low = trace->input_count > trace->step_mask ? trace->input_count - trace->step_mask - 1 : 0;
+    uint64_t high = trace->input_count;
+
+    while (low < high) {
+        uint64_t middle = low + (high - low) / 2;
+
+        if (trace->inputs[middle & trace->step_mask] >> 8 < cycle)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    return low;
+}
+
+/*
+    The addresses of the data the instruction of step reads from memory, returns how many.
+    The operands are in the step, RET and Rcc only read the next PC, which the steps give.
+*/
+static int trace_reads(const State8080 *state, uint64_t step, uint16_t address[2])
+{
+    uint8_t opcode = (uint8_t)step;
+    uint16_t operand = (uint16_t)(step >> 8);
+
+    // MOV r, M / ALU M / INR M / DCR M
+    if (((opcode & 0xc7) == 0x46 && opcode != 0x76) || (opcode & 0xc7) == 0x86 || opcode == 0x34 || opcode == 0x35) {
+        address[0] = state->hl;
+        return 1;
+    }
+    switch (opcode) {
+    case 0x0a:  // LDAX B
+        address[0] = state->bc;
+        return 1;
+    case 0x1a:  // LDAX D
+        address[0] = state->de;
+        return 1;
+    case 0x3a:  // LDA
+        address[0] = operand;
+        return 1;
+    case 0x2a:  // LHLD
+        address[0] = operand;
+        address[1] = (uint16_t)(operand + 1);
+        return 2;
+    case 0xc1:  // POP
+    case 0xd1:
+    case 0xe1:
+    case 0xf1:
+    case 0xe3:  // XTHL
+        address[0] = state->sp;
+        address[1] = (uint16_t)(state->sp + 1);
+        return 2;
+    }
+    return 0;
+}
+
+// The writes seen by trace_replay
+typedef struct TraceWrites {
+    // 1 + the last step writing each address
+    uint64_t *last;
+    /*
+        0 : not written by the replay, the copy holds the current value
+        1 : written by the replay with sure registers
+        2 : written by the replay once the registers were not sure anymore
+    */
+    uint8_t *written;
+    uint64_t step;
+    // the registers are sure
+    int sure;
+    // the code bytes of the step are being put back, the program doesn't write them
+    int restoring;
+} TraceWrites;
+
+static void trace_watch(Memory8080 *memory, uint16_t address, uint8_t value)
+{
+    TraceWrites *writes = (TraceWrites *)memory->watch_user;
+
+    (void)value;
+    writes->written[address] = writes->restoring || writes->sure ? 1 : 2;
+    if (!writes->restoring && writes->last[address] < writes->step + 1)
+        writes->last[address] = writes->step + 1;
+}
+
+/*
+    Move the replay to pc, the PC of the next step : an interrupt (interrupt8080) if pc is a
+    RST address with the interrupts enabled, else a jump to an address read from memory
+    which has since changed (RET, ...)
+*/
+static void trace_follow(State8080 *state, uint16_t pc)
+{
+    if (pc == state->pc)
+        return;
+    if (state->int_enable && (pc & ~0x38) == 0) {
+        state->int_enable = 0;
+        state->halted = 0;
+        push8080(state, state->pc);
+        state->cycles += 11;
+    }
+    state->pc = pc;
+}
+
+/*
+    Replay the steps base (a multiple of the sample) to end from the snapshot of base and
+    print those from first on. The steps run on memory, a copy of the current memory the
+    replays of the previous steps have written to, without the devices :
+        - the code bytes of each step are put back in memory before it runs
+        - IN reads the value trace_port_in has logged at the same cycle
+        - PC follows the steps, see trace_follow
+    The data the program read may have been overwritten since : once the replay reads an
+    address a later step writes (writes->last, filled by a first replay of every step) and
+    it hasn't written itself with sure registers, or once an IN has no value logged at its
+    cycle, the registers are not sure anymore and the lines get a '?' after the cycle
+    counter, as do all of them but the first one (the snapshot) if same is 0.
+    Returns 1 if the replay ends in the recorded state of end (the next snapshot or the
+    traced state).
+*/
+static int trace_replay(const Trace8080 *trace, Memory8080 *memory, TraceWrites *writes, uint64_t base, uint64_t end,
+    uint64_t first, int same)
+{
+    State8080 state = {0};
+    State8080 snapshot;
+    const State8080 *expected = trace->state;
+    uint64_t input;
+    int stale = 0;
+
+    trace_load(trace, base, &state);
+    state.memory = memory;
+    input = trace_input(trace, state.cycles);
+    for (uint64_t i = base; i < end; i++) {
+        uint64_t step = trace->steps[i & trace->step_mask];
+        uint8_t opcode = (uint8_t)step;
+        uint16_t address[2];
+        uint64_t cycle;
+        int reads;
+
+        writes->step = i;
+        writes->sure = same && !stale;
+        trace_follow(&state, (uint16_t)(step >> 32));
+        writes->restoring = 1;
+        for (int k = 0; k < 3; k++)
+            memory_write(memory, (uint16_t)(state.pc + k), (uint8_t)(step >> (8 * k)));
+        writes->restoring = 0;
+        if (i >= first) {
+            unsigned char code[3] = {opcode, (unsigned char)(step >> 8), (unsigned char)(step >> 16)};
+
+            printf("%12llu%c\t%04x\t%02x %02x%02x %02x%02x %02x%02x %04x %02x\t", (unsigned long long)state.cycles,
+                stale || (!same && i != base) ? '?' : ' ', state.pc, state.a, state.b, state.c, state.d, state.e,
+                state.h, state.l, state.sp, psw8080(&state));
+            disassemble8080(code, 0);
+        }
+        if (state.halted) {
+            emulate8080(&state);
+            continue;
+        }
+        reads = trace_reads(&state, step, address);
+        for (int k = 0; k < reads; k++)
+            if (writes->written[address[k]] == 2 || (writes->written[address[k]] == 0 && writes->last[address[k]] > i + 1))
+                stale = 1;
+        cycle = state.cycles;
+        state.pc++;
+        state.cycles += handlers8080[opcode](&state);
+        if (opcode == 0xdb) {
+            // IN, the replay has no device
+            if (input < trace->input_count && trace->inputs[input & trace->step_mask] >> 8 == cycle)
+                state.a = (uint8_t)trace->inputs[input++ & trace->step_mask];
+            else
+                stale = 1;
+        }
+    }
+    if (end != trace->count) {
+        trace_load(trace, end, &snapshot);
+        expected = &snapshot;
+    }
+    writes->sure = 0;
+    trace_follow(&state, expected->pc);
+    return trace_same(&state, expected);
+}
+
+// A copy of the memory of the traced state for trace_replay
+static Memory8080 *trace_memory(const Trace8080 *trace, TraceWrites *writes)
+{
+    Memory8080 *memory = memory_fork(trace->state->memory);
+
+    // the written bits and the watch callback of the traced machine don't follow the copy
+    memory_set_flags(memory, 0, 0x10000, MEMORY_TRACK, 0);
+    memory_set_flags(memory, 0, 0x10000, MEMORY_WATCH, 1);
+    memory->watch = trace_watch;
+    memory->watch_user = writes;
+    memset(writes->written, 0, 0x10000);
+    return memory;
+}
+
+/*
+    Print the last count records (all of them for count <= 0), oldest first, with the
+    registers before each instruction, rebuilt by trace_replay from the snapshots.
+*/
+void trace_dump(const Trace8080 *trace, int count)
+{
+    uint64_t kept = trace->count < trace->size ? trace->count : trace->size;
+    uint64_t period = trace->sample_mask + 1;
+    uint64_t first, start;
+    TraceWrites writes = {0};
+    Memory8080 *memory;
+    unsigned char *same;
+
+    if (count <= 0 || (uint64_t)count > kept)
+        count = (int)kept;
+    printf("      cycles \tPC  \tA  BC   DE   HL   SP   F \tinstruction\n");
+    if (count == 0) {
+        fflush(stdout);
+        return;
+    }
+    first = trace->count - count;
+    start = first & ~trace->sample_mask;
+    writes.last = calloc(0x10000, sizeof(uint64_t));
+    writes.written = malloc(0x10000);
+    same = malloc((trace->count - start) / period + 1);
+    if (writes.last == NULL || writes.written == NULL || same == NULL) {
+        printf("Error : couldn't allocate the replay of the trace\n");
+        free(writes.last);
+        free(writes.written);
+        free(same);
+        return;
+    }
+
+    // first replay : the last write of every address, and the replays ending in the recorded state
+    memory = trace_memory(trace, &writes);
+    for (uint64_t base = start; base < trace->count; base += period) {
+        uint64_t end = base + period < trace->count ? base + period : trace->count;
+
+        same[(base - start) / period] = (unsigned char)trace_replay(trace, memory, &writes, base, end, end, 1);
+    }
+    memory_destroy(memory);
+    memory = trace_memory(trace, &writes);
+    for (uint64_t base = start; base < trace->count; base += period) {
+        uint64_t end = base + period < trace->count ? base + period : trace->count;
+
+        trace_replay(trace, memory, &writes, base, end, first > base ? first : base, same[(base - start) / period]);
+    }
+    memory_destroy(memory);
+    free(writes.last);
+    free(writes.written);
+    free(same);
+    fflush(stdout);
+}
+
+
+static const Trace8080 *trace_crash;
+static int trace_crash_count;
+
+static void trace_signal(int signal_number)
+{
+    // not async signal safe, the process is going down anyway
+    printf("\nSignal %d, last instructions :\n", signal_number);
+    trace_dump(trace_crash, trace_crash_count);
+    signal(signal_number, SIG_DFL);
+    raise(signal_number);
+}
+
+// Dump the last count instructions of trace if the process crashes
+void trace_dump_on_crash(const Trace8080 *trace, int count)
+{
+    trace_crash = trace;
+    trace_crash_count = count;
+    signal(SIGSEGV, trace_signal);
+    signal(SIGABRT, trace_signal);
+    signal(SIGFPE, trace_signal);
+    signal(SIGILL, trace_signal);
+}
+
+
+/*
+    Run program (loaded at 0) for cycles states without and with the trace (registers saved
+    every sample instructions), print the overhead and the last count instructions
+*/
+int trace_run(const unsigned char *program, int size, uint64_t cycles, int count, uint32_t sample)
+{
+    State8080 state;
+    Trace8080 *trace = trace_create(4096, sample);
+    clock_t start;
+    double plain, traced;
+
+    init8080(&state, memory_create());
+    memory_load(state.memory, 0, program, size);
+    start = clock();
+    while (state.cycles < cycles && !(state.halted && !state.int_enable))
+        emulate8080(&state);
+    plain = (double)(clock() - start) / CLOCKS_PER_SEC;
+    memory_destroy(state.memory);
+
+    init8080(&state, memory_create());
+    memory_load(state.memory, 0, program, size);
+    trace_dump_on_crash(trace, count);
+    start = clock();
+    trace_execute(trace, &state, cycles);
+    traced = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    trace_dump(trace, count);
+    printf("\n%llu instructions traced, %.3f s without the trace, %.3f s with it (%+.1f %%)\n",
+        (unsigned long long)trace->count, plain, traced, plain > 0 ? 100.0 * (traced - plain) / plain : 0.0);
+    signal(SIGSEGV, SIG_DFL);
+    signal(SIGABRT, SIG_DFL);
+    signal(SIGFPE, SIG_DFL);
+    signal(SIGILL, SIG_DFL);
+    trace_destroy(trace);
+    memory_destroy(state.memory);
+    return 0;
+}
+
+#endif
@@ -0,0 +1,330 @@
+#ifndef INVADERS_AUDIO_C
+#define INVADERS_AUDIO_C
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*
+    Offline Space Invaders audio
+
+    The sound board plays a sample on the rising edge of a bit of OUT 3 / OUT 5 :
+        OUT 3 : bit 0 UFO (repeats while set), bit 1 shot, bit 2 player dies,
+                bit 3 invader dies, bit 4 extended play
+        OUT 5 : bits 0-3 fleet movement 1-4, bit 4 UFO hit
+
+    1. OUT only appends (cycle, port, value) to the event list of the frame
+    2. Once per frame (or when the event list is full), audio_mix_frame mixes the voices
+       between two events into a block and applies the events in cycle order
+    3. The block goes into a single producer / single consumer lock-free ring buffer
+    4. A consumer (audio thread, WAV writer, ...) drains the ring
+
+    The samples are synthesized, 16-bit mono at AUDIO_RATE.
+*/
+
+
+#define AUDIO_RATE 44100
+#define AUDIO_CLOCK 2000000
+#define AUDIO_SOUNDS 10
+#define AUDIO_EVENTS 1024
+// power of two, about 1.5 s of audio
+#define AUDIO_RING_SIZE 65536
+
+typedef struct AudioEvent {
+    uint64_t cycle;
+    uint8_t port;
+    uint8_t value;
+} AudioEvent;
+
+typedef struct AudioSample {
+    int16_t *data;
+    uint32_t length;
+    // the UFO sound repeats while its bit is set
+    int loop;
+} AudioSample;
+
+// Single producer / single consumer, head is only written by the producer and tail by the consumer
+typedef struct AudioRing {
+    int16_t data[AUDIO_RING_SIZE];
+    atomic_uint head;
+    atomic_uint tail;
+} AudioRing;
+
+typedef struct Audio {
+    AudioSample samples[AUDIO_SOUNDS];
+    // play position of each sound, -1 when silent
+    int32_t position[AUDIO_SOUNDS];
+    uint8_t port3;
+    uint8_t port5;
+    AudioEvent events[AUDIO_EVENTS];
+    int event_count;
+    // output samples produced so far, sample n is at cycle n * AUDIO_CLOCK / AUDIO_RATE
+    uint64_t mixed;
+    // samples dropped because the ring was full
+    uint64_t overruns;
+    // samples of the frame being mixed
+    int16_t block[AUDIO_RATE];
+    AudioRing ring;
+} Audio;
+
+
+/*
+    Synthesized sounds : square waves with a frequency sweep, or noise
+        frequency, end frequency (Hz, 0 for noise), duration (ms)
+*/
+static const struct {
+    float frequency;
+    float end_frequency;
+    int duration;
+} audio_sounds[AUDIO_SOUNDS] = {
+    {1000.0f, 600.0f, 100},     // UFO
+    {0.0f, 0.0f, 300},          // shot
+    {0.0f, 0.0f, 1000},         // player dies
+    {0.0f, 0.0f, 200},          // invader dies
+    {880.0f, 880.0f, 500},      // extended play
+    {110.0f, 110.0f, 60},       // fleet movement 1
+    {98.0f, 98.0f, 60},         // fleet movement 2
+    {87.0f, 87.0f, 60},         // fleet movement 3
+    {82.0f, 82.0f, 60},         // fleet movement 4
+    {1200.0f, 300.0f, 500},     // UFO hit
+};
+
+static void audio_synthesize(AudioSample *sample, float frequency, float end_frequency, int duration)
+{
+    uint32_t noise = 0x12345678u;
+    double phase = 0;
+
+    sample->length = (uint32_t)((uint64_t)AUDIO_RATE * duration / 1000);
+    sample->data = malloc(sample->length * sizeof(int16_t));
+    if (sample->data == NULL) {
+        printf("Error : couldn't allocate the audio samples\n");
+        exit(1);
+    }
+    for (uint32_t i = 0; i < sample->length; i++) {
+        double t = (double)i / sample->length;
+        // linear fade out
+        double volume = 6000.0 * (1.0 - t);
+
+        if (frequency == 0.0f) {
+            noise ^= noise << 13;
+            noise ^= noise >> 17;
+            noise ^= noise << 5;
+            sample->data[i] = (int16_t)(noise & 0x8000 ? volume : -volume);
+        } else {
+            phase += (frequency + (end_frequency - frequency) * t) / AUDIO_RATE;
+            if (phase >= 1.0)
+                phase -= 1.0;
+            sample->data[i] = (int16_t)(phase < 0.5 ? volume : -volume);
+        }
+    }
+}
+
+void audio_init(Audio *audio)
+{
+    memset(audio, 0, sizeof(*audio));
+    for (int i = 0; i < AUDIO_SOUNDS; i++) {
+        audio_synthesize(&audio->samples[i], audio_sounds[i].frequency, audio_sounds[i].end_frequency, audio_sounds[i].duration);
+        audio->position[i] = -1;
+    }
+    audio->samples[0].loop = 1;
+    atomic_init(&audio->ring.head, 0);
+    atomic_init(&audio->ring.tail, 0);
+}
+
+void audio_free(Audio *audio)
+{
+    for (int i = 0; i < AUDIO_SOUNDS; i++)
+        free(audio->samples[i].data);
+}
+
+// Rising edges start a sound, the looping sound stops when its bit is cleared
+static void audio_apply(Audio *audio, uint8_t port, uint8_t value)
+{
+    uint8_t *previous = port == 3 ? &audio->port3 : &audio->port5;
+    int first = port == 3 ? 0 : 5;
+    uint8_t rising = value & ~*previous;
+
+    for (int bit = 0; bit < 5; bit++) {
+        AudioSample *sample = &audio->samples[first + bit];
+
+        if ((rising >> bit) & 1)
+            audio->position[first + bit] = 0;
+        else if (sample->loop && !((value >> bit) & 1))
+            audio->position[first + bit] = -1;
+    }
+    *previous = value;
+}
+
+static void audio_push(Audio *audio, const int16_t *block, uint32_t count)
+{
+    AudioRing *ring = &audio->ring;
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+    uint32_t space = AUDIO_RING_SIZE - (head - tail);
+
+    if (count > space) {
+        audio->overruns += count - space;
+        count = space;
+    }
+    for (uint32_t i = 0; i < count; i++)
+        ring->data[(head + i) & (AUDIO_RING_SIZE - 1)] = block[i];
+    atomic_store_explicit(&ring->head, head + count, memory_order_release);
+}
+
+// Consumer side : copy at most count samples out of the ring, returns the number copied
+uint32_t audio_pull(Audio *audio, int16_t *output, uint32_t count)
+{
+    AudioRing *ring = &audio->ring;
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+    if (count > head - tail)
+        count = head - tail;
+    for (uint32_t i = 0; i < count; i++)
+        output[i] = ring->data[(tail + i) & (AUDIO_RING_SIZE - 1)];
+    atomic_store_explicit(&ring->tail, tail + count, memory_order_release);
+    return count;
+}
+
+// Mix the playing voices into block[0..count)
+static void audio_mix(Audio *audio, int16_t *block, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        int32_t sum = 0;
+
+        for (int sound = 0; sound < AUDIO_SOUNDS; sound++) {
+            AudioSample *sample = &audio->samples[sound];
+            int32_t position = audio->position[sound];
+
+            if (position < 0)
+                continue;
+            sum += sample->data[position++];
+            if ((uint32_t)position == sample->length)
+                position = sample->loop ? 0 : -1;
+            audio->position[sound] = position;
+        }
+        block[i] = (int16_t)(sum > 32767 ? 32767 : sum < -32768 ? -32768 : sum);
+    }
+}
+
+/*
+    Produce the samples up to cycle (the end of the frame) and push them into the ring.
+    Returns the number of samples produced.
+*/
+uint32_t audio_mix_frame(Audio *audio, uint64_t cycle)
+{
+    int16_t *block = audio->block;
+    uint64_t end = cycle * AUDIO_RATE / AUDIO_CLOCK;
+    uint32_t count = 0;
+
+    if (end - audio->mixed > AUDIO_RATE)
+        audio->mixed = end - AUDIO_RATE;
+
+    for (int i = 0; i <= audio->event_count; i++) {
+        uint64_t until = end;
+
+        if (i < audio->event_count) {
+            until = audio->events[i].cycle * AUDIO_RATE / AUDIO_CLOCK;
+            if (until > end)
+                until = end;
+        }
+        if (until > audio->mixed) {
+            audio_mix(audio, block + count, (uint32_t)(until - audio->mixed));
+            count += (uint32_t)(until - audio->mixed);
+            audio->mixed = until;
+        }
+        if (i < audio->event_count)
+            audio_apply(audio, audio->events[i].port, audio->events[i].value);
+    }
+    audio->event_count = 0;
+    audio_push(audio, block, count);
+    return count;
+}
+
+// Called on OUT : only records the write
+static inline void audio_port_write(Audio *audio, uint64_t cycle, uint8_t port, uint8_t value)
+{
+    // more writes than expected in a frame : mix up to this one to make room, the writes stay in order
+    if (audio->event_count == AUDIO_EVENTS)
+        audio_mix_frame(audio, cycle);
+    audio->events[audio->event_count].cycle = cycle;
+    audio->events[audio->event_count].port = port;
+    audio->events[audio->event_count].value = value;
+    audio->event_count++;
+}
+
+
+/*
+    WAV writer : 16-bit mono PCM, the sizes of the header are written by audio_wav_close
+*/
+typedef struct AudioWav {
+    FILE *f;
+    uint32_t samples;
+} AudioWav;
+
+static void audio_write32(FILE *f, uint32_t value)
+{
+    uint8_t bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24};
+
+    fwrite(bytes, sizeof(bytes), 1, f);
+}
+
+static void audio_write16(FILE *f, uint16_t value)
+{
+    uint8_t bytes[2] = {value & 0xff, value >> 8};
+
+    fwrite(bytes, sizeof(bytes), 1, f);
+}
+
+static void audio_wav_header(AudioWav *wav)
+{
+    fwrite("RIFF", 4, 1, wav->f);
+    audio_write32(wav->f, 36 + wav->samples * 2);
+    fwrite("WAVEfmt ", 8, 1, wav->f);
+    audio_write32(wav->f, 16);
+    audio_write16(wav->f, 1);
+    audio_write16(wav->f, 1);
+    audio_write32(wav->f, AUDIO_RATE);
+    audio_write32(wav->f, AUDIO_RATE * 2);
+    audio_write16(wav->f, 2);
+    audio_write16(wav->f, 16);
+    fwrite("data", 4, 1, wav->f);
+    audio_write32(wav->f, wav->samples * 2);
+}
+
+int audio_wav_open(AudioWav *wav, const char *path)
+{
+    wav->samples = 0;
+    wav->f = fopen(path, "wb");
+    if (wav->f == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        return 0;
+    }
+    audio_wav_header(wav);
+    return 1;
+}
+
+// Drain the ring of audio into the file
+void audio_wav_write(AudioWav *wav, Audio *audio)
+{
+    int16_t buffer[4096];
+    uint32_t count;
+
+    while ((count = audio_pull(audio, buffer, 4096)) > 0) {
+        for (uint32_t i = 0; i < count; i++)
+            audio_write16(wav->f, (uint16_t)buffer[i]);
+        wav->samples += count;
+    }
+}
+
+void audio_wav_close(AudioWav *wav)
+{
+    fseek(wav->f, 0, SEEK_SET);
+    audio_wav_header(wav);
+    fclose(wav->f);
+    wav->f = NULL;
+}
+
+#endif
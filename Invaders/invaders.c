@@ -0,0 +1,318 @@
+#ifndef INVADERS_INVADERS_C
+#define INVADERS_INVADERS_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Emulator/emulator.c"
+#include "../Emulator/replay.c"
+#include "video.c"
+#include "audio.c"
+
+/*
+    Space Invaders (Taito / Midway 8080 board)
+
+    Memory :
+        0x0000 - 0x1FFF : ROM (invaders.h, invaders.g, invaders.f, invaders.e)
+        0x2000 - 0x23FF : work RAM
+        0x2400 - 0x3FFF : video RAM, see video.c
+
+    Ports :
+        IN 1, IN 2  : coins, start buttons, player controls and DIP switches
+        IN 3        : shift register result
+        OUT 2       : shift amount (3 bits)
+        OUT 3, 5    : sounds, see audio.c
+        OUT 4       : shift data, the new byte goes in the high-order byte of the register
+        OUT 6       : watchdog
+
+    The CPU runs at 2 MHz. The video hardware sends RST 1 when the beam is in the middle
+    of the screen and RST 2 at the start of the vertical blank, 60 times per second.
+*/
+
+
+#define INVADERS_CLOCK 2000000
+#define INVADERS_FRAME_CYCLES (INVADERS_CLOCK / 60)
+#define INVADERS_ROM_SIZE 0x2000
+
+// IN 1 bits
+#define INVADERS_COIN 0x01
+#define INVADERS_P2_START 0x02
+#define INVADERS_P1_START 0x04
+#define INVADERS_P1_SHOT 0x10
+#define INVADERS_P1_LEFT 0x20
+#define INVADERS_P1_RIGHT 0x40
+
+typedef struct Invaders {
+    State8080 cpu;
+    uint16_t shift;
+    uint8_t shift_offset;
+    // values read by IN 1 and IN 2, set by the host
+    uint8_t port1;
+    uint8_t port2;
+    uint64_t frames;
+    // NULL to ignore the sound ports
+    Audio *audio;
+} Invaders;
+
+
+static uint8_t invaders_in(State8080 *state, uint8_t port)
+{
+    Invaders *machine = (Invaders *)state->user;
+
+    switch (port) {
+        case 0: return 0x0e;
+        case 1: return machine->port1;
+        case 2: return machine->port2;
+        case 3: return (uint8_t)(machine->shift >> (8 - machine->shift_offset));
+        default: return 0;
+    }
+}
+
+static void invaders_out(State8080 *state, uint8_t port, uint8_t value)
+{
+    Invaders *machine = (Invaders *)state->user;
+
+    switch (port) {
+        case 2:
+            machine->shift_offset = value & 7;
+            break;
+        case 4:
+            machine->shift = (uint16_t)((value << 8) | (machine->shift >> 8));
+            break;
+        case 3:
+        case 5:
+            if (machine->audio != NULL)
+                audio_port_write(machine->audio, state->cycles, port, value);
+            break;
+        default:
+            break;
+    }
+}
+
+// Returns 0 if the ROM doesn't fit in the ROM area
+int invaders_init(Invaders *machine, const uint8_t *rom, int size)
+{
+    if (size > INVADERS_ROM_SIZE) {
+        printf("Error : the ROM is %d bytes, at most %d bytes are expected\n", size, INVADERS_ROM_SIZE);
+        return 0;
+    }
+    memset(machine, 0, sizeof(*machine));
+    init8080(&machine->cpu, memory_create());
+    memory_load(machine->cpu.memory, 0, rom, size);
+    memory_protect(machine->cpu.memory, 0, INVADERS_ROM_SIZE);
+    video_track(machine->cpu.memory);
+    machine->cpu.port_in = invaders_in;
+    machine->cpu.port_out = invaders_out;
+    machine->cpu.user = machine;
+    // bit 3 of IN 1 is always set
+    machine->port1 = 0x08;
+    return 1;
+}
+
+void invaders_free(Invaders *machine)
+{
+    memory_destroy(machine->cpu.memory);
+    machine->cpu.memory = NULL;
+}
+
+// Run one frame : half a frame, RST 1, the other half, RST 2
+void invaders_frame(Invaders *machine)
+{
+    State8080 *cpu = &machine->cpu;
+    uint64_t end = cpu->cycles + INVADERS_FRAME_CYCLES;
+    uint64_t middle = end - INVADERS_FRAME_CYCLES / 2;
+
+    while (cpu->cycles < middle)
+        emulate8080(cpu);
+    replay_interrupt(cpu, 1);
+    while (cpu->cycles < end)
+        emulate8080(cpu);
+    replay_interrupt(cpu, 2);
+    if (machine->audio != NULL)
+        audio_mix_frame(machine->audio, cpu->cycles);
+    machine->frames++;
+}
+
+
+/*
+    Headless run : emulate frames frames and write one PPM every every frames
+    in directory (nothing is written without a directory) and the sound to wav
+*/
+int invaders_run(const uint8_t *rom, int size, int frames, const char *directory, int every, const char *wav)
+{
+    static Invaders machine;
+    static Video video;
+    static Audio audio;
+    AudioWav output;
+    clock_t start;
+    double emulation = 0, rendering = 0;
+    int written = 0;
+
+    if (!invaders_init(&machine, rom, size))
+        return 1;
+    video_init(&video, 1);
+    if (wav != NULL) {
+        if (!audio_wav_open(&output, wav)) {
+            invaders_free(&machine);
+            return 1;
+        }
+        audio_init(&audio);
+        machine.audio = &audio;
+    }
+
+    for (int frame = 0; frame < frames; frame++) {
+        // insert a coin and start a game after two seconds
+        machine.port1 = 0x08;
+        if (frame >= 120 && frame < 125)
+            machine.port1 |= INVADERS_COIN;
+        if (frame >= 180 && frame < 185)
+            machine.port1 |= INVADERS_P1_START;
+
+        start = clock();
+        invaders_frame(&machine);
+        emulation += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        start = clock();
+        video_render(&video, machine.cpu.memory);
+        rendering += (double)(clock() - start) / CLOCKS_PER_SEC;
+
+        if (machine.audio != NULL)
+            audio_wav_write(&output, &audio);
+
+        if (directory != NULL && every > 0 && frame % every == 0) {
+            char path[1024];
+
+            snprintf(path, sizeof(path), "%s/frame_%05d.ppm", directory, frame);
+            if (!video_write_ppm(&video, path))
+                break;
+            written++;
+        }
+    }
+
+    printf("%d frames, %d written\n", frames, written);
+    printf("emulation : %.3f ms per frame\n", frames ? emulation * 1000 / frames : 0.0);
+    printf("rendering : %.3f ms per frame, %.2f %% of the frame rendered\n", frames ? rendering * 1000 / frames : 0.0,
+        video_rendered_percent(&video));
+    if (machine.audio != NULL) {
+        printf("audio : %u samples written, %llu dropped\n", output.samples, (unsigned long long)audio.overruns);
+        audio_wav_close(&output);
+        audio_free(&audio);
+    }
+    invaders_free(&machine);
+    return 0;
+}
+
+// Hash of the registers, the cycle counter and the memory, two runs are identical if their fingerprints are
+static uint32_t invaders_fingerprint(const Invaders *machine)
+{
+    const State8080 *cpu = &machine->cpu;
+    uint8_t registers[] = {
+        cpu->a, cpu->b, cpu->c, cpu->d, cpu->e, cpu->h, cpu->l, cpu->sp >> 8, cpu->sp & 0xff,
+        cpu->pc >> 8, cpu->pc & 0xff, psw8080(cpu), cpu->int_enable, cpu->halted
+    };
+    uint32_t hash = replay_hash(registers, sizeof(registers)) ^ (uint32_t)cpu->cycles;
+
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++)
+        hash = hash * 31 + replay_hash(cpu->memory->read[index], MEMORY_PAGE_SIZE);
+    return hash;
+}
+
+/*
+    Record frames frames to the log path. The player moves and shoots at random, so two
+    recordings differ, but each one replays exactly.
+*/
+int invaders_record(const uint8_t *rom, int size, int frames, const char *path)
+{
+    static Invaders machine;
+    Replay8080 replay;
+    uint32_t random = (uint32_t)time(NULL) * 2 + 1;
+    clock_t start;
+    double seconds;
+    int result;
+
+    if (!invaders_init(&machine, rom, size))
+        return 1;
+    replay_init(&replay, REPLAY_RECORD, replay_hash(rom, size));
+    replay_attach(&replay, &machine.cpu);
+
+    start = clock();
+    for (int frame = 0; frame < frames; frame++) {
+        machine.port1 = 0x08;
+        if (frame >= 120 && frame < 125)
+            machine.port1 |= INVADERS_COIN;
+        if (frame >= 180 && frame < 185)
+            machine.port1 |= INVADERS_P1_START;
+        if (frame % 15 == 0) {
+            random ^= random << 13;
+            random ^= random >> 17;
+            random ^= random << 5;
+        }
+        if (frame >= 240)
+            machine.port1 |= random & (INVADERS_P1_SHOT | INVADERS_P1_LEFT | INVADERS_P1_RIGHT);
+        replay_host(&machine.cpu, 1, machine.port1);
+        invaders_frame(&machine);
+    }
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+    replay_detach(&replay, &machine.cpu);
+
+    printf("%d frames recorded in %.3f s, %llu events, %zu bytes\n", frames, seconds,
+        (unsigned long long)replay.events, replay.size);
+    printf("fingerprint %08x\n", invaders_fingerprint(&machine));
+    result = replay_save(&replay, path) ? 0 : 1;
+    replay_free(&replay);
+    invaders_free(&machine);
+    return result;
+}
+
+static void invaders_replay_host(State8080 *state, uint8_t channel, uint8_t value)
+{
+    Invaders *machine = (Invaders *)state->user;
+
+    if (channel == 1)
+        machine->port1 = value;
+    else if (channel == 2)
+        machine->port2 = value;
+}
+
+// Play the log path as fast as possible, returns 1 if the run left the log
+int invaders_replay(const uint8_t *rom, int size, const char *path)
+{
+    static Invaders machine;
+    Replay8080 replay;
+    clock_t start;
+    double seconds;
+    int result = 0;
+
+    if (!replay_load(&replay, path))
+        return 1;
+    if (replay.program != replay_hash(rom, size)) {
+        printf("Error : %s was recorded with another ROM\n", path);
+        replay_free(&replay);
+        return 1;
+    }
+    if (!invaders_init(&machine, rom, size)) {
+        replay_free(&replay);
+        return 1;
+    }
+    replay_attach(&replay, &machine.cpu);
+
+    start = clock();
+    while (replay_play(&machine.cpu, replay.end, invaders_replay_host))
+        ;
+    seconds = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    if (replay.desync || machine.cpu.cycles != replay.end) {
+        printf("Error : the run left the log at cycle %llu\n", (unsigned long long)machine.cpu.cycles);
+        result = 1;
+    }
+    printf("%.1f s of emulated time replayed in %.3f s\n", (double)replay.end / INVADERS_CLOCK, seconds);
+    printf("fingerprint %08x\n", invaders_fingerprint(&machine));
+    replay_detach(&replay, &machine.cpu);
+    replay_free(&replay);
+    invaders_free(&machine);
+    return result;
+}
+
+#endif
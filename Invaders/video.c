@@ -0,0 +1,245 @@
+#ifndef INVADERS_VIDEO_C
+#define INVADERS_VIDEO_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Emulator/memory.c"
+
+/*
+    Offscreen Space Invaders video
+
+    The video RAM (0x2400 - 0x3FFF) holds 224 rows of 32 bytes, one bit per pixel, the
+    first pixel of a row is bit 0 of its first byte. The monitor is rotated : memory row r
+    is screen column r and bit x of a memory row is screen row 255 - x.
+
+    1. Take a block of 8 memory rows x 1 byte, an 8 x 8 bit matrix
+    2. Transpose it in a 64-bit word, each byte is now 8 pixels of a screen row
+    3. Expand each bit to a 32-bit pixel with SIMD compares (AVX2 / SSE2)
+    4. Go to step 1
+
+    The pixels are stored as 0xAABBGGRR words, so R, G, B, A bytes on little endian hosts.
+    Nothing depends on a display server, the frames are written as PPM files.
+
+    Once video_track has been called on the memory map, the memory records the bytes of
+    the video RAM changed by the CPU and only the blocks holding them are rendered again.
+    dirty_rows tells which screen rows changed since the previous frame, so a front end
+    only has to upload those.
+*/
+
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#define VIDEO_WIDTH 224
+#define VIDEO_HEIGHT 256
+#define VIDEO_START 0x2400
+#define VIDEO_SIZE 0x1C00
+// bytes per memory row
+#define VIDEO_PITCH 32
+// blocks of 8 memory rows x 1 byte
+#define VIDEO_BLOCKS (VIDEO_WIDTH / 8 * VIDEO_PITCH)
+
+#define VIDEO_RGBA(r, g, b) ((uint32_t)(r) | ((uint32_t)(g) << 8) | ((uint32_t)(b) << 16) | 0xff000000u)
+
+typedef struct Video {
+    uint32_t pixels[VIDEO_HEIGHT * VIDEO_WIDTH];
+    // color of the lit pixels of each screen row
+    uint32_t foreground[VIDEO_HEIGHT];
+    uint32_t background;
+    // 0 until the first full render
+    int valid;
+    // 1 for the screen rows changed by the last render
+    uint8_t dirty_rows[VIDEO_HEIGHT];
+    // blocks rendered / blocks in the frames rendered so far
+    uint64_t rendered_blocks;
+    uint64_t total_blocks;
+} Video;
+
+
+/*
+    overlay : colors of the cellophane strips of the cabinet, red at the top for the
+    UFO, green at the bottom for the shields and the player
+*/
+void video_init(Video *video, int overlay)
+{
+    memset(video, 0, sizeof(*video));
+    video->background = VIDEO_RGBA(0, 0, 0);
+    for (int y = 0; y < VIDEO_HEIGHT; y++) {
+        uint32_t color = VIDEO_RGBA(0xff, 0xff, 0xff);
+
+        if (overlay && y >= 32 && y < 64)
+            color = VIDEO_RGBA(0xff, 0x20, 0x20);
+        else if (overlay && y >= 184)
+            color = VIDEO_RGBA(0x20, 0xff, 0x20);
+        video->foreground[y] = color;
+    }
+}
+
+/*
+    Transpose the 8 x 8 bit matrix held in x, bit j of byte i moves to bit i of byte j
+    (Hacker's Delight, 7-3)
+*/
+static inline uint64_t video_transpose8(uint64_t x)
+{
+    uint64_t t;
+
+    t = (x ^ (x >> 7)) & 0x00AA00AA00AA00AAull;
+    x = x ^ t ^ (t << 7);
+    t = (x ^ (x >> 14)) & 0x0000CCCC0000CCCCull;
+    x = x ^ t ^ (t << 14);
+    t = (x ^ (x >> 28)) & 0x00000000F0F0F0F0ull;
+    x = x ^ t ^ (t << 28);
+    return x;
+}
+
+// Write 8 pixels, bit i of bits lights pixel i
+static inline void video_expand8(uint32_t *pixels, uint8_t bits, uint32_t foreground, uint32_t background)
+{
+#if defined(__AVX2__)
+    const __m256i select = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+    __m256i mask = _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), select), select);
+    __m256i value = _mm256_or_si256(_mm256_and_si256(mask, _mm256_set1_epi32((int)foreground)),
+        _mm256_andnot_si256(mask, _mm256_set1_epi32((int)background)));
+
+    _mm256_storeu_si256((__m256i *)pixels, value);
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i select_low = _mm_setr_epi32(1, 2, 4, 8);
+    const __m128i select_high = _mm_setr_epi32(16, 32, 64, 128);
+    __m128i value = _mm_set1_epi32(bits);
+    __m128i fg = _mm_set1_epi32((int)foreground);
+    __m128i bg = _mm_set1_epi32((int)background);
+    __m128i low = _mm_cmpeq_epi32(_mm_and_si128(value, select_low), select_low);
+    __m128i high = _mm_cmpeq_epi32(_mm_and_si128(value, select_high), select_high);
+
+    _mm_storeu_si128((__m128i *)pixels, _mm_or_si128(_mm_and_si128(low, fg), _mm_andnot_si128(low, bg)));
+    _mm_storeu_si128((__m128i *)(pixels + 4), _mm_or_si128(_mm_and_si128(high, fg), _mm_andnot_si128(high, bg)));
+#else
+    for (int i = 0; i < 8; i++)
+        pixels[i] = (bits >> i) & 1 ? foreground : background;
+#endif
+}
+
+/*
+    Render the 8 screen rows of memory column column (byte column of the memory rows)
+    for the 8 memory rows starting at 8 * block
+*/
+static inline void video_render_block(Video *video, const Memory8080 *memory, int block, int column)
+{
+    // the 8 memory rows of a block never cross a page
+    uint16_t address = VIDEO_START + block * 8 * VIDEO_PITCH + column;
+    const uint8_t *source = memory->read[address >> MEMORY_PAGE_SHIFT] + (address & MEMORY_PAGE_MASK);
+    uint64_t matrix = 0;
+
+    for (int i = 0; i < 8; i++)
+        matrix |= (uint64_t)source[i * VIDEO_PITCH] << (8 * i);
+    matrix = video_transpose8(matrix);
+
+    for (int bit = 0; bit < 8; bit++) {
+        int y = VIDEO_HEIGHT - 1 - (column * 8 + bit);
+
+        video_expand8(&video->pixels[y * VIDEO_WIDTH + block * 8], (uint8_t)(matrix >> (8 * bit)),
+            video->foreground[y], video->background);
+        video->dirty_rows[y] = 1;
+    }
+    video->rendered_blocks++;
+}
+
+// Record the writes of the CPU to the video RAM of memory
+void video_track(Memory8080 *memory)
+{
+    memory_track(memory, VIDEO_START, VIDEO_SIZE);
+}
+
+/*
+    Render the frame. Without tracking (or for the first frame) every block is rendered,
+    otherwise only the blocks holding a byte changed since the previous call.
+*/
+void video_render(Video *video, Memory8080 *memory)
+{
+    memset(video->dirty_rows, 0, sizeof(video->dirty_rows));
+    video->total_blocks += VIDEO_BLOCKS;
+
+    if (memory->written == NULL || !video->valid) {
+        for (int block = 0; block < VIDEO_WIDTH / 8; block++)
+            for (int column = 0; column < VIDEO_PITCH; column++)
+                video_render_block(video, memory, block, column);
+        if (memory->written != NULL)
+            memset(memory->written + VIDEO_START / 8, 0, VIDEO_SIZE / 8);
+        video->valid = 1;
+        return;
+    }
+
+    // 4 bytes of the bitmap are a memory row, a block is 8 memory rows
+    for (int block = 0; block < VIDEO_WIDTH / 8; block++) {
+        uint8_t *written = memory->written + (VIDEO_START + block * 8 * VIDEO_PITCH) / 8;
+        uint32_t columns = 0;
+
+        for (int i = 0; i < 32; i += 4)
+            columns |= written[i] | (written[i + 1] << 8) | (written[i + 2] << 16) | ((uint32_t)written[i + 3] << 24);
+        if (columns == 0)
+            continue;
+        memset(written, 0, 32);
+        for (int column = 0; column < VIDEO_PITCH; column++)
+            if ((columns >> column) & 1)
+                video_render_block(video, memory, block, column);
+    }
+}
+
+// Percentage of the blocks rendered again since the first frame
+double video_rendered_percent(const Video *video)
+{
+    return video->total_blocks ? 100.0 * video->rendered_blocks / video->total_blocks : 0.0;
+}
+
+// Binary PPM (P6), the alpha channel is dropped
+int video_write_ppm(const Video *video, const char *path)
+{
+    uint8_t row[VIDEO_WIDTH * 3];
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        return 0;
+    }
+    fprintf(f, "P6\n%d %d\n255\n", VIDEO_WIDTH, VIDEO_HEIGHT);
+    for (int y = 0; y < VIDEO_HEIGHT; y++) {
+        for (int x = 0; x < VIDEO_WIDTH; x++) {
+            uint32_t pixel = video->pixels[y * VIDEO_WIDTH + x];
+
+            row[x * 3] = pixel & 0xff;
+            row[x * 3 + 1] = (pixel >> 8) & 0xff;
+            row[x * 3 + 2] = (pixel >> 16) & 0xff;
+        }
+        fwrite(row, sizeof(row), 1, f);
+    }
+    fclose(f);
+    return 1;
+}
+
+// Raw RGBA bytes, VIDEO_WIDTH x VIDEO_HEIGHT, top row first
+int video_write_rgba(const Video *video, const char *path)
+{
+    FILE *f = fopen(path, "wb");
+
+    if (f == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        return 0;
+    }
+    for (int i = 0; i < VIDEO_WIDTH * VIDEO_HEIGHT; i++) {
+        uint8_t rgba[4] = {
+            video->pixels[i] & 0xff, (video->pixels[i] >> 8) & 0xff,
+            (video->pixels[i] >> 16) & 0xff, video->pixels[i] >> 24
+        };
+
+        fwrite(rgba, sizeof(rgba), 1, f);
+    }
+    fclose(f);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,491 @@
+#ifndef RECOMPILER_RECOMPILER_C
+#define RECOMPILER_RECOMPILER_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../Emulator/emulator.c"
+
+/*
+    Static recompiler : 8080 image -> C source
+
+    Recursive descent from the entry points (the load address and the RST vectors inside
+    the image) : every JMP / CALL / RST target, every conditional jump target and every
+    return address becomes the start of a basic block. A block runs until an unconditional
+    transfer (JMP, CALL, RET, RST, PCHL, HLT), the end of the image or
+    RECOMPILE_INSTRUCTIONS instructions, the conditional jumps, calls and returns leave
+    it only when they are taken.
+
+    Each block is written as a C function on local copies of the registers (see
+    Recompiler/runtime.c for the macros and helpers it uses), the states of every
+    instruction are added as on the interpreter. The code reached only through PCHL or
+    never found by the descent runs on the interpreter.
+
+    The generated file embeds the image and includes Recompiler/runtime.c :
+        gcc -O2 -I <repository> program.c -o program
+        ./program -verify
+*/
+
+
+// at most 64 * 3 bytes, the runtime expects blocks shorter than 256 bytes
+#define RECOMPILE_INSTRUCTIONS 64
+
+// same values as the AOT_* machines of runtime.c
+#define RECOMPILE_RAW 0
+#define RECOMPILE_CPM 1
+#define RECOMPILE_INVADERS 2
+
+static const uint8_t recompile_length[256] = {
+//  0  1  2  3  4  5  6  7  8  9  A  B  C  D  E  F
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 0
+    1, 3, 1, 1, 1, 1, 2, 1, 1, 1, 1, 1, 1, 1, 2, 1, // 1
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 2
+    1, 3, 3, 1, 1, 1, 2, 1, 1, 1, 3, 1, 1, 1, 2, 1, // 3
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 4
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 5
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 6
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 7
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 8
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 9
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // A
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // B
+    1, 1, 3, 3, 3, 1, 2, 1, 1, 1, 3, 3, 3, 3, 2, 1, // C
+    1, 1, 3, 2, 3, 1, 2, 1, 1, 1, 3, 2, 3, 3, 2, 1, // D
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1, // E
+    1, 1, 3, 1, 3, 1, 2, 1, 1, 1, 3, 1, 3, 3, 2, 1  // F
+};
+
+// DDD / SSS encoding, 6 is the memory location (H)(L)
+static const char *recompile_register[8] = {"b", "c", "d", "e", "h", "l", NULL, "a"};
+// BC, DE, HL, SP as a 16 bits value
+static const char *recompile_pair[4] = {"(uint16_t)(b << 8 | c)", "(uint16_t)(d << 8 | e)", "AOT_HL", "sp"};
+// CCC condition field
+static const char *recompile_condition[8] = {"!cc.z", "cc.z", "!cc.cy", "cc.cy", "!cc.p", "cc.p", "!cc.s", "cc.s"};
+
+typedef struct Recompiler {
+    const uint8_t *image;
+    uint32_t size;
+    uint16_t load;
+    FILE *f;
+    // 1 once the address is queued as the start of a block
+    uint8_t queued[0x10000];
+    uint16_t queue[0x10000];
+    uint32_t head;
+    uint32_t tail;
+    // blocks written, in queue order
+    uint16_t block_address[0x10000];
+    uint16_t block_size[0x10000];
+    uint16_t block_cycles[0x10000];
+    uint32_t block_count;
+    uint32_t instructions;
+} Recompiler;
+
+
+// 1 if the size bytes at address are all in the image
+static int recompile_inside(const Recompiler *r, uint32_t address, uint32_t size)
+{
+    return address >= r->load && address + size <= (uint32_t)r->load + r->size;
+}
+
+static uint8_t recompile_byte(const Recompiler *r, uint32_t address)
+{
+    return r->image[address - r->load];
+}
+
+static void recompile_target(Recompiler *r, uint16_t address)
+{
+    if (!recompile_inside(r, address, 1) || r->queued[address])
+        return;
+    r->queued[address] = 1;
+    r->queue[r->tail++] = address;
+}
+
+// the source operand SSS as a C expression
+static const char *recompile_source(uint8_t index)
+{
+    return index == 6 ? "memory_read(m, AOT_HL)" : recompile_register[index];
+}
+
+/*
+    Write the C code of the instruction at pc, returns its states on the longest path.
+    *end is set when the instruction leaves the block.
+*/
+static int recompile_instruction(Recompiler *r, uint16_t pc, int *end)
+{
+    FILE *f = r->f;
+    uint8_t op = recompile_byte(r, pc);
+    uint8_t byte2 = recompile_length[op] > 1 ? recompile_byte(r, pc + 1u) : 0;
+    uint16_t address = recompile_length[op] > 2 ? (uint16_t)(byte2 | recompile_byte(r, pc + 2u) << 8) : 0;
+    uint16_t next = (uint16_t)(pc + recompile_length[op]);
+    int states = cycles8080[op];
+    uint8_t ddd = (op >> 3) & 7;
+    uint8_t sss = op & 7;
+    // 1 if the instruction writes the memory and may change the code of a block
+    int writes = 0;
+
+    fprintf(f, "    // %04x :", pc);
+    for (int i = 0; i < recompile_length[op]; i++)
+        fprintf(f, " %02x", recompile_byte(r, pc + (uint32_t)i));
+    fprintf(f, "\n    ");
+
+    if (op >= 0x40 && op < 0x80 && op != 0x76) {
+        // MOV
+        if (ddd == 6) {
+            fprintf(f, "memory_write(m, AOT_HL, %s);", recompile_register[sss]);
+            writes = 1;
+        } else {
+            fprintf(f, "%s = %s;", recompile_register[ddd], recompile_source(sss));
+        }
+    } else if (op >= 0x80 && op < 0xC0) {
+        // ADD ADC SUB SBB ANA XRA ORA CMP
+        const char *source = recompile_source(sss);
+
+        switch (ddd) {
+            case 0: fprintf(f, "a = aot_add(&cc, a, %s, 0);", source); break;
+            case 1: fprintf(f, "a = aot_add(&cc, a, %s, cc.cy);", source); break;
+            case 2: fprintf(f, "a = aot_sub(&cc, a, %s, 0);", source); break;
+            case 3: fprintf(f, "a = aot_sub(&cc, a, %s, cc.cy);", source); break;
+            case 4: fprintf(f, "a = aot_and(&cc, a, %s);", source); break;
+            case 5: fprintf(f, "a = aot_xor(&cc, a, %s);", source); break;
+            case 6: fprintf(f, "a = aot_or(&cc, a, %s);", source); break;
+            default: fprintf(f, "(void)aot_sub(&cc, a, %s, 0);", source); break;
+        }
+    } else if ((op & 0xC7) == 0xC6) {
+        // ADI ACI SUI SBI ANI XRI ORI CPI
+        switch (ddd) {
+            case 0: fprintf(f, "a = aot_add(&cc, a, 0x%02x, 0);", byte2); break;
+            case 1: fprintf(f, "a = aot_add(&cc, a, 0x%02x, cc.cy);", byte2); break;
+            case 2: fprintf(f, "a = aot_sub(&cc, a, 0x%02x, 0);", byte2); break;
+            case 3: fprintf(f, "a = aot_sub(&cc, a, 0x%02x, cc.cy);", byte2); break;
+            case 4: fprintf(f, "a = aot_and(&cc, a, 0x%02x);", byte2); break;
+            case 5: fprintf(f, "a = aot_xor(&cc, a, 0x%02x);", byte2); break;
+            case 6: fprintf(f, "a = aot_or(&cc, a, 0x%02x);", byte2); break;
+            default: fprintf(f, "(void)aot_sub(&cc, a, 0x%02x, 0);", byte2); break;
+        }
+    } else if ((op & 0xC7) == 0x06) {
+        // MVI
+        if (ddd == 6) {
+            fprintf(f, "memory_write(m, AOT_HL, 0x%02x);", byte2);
+            writes = 1;
+        } else {
+            fprintf(f, "%s = 0x%02x;", recompile_register[ddd], byte2);
+        }
+    } else if ((op & 0xC6) == 0x04) {
+        // INR / DCR
+        const char *function = op & 1 ? "aot_dcr" : "aot_inr";
+
+        if (ddd == 6) {
+            fprintf(f, "memory_write(m, AOT_HL, %s(&cc, memory_read(m, AOT_HL)));", function);
+            writes = 1;
+        } else {
+            fprintf(f, "%s = %s(&cc, %s);", recompile_register[ddd], function, recompile_register[ddd]);
+        }
+    } else if ((op & 0xC7) == 0xC2 || (op & 0xC7) == 0xC4 || (op & 0xC7) == 0xC0) {
+        // Jccc / Cccc / Rccc, only leave the block when the condition is true
+        const char *condition = recompile_condition[ddd];
+
+        if ((op & 0xC7) == 0xC2) {
+            fprintf(f, "if (%s) { pc = 0x%04x; cycles += %d; goto aot_leave; }", condition, address,
+                cycles8080[op] + JUMP_TAKEN8080);
+            recompile_target(r, address);
+            states += JUMP_TAKEN8080;
+        } else if ((op & 0xC7) == 0xC4) {
+            fprintf(f, "if (%s) { AOT_PUSH(0x%04x); pc = 0x%04x; cycles += %d; goto aot_leave; }",
+                condition, next, address, cycles8080[op] + CALL_TAKEN8080);
+            recompile_target(r, address);
+            recompile_target(r, next);
+            states += CALL_TAKEN8080;
+        } else {
+            fprintf(f, "if (%s) { pc = aot_pop(m, &sp); cycles += %d; goto aot_leave; }", condition,
+                cycles8080[op] + RETURN_TAKEN8080);
+            states += RETURN_TAKEN8080;
+        }
+        fprintf(f, "\n    cycles += %d;\n", cycles8080[op]);
+        return states;
+    } else if ((op & 0xC7) == 0xC7) {
+        // RST n
+        fprintf(f, "AOT_PUSH(0x%04x); pc = 0x%04x;", next, op & 0x38);
+        recompile_target(r, (uint16_t)(op & 0x38));
+        recompile_target(r, next);
+        *end = 1;
+    } else {
+        switch (op) {
+            case 0x01: case 0x11: case 0x21:
+                fprintf(f, "%s = 0x%02x; %s = 0x%02x;", recompile_register[(op >> 4) * 2],
+                    address >> 8, recompile_register[(op >> 4) * 2 + 1], byte2);
+                break;
+            case 0x31:
+                fprintf(f, "sp = 0x%04x;", address);
+                break;
+            case 0x3A:
+                fprintf(f, "a = memory_read(m, 0x%04x);", address);
+                break;
+            case 0x32:
+                fprintf(f, "memory_write(m, 0x%04x, a);", address);
+                writes = 1;
+                break;
+            case 0x2A:
+                fprintf(f, "l = memory_read(m, 0x%04x); h = memory_read(m, 0x%04x);", address, (uint16_t)(address + 1));
+                break;
+            case 0x22:
+                fprintf(f, "memory_write(m, 0x%04x, l); memory_write(m, 0x%04x, h);", address, (uint16_t)(address + 1));
+                writes = 1;
+                break;
+            case 0x0A: case 0x1A:
+                fprintf(f, "a = memory_read(m, %s);", recompile_pair[op >> 4]);
+                break;
+            case 0x02: case 0x12:
+                fprintf(f, "memory_write(m, %s, a);", recompile_pair[op >> 4]);
+                writes = 1;
+                break;
+            case 0xEB:
+                fprintf(f, "{ uint8_t t = h; h = d; d = t; t = l; l = e; e = t; }");
+                break;
+            case 0x03: case 0x13: case 0x23: case 0x0B: case 0x1B: case 0x2B:
+                fprintf(f, "{ uint16_t t = (uint16_t)(%s %c 1); %s = (uint8_t)(t >> 8); %s = (uint8_t)t; }",
+                    recompile_pair[op >> 4], op & 8 ? '-' : '+',
+                    recompile_register[(op >> 4) * 2], recompile_register[(op >> 4) * 2 + 1]);
+                break;
+            case 0x33:
+                fprintf(f, "sp++;");
+                break;
+            case 0x3B:
+                fprintf(f, "sp--;");
+                break;
+            case 0x09: case 0x19: case 0x29: case 0x39:
+                fprintf(f, "{ uint32_t t = (uint32_t)AOT_HL + %s; h = (uint8_t)(t >> 8); l = (uint8_t)t; cc.cy = (t >> 16) & 1; }",
+                    recompile_pair[op >> 4]);
+                break;
+            case 0x27:
+                fprintf(f, "a = aot_daa(&cc, a);");
+                break;
+            case 0x07:
+                fprintf(f, "cc.cy = a >> 7; a = (uint8_t)(a << 1 | cc.cy);");
+                break;
+            case 0x0F:
+                fprintf(f, "cc.cy = a & 1; a = (uint8_t)(a >> 1 | cc.cy << 7);");
+                break;
+            case 0x17:
+                fprintf(f, "{ uint8_t t = cc.cy; cc.cy = a >> 7; a = (uint8_t)(a << 1 | t); }");
+                break;
+            case 0x1F:
+                fprintf(f, "{ uint8_t t = cc.cy; cc.cy = a & 1; a = (uint8_t)(a >> 1 | t << 7); }");
+                break;
+            case 0x2F:
+                fprintf(f, "a = (uint8_t)~a;");
+                break;
+            case 0x3F:
+                fprintf(f, "cc.cy = !cc.cy;");
+                break;
+            case 0x37:
+                fprintf(f, "cc.cy = 1;");
+                break;
+            case 0xC3: case 0xCB:
+                fprintf(f, "pc = 0x%04x;", address);
+                recompile_target(r, address);
+                *end = 1;
+                break;
+            case 0xCD: case 0xDD: case 0xED: case 0xFD:
+                fprintf(f, "AOT_PUSH(0x%04x); pc = 0x%04x;", next, address);
+                recompile_target(r, address);
+                recompile_target(r, next);
+                *end = 1;
+                break;
+            case 0xC9: case 0xD9:
+                fprintf(f, "pc = aot_pop(m, &sp);");
+                *end = 1;
+                break;
+            case 0xE9:
+                fprintf(f, "pc = AOT_HL;");
+                *end = 1;
+                break;
+            case 0xC5: case 0xD5: case 0xE5:
+                fprintf(f, "AOT_PUSH(%s);", recompile_pair[(op >> 4) & 3]);
+                writes = 1;
+                break;
+            case 0xF5:
+                fprintf(f, "AOT_PUSH((uint16_t)(a << 8 | aot_psw(&cc)));");
+                writes = 1;
+                break;
+            case 0xC1: case 0xD1: case 0xE1:
+                fprintf(f, "{ uint16_t t = aot_pop(m, &sp); %s = (uint8_t)(t >> 8); %s = (uint8_t)t; }",
+                    recompile_register[((op >> 4) & 3) * 2], recompile_register[((op >> 4) & 3) * 2 + 1]);
+                break;
+            case 0xF1:
+                fprintf(f, "{ uint16_t t = aot_pop(m, &sp); a = (uint8_t)(t >> 8); aot_set_psw(&cc, (uint8_t)t); }");
+                break;
+            case 0xE3:
+                fprintf(f, "{ uint16_t t = aot_read_word(m, sp); aot_write_word(m, sp, AOT_HL); h = (uint8_t)(t >> 8); l = (uint8_t)t; }");
+                writes = 1;
+                break;
+            case 0xF9:
+                fprintf(f, "sp = AOT_HL;");
+                break;
+            // the device sees the registers, the cycle counter and PC as on the interpreter
+            case 0xDB:
+                fprintf(f, "{ uint8_t t; AOT_STORE; s->pc = 0x%04x; t = s->port_in ? s->port_in(s, 0x%02x) : 0; AOT_LOAD; a = t; }",
+                    (uint16_t)(pc + 1), byte2);
+                break;
+            case 0xD3:
+                fprintf(f, "AOT_STORE; s->pc = 0x%04x; if (s->port_out) s->port_out(s, 0x%02x, a); AOT_LOAD;",
+                    (uint16_t)(pc + 1), byte2);
+                break;
+            case 0xFB:
+                fprintf(f, "s->int_enable = 1;");
+                break;
+            case 0xF3:
+                fprintf(f, "s->int_enable = 0;");
+                break;
+            case 0x76:
+                fprintf(f, "s->halted = 1; pc = 0x%04x;", next);
+                recompile_target(r, next);
+                *end = 1;
+                break;
+#ifdef CPU_8085
+            // RIM / SIM through the handlers of the interpreter
+            case 0x20: case 0x30:
+                fprintf(f, "AOT_STORE; s->pc = 0x%04x; handlers8080[0x%02x](s); AOT_LOAD;", next, op);
+                break;
+#endif
+            // NOP and its aliases
+            default:
+                break;
+        }
+    }
+
+    fprintf(f, "\n    cycles += %d;\n", states);
+    if (writes)
+        fprintf(f, "    AOT_CHECK(0x%04x)\n", next);
+    if (*end)
+        fprintf(f, "    goto aot_leave;\n");
+    return states;
+}
+
+// Write the block starting at start
+static void recompile_block(Recompiler *r, uint16_t start)
+{
+    uint32_t pc = start;
+    int states = 0;
+    int count = 0;
+    int end = 0;
+
+    fprintf(r->f, "static void aot_%04x(State8080 *s)\n{\n    AOT_ENTER;\n\n", start);
+    while (!end && count < RECOMPILE_INSTRUCTIONS && recompile_inside(r, pc, recompile_length[recompile_byte(r, pc)])) {
+        states += recompile_instruction(r, (uint16_t)pc, &end);
+        pc += recompile_length[recompile_byte(r, pc)];
+        count++;
+        // the next instruction must start inside the image
+        if (!recompile_inside(r, pc, 1))
+            break;
+    }
+    if (!end) {
+        fprintf(r->f, "    pc = 0x%04x;\n    goto aot_leave;\n", (uint16_t)pc);
+        recompile_target(r, (uint16_t)pc);
+    }
+    fprintf(r->f, "\n    AOT_LEAVE;\n}\n\n");
+
+    r->block_address[r->block_count] = start;
+    r->block_size[r->block_count] = (uint16_t)(pc - start);
+    r->block_cycles[r->block_count] = (uint16_t)states;
+    r->block_count++;
+    r->instructions += count;
+}
+
+
+// A file name in the header comment, without "*/" and with '?' for the characters outside printable ASCII
+static void recompile_comment(FILE *f, const char *text)
+{
+    char last = '\0';
+
+    for (; *text != '\0'; text++) {
+        char c = *text >= 0x20 && *text < 0x7f ? *text : '?';
+
+        // the '/' closing a comment is dropped
+        if (c == '/' && last == '*')
+            continue;
+        fputc(c, f);
+        last = c;
+    }
+}
+
+// A file name in a string literal, '?' is escaped for the trigraphs
+static void recompile_string(FILE *f, const char *text)
+{
+    for (; *text != '\0'; text++) {
+        unsigned char c = (unsigned char)*text;
+
+        if (c == '"' || c == '\\' || c == '?')
+            fprintf(f, "\\%c", c);
+        else if (c >= 0x20 && c < 0x7f)
+            fputc(c, f);
+        else
+            fprintf(f, "\\%03o", c);
+    }
+}
+
+
+/*
+    Recompile image (loaded at load on machine) to the C source path.
+    Returns 0 if the file can't be written.
+*/
+int recompile(const uint8_t *image, uint32_t size, uint16_t load, int machine, const char *name, const char *path)
+{
+    static const char *machines[] = {"AOT_RAW", "AOT_CPM", "AOT_INVADERS"};
+    Recompiler *r = calloc(1, sizeof(Recompiler));
+
+    if (r == NULL) {
+        printf("Error : couldn't allocate the recompiler\n");
+        return 0;
+    }
+    if (size == 0 || load + size > 0x10000) {
+        printf("Error : the image doesn't fit in memory at %04x\n", load);
+        free(r);
+        return 0;
+    }
+    r->image = image;
+    r->size = size;
+    r->load = load;
+    if ((r->f = fopen(path, "w")) == NULL) {
+        printf("Error : couldn't open the file %s\n", path);
+        free(r);
+        return 0;
+    }
+
+    fprintf(r->f, "/*\n    ");
+    recompile_comment(r->f, name);
+    fprintf(r->f, " recompiled by the 8080 static recompiler, do not edit\n\n        gcc -O2 -I <repository> ");
+    recompile_comment(r->f, path);
+    fprintf(r->f, " -o program && ./program -verify\n*/\n\n");
+#ifdef CPU_8085
+    fprintf(r->f, "#define CPU_8085\n");
+#endif
+    fprintf(r->f, "#include \"Recompiler/runtime.c\"\n\n\n");
+
+    recompile_target(r, load);
+    for (int rst = 0; rst < 8; rst++)
+        recompile_target(r, (uint16_t)(rst * 8));
+    // every block queues the targets it finds
+    while (r->head < r->tail)
+        recompile_block(r, r->queue[r->head++]);
+
+    fprintf(r->f, "static const AotBlock aot_blocks[] = {\n");
+    for (uint32_t i = 0; i < r->block_count; i++)
+        fprintf(r->f, "    {0x%04x, %u, %u, aot_%04x},\n", r->block_address[i], r->block_size[i],
+            r->block_cycles[i], r->block_address[i]);
+    fprintf(r->f, "};\n\nstatic const uint8_t aot_image[] = {");
+    for (uint32_t i = 0; i < size; i++)
+        fprintf(r->f, "%s0x%02x,", i % 16 ? " " : "\n    ", image[i]);
+    fprintf(r->f, "\n};\n\n");
+    fprintf(r->f, "static const AotProgram aot_program = {\"");
+    recompile_string(r->f, name);
+    fprintf(r->f, "\", %s, 0x%04x, aot_image, %u, aot_blocks, %u};\n\n", machines[machine], load, size, r->block_count);
+    fprintf(r->f, "int main(int argc, char *argv[])\n{\n    return aot_main(argc, argv, &aot_program);\n}\n");
+    fclose(r->f);
+
+    printf("%u blocks, %u instructions recompiled to %s\n", r->block_count, r->instructions, path);
+    free(r);
+    return 1;
+}
+
+#endif
@@ -0,0 +1,483 @@
+#ifndef RECOMPILER_RUNTIME_C
+#define RECOMPILER_RUNTIME_C
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "../Emulator/emulator.c"
+#include "../Emulator/cpm.c"
+#include "../Invaders/invaders.c"
+
+/*
+    Runtime of the recompiled programs
+
+    The source written by recompiler.c includes this file. Each basic block of the program
+    is a C function working on local copies of the registers (AOT_ENTER), written back to
+    State8080 when the block is left (AOT_LEAVE) or before an IN / OUT, so the host compiler
+    keeps them in host registers and drops the flags nobody reads.
+
+    aot_run looks up the block starting at PC and runs it, or runs one instruction on the
+    interpreter when there is no block there (code reached through PCHL, a return to an
+    address that isn't the target of a call, code outside the image, ...).
+    A block only runs if its longest path ends before the cycle limit, so aot_run stops on
+    the same instruction as the interpreter and the interrupts are taken at the same cycle.
+
+    Self-modifying code : the pages holding recompiled code are watched. A write changing a
+    byte of a block removes every block containing that byte (the interpreter runs that code
+    from then on) and sets aot_dirty, the running block stops after the instruction.
+*/
+
+
+// machine the program is recompiled for
+#define AOT_RAW 0
+#define AOT_CPM 1
+#define AOT_INVADERS 2
+
+// states run between two checks of the end of a CP/M or raw program
+#define AOT_SLICE 1000000
+
+typedef void (*AotBlockFn)(State8080 *s);
+
+typedef struct AotBlock {
+    uint16_t address;
+    // bytes of code, at most 255
+    uint16_t size;
+    // states of the longest path through the block
+    uint16_t cycles;
+    AotBlockFn run;
+} AotBlock;
+
+typedef struct AotProgram {
+    const char *name;
+    int machine;
+    uint16_t load;
+    const uint8_t *image;
+    uint32_t size;
+    const AotBlock *blocks;
+    uint32_t block_count;
+} AotProgram;
+
+// block starting at each address, NULL once the block is invalidated
+static const AotBlock *aot_entry[0x10000];
+// one bit per byte of recompiled code
+static uint8_t aot_code[0x10000 / 8];
+// set by a write to the code of a block, the running block leaves after the instruction
+static int aot_dirty;
+static uint64_t aot_invalidated;
+
+
+#define AOT_HL ((uint16_t)(h << 8 | l))
+
+#define AOT_ENTER \
+    uint8_t a = s->a, b = s->b, c = s->c, d = s->d, e = s->e, h = s->h, l = s->l; \
+    uint16_t sp = s->sp, pc; \
+    ConditionCodes cc = s->cc; \
+    uint64_t cycles = s->cycles; \
+    Memory8080 *m = s->memory; \
+    (void)m
+
+#define AOT_STORE \
+    s->a = a; s->b = b; s->c = c; s->d = d; s->e = e; s->h = h; s->l = l; \
+    s->sp = sp; s->cc = cc; s->cycles = cycles
+
+#define AOT_LOAD \
+    a = s->a; b = s->b; c = s->c; d = s->d; e = s->e; h = s->h; l = s->l; \
+    sp = s->sp; cc = s->cc; cycles = s->cycles
+
+#define AOT_LEAVE \
+    aot_leave: \
+    AOT_STORE; \
+    s->pc = pc
+
+// after a write : leave the block if the write changed recompiled code
+#define AOT_CHECK(next) \
+    if (aot_dirty) { pc = next; goto aot_leave; }
+
+#define AOT_PUSH(value) \
+    do { \
+        uint16_t pushed = (value); \
+        sp -= 2; \
+        memory_write(m, sp, (uint8_t)pushed); \
+        memory_write(m, (uint16_t)(sp + 1), (uint8_t)(pushed >> 8)); \
+    } while (0)
+
+
+// Same flags as the helpers of emulator.c, on the local copy of the condition codes
+static inline void aot_zsp(ConditionCodes *cc, uint8_t value)
+{
+    cc->z = value == 0;
+    cc->s = value >> 7;
+    cc->p = parity8080[value];
+}
+
+static inline uint8_t aot_add(ConditionCodes *cc, uint8_t lhs, uint8_t rhs, uint8_t carry)
+{
+    uint16_t result = lhs + rhs + carry;
+    cc->cy = result >> 8;
+    cc->ac = ((lhs ^ rhs ^ result) >> 4) & 1;
+    aot_zsp(cc, (uint8_t)result);
+    return (uint8_t)result;
+}
+
+static inline uint8_t aot_sub(ConditionCodes *cc, uint8_t lhs, uint8_t rhs, uint8_t borrow)
+{
+    uint8_t result = aot_add(cc, lhs, (uint8_t)~rhs, !borrow);
+    cc->cy = !cc->cy;
+    return result;
+}
+
+static inline uint8_t aot_and(ConditionCodes *cc, uint8_t a, uint8_t value)
+{
+#ifdef CPU_8085
+    cc->ac = 1;
+#else
+    cc->ac = ((a | value) >> 3) & 1;
+#endif
+    a &= value;
+    cc->cy = 0;
+    aot_zsp(cc, a);
+    return a;
+}
+
+static inline uint8_t aot_xor(ConditionCodes *cc, uint8_t a, uint8_t value)
+{
+    a ^= value;
+    cc->cy = 0;
+    cc->ac = 0;
+    aot_zsp(cc, a);
+    return a;
+}
+
+static inline uint8_t aot_or(ConditionCodes *cc, uint8_t a, uint8_t value)
+{
+    a |= value;
+    cc->cy = 0;
+    cc->ac = 0;
+    aot_zsp(cc, a);
+    return a;
+}
+
+static inline uint8_t aot_inr(ConditionCodes *cc, uint8_t value)
+{
+    value++;
+    cc->ac = (value & 0x0f) == 0;
+    aot_zsp(cc, value);
+    return value;
+}
+
+static inline uint8_t aot_dcr(ConditionCodes *cc, uint8_t value)
+{
+    value--;
+    cc->ac = (value & 0x0f) != 0x0f;
+    aot_zsp(cc, value);
+    return value;
+}
+
+static inline uint8_t aot_daa(ConditionCodes *cc, uint8_t a)
+{
+    uint8_t carry = cc->cy;
+    uint8_t correction = 0;
+    uint8_t lsb = a & 0x0f;
+    uint8_t msb = a >> 4;
+
+    if (cc->ac || lsb > 9)
+        correction += 0x06;
+    if (cc->cy || msb > 9 || (msb >= 9 && lsb > 9)) {
+        correction += 0x60;
+        carry = 1;
+    }
+    a = aot_add(cc, a, correction, 0);
+    cc->cy = carry;
+    return a;
+}
+
+static inline uint8_t aot_psw(const ConditionCodes *cc)
+{
+    return (cc->s << 7) | (cc->z << 6) | (cc->ac << 4) | (cc->p << 2) | 0x02 | cc->cy;
+}
+
+static inline void aot_set_psw(ConditionCodes *cc, uint8_t psw)
+{
+    cc->s = (psw >> 7) & 1;
+    cc->z = (psw >> 6) & 1;
+    cc->ac = (psw >> 4) & 1;
+    cc->p = (psw >> 2) & 1;
+    cc->cy = psw & 1;
+}
+
+static inline uint16_t aot_read_word(const Memory8080 *m, uint16_t address)
+{
+    return memory_read(m, address) | (memory_read(m, (uint16_t)(address + 1)) << 8);
+}
+
+static inline void aot_write_word(Memory8080 *m, uint16_t address, uint16_t value)
+{
+    memory_write(m, address, (uint8_t)value);
+    memory_write(m, (uint16_t)(address + 1), (uint8_t)(value >> 8));
+}
+
+static inline uint16_t aot_pop(const Memory8080 *m, uint16_t *sp)
+{
+    uint16_t value = aot_read_word(m, *sp);
+    *sp += 2;
+    return value;
+}
+
+
+static void aot_watch(Memory8080 *memory, uint16_t address, uint8_t value)
+{
+    if (!(aot_code[address >> 3] & (1 << (address & 7))) || (memory->flags[address >> MEMORY_PAGE_SHIFT] & MEMORY_ROM)
+            || memory_read(memory, address) == value)
+        return;
+    // the blocks are at most 255 bytes long
+    for (int back = 0; back < 256; back++) {
+        uint16_t start = (uint16_t)(address - back);
+
+        if (aot_entry[start] != NULL && back < aot_entry[start]->size) {
+            aot_entry[start] = NULL;
+            aot_invalidated++;
+        }
+    }
+    aot_code[address >> 3] &= ~(1 << (address & 7));
+    aot_dirty = 1;
+}
+
+// Use the blocks of program for state, the image must be loaded at program->load
+void aot_attach(const AotProgram *program, State8080 *state)
+{
+    Memory8080 *memory = state->memory;
+
+    memset(aot_entry, 0, sizeof(aot_entry));
+    memset(aot_code, 0, sizeof(aot_code));
+    aot_dirty = 0;
+    aot_invalidated = 0;
+    for (uint32_t i = 0; i < program->block_count; i++) {
+        const AotBlock *block = &program->blocks[i];
+
+        aot_entry[block->address] = block;
+        for (uint16_t j = 0; j < block->size; j++) {
+            uint16_t address = (uint16_t)(block->address + j);
+
+            aot_code[address >> 3] |= 1 << (address & 7);
+        }
+    }
+    for (int index = 0; index < MEMORY_PAGE_COUNT; index++) {
+        int code = 0;
+
+        for (int i = 0; i < MEMORY_PAGE_SIZE / 8; i++)
+            code |= aot_code[index * MEMORY_PAGE_SIZE / 8 + i];
+        if (code && !(memory->flags[index] & MEMORY_ROM))
+            memory_set_flags(memory, (uint16_t)(index << MEMORY_PAGE_SHIFT), MEMORY_PAGE_SIZE, MEMORY_WATCH, 1);
+    }
+    memory->watch = aot_watch;
+}
+
+// Run state until the cycle counter reaches limit or the processor halts
+void aot_run(State8080 *s, uint64_t limit)
+{
+    while (s->cycles < limit && !s->halted) {
+        const AotBlock *block = aot_entry[s->pc];
+
+        if (block != NULL && s->cycles + block->cycles <= limit) {
+            block->run(s);
+            aot_dirty = 0;
+        } else {
+            emulate8080(s);
+        }
+    }
+}
+
+// aot_run on the interpreter, the reference of the verification
+static void aot_interpret(State8080 *s, uint64_t limit)
+{
+    while (s->cycles < limit && !s->halted)
+        emulate8080(s);
+}
+
+static void aot_slice(State8080 *s, uint64_t limit, int native)
+{
+    if (native)
+        aot_run(s, limit);
+    else
+        aot_interpret(s, limit);
+}
+
+
+/*
+    The machines : each one runs the program either on the blocks (native) or on the
+    interpreter, with the same slices, the same input and the same interrupts
+*/
+static void aot_run_raw(const AotProgram *program, State8080 *state, int native, uint64_t cycles)
+{
+    init8080(state, memory_create());
+    memory_load(state->memory, program->load, program->image, program->size);
+    state->pc = program->load;
+    if (native)
+        aot_attach(program, state);
+    while (state->cycles < cycles && !state->halted)
+        aot_slice(state, state->cycles + AOT_SLICE < cycles ? state->cycles + AOT_SLICE : cycles, native);
+}
+
+static void aot_run_cpm(const AotProgram *program, Cpm8080 *cpm, int native, uint64_t cycles, int echo)
+{
+    State8080 *cpu = &cpm->cpu;
+
+    if (!cpm_init(cpm, program->image, (int)program->size))
+        exit(1);
+    cpm->echo = echo;
+    if (native)
+        aot_attach(program, cpu);
+    while (!cpm->done && !cpu->halted && cpu->cycles < cycles)
+        aot_slice(cpu, cpu->cycles + AOT_SLICE < cycles ? cpu->cycles + AOT_SLICE : cycles, native);
+}
+
+// Scripted player : coin, start, then move and shoot
+static void aot_invaders_input(Invaders *machine)
+{
+    uint64_t frame = machine->frames;
+
+    machine->port1 = 0x08;
+    if (frame >= 60 && frame < 64)
+        machine->port1 |= INVADERS_COIN;
+    if (frame >= 120 && frame < 124)
+        machine->port1 |= INVADERS_P1_START;
+    if (frame >= 200) {
+        if (frame % 20 < 2)
+            machine->port1 |= INVADERS_P1_SHOT;
+        if (frame / 50 % 3 == 0)
+            machine->port1 |= INVADERS_P1_LEFT;
+        else if (frame / 50 % 3 == 1)
+            machine->port1 |= INVADERS_P1_RIGHT;
+    }
+}
+
+// invaders_frame, a halted processor burns the states up to the interrupt
+static void aot_invaders_frame(Invaders *machine, int native)
+{
+    State8080 *cpu = &machine->cpu;
+    uint64_t end = cpu->cycles + INVADERS_FRAME_CYCLES;
+    uint64_t middle = end - INVADERS_FRAME_CYCLES / 2;
+
+    aot_slice(cpu, middle, native);
+    while (cpu->cycles < middle)
+        emulate8080(cpu);
+    interrupt8080(cpu, 1);
+    aot_slice(cpu, end, native);
+    while (cpu->cycles < end)
+        emulate8080(cpu);
+    interrupt8080(cpu, 2);
+    machine->frames++;
+}
+
+static void aot_run_invaders(const AotProgram *program, Invaders *machine, int native, uint64_t frames)
+{
+    if (!invaders_init(machine, program->image, (int)program->size))
+        exit(1);
+    if (native)
+        aot_attach(program, &machine->cpu);
+    while (machine->frames < frames) {
+        aot_invaders_input(machine);
+        aot_invaders_frame(machine, native);
+    }
+}
+
+
+// Returns 1 if both states and memories are identical, prints the first difference
+static int aot_compare(const State8080 *native, const State8080 *reference)
+{
+    const uint8_t lhs[] = {native->a, native->b, native->c, native->d, native->e, native->h, native->l,
+        psw8080(native), native->int_enable, native->halted};
+    const uint8_t rhs[] = {reference->a, reference->b, reference->c, reference->d, reference->e, reference->h,
+        reference->l, psw8080(reference), reference->int_enable, reference->halted};
+
+    if (memcmp(lhs, rhs, sizeof(lhs)) != 0 || native->sp != reference->sp || native->pc != reference->pc) {
+        printf("Error : the registers differ, native PC %04x SP %04x, interpreter PC %04x SP %04x\n",
+            native->pc, native->sp, reference->pc, reference->sp);
+        return 0;
+    }
+    if (native->cycles != reference->cycles) {
+        printf("Error : %llu states native, %llu states on the interpreter\n",
+            (unsigned long long)native->cycles, (unsigned long long)reference->cycles);
+        return 0;
+    }
+    for (int address = 0; address < 0x10000; address++) {
+        if (memory_read(native->memory, (uint16_t)address) != memory_read(reference->memory, (uint16_t)address)) {
+            printf("Error : the memory differs at %04x\n", address);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+static double aot_seconds(const struct timespec *start)
+{
+    struct timespec end;
+
+    timespec_get(&end, TIME_UTC);
+    return (end.tv_sec - start->tv_sec) + (end.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+/*
+    main of a recompiled program : [-verify] [limit]
+        limit   : states (raw, CP/M) or frames (Space Invaders) to run
+        -verify : run the program on the interpreter too, compare the final states and the speed
+*/
+int aot_main(int argc, char *argv[], const AotProgram *program)
+{
+    static Cpm8080 cpm[2];
+    static Invaders invaders[2];
+    State8080 raw[2];
+    State8080 *cpu[2];
+    int verify = argc > 1 && strcmp(argv[1], "-verify") == 0;
+    const char *limit = argc > 1 + verify ? argv[1 + verify] : NULL;
+    double seconds[2] = {0, 0};
+    int result = 0;
+
+    for (int pass = 0; pass < 1 + verify; pass++) {
+        // pass 0 : native, pass 1 : interpreter
+        int native = pass == 0;
+        struct timespec start;
+
+        timespec_get(&start, TIME_UTC);
+        switch (program->machine) {
+            case AOT_CPM:
+                aot_run_cpm(program, &cpm[pass], native, limit ? strtoull(limit, NULL, 10) : UINT64_MAX, native);
+                cpu[pass] = &cpm[pass].cpu;
+                break;
+            case AOT_INVADERS:
+                aot_run_invaders(program, &invaders[pass], native, limit ? strtoull(limit, NULL, 10) : 3600);
+                cpu[pass] = &invaders[pass].cpu;
+                break;
+            default:
+                aot_run_raw(program, &raw[pass], native, limit ? strtoull(limit, NULL, 10) : 100000000);
+                cpu[pass] = &raw[pass];
+                break;
+        }
+        seconds[pass] = aot_seconds(&start);
+    }
+
+    printf("\n%s : %u blocks, %llu invalidated, %llu states in %.3f s native",
+        program->name, program->block_count, (unsigned long long)aot_invalidated,
+        (unsigned long long)cpu[0]->cycles, seconds[0]);
+    if (verify) {
+        printf(", %.3f s on the interpreter (x%.1f)\n", seconds[1], seconds[0] > 0 ? seconds[1] / seconds[0] : 0.0);
+        if (aot_compare(cpu[0], cpu[1]))
+            printf("Identical to the interpreter\n");
+        else
+            result = 1;
+        if (program->machine == AOT_CPM && cpm[0].characters != cpm[1].characters) {
+            printf("Error : %llu characters printed native, %llu on the interpreter\n",
+                (unsigned long long)cpm[0].characters, (unsigned long long)cpm[1].characters);
+            result = 1;
+        }
+    } else {
+        printf("\n");
+    }
+    for (int pass = 0; pass < 1 + verify; pass++)
+        memory_destroy(cpu[pass]->memory);
+    return result;
+}
+
+#endif
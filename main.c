@@ -1,39 +1,403 @@
+// POSIX threads and directories for the corpus mode
+#define _DEFAULT_SOURCE
+
 #include <stdlib.h>
 #include <stdio.h>
-#include "disassembler/disassembler.c"
+#include <string.h>
+#include "Disassembler/disassembler.c"
+#include "Disassembler/corpus.c"
+#include "Disassembler/labels.c"
+#include "Disassembler/diff.c"
+#include "Disassembler/index.c"
+#include "Disassembler/cache.c"
+#include "Disassembler/incremental.c"
+#include "Assembler/assembler.c"
+#include "Emulator/lockstep.c"
+#include "Emulator/fork.c"
+#include "Emulator/profile.c"
+#include "Emulator/coverage.c"
+#include "Emulator/trace.c"
+#include "Emulator/debug.c"
+#include "Emulator/cpm.c"
+#include "Emulator/benchmark.c"
+#include "Emulator/stats.c"
+#include "Invaders/invaders.c"
+#include "Recompiler/recompiler.c"
 
-int main(int argc, char * argv[]) {
-    
-    if (argc != 2) {
-        printf("Error : 1 argument is required");
-        return 1;
-    }
+unsigned char *load_file(const char *path, int *f_size) {
 
-    FILE *f = fopen(argv[1], "rb");
+    FILE *f = fopen(path, "rb");
     if (f == NULL) {
-        printf("Error : couldn't open the file %s", argv[1]);
-        return 1;
+        printf("Error : couldn't open the file %s", path);
+        return NULL;
     }
 
     fseek(f, 0l, SEEK_END);
-    int f_size = ftell(f);
+    *f_size = ftell(f);
     fseek(f, 0l, SEEK_SET);
 
+    // zeroed padding, so the last instruction never reads past the buffer
     unsigned char *buffer = NULL;
-    buffer = malloc(f_size);
+    buffer = calloc(*f_size + 2, 1);
     if (buffer == NULL) {
-        printf("Error : couldn't allocate %d bytes of memory", f_size);
+        printf("Error : couldn't allocate %d bytes of memory", *f_size);
         fclose(f);
-        return 1;
+        return NULL;
     }
 
-    fread(buffer, f_size, 1, f);
+    fread(buffer, *f_size, 1, f);
     fclose(f);
+    return buffer;
+}
+
+int main(int argc, char * argv[]) {
+
+    int f_size = 0;
+    unsigned char *buffer = NULL;
+
+    /*
+        -lockstep file [lanes] [cycles] [rom_end] : run the file on the lockstep engine and check it against the scalar core,
+        rom_end is the end of the code the program never modifies
+        the 8085 build first runs a built-in check of the 8085 specific instructions
+    */
+    if (argc >= 3 && strcmp(argv[1], "-lockstep") == 0) {
+        int lanes = argc > 3 ? atoi(argv[3]) : LOCKSTEP_LANES;
+        uint64_t cycles = argc > 4 ? strtoull(argv[4], NULL, 10) : 10000000;
+        uint16_t rom_end = argc > 5 ? (uint16_t)strtoul(argv[5], NULL, 0) : 0;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int mismatches = 0;
+#ifdef CPU_8085
+        mismatches += lockstep_check(lanes);
+#endif
+        mismatches += lockstep_benchmark(buffer, f_size, lanes, cycles, rom_end);
+        free(buffer);
+        return mismatches != 0;
+    }
+
+    // -fork file [forks] [cycles] : run the file, fork it and run every fork with its own input
+    if (argc >= 3 && strcmp(argv[1], "-fork") == 0) {
+        int forks = argc > 3 ? atoi(argv[3]) : 1000;
+        uint64_t cycles = argc > 4 ? strtoull(argv[4], NULL, 10) : 100000;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        fork_benchmark(buffer, f_size, forks, cycles);
+        free(buffer);
+        return 0;
+    }
+
+    /*
+        -invaders rom [frames] [directory] [every] [wav] : run Space Invaders headless, one PPM frame
+        every every frames, the sound is written to wav
+    */
+    if (argc >= 3 && strcmp(argv[1], "-invaders") == 0) {
+        int frames = argc > 3 ? atoi(argv[3]) : 600;
+        const char *directory = argc > 4 && strcmp(argv[4], "-") != 0 ? argv[4] : NULL;
+        int every = argc > 5 ? atoi(argv[5]) : 60;
+        const char *wav = argc > 6 ? argv[6] : NULL;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = invaders_run(buffer, f_size, frames, directory, every, wav);
+        free(buffer);
+        return result;
+    }
+
+    // -profile file [cycles] [folded] : profile file, the call stacks are written to folded
+    if (argc >= 3 && strcmp(argv[1], "-profile") == 0) {
+        uint64_t cycles = argc > 3 ? strtoull(argv[3], NULL, 10) : 100000000;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = profile_run(buffer, f_size, cycles, argc > 4 ? argv[4] : NULL);
+        free(buffer);
+        return result;
+    }
+
+    /*
+        -coverage file [cycles] [runs] [output] : run file runs times on every processor with its own input, the merged
+        coverage (executed / read / written bitmaps, branches taken and not taken) is saved to output
+    */
+    if (argc >= 3 && argc <= 6 && strcmp(argv[1], "-coverage") == 0) {
+        uint64_t cycles = argc > 3 ? strtoull(argv[3], NULL, 10) : 10000000;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = coverage_run(buffer, f_size, cycles, argc > 4 ? atoi(argv[4]) : 1, argc > 5 ? argv[5] : NULL);
+        free(buffer);
+        return result;
+    }
+
+    // -coverage-merge output input ... : merge the coverage files
+    if (argc >= 4 && strcmp(argv[1], "-coverage-merge") == 0)
+        return coverage_merge_files(argv[2], argv + 3, argc - 3);
+
+    // -coverage-list file input ... : listing of file marked with the merged coverage files
+    if (argc >= 4 && strcmp(argv[1], "-coverage-list") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = coverage_list_files(buffer, f_size, argv + 3, argc - 3);
+        free(buffer);
+        return result;
+    }
+
+    /*
+        -trace file [cycles] [count] [sample] : run file with the trace and print the last count instructions,
+        the registers are saved every sample instructions (1 for all of them) and rebuilt for the others
+    */
+    if (argc >= 3 && strcmp(argv[1], "-trace") == 0) {
+        uint64_t cycles = argc > 3 ? strtoull(argv[3], NULL, 10) : 100000000;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = trace_run(buffer, f_size, cycles, argc > 4 ? atoi(argv[4]) : 32,
+            argc > 5 ? (uint32_t)atoi(argv[5]) : TRACE_SAMPLE);
+        free(buffer);
+        return result;
+    }
+
+    /*
+        -debug file cycles spec ... : run file with breakpoints and watchpoints
+            b:address[:condition], r:start[-end], w:start[-end], rw:start[-end] (hexadecimal)
+    */
+    if (argc >= 4 && strcmp(argv[1], "-debug") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = debug_run_program(buffer, f_size, strtoull(argv[3], NULL, 10), argv + 4, argc - 4);
+        free(buffer);
+        return result;
+    }
+
+    // -cpm file [quiet] : run a CP/M program (8080EXM.COM, ...) and report the emulated MIPS
+    if (argc >= 3 && strcmp(argv[1], "-cpm") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = cpm_benchmark(buffer, f_size, argc < 4);
+        free(buffer);
+        return result;
+    }
 
-    int program_counter = 0;
-    while (program_counter < f_size) {
-        program_counter += disassemble8080(buffer, program_counter);
+    // -stats file [cycles] : instruction mix of file, and of a run of cycles states
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "-stats") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = stats_run(buffer, f_size, argc > 3 ? strtoull(argv[3], NULL, 10) : 0);
+        free(buffer);
+        return result;
     }
 
+    // -pairs [cycles] : benchmark the register pair instructions
+    if (argc >= 2 && argc <= 3 && strcmp(argv[1], "-pairs") == 0)
+        return pair_benchmark(argc > 2 ? strtoull(argv[2], NULL, 10) : 1000000000);
+
+    // -record rom frames log : play Space Invaders with random input and record the input to log
+    if (argc == 5 && strcmp(argv[1], "-record") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = invaders_record(buffer, f_size, atoi(argv[3]), argv[4]);
+        free(buffer);
+        return result;
+    }
+
+    // -replay rom log : replay a log made by -record
+    if (argc == 4 && strcmp(argv[1], "-replay") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = invaders_replay(buffer, f_size, argv[3]);
+        free(buffer);
+        return result;
+    }
+
+    /*
+        -recompile file output.c [raw|cpm|invaders] : recompile file to C for the machine (raw by default),
+        see Recompiler/recompiler.c
+    */
+    if (argc >= 4 && strcmp(argv[1], "-recompile") == 0) {
+        const char *machine = argc > 4 ? argv[4] : "raw";
+        const char *name = strrchr(argv[2], '/') ? strrchr(argv[2], '/') + 1 : argv[2];
+        int kind = strcmp(machine, "cpm") == 0 ? RECOMPILE_CPM : strcmp(machine, "invaders") == 0 ? RECOMPILE_INVADERS : RECOMPILE_RAW;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = recompile(buffer, f_size, kind == RECOMPILE_CPM ? CPM_LOAD : 0, kind, name, argv[3]);
+        free(buffer);
+        return !result;
+    }
+
+    /*
+        -corpus [-j threads] [-o directory] [-ordered] [-stats] [-p pattern ...] [-c context] [-l] [-s symbols] input ... :
+        disassemble files, directories, @lists and globs on a pool of threads, the listings go to directory or to stdout
+        (in input order with -ordered), -stats prints the instruction mix of the corpus instead, -p searches the patterns
+        ("LXI H, xxxx; MOV A, M; CPI 0x20") and prints the hits with context instructions around them, -l labels the
+        listings, -s names the labels with the symbol file
+    */
+    if (argc >= 3 && strcmp(argv[1], "-corpus") == 0) {
+        int threads = 0, ordered = 0, stats = 0, context = 2, labelled = 0;
+        const char *directory = NULL;
+        Search8080 *search = NULL;
+        Symbols8080 *symbols = NULL;
+        int i = 2;
+
+        for (; i < argc && argv[i][0] == '-'; i++) {
+            if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+                threads = atoi(argv[++i]);
+            else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+                directory = argv[++i];
+            else if (strcmp(argv[i], "-ordered") == 0)
+                ordered = 1;
+            else if (strcmp(argv[i], "-stats") == 0)
+                stats = 1;
+            else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc)
+                context = atoi(argv[++i]);
+            else if (strcmp(argv[i], "-l") == 0)
+                labelled = 1;
+            else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+                symbols_destroy(symbols);
+                if ((symbols = symbols_load(argv[++i])) == NULL)
+                    return 1;
+                labelled = 1;
+            }
+            else if (strcmp(argv[i], "-p") == 0 && i + 1 < argc) {
+                if (search == NULL)
+                    search = search_create();
+                if (!search_add(search, argv[++i])) {
+                    search_destroy(search);
+                    symbols_destroy(symbols);
+                    return 1;
+                }
+            }
+            else {
+                printf("Error : unknown option %s\n", argv[i]);
+                return 1;
+            }
+        }
+        if (search != NULL)
+            search_build(search);
+        int result = corpus_run(argv + i, argc - i, threads, directory, ordered, stats, search, context, labelled, symbols);
+        search_destroy(search);
+        symbols_destroy(symbols);
+        return result != 0;
+    }
+
+    // -diff old new [context] : disassembly diff of two images of at most 64 KB, aligned instruction by instruction
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "-diff") == 0) {
+        int old_size = 0;
+        unsigned char *old = load_file(argv[2], &old_size);
+
+        buffer = load_file(argv[3], &f_size);
+        if (old == NULL || buffer == NULL)
+            return 2;
+        int result = diff_run(old, old_size, buffer, f_size, argc > 4 ? atoi(argv[4]) : 3);
+        free(old);
+        free(buffer);
+        return result;
+    }
+
+    // -labels file [symbols] : listing of the file with labels, named with the symbol file
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "-labels") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = labels_run(buffer, f_size, argc > 3 ? argv[3] : NULL);
+        free(buffer);
+        return result;
+    }
+
+    // -assemble source output : assemble the source, in the syntax of the listings, to the image output
+    if (argc == 4 && strcmp(argv[1], "-assemble") == 0)
+        return assembler_run(argv[2], argv[3]) != 0;
+
+    // -roundtrip input ... : check that the labelled listing of every file assembles back to the file
+    if (argc >= 3 && strcmp(argv[1], "-roundtrip") == 0)
+        return assembler_roundtrip(argv + 2, argc - 2) != 0;
+
+    // -at file address [count] : count instructions around address, with the index saved next to the file
+    if (argc >= 4 && argc <= 5 && strcmp(argv[1], "-at") == 0) {
+        Index8080 index;
+        int address = (int)strtol(argv[3], NULL, 0);
+        int count = argc > 4 ? atoi(argv[4]) : 20;
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        if (address < 0 || address >= f_size) {
+            printf("Error : %s is outside of the %d bytes of %s\n", argv[3], f_size, argv[2]);
+            free(buffer);
+            return 1;
+        }
+        if (!index_open(&index, argv[2], buffer, f_size)) {
+            free(buffer);
+            return 1;
+        }
+        index_print(&index, buffer, address, count, stdout);
+        index_free(&index);
+        free(buffer);
+        return 0;
+    }
+
+    // -xrefs file address : block of address and references to it, from the analysis cache
+    if (argc == 4 && strcmp(argv[1], "-xrefs") == 0) {
+        int address = (int)strtol(argv[3], NULL, 0);
+
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        if (address < 0 || address > 0xFFFF) {
+            printf("Error : %s isn't a 16 bits address\n", argv[3]);
+            free(buffer);
+            return 1;
+        }
+        int result = analysis_run(buffer, f_size, address);
+        free(buffer);
+        return result;
+    }
+
+    // -patch file address bytes [address bytes ...] : patch the file in memory and update its analysis incrementally
+    if (argc >= 5 && argc % 2 == 1 && strcmp(argv[1], "-patch") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int result = incremental_run(buffer, f_size, argv + 3, argc - 3);
+        free(buffer);
+        return result;
+    }
+
+    // -strict file : disassemble file and flag the undocumented opcodes, fails if there are any
+    if (argc == 3 && strcmp(argv[1], "-strict") == 0) {
+        buffer = load_file(argv[2], &f_size);
+        if (buffer == NULL)
+            return 1;
+        int undocumented = disassemble_buffer8080(stdout, buffer, f_size, 1);
+        free(buffer);
+        return undocumented != 0;
+    }
+
+    if (argc != 2) {
+        printf("Error : 1 argument is required");
+        return 1;
+    }
+
+    buffer = load_file(argv[1], &f_size);
+    if (buffer == NULL)
+        return 1;
+
+    disassemble_buffer8080(stdout, buffer, f_size, 0);
+    free(buffer);
+
     return 0;
-}
\ No newline at end of file
+}